@@ -267,10 +267,15 @@ main(int argc, char* argv[])
                 npels = 1;  // Avoid divide by zero for 0x0 images
             ASSERT(img0.spec().format == TypeFloat);
 
-            // Compare the two images.
-            //
+            // Compare the two images.  When verbose, also gather the
+            // statistics of each image in the same pass.
             ImageBufAlgo::CompareResults cr;
-            ImageBufAlgo::compare(img0, img1, failthresh, warnthresh, cr);
+            ImageBufAlgo::PixelStats stats0, stats1;
+            if (verbose)
+                cr = ImageBufAlgo::compare(img0, img1, failthresh, warnthresh,
+                                           stats0, stats1);
+            else
+                ImageBufAlgo::compare(img0, img1, failthresh, warnthresh, cr);
 
             int yee_failures = 0;
             if (perceptual && !img0.deep()) {
@@ -347,6 +352,9 @@ main(int argc, char* argv[])
                               << (100.0 * yee_failures / npels)
                               << std::setprecision(precis)
                               << "%) failed the perceptual test\n";
+                if (verbose)
+                    ImageBufAlgo::print_stats_comparison(std::cout, stats0,
+                                                         stats1);
             }
 
             // If the user requested that a difference image be output,
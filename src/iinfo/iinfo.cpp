@@ -87,6 +87,8 @@ print_sha1(ImageInput* input)
             return;
         }
         // Hash both the sample counds and the data block
+        // all_data() is only one contiguous block in the Interleaved layout
+        dd.set_layout(DeepData::Interleaved);
         sha.append(dd.all_samples());
         sha.append(dd.all_data());
     } else {
@@ -108,6 +108,28 @@ public:
     /// The size for all channels of one sample.
     size_t samplesize() const;
 
+    /// Sample storage layouts. Interleaved (the default) keeps all the
+    /// channels of each sample together in one buffer, [pixel][sample]
+    /// [channel], which is what all_data() returns. Planar groups the
+    /// pixels into chunks, each with its own buffer holding the samples
+    /// channel by channel, so that per-channel passes such as depth
+    /// sorting read contiguous arrays, and growing a pixel's capacity only
+    /// reallocates its own chunk.
+    enum Layout { Interleaved = 0, Planar = 1 };
+
+    /// Retrieve the sample storage layout.
+    Layout layout() const;
+
+    /// Set the sample storage layout. This must be called after init().
+    /// If the data is already allocated, it is repacked into the new
+    /// layout (which also trims each pixel's capacity to its samples).
+    void set_layout(Layout layout);
+
+    /// The distance in bytes between successive samples of channel c
+    /// within a pixel: samplesize() for the Interleaved layout, or
+    /// channelsize(c) for Planar.
+    size_t sample_stride(int c) const;
+
     /// Retrieve the number of samples for the given pixel index.
     int samples(int pixel) const;
 
@@ -149,18 +171,29 @@ public:
     /// Retrieve the pointer to a given pixel/channel/sample, or NULL if
     /// there are no samples for that pixel. Use with care, and note that
     /// calls to insert_samples and erase_samples can invalidate pointers
-    /// returend by prior calls to data_ptr.
+    /// returend by prior calls to data_ptr. Successive samples of the
+    /// channel are sample_stride(channel) bytes apart.
     void* data_ptr(int pixel, int channel, int sample);
     const void* data_ptr(int pixel, int channel, int sample) const;
 
     cspan<TypeDesc> all_channeltypes() const;
     cspan<unsigned int> all_samples() const;
+    /// All the sample data in one contiguous span, for the Interleaved
+    /// layout. The span is empty for the Planar layout.
     cspan<char> all_data() const;
 
-    /// Fill in the vector with pointers to the start of the first
-    /// channel for each pixel.
+    /// Fill in the vector with pointers to the first sample of each
+    /// channel for each pixel, pointers[pixel*channels()+channel].
     void get_pointers(std::vector<void*>& pointers) const;
 
+    /// Fill in the vector with pointers to the first sample of each
+    /// channel, for just the pixels [pixelbegin,pixelend), laid out as
+    /// pointers[(pixel-pixelbegin)*channels()+channel], NULL for pixels
+    /// with no samples. This lets readers and writers that process the
+    /// image in bands reuse one modest pointer array.
+    void get_pointers(std::vector<void*>& pointers, int pixelbegin,
+                      int pixelend) const;
+
     /// Copy the designated sample from a source DeepData into this
     /// DeepData. The two DeepData structures need to have the same channel
     /// layout.
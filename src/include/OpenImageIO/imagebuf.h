@@ -351,6 +351,11 @@ public:
     /// size).
     const ImageSpec& nativespec() const;
 
+    /// Return a pointer to the configuration hints that will be (or were)
+    /// passed to the ImageInput when reading the file, or NULL if there
+    /// are none.
+    const ImageSpec* configspec() const;
+
     /// Return the name of this image.
     ///
     string_view name(void) const;
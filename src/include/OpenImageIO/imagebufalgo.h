@@ -50,6 +50,7 @@
 #include <OpenEXR/ImathMatrix.h>       /* because we need M33f */
 
 #include <limits>
+#include <memory>
 
 #if !defined(__OPENCV_CORE_TYPES_H__) && !defined(OPENCV_CORE_TYPES_H)
 struct IplImage;  // Forward declaration; used by Intel Image lib & OpenCV
@@ -905,6 +906,26 @@ bool OIIO_API compare (const ImageBuf &A, const ImageBuf &B,
                        float failthresh, float warnthresh,
                        CompareResults &result, ROI roi={}, int nthreads=0);
 
+/// Compare two images as above, and in the same pass over the pixels,
+/// also compute the statistics of each (see computePixelStats), storing
+/// them in Astats and Bstats.  The statistics of each image cover the
+/// part of the compared region that lies within that image's own data
+/// window.  This is cheaper than separate calls to compare() and
+/// computePixelStats() when both results are needed.
+CompareResults OIIO_API compare (const ImageBuf &A, const ImageBuf &B,
+                                 float failthresh, float warnthresh,
+                                 PixelStats &Astats, PixelStats &Bstats,
+                                 ROI roi={}, int nthreads=0);
+
+/// Print the per-channel min, max, and average values of two images (such
+/// as those computed by the compare() above) side by side to out, one
+/// line per statistic, followed by the NaN and Inf counts if either image
+/// has any.  Values are printed with the current formatting of out.  This
+/// is the report given by "idiff -v" and "oiiotool -v --diff".
+void OIIO_API print_stats_comparison (std::ostream &out,
+                                      const PixelStats &Astats,
+                                      const PixelStats &Bstats);
+
 /// Compare two images using Hector Yee's perceptual metric, returning
 /// the number of pixels that fail the comparison.  Only the first three
 /// channels (or first three channels specified by roi) are compared.
@@ -1197,6 +1218,10 @@ bool OIIO_API fit (ImageBuf &dst, const ImageBuf &src, Filter2D *filter,
 /// allocated to be the size specified by roi.  If  normalized is true, the
 /// kernel will be normalized for the  convolution, otherwise the original
 /// values will be used.
+///
+/// For 2D images, separable kernels (such as "gaussian" or "box" from
+/// make_kernel) are applied as two 1D passes, and other large kernels are
+/// applied via the FFT, so wide kernels are not prohibitively expensive.
 ImageBuf OIIO_API convolve (const ImageBuf &src, const ImageBuf &kernel,
                             bool normalize = true, ROI roi={}, int nthreads=0);
 bool OIIO_API convolve (ImageBuf &dst, const ImageBuf &src, const ImageBuf &kernel,
@@ -1275,6 +1300,11 @@ bool OIIO_API laplacian (ImageBuf &dst, const ImageBuf &src,
 /// Median filters are good for removing high-frequency detail smaller than
 /// the window size (including noise), without blurring edges that are
 /// larger than the window size.
+///
+/// For 8 and 16 bit source images the median is found with sliding
+/// histograms, so the cost per pixel is nearly independent of the window
+/// size; other types keep an incrementally sorted window, which is still
+/// much cheaper than sorting every window from scratch.
 ImageBuf OIIO_API median_filter (const ImageBuf &src,
                                  int width = 3, int height = -1,
                                  ROI roi={}, int nthreads=0);
@@ -1289,6 +1319,10 @@ bool OIIO_API median_filter (ImageBuf &dst, const ImageBuf &src,
 /// x height square). If height is not set, it will default to be the same
 /// as width. Dilation makes bright features wider and more prominent, dark
 /// features thinner, and removes small isolated dark spots.
+///
+/// The rectangle is processed as a horizontal and a vertical pass using
+/// the van Herk/Gil-Werman algorithm, so the cost per pixel does not grow
+/// with the size of the structuring element (the same goes for erode).
 ImageBuf OIIO_API dilate (const ImageBuf &src, int width=3, int height=-1,
                           ROI roi={}, int nthreads=0);
 bool OIIO_API dilate (ImageBuf &dst, const ImageBuf &src,
@@ -1721,6 +1755,10 @@ enum OIIO_API MakeTextureMode {
 ///                              output file doesn't already exist, or is
 ///                              older than the input file, or was created
 ///                              with different command-line arguments. (0)
+///                              An output whose time stamp differs is
+///                              still considered current if the input's
+///                              contents match the "oiio:SourceSHA-1"
+///                              hash recorded in it.
 ///    maketx:constant_color_detect (int)
 ///                           If nonzero, detect images that are entirely
 ///                             one color, and change them to be low
@@ -1807,6 +1845,18 @@ enum OIIO_API MakeTextureMode {
 ///                               if it is smaller than this threshold. Zero
 ///                               causes the system to make a good guess at
 ///                               a reasonable threshold (e.g. 1 GB). (0)
+///    maketx:outofcore_MB (int)
+///                           If nonzero, build the texture out-of-core:
+///                               the pixels are streamed from the input file
+///                               in bands of scanlines, and MIP levels are
+///                               built band by band via scratch files, using
+///                               at most roughly this many MB of memory for
+///                               pixels. Only applies when reading from a
+///                               file and no options need the whole image
+///                               at once (resizing, non-box filters,
+///                               sharpening, channel detection, or --fixnan);
+///                               otherwise the usual in-memory path is
+///                               used. (0)
 ///    maketx:forcefloat (int)
 ///                           Forces a conversion through float data for
 ///                               the sake of ImageBuf math. (1)
@@ -1847,6 +1897,111 @@ bool OIIO_API make_texture (MakeTextureMode mode,
                             std::ostream *outstream = nullptr);
 
 
+/// ImageExpr records a chain of point-wise ImageBufAlgo operations on a
+/// source image without computing anything, and eval() later runs the
+/// whole chain as a single parallel pass over the image.  Each scanline of
+/// the source is converted to float once, every recorded stage is applied
+/// to it while it is still in cache, and the result is converted straight
+/// into dst.  Unlike calling the ImageBufAlgo functions one after another,
+/// no intermediate ImageBuf is allocated and each image is traversed only
+/// once, no matter how many stages there are.
+///
+/// Every stage computes the same values as the ImageBufAlgo function of
+/// the same name, and eval() makes the same metadata changes that those
+/// functions would ("oiio:UnassociatedAlpha" for premult/unpremult,
+/// "oiio:ColorSpace" for colorconvert by name).  A few differences follow
+/// from the single pass: the result always has the channels and pixel data
+/// window of the source (or of the ROI passed to eval()), and image
+/// operands (for add, sub, mul, mad, over) contribute 0 for any pixels or
+/// channels they lack.  The ImageExpr keeps only references to the source
+/// and operand images and to any ColorProcessor passed in, so they must
+/// stay alive until the expression is evaluated.
+///
+/// Example:
+///
+///     ImageBuf A ("fg.exr"), B ("bg.exr");
+///     ImageBuf R = ImageBufAlgo::ImageExpr (A).mad (0.5f, 0.1f)
+///                        .clamp (0.0f, 1.0f).premult().over (B).eval();
+///
+class OIIO_API ImageExpr {
+public:
+    /// Start an expression whose input is src.
+    ImageExpr (const ImageBuf &src);
+    ImageExpr (const ImageExpr &other);
+    ~ImageExpr ();
+    const ImageExpr& operator= (const ImageExpr &other);
+
+    /// Append a stage. Each has the per-pixel semantics of the
+    /// ImageBufAlgo function of the same name, with the expression so far
+    /// as its first input, and returns *this so that calls may be chained.
+    ImageExpr& add (Image_or_Const B);
+    ImageExpr& sub (Image_or_Const B);
+    ImageExpr& mul (Image_or_Const B);
+    ImageExpr& mad (Image_or_Const B, Image_or_Const C);
+    ImageExpr& pow (cspan<float> b);
+    ImageExpr& abs ();
+    ImageExpr& clamp (cspan<float> min=-std::numeric_limits<float>::max(),
+                      cspan<float> max=std::numeric_limits<float>::max(),
+                      bool clampalpha01 = false);
+    ImageExpr& premult ();
+    ImageExpr& unpremult ();
+    ImageExpr& colorconvert (const ColorProcessor *processor,
+                             bool unpremult=true);
+    ImageExpr& colorconvert (string_view fromspace, string_view tospace,
+                             bool unpremult=true,
+                             string_view context_key="",
+                             string_view context_value="",
+                             ColorConfig *colorconfig=nullptr);
+    /// The expression so far, composited over B.
+    ImageExpr& over (const ImageBuf &B);
+
+    /// The source image.
+    const ImageBuf& source () const;
+    /// The spec that eval() will give an uninitialized dst: the source's,
+    /// with the metadata changes made by the stages recorded so far.
+    const ImageSpec& spec () const;
+    /// Number of stages recorded.
+    int nstages () const;
+
+    /// Evaluate the expression over roi (by default, the whole data window
+    /// of the source), writing the result into dst, which may be the
+    /// source image itself.  Return true on success, false (with an error
+    /// message set on dst) if the expression could not be evaluated.
+    bool eval (ImageBuf &dst, ROI roi={}, int nthreads=0) const;
+    /// Evaluate the expression and return the result as a new image.
+    ImageBuf eval (ROI roi={}, int nthreads=0) const;
+
+    /// Evaluate the expression a band of scanlines at a time, writing each
+    /// band to out (which must already be opened, with the data window and
+    /// channels of the source) as soon as it is done, so that neither the
+    /// source nor the result ever needs to be entirely in memory.  If the
+    /// source ImageBuf is still backed by the ImageCache, its file is read
+    /// directly with read_scanlines (or read_tiles), a band at a time.
+    /// Reading the next band and writing the previous one overlap with
+    /// computing the current one.  Return true on success, false (with
+    /// geterror() explaining why) on failure.
+    bool write (ImageOutput *out, int nthreads=0) const;
+    /// Open filename (of type fileformat, by default deduced from the
+    /// name) as scanlines of type dtype (by default the source file's
+    /// format), stream the result to it as above, and close it.
+    bool write (string_view filename, TypeDesc dtype=TypeUnknown,
+                string_view fileformat="", int nthreads=0) const;
+
+    /// Was there an error recording a stage (for example, an unknown color
+    /// space name)?  If so, eval() will fail with the same message.
+    /// geterror() also explains why the last write() failed.
+    bool has_error () const;
+    std::string geterror () const;
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> m_impl;
+    ImageExpr& colorconvert (ColorProcessorHandle processor, bool unpremult,
+                             string_view tospace);
+    void error (string_view message);
+};
+
+
 ///////////////////////////////////////////////////////////////////////
 // DEPRECATED(1.9): These are all functions that take raw pointers,
 // which we are deprecating as of 1.9, replaced by new versions that
@@ -33,6 +33,8 @@
 #pragma once
 
 #include <functional>
+#include <type_traits>
+#include <vector>
 
 #include <OpenImageIO/parallel.h>
 #include <OpenImageIO/imagebufalgo.h>
@@ -62,7 +64,12 @@ namespace ImageBufAlgo {
 /// made. The default is Split_Y (vertical splits), which generally seems
 /// the fastest (due to cache layout issues?), but perhaps there are
 /// algorithms where it's better to split in X, Z, or along the longest
-/// axis.
+/// axis. Split_Tile instead splits the region into tiles of
+/// opt.tilewidth x opt.tileheight (or a size chosen automatically if those
+/// are 0), aligned to the grid of that size that starts at
+/// (opt.tilexorigin, opt.tileyorigin); this gives neighborhood operations
+/// better locality. Whatever the split, threads that finish their pieces
+/// early go on to take the remaining ones, so uneven costs are balanced.
 ///
 /// Most image operations will require additional arguments, including
 /// additional input and output images or other parameters.  The
@@ -102,8 +109,31 @@ parallel_image (ROI roi, parallel_image_options opt,
         ychunk = roi.height();
         // ychunk = std::max (64, minitems/xchunk);
     } else if (splitdir == Split_Tile) {
-        int64_t n = std::min<imagesize_t>(opt.minitems, roi.npixels());
-        xchunk = ychunk = std::max (1, int(std::sqrt(n))/4);
+        if (opt.tilewidth > 0 && opt.tileheight > 0) {
+            xchunk = opt.tilewidth;
+            ychunk = opt.tileheight;
+        } else {
+            // Square tiles of about the minimum worthwhile task size
+            // (128x128 for the default 16k), so that each task amortizes
+            // its setup over enough pixels.
+            int64_t n = std::min<imagesize_t>(opt.minitems, roi.npixels());
+            xchunk = ychunk = std::max (1, int(std::sqrt(double(n))));
+        }
+        // Step over the tiles of the grid that overlap roi, and clip each
+        // task to roi.
+        int64_t xoff = (roi.xbegin - opt.tilexorigin) % xchunk;
+        int64_t yoff = (roi.ybegin - opt.tileyorigin) % ychunk;
+        int64_t x0 = roi.xbegin - (xoff < 0 ? xoff + xchunk : xoff);
+        int64_t y0 = roi.ybegin - (yoff < 0 ? yoff + ychunk : yoff);
+        auto tiletask = [&](int id, int64_t xbegin, int64_t xend,
+                            int64_t ybegin, int64_t yend) {
+            f (ROI (std::max (xbegin, int64_t(roi.xbegin)), xend,
+                    std::max (ybegin, int64_t(roi.ybegin)), yend,
+                    roi.zbegin, roi.zend, roi.chbegin, roi.chend));
+        };
+        parallel_for_chunked_2D (x0, roi.xend, xchunk, y0, roi.yend, ychunk,
+                                 tiletask, opt);
+        return;
     } else {
         xchunk = ychunk = std::max (int64_t(1), int64_t(std::sqrt(opt.maxthreads))/2);
     }
@@ -126,6 +156,30 @@ parallel_image (ROI roi, std::function<void(ROI)> f)
 
 
 
+/// Return parallel_image_options suited to a neighborhood operation whose
+/// result at (x,y) reads the pixels of src around (x,y): Split_Tile, and
+/// if src is backed by an ImageCache and its file is tiled, tasks made of
+/// whole file tiles and aligned to the file's tile grid, so that each task
+/// touches as few cache tiles as possible and neighboring tasks don't
+/// contend for the same ones.
+inline parallel_image_options
+neighborhood_parallel_options (const ImageBuf& src, int nthreads=0)
+{
+    parallel_image_options opt (nthreads, Split_Tile);
+    const ImageSpec& file (src.nativespec());
+    if (src.cachedpixels() && file.tile_width > 0 && file.tile_height > 0) {
+        size_t tilepixels = size_t(file.tile_width) * file.tile_height;
+        int n = std::max (1, int(std::sqrt (double(opt.minitems) / tilepixels)));
+        opt.tilewidth   = n * file.tile_width;
+        opt.tileheight  = n * file.tile_height;
+        opt.tilexorigin = file.x;
+        opt.tileyorigin = file.y;
+    }
+    return opt;
+}
+
+
+
 // DEPRECATED(1.8) -- eventually enable the OIIO_DEPRECATION
 template <class Func>
 // OIIO_DEPRECATED("switch to new parallel_image (1.8)")
@@ -137,6 +191,132 @@ parallel_image (Func f, ROI roi, int nthreads=0, SplitDir splitdir=Split_Y)
 
 
 
+/// Helpers for IBA kernels that want to skip the ImageBuf iterators when
+/// they can.  contiguous_rows(roi, img, ...) is true if every image holds
+/// its pixels in local memory (not deep, not backed by the ImageCache) with
+/// no gaps between pixels, the roi lies entirely within its data window,
+/// and the roi spans all of its channels.  Each scanline of the roi is then
+/// one contiguous run of roi.width()*nchannels values, starting at
+/// img.pixeladdr(roi.xbegin,y,z), that a kernel can walk with plain
+/// (SIMD) loops, with no per-pixel bounds, wrap, or existence checks.
+inline bool
+contiguous_rows (ROI roi)
+{
+    return true;
+}
+
+template<typename... Images>
+inline bool
+contiguous_rows (ROI roi, const ImageBuf &img, const Images&... more)
+{
+    return img.localpixels() && ! img.deep()
+        && roi.chbegin == 0 && roi.chend == img.nchannels()
+        && img.contains_roi (roi)
+        && img.pixel_stride() == stride_t(img.spec().format.size()
+                                          * img.nchannels())
+        && contiguous_rows (roi, more...);
+}
+
+
+/// Row (y,z) of img within roi, which must have passed contiguous_rows(),
+/// as roi.width()*nchannels floats. Float images are read in place, other
+/// types are converted into buf.
+template<typename T>
+inline const float *
+contiguous_row_float (const ImageBuf &img, ROI roi, int y, int z,
+                      std::vector<float> &buf)
+{
+    const T *p = (const T *) img.pixeladdr (roi.xbegin, y, z);
+    if (std::is_same<T,float>::value)
+        return (const float *) p;
+    size_t n = size_t(roi.width()) * img.nchannels();
+    buf.resize (n);
+    convert_type (p, buf.data(), n);
+    return buf.data();
+}
+
+
+/// Run a float row kernel over the rows of roi, for images that passed
+/// contiguous_rows(). For each scanline, f(r, a, n) is called with the n
+/// values of that row of A (converted to float if Atype is not float),
+/// and must write the n results to r, which points straight into R for
+/// float results or to a temporary that is converted to Rtype afterwards.
+/// R may be the same image as A. The versions with more inputs call
+/// f(r, a, b, n) and f(r, a, b, c, n).
+template<class Rtype, class Atype, class FUNC>
+void
+contiguous_rows_apply (ImageBuf &R, const ImageBuf &A, ROI roi, FUNC f)
+{
+    const bool rfloat = std::is_same<Rtype,float>::value;
+    const size_t n = size_t(roi.width()) * R.nchannels();
+    std::vector<float> rbuf (rfloat ? 0 : n), abuf;
+    for (int z = roi.zbegin; z < roi.zend; ++z) {
+        for (int y = roi.ybegin; y < roi.yend; ++y) {
+            Rtype *rp = (Rtype *) R.pixeladdr (roi.xbegin, y, z);
+            float *r = rfloat ? (float *) rp : rbuf.data();
+            f (r, contiguous_row_float<Atype> (A, roi, y, z, abuf), n);
+            if (! rfloat)
+                convert_type (r, rp, n);
+        }
+    }
+}
+
+template<class Rtype, class Atype, class Btype, class FUNC>
+void
+contiguous_rows_apply (ImageBuf &R, const ImageBuf &A, const ImageBuf &B,
+                       ROI roi, FUNC f)
+{
+    const bool rfloat = std::is_same<Rtype,float>::value;
+    const size_t n = size_t(roi.width()) * R.nchannels();
+    std::vector<float> rbuf (rfloat ? 0 : n), abuf, bbuf;
+    for (int z = roi.zbegin; z < roi.zend; ++z) {
+        for (int y = roi.ybegin; y < roi.yend; ++y) {
+            Rtype *rp = (Rtype *) R.pixeladdr (roi.xbegin, y, z);
+            float *r = rfloat ? (float *) rp : rbuf.data();
+            f (r, contiguous_row_float<Atype> (A, roi, y, z, abuf),
+               contiguous_row_float<Btype> (B, roi, y, z, bbuf), n);
+            if (! rfloat)
+                convert_type (r, rp, n);
+        }
+    }
+}
+
+template<class Rtype, class Atype, class Btype, class Ctype, class FUNC>
+void
+contiguous_rows_apply (ImageBuf &R, const ImageBuf &A, const ImageBuf &B,
+                       const ImageBuf &C, ROI roi, FUNC f)
+{
+    const bool rfloat = std::is_same<Rtype,float>::value;
+    const size_t n = size_t(roi.width()) * R.nchannels();
+    std::vector<float> rbuf (rfloat ? 0 : n), abuf, bbuf, cbuf;
+    for (int z = roi.zbegin; z < roi.zend; ++z) {
+        for (int y = roi.ybegin; y < roi.yend; ++y) {
+            Rtype *rp = (Rtype *) R.pixeladdr (roi.xbegin, y, z);
+            float *r = rfloat ? (float *) rp : rbuf.data();
+            f (r, contiguous_row_float<Atype> (A, roi, y, z, abuf),
+               contiguous_row_float<Btype> (B, roi, y, z, bbuf),
+               contiguous_row_float<Ctype> (C, roi, y, z, cbuf), n);
+            if (! rfloat)
+                convert_type (r, rp, n);
+        }
+    }
+}
+
+
+/// Expand per-channel constants vals[0..nchannels-1] into a whole row of
+/// npixels pixels, so that constant operands can use the same row kernels
+/// as image operands.
+inline std::vector<float>
+constant_row (cspan<float> vals, int nchannels, int npixels)
+{
+    std::vector<float> row (size_t(npixels) * nchannels);
+    for (size_t i = 0, e = row.size(); i < e; ++i)
+        row[i] = vals[i % nchannels];
+    return row;
+}
+
+
+
 /// Common preparation for IBA functions: Given an ROI (which may or may not
 /// be the default ROI::All()), destination image (which may or may not yet
 /// be allocated), and optional input images, adjust roi if necessary and
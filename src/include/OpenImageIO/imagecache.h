@@ -100,6 +100,9 @@ public:
     ///     int statistics:level : verbosity of statistics auto-printed.
     ///     int forcefloat : if nonzero, convert all to float.
     ///     int failure_retries : number of times to retry a read before fail.
+    ///     int max_tile_channels : for files with more channels than this,
+    ///                   get_pixels() caches only the requested channels,
+    ///                   unless told otherwise (default: 6)
     ///     int deduplicate : if nonzero, detect duplicate textures (default=1)
     ///     string substitute_image : uses the named image in place of all
     ///                               texture and image references.
@@ -263,7 +266,8 @@ public:
     /// format).  Requested pixels outside the valid pixel data region
     /// will be filled in with 0 values. The optional cache_chbegin and
     /// cache_chend hint as to which range of channels should be cached
-    /// (which by default will be all channels of the file).
+    /// (which by default will be all channels of the file, or only the
+    /// requested channels for files with more than "max_tile_channels").
     ///
     /// Return true if the file is found and could be opened by an
     /// available ImageIO plugin, otherwise return false.
@@ -1619,6 +1619,12 @@ OIIO_API std::string geterror ();
 ///             When nonzero, allows TIFF to write 'half' pixel data.
 ///             N.B. Most apps may not read these correctly, but OIIO will.
 ///             That's why the default is not to support it.
+///     int jpeg:multithread
+///             When nonzero (the default), JPEG files with restart markers
+///             may be decoded and encoded in parallel bands.
+///     int png:multithread
+///             When nonzero (the default), large PNG files may be filtered
+///             and compressed in parallel bands.
 ///
 OIIO_API bool attribute (string_view name, TypeDesc type, const void *val);
 // Shortcuts for common types
@@ -92,6 +92,10 @@ public:
     size_t minitems   = 16384;    // Min items per task
     thread_pool* pool = nullptr;  // If non-NULL, custom thread pool
     string_view name;             // For debugging
+    int tilewidth     = 0;        // Split_Tile task size (0 = auto)
+    int tileheight    = 0;
+    int tilexorigin   = 0;        // Split_Tile tasks are aligned to the
+    int tileyorigin   = 0;        //   tile grid starting here
 };
 
 
@@ -219,6 +223,11 @@ parallel_for_each (InputIt first, InputIt last, UnaryFunction f,
 /// a number of chunks equal to the twice number of threads in the queue.
 /// (We do this to offer better load balancing than if we used exactly the
 /// thread count.)
+///
+/// The chunks are not assigned to threads up front: each thread, including
+/// the calling one, repeatedly claims the next unclaimed chunk (in
+/// scanline order) until none are left, so chunks that take unequal time
+/// still keep all the threads busy.
 OIIO_API void
 parallel_for_chunked_2D (int64_t xstart, int64_t xend, int64_t xchunksize,
                          int64_t ystart, int64_t yend, int64_t ychunksize,
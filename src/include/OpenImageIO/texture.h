@@ -489,6 +489,10 @@ public:
     ///     int max_tile_channels : max channels to store all chans in a tile
     ///     string latlong_up : default "up" direction for latlong ("y")
     ///     int flip_t : flip v coord for texture lookups?
+    ///     int lookup_cache_size : per-thread entries memoizing filtered
+    ///                             2D lookups (default: 0, disabled)
+    ///     float lookup_cache_tolerance : quantization of memoized lookup
+    ///                             coordinates (default: 0, exact only)
     ///     int max_errors_per_file : Limits how many errors to issue for
     ///                               issue for each (default: 100)
     ///
@@ -652,6 +652,11 @@ private:
 /// Note that the tasks.wait() is optional -- it will be called
 /// automatically when the task_set exits its scope.
 ///
+/// Code that may itself be running as a pool task (for example, an image
+/// reader invoked from a parallel ImageCache or IBA loop) should instead
+/// use tasks.submit(myfunc), which is safe against the nested-submission
+/// deadlock described for task_set below.
+///
 /// The task function's first argument, the thread_id, is the thread number
 /// for the pool, or -1 if it's being executed by a non-pool thread (this
 /// can happen in cases where the whole pool is occupied and the calling
@@ -802,6 +807,23 @@ OIIO_API thread_pool* default_thread_pool ();
 ///        // wait for all those queue tasks to finish.
 ///    }
 ///
+/// Tasks added with push() may only be waited on by blocking, if the
+/// submitter is itself a pool thread. If every pool thread does that at
+/// once, nobody is left to run the queued subtasks and the pool deadlocks.
+/// Tasks added with submit() avoid this: each one may be claimed exactly
+/// once, either by a pool thread that pops it or by the submitter while it
+/// waits. A waiting submitter runs its own unclaimed tasks itself (most
+/// recently submitted first) and only blocks on tasks that a pool thread
+/// is already executing, so nested submission always makes progress. The
+/// submitter never runs unrelated tasks from the queue while waiting on
+/// submitted tasks, which might otherwise try to take locks it holds.
+///
+///    void read_tiles (...) {   // may be called from a pool thread
+///        task_set tasks (pool);
+///        for (int i = 0; i < ntiles; ++i)
+///            tasks.submit ([&,i](int id){ decode_tile (i); });
+///    }
+///
 class OIIO_API task_set {
 public:
     task_set(thread_pool* pool = nullptr)
@@ -826,8 +848,35 @@ public:
             std::this_thread::get_id() == submitter()
             && "All tasks in a tast_set should be added by the same thread");
         m_futures.emplace_back(std::move(f));
+        m_claims.emplace_back();
+    }
+
+    // Add a task to the pool as part of this task set, in a way that is
+    // safe to use even if the calling thread is itself a pool thread (see
+    // the notes above). The function takes the usual int thread id
+    // argument (-1 if it ends up being run by the submitting thread). It
+    // should not throw.
+    template<typename F> void submit(F&& f)
+    {
+        DASSERT(
+            std::this_thread::get_id() == submitter()
+            && "All tasks in a tast_set should be added by the same thread");
+        auto claim = std::make_shared<claimable>(std::forward<F>(f));
+        m_futures.emplace_back(m_pool->push([claim](int id) {
+            int unclaimed = 0;
+            if (claim->state.compare_exchange_strong(unclaimed, 1))
+                claim->func(id);
+        }));
+        m_claims.emplace_back(std::move(claim));
+        m_own_hint = m_claims.size();
     }
 
+    // If any task added by submit() has not yet been claimed by a pool
+    // thread, run the most recently submitted such task on the calling
+    // (submitting) thread and return true. Return false if there were no
+    // unclaimed tasks left.
+    bool run_own_task();
+
     // Wait for the given taskindex (0..n-1, where n is the number of tasks
     // submitted as part of this task_set). If block == true, fully block
     // while waiting for that task to finish. If block is false, then busy
@@ -846,14 +895,43 @@ public:
     void check_done()
     {
         const std::chrono::milliseconds wait_time(0);
-        for (auto&& f : m_futures)
-            ASSERT(f.wait_for(wait_time) == std::future_status::ready);
+        for (size_t i = 0, e = m_futures.size(); i < e; ++i)
+            ASSERT(ran_by_submitter(i)
+                   || m_futures[i].wait_for(wait_time)
+                          == std::future_status::ready);
     }
 
 private:
+    // Shared between the submitter and the queued wrapper of a submit()'ed
+    // task. state is 0 while unclaimed, 1 once a pool thread has claimed
+    // it, 2 once the submitter has claimed it.
+    struct claimable {
+        template<typename F>
+        claimable(F&& f)
+            : state(0)
+            , func(std::forward<F>(f))
+        {
+        }
+        std::atomic<int> state;
+        std::function<void(int)> func;
+    };
+
+    // Try to claim task i (if it was submit()'ed) for the submitter, and
+    // run it if successful.
+    bool run_own_task(size_t i);
+
+    // Was task i claimed and run by the submitting thread? Its future then
+    // only becomes ready whenever the queue gets around to discarding it.
+    bool ran_by_submitter(size_t i) const
+    {
+        return m_claims[i] && m_claims[i]->state.load() == 2;
+    }
+
     thread_pool* m_pool;
     std::thread::id m_submitter_thread;
     std::vector<std::future<void>> m_futures;
+    std::vector<std::shared_ptr<claimable>> m_claims;  // null for push()
+    size_t m_own_hint = 0;  // no unclaimed submit()'ed tasks at or above
 };
 
 
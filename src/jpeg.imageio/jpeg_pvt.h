@@ -83,6 +83,8 @@ public:
                       const ImageSpec& config) override;
     virtual bool read_native_scanline(int subimage, int miplevel, int y, int z,
                                       void* data) override;
+    virtual bool read_native_scanlines(int subimage, int miplevel, int ybegin,
+                                       int yend, int z, void* data) override;
     virtual bool close() override;
     const std::string& filename() const { return m_filename; }
     void* coeffs() const { return m_coeffs; }
@@ -97,6 +99,15 @@ public:
     void jpegerror(my_error_ptr myerr, bool fatal = false);
 
 private:
+    // Decoding options requested by the open() configuration, which must
+    // survive a re-open to rewind the decoder.
+    struct DecodeHints {
+        int scale_denom = 1;      // decode at 1/scale_denom resolution,
+        int min_width   = 0;      // or as reduced as possible while still
+        int min_height  = 0;      //   at least this wide and high
+        bool fastdct    = false;  // use the fast, less accurate integer DCT
+    };
+
     FILE* m_fd;
     std::string m_filename;
     int m_next_scanline;  // Which scanline is the next to read?
@@ -107,15 +118,28 @@ private:
     my_error_mgr m_jerr;
     jvirt_barray_ptr* m_coeffs;
     std::vector<unsigned char> m_cmyk_buf;  // For CMYK translation
+    DecodeHints m_hints;
+    // Index of the restart segments, for decoding bands in parallel:
+    int m_rstindex;  // 1 = indexed, -1 = can't be done, 0 = not tried yet
+    std::vector<unsigned char> m_filebuf;     // The whole file
+    std::vector<unsigned char> m_bandheader;  // Tables, frame & scan header
+    size_t m_sof_height;                      // Offset of height in header
+    std::vector<size_t> m_segments;  // Offset of each segment's data
 
     void init()
     {
         m_fd            = NULL;
+        m_hints         = DecodeHints();
         m_raw           = false;
         m_cmyk          = false;
         m_fatalerr      = false;
         m_coeffs        = NULL;
         m_jerr.jpginput = this;
+        m_rstindex      = 0;
+        m_sof_height    = 0;
+        std::vector<unsigned char>().swap(m_filebuf);
+        std::vector<unsigned char>().swap(m_bandheader);
+        std::vector<size_t>().swap(m_segments);
     }
 
     // Rummage through the JPEG "APP1" marker pointed to by buf, decoding
@@ -127,6 +151,26 @@ private:
 
     bool read_icc_profile(j_decompress_ptr cinfo, ImageSpec& spec);
 
+    // Set the libjpeg output scaling and DCT method from m_hints, before
+    // jpeg_start_decompress.
+    void set_decode_options();
+
+    // Find the restart markers in the file, so that bands of MCU rows can
+    // be decoded independently. Return false if the file doesn't have the
+    // (baseline, single scan, restart interval) structure it requires.
+    bool index_restarts();
+
+    // Decode scanlines [ybegin,yend) in parallel bands, independently of
+    // m_cinfo. Return false (having done nothing useful) if that isn't
+    // possible, so the caller may fall back to sequential decoding.
+    bool read_bands(int ybegin, int yend, void* data);
+
+    // Decode the MCU rows [mcubegin,mcuend), plus 'context' MCU rows on
+    // either side, as a stand-alone JPEG stream, and store the scanlines
+    // of [mcubegin,mcuend) that are within [ybegin,yend).
+    bool decode_band(int mcubegin, int mcuend, int ybegin, int yend,
+                     int context, void* data) const;
+
     void close_file()
     {
         if (m_fd)
@@ -31,11 +31,13 @@
 #include <algorithm>
 #include <cassert>
 #include <cstdio>
+#include <cstring>
 
 #include <OpenImageIO/color.h>
 #include <OpenImageIO/filesystem.h>
 #include <OpenImageIO/fmath.h>
 #include <OpenImageIO/imageio.h>
+#include <OpenImageIO/thread.h>
 #include <OpenImageIO/tiffutils.h>
 
 #include "jpeg_pvt.h"
@@ -118,6 +120,79 @@ my_output_message(j_common_ptr cinfo)
 
 
 
+// Error handling for the decompressors of parallel bands, which must not
+// touch the JpgInput: any error or warning just makes the band fail, and
+// the caller falls back to the sequential decoder, which reports it.
+
+struct band_error_mgr {
+    struct jpeg_error_mgr pub;
+    jmp_buf setjmp_buffer;
+};
+
+
+
+static void
+band_error_exit(j_common_ptr cinfo)
+{
+    longjmp(((band_error_mgr*)cinfo->err)->setjmp_buffer, 1);
+}
+
+
+
+static void
+band_output_message(j_common_ptr /*cinfo*/)
+{
+}
+
+
+
+// A libjpeg data source that reads from a block of memory (jpeg_mem_src
+// is not available in all the libjpeg versions we support).
+
+static void
+mem_init_source(j_decompress_ptr /*cinfo*/)
+{
+}
+
+
+
+static boolean
+mem_fill_input_buffer(j_decompress_ptr cinfo)
+{
+    // Premature end of data: count a warning and insert a fake EOI
+    // marker, as libjpeg's own data sources do.
+    static const JOCTET fake_eoi[2] = { 0xFF, JPEG_EOI };
+    cinfo->err->num_warnings++;
+    cinfo->src->next_input_byte = fake_eoi;
+    cinfo->src->bytes_in_buffer = 2;
+    return TRUE;
+}
+
+
+
+static void
+mem_skip_input_data(j_decompress_ptr cinfo, long num_bytes)
+{
+    jpeg_source_mgr* src = cinfo->src;
+    if (num_bytes <= 0)
+        return;
+    if (size_t(num_bytes) > src->bytes_in_buffer) {
+        mem_fill_input_buffer(cinfo);
+        return;
+    }
+    src->next_input_byte += num_bytes;
+    src->bytes_in_buffer -= num_bytes;
+}
+
+
+
+static void
+mem_term_source(j_decompress_ptr /*cinfo*/)
+{
+}
+
+
+
 static std::string
 comp_info_to_attr(const jpeg_decompress_struct& cinfo)
 {
@@ -189,11 +264,41 @@ JpgInput::open(const std::string& name, ImageSpec& newspec,
 {
     const ParamValue* p = config.find_attribute("_jpeg:raw", TypeInt);
     m_raw               = p && *(int*)p->data();
+    m_hints.scale_denom = config.get_int_attribute("jpeg:scale", 1);
+    m_hints.fastdct     = config.get_int_attribute("jpeg:fastdct", 0) != 0;
+    p = config.find_attribute("jpeg:size", TypeDesc(TypeDesc::INT, 2));
+    if (p) {
+        m_hints.min_width  = ((const int*)p->data())[0];
+        m_hints.min_height = ((const int*)p->data())[1];
+    }
     return open(name, newspec);
 }
 
 
 
+void
+JpgInput::set_decode_options()
+{
+    // libjpeg can scale down by 1/2, 1/4 or 1/8 nearly for free, as part
+    // of the inverse DCT, by discarding high frequency coefficients.
+    int denom = m_hints.scale_denom;
+    if (m_hints.min_width > 0 || m_hints.min_height > 0) {
+        // Choose the most reduced scale that's still big enough.
+        denom = 1;
+        while (denom < 8
+               && int(m_cinfo.image_width) >= 2 * denom * m_hints.min_width
+               && int(m_cinfo.image_height) >= 2 * denom * m_hints.min_height)
+            denom *= 2;
+    }
+    denom = denom >= 8 ? 8 : denom >= 4 ? 4 : denom >= 2 ? 2 : 1;
+    m_cinfo.scale_num   = 1;
+    m_cinfo.scale_denom = denom;
+    if (m_hints.fastdct)
+        m_cinfo.dct_method = JDCT_IFAST;
+}
+
+
+
 bool
 JpgInput::open(const std::string& name, ImageSpec& newspec)
 {
@@ -259,10 +364,12 @@ JpgInput::open(const std::string& name, ImageSpec& newspec)
         m_cmyk                  = true;
     }
 
-    if (m_raw)
+    if (m_raw) {
         m_coeffs = jpeg_read_coefficients(&m_cinfo);
-    else
+    } else {
+        set_decode_options();
         jpeg_start_decompress(&m_cinfo);  // start working
+    }
     if (m_fatalerr)
         return false;
     m_next_scanline = 0;  // next scanline we'll read
@@ -437,11 +544,15 @@ JpgInput::read_native_scanline(int subimage, int miplevel, int y, int z,
         return false;
     if (m_next_scanline > y) {
         // User is trying to read an earlier scanline than the one we're
-        // up to.  Easy fix: close the file and re-open.
+        // up to.  Easy fix: close the file and re-open (with the same
+        // decoding options).
         ImageSpec dummyspec;
-        int subimage = current_subimage();
-        if (!close() || !open(m_filename, dummyspec)
-            || !seek_subimage(subimage, 0))
+        int subimage      = current_subimage();
+        DecodeHints hints = m_hints;
+        if (!close())
+            return false;
+        m_hints = hints;
+        if (!open(m_filename, dummyspec) || !seek_subimage(subimage, 0))
             return false;  // Somehow, the re-open failed
         assert(m_next_scanline == 0 && current_subimage() == subimage);
     }
@@ -479,6 +590,316 @@ JpgInput::read_native_scanline(int subimage, int miplevel, int y, int z,
 
 
 
+bool
+JpgInput::read_native_scanlines(int subimage, int miplevel, int ybegin,
+                                int yend, int z, void* data)
+{
+    // Let read_native_scanline position the decoder (rewinding or skipping
+    // as needed) and read the first scanline, then hand libjpeg the rest
+    // of the range in one call, so it can emit several rows per pass
+    // through its upsampling and color conversion.
+    yend = std::min(yend, m_spec.y + m_spec.height);
+    if (ybegin >= yend)
+        return true;
+    if (!seek_subimage(subimage, miplevel))
+        return false;
+    // Files with restart markers may instead be decoded in bands, in
+    // parallel, which also doesn't disturb the sequential decoder.
+    if (yend - ybegin > 1 && read_bands(ybegin, yend, data))
+        return true;
+    if (!read_native_scanline(subimage, miplevel, ybegin, z, data))
+        return false;
+
+    // Set up our custom error handler
+    if (setjmp(m_jerr.setjmp_buffer)) {
+        // Jump to here if there's a libjpeg internal error
+        return false;
+    }
+
+    int nlines = yend - m_next_scanline;
+    if (nlines <= 0)
+        return true;
+    unsigned char* dst = (unsigned char*)data + m_spec.scanline_bytes();
+    unsigned char* buf = dst;
+    size_t rowbytes    = m_spec.scanline_bytes();
+    if (m_cmyk) {
+        // Read into a 4-channel buffer, then convert.
+        rowbytes = size_t(m_spec.width) * 4;
+        m_cmyk_buf.resize(rowbytes * nlines);
+        buf = &m_cmyk_buf[0];
+    }
+    std::vector<JSAMPROW> rows(nlines);
+    for (int i = 0; i < nlines; ++i)
+        rows[i] = buf + i * rowbytes;
+    for (int done = 0; done < nlines;) {
+        int n = jpeg_read_scanlines(&m_cinfo, &rows[done], nlines - done);
+        if (n <= 0 || m_fatalerr) {
+            error("JPEG failed scanline read (\"%s\")", filename().c_str());
+            return false;
+        }
+        done += n;
+        m_next_scanline += n;
+    }
+
+    if (m_cmyk)
+        cmyk_to_rgb(nlines * m_spec.width, buf, 4, dst, 3);
+    return true;
+}
+
+
+
+bool
+JpgInput::index_restarts()
+{
+    m_rstindex = -1;
+    if (m_raw || m_cinfo.progressive_mode || m_cinfo.arith_code
+        || !m_cinfo.restart_interval
+        || m_cinfo.comps_in_scan != m_cinfo.num_components
+        || m_cinfo.output_width != m_cinfo.image_width
+        || m_cinfo.output_height != m_cinfo.image_height)
+        return false;
+
+    size_t size = Filesystem::file_size(m_filename);
+    m_filebuf.resize(size);
+    if (size < 4
+        || Filesystem::read_bytes(m_filename, m_filebuf.data(), size) != size)
+        return false;
+    const unsigned char* buf = m_filebuf.data();
+
+    // Walk the marker segments up to and including the SOS, keeping the
+    // ones a decoder needs (and the JFIF and Adobe markers, which decide
+    // the color space) in m_bandheader.
+    m_bandheader.assign(buf, buf + 2);  // SOI
+    m_sof_height = 0;
+    size_t pos   = 2;
+    for (;;) {
+        if (pos + 4 > size || buf[pos] != 0xFF)
+            return false;
+        while (pos + 4 < size && buf[pos + 1] == 0xFF)
+            ++pos;  // fill bytes
+        int marker = buf[pos + 1];
+        size_t len = (size_t(buf[pos + 2]) << 8) + buf[pos + 3];
+        size_t end = pos + 2 + len;
+        if (len < 2 || end > size || (marker >= 0xD0 && marker <= 0xD9))
+            return false;
+        if (marker == 0xC0 || marker == 0xC1) {  // Huffman baseline/extended
+            if (len < 8)
+                return false;
+            m_sof_height = m_bandheader.size() + 5;
+        } else if ((marker >= 0xC2 && marker <= 0xCF && marker != 0xC4
+                    && marker != 0xC8 && marker != 0xCC)
+                   || marker == 0xDC) {  // other SOFs, or DNL
+            return false;
+        }
+        bool metadata = (marker > JPEG_APP0 && marker <= JPEG_APP0 + 15
+                         && marker != JPEG_APP0 + 14)
+                        || marker == JPEG_COM;
+        if (!metadata)
+            m_bandheader.insert(m_bandheader.end(), buf + pos, buf + end);
+        pos = end;
+        if (marker == 0xDA)  // SOS
+            break;
+    }
+    if (!m_sof_height)
+        return false;
+
+    // Find where each restart segment of the entropy coded data starts.
+    // The last entry is just past the EOI, so that every segment ends two
+    // bytes before the start of the next.
+    m_segments.assign(1, pos);
+    for (;;) {
+        const unsigned char* p = (const unsigned char*)memchr(buf + pos, 0xFF,
+                                                              size - pos);
+        if (!p || p + 1 >= buf + size)
+            return false;  // no EOI
+        pos      = p - buf;
+        int code = buf[pos + 1];
+        if (code == 0x00) {  // stuffed zero
+            pos += 2;
+        } else if (code == 0xFF) {  // fill byte
+            pos += 1;
+        } else if (code >= 0xD0 && code <= 0xD7) {  // RSTn
+            if (code != 0xD0 + int((m_segments.size() - 1) & 7))
+                return false;
+            pos += 2;
+            m_segments.push_back(pos);
+        } else if (code == 0xD9) {  // EOI
+            m_segments.push_back(pos + 2);
+            break;
+        } else {  // another scan, or something else we don't expect
+            return false;
+        }
+    }
+    size_t mcus = size_t(m_cinfo.MCUs_per_row) * m_cinfo.MCU_rows_in_scan;
+    size_t ri   = m_cinfo.restart_interval;
+    if (m_segments.size() - 1 != (mcus + ri - 1) / ri)
+        return false;
+    m_rstindex = 1;
+    return true;
+}
+
+
+
+bool
+JpgInput::read_bands(int ybegin, int yend, void* data)
+{
+    thread_pool* pool = default_thread_pool();
+    if (!m_fd || m_raw || m_rstindex < 0 || pool->size() <= 1
+        || !OIIO::get_int_attribute("jpeg:multithread"))
+        return false;
+    if (!m_rstindex && !index_restarts()) {
+        // Not suitable: don't hold on to the file contents.
+        std::vector<unsigned char>().swap(m_filebuf);
+        std::vector<unsigned char>().swap(m_bandheader);
+        std::vector<size_t>().swap(m_segments);
+        return false;
+    }
+
+    // A band may only start at an MCU row that starts a restart segment,
+    // i.e. every 'step' MCU rows.
+    int vsamp   = m_cinfo.comps_in_scan > 1 ? m_cinfo.max_v_samp_factor : 1;
+    int mcuh    = DCTSIZE * vsamp;
+    int mcurows = m_cinfo.MCU_rows_in_scan;
+    int ri      = m_cinfo.restart_interval;
+    int gcd     = ri;
+    for (int b = m_cinfo.MCUs_per_row; b;) {
+        int t = gcd % b;
+        gcd   = b;
+        b     = t;
+    }
+    int step = ri / gcd;
+
+    // Vertically subsampled chroma is upsampled using the chroma rows
+    // above and below, so then bands are decoded with an extra restart
+    // segment of context on either side.
+    int context = 0;
+    for (int c = 0; c < m_cinfo.num_components; ++c)
+        if (m_cinfo.comp_info[c].v_samp_factor < m_cinfo.max_v_samp_factor)
+            context = step;
+
+    int mcubegin = (ybegin / mcuh) / step * step;
+    int mcuend   = std::min(((yend + mcuh - 1) / mcuh + step - 1) / step * step,
+                          mcurows);
+    int nsteps   = (mcuend - mcubegin + step - 1) / step;
+    // Split into a band per thread, but at least 64 scanlines per band.
+    int bandsteps = std::max((nsteps + pool->size() - 1) / pool->size(),
+                             (64 + step * mcuh - 1) / (step * mcuh));
+    if (bandsteps >= nsteps)
+        return false;  // Just one band, no point
+
+    atomic_int nfailed(0);
+    task_set tasks(pool);
+    for (int b = mcubegin; b < mcuend; b += bandsteps * step) {
+        int e = std::min(b + bandsteps * step, mcuend);
+        tasks.submit([&, b, e](int /*id*/) {
+            if (!decode_band(b, e, ybegin, yend, context, data))
+                ++nfailed;
+        });
+    }
+    tasks.wait();
+    return nfailed == 0;
+}
+
+
+
+bool
+JpgInput::decode_band(int mcubegin, int mcuend, int ybegin, int yend,
+                      int context, void* data) const
+{
+    int vsamp   = m_cinfo.comps_in_scan > 1 ? m_cinfo.max_v_samp_factor : 1;
+    int mcuh    = DCTSIZE * vsamp;
+    int mcurows = m_cinfo.MCU_rows_in_scan;
+    int ri      = m_cinfo.restart_interval;
+    int first   = std::max(mcubegin - context, 0);
+    int last    = std::min(mcuend + context, mcurows);
+    int y0      = first * mcuh;  // first scanline we decode
+    int ykeep   = std::max(mcubegin * mcuh, ybegin);
+    int yret    = std::min(mcuend * mcuh, yend);
+    int height  = std::min(last * mcuh, int(m_cinfo.image_height)) - y0;
+    if (ykeep >= yret)
+        return true;
+
+    // Assemble a stand-alone stream: the header with the frame height
+    // patched to that of the band, then the band's restart segments,
+    // renumbering their RST markers from 0.
+    size_t seg0 = size_t(first) * m_cinfo.MCUs_per_row / ri;
+    size_t seg1 = last == mcurows ? m_segments.size() - 1
+                                  : size_t(last) * m_cinfo.MCUs_per_row / ri;
+    std::vector<unsigned char> stream(m_bandheader);
+    stream.reserve(stream.size() + m_segments[seg1] - m_segments[seg0] + 2);
+    stream[m_sof_height]     = (unsigned char)(height >> 8);
+    stream[m_sof_height + 1] = (unsigned char)(height & 0xff);
+    for (size_t s = seg0; s < seg1; ++s) {
+        if (s > seg0) {
+            stream.push_back(0xFF);
+            stream.push_back((unsigned char)(0xD0 + ((s - seg0 - 1) & 7)));
+        }
+        stream.insert(stream.end(), m_filebuf.begin() + m_segments[s],
+                      m_filebuf.begin() + m_segments[s + 1] - 2);
+    }
+    stream.push_back(0xFF);
+    stream.push_back(JPEG_EOI);
+
+    size_t rowbytes = m_spec.scanline_bytes();
+    size_t decbytes = m_cmyk ? size_t(m_spec.width) * 4 : rowbytes;
+    unsigned char* dst = (unsigned char*)data;
+    // Discarded scanlines go to the front of buf, CMYK ones after that.
+    std::vector<unsigned char> buf(decbytes * (m_cmyk ? yret - ykeep + 1 : 1));
+    std::vector<JSAMPROW> rows(yret - y0);
+    for (int y = y0; y < yret; ++y) {
+        if (y < ykeep)
+            rows[y - y0] = &buf[0];
+        else if (m_cmyk)
+            rows[y - y0] = &buf[(y - ykeep + 1) * decbytes];
+        else
+            rows[y - y0] = dst + (y - ybegin) * rowbytes;
+    }
+
+    struct jpeg_decompress_struct cinfo;
+    band_error_mgr jerr;
+    jpeg_source_mgr src;
+    cinfo.err               = jpeg_std_error(&jerr.pub);
+    jerr.pub.error_exit     = band_error_exit;
+    jerr.pub.output_message = band_output_message;
+    if (setjmp(jerr.setjmp_buffer)) {
+        jpeg_destroy_decompress(&cinfo);
+        return false;
+    }
+    jpeg_create_decompress(&cinfo);
+    src.init_source       = mem_init_source;
+    src.fill_input_buffer = mem_fill_input_buffer;
+    src.skip_input_data   = mem_skip_input_data;
+    src.resync_to_restart = jpeg_resync_to_restart;
+    src.term_source       = mem_term_source;
+    src.next_input_byte   = stream.data();
+    src.bytes_in_buffer   = stream.size();
+    cinfo.src             = &src;
+    bool ok = (jpeg_read_header(&cinfo, TRUE) == JPEG_HEADER_OK);
+    if (ok) {
+        cinfo.out_color_space     = m_cinfo.out_color_space;
+        cinfo.dct_method          = m_cinfo.dct_method;
+        cinfo.do_fancy_upsampling = m_cinfo.do_fancy_upsampling;
+        jpeg_start_decompress(&cinfo);
+        ok = (cinfo.output_width == m_cinfo.output_width
+              && cinfo.output_height == JDIMENSION(height)
+              && cinfo.output_components == m_cinfo.output_components);
+    }
+    for (int done = 0, n = yret - y0; ok && done < n;) {
+        int r = jpeg_read_scanlines(&cinfo, &rows[done], n - done);
+        done += r;
+        ok = (r > 0 && !jerr.pub.num_warnings);
+    }
+    ok &= !jerr.pub.num_warnings;
+    jpeg_destroy_decompress(&cinfo);
+
+    if (ok && m_cmyk)
+        cmyk_to_rgb((yret - ykeep) * m_spec.width, &buf[decbytes], 4,
+                    dst + (ykeep - ybegin) * rowbytes, 3);
+    return ok;
+}
+
+
+
 bool
 JpgInput::close()
 {
@@ -35,6 +35,7 @@
 #include <OpenImageIO/filesystem.h>
 #include <OpenImageIO/fmath.h>
 #include <OpenImageIO/imageio.h>
+#include <OpenImageIO/thread.h>
 #include <OpenImageIO/tiffutils.h>
 
 #include "jpeg_pvt.h"
@@ -52,6 +53,63 @@ OIIO_PLUGIN_NAMESPACE_BEGIN
 
 
 
+// A libjpeg destination that appends to a std::vector, for the bands that
+// are compressed in parallel (jpeg_mem_dest is not available in all the
+// libjpeg versions we support).
+struct vector_dest_mgr {
+    struct jpeg_destination_mgr pub;
+    std::vector<unsigned char>* vec;
+};
+
+
+
+static void
+vec_init_destination(j_compress_ptr cinfo)
+{
+    vector_dest_mgr* dest = (vector_dest_mgr*)cinfo->dest;
+    dest->vec->resize(std::max(dest->vec->size(), size_t(4096)));
+    dest->pub.next_output_byte = dest->vec->data();
+    dest->pub.free_in_buffer   = dest->vec->size();
+}
+
+
+
+static boolean
+vec_empty_output_buffer(j_compress_ptr cinfo)
+{
+    // The buffer is full, so double it.
+    vector_dest_mgr* dest = (vector_dest_mgr*)cinfo->dest;
+    size_t used           = dest->vec->size();
+    dest->vec->resize(2 * used);
+    dest->pub.next_output_byte = dest->vec->data() + used;
+    dest->pub.free_in_buffer   = used;
+    return TRUE;
+}
+
+
+
+static void
+vec_term_destination(j_compress_ptr cinfo)
+{
+    vector_dest_mgr* dest = (vector_dest_mgr*)cinfo->dest;
+    dest->vec->resize(dest->vec->size() - dest->pub.free_in_buffer);
+}
+
+
+
+static void
+vec_dest(j_compress_ptr cinfo, vector_dest_mgr* dest,
+         std::vector<unsigned char>* vec)
+{
+    dest->pub.init_destination    = vec_init_destination;
+    dest->pub.empty_output_buffer = vec_empty_output_buffer;
+    dest->pub.term_destination    = vec_term_destination;
+    dest->vec                     = vec;
+    cinfo->dest                   = &dest->pub;
+}
+
+
+
 class JpgOutput final : public ImageOutput {
 public:
     JpgOutput() { init(); }
@@ -65,6 +123,10 @@ public:
                       OpenMode mode = Create) override;
     virtual bool write_scanline(int y, int z, TypeDesc format, const void* data,
                                 stride_t xstride) override;
+    virtual bool write_scanlines(int ybegin, int yend, int z, TypeDesc format,
+                                 const void* data,
+                                 stride_t xstride = AutoStride,
+                                 stride_t ystride = AutoStride) override;
     virtual bool write_tile(int x, int y, int z, TypeDesc format,
                             const void* data, stride_t xstride,
                             stride_t ystride, stride_t zstride) override;
@@ -82,12 +144,24 @@ private:
     jvirt_barray_ptr* m_copy_coeffs;
     struct jpeg_decompress_struct* m_copy_decompressor;
     std::vector<unsigned char> m_tilebuffer;
+    // When encoding in parallel, m_cinfo only writes the file header (to
+    // m_header), and bands of m_band_rows scanlines are compressed
+    // separately and joined at restart markers in close().
+    int m_band_rows;                                  // 0 if not parallel
+    vector_dest_mgr m_header_dest;
+    std::vector<unsigned char> m_header;              // SOI, JFIF, metadata
+    std::vector<unsigned char> m_band_pixels;         // Not yet encoded
+    std::vector<std::vector<unsigned char>> m_bands;  // Encoded bands
 
     void init(void)
     {
         m_fd                = NULL;
         m_copy_coeffs       = NULL;
         m_copy_decompressor = NULL;
+        m_band_rows         = 0;
+        std::vector<unsigned char>().swap(m_header);
+        std::vector<unsigned char>().swap(m_band_pixels);
+        std::vector<std::vector<unsigned char>>().swap(m_bands);
     }
 
     void set_subsampling(const int components[])
@@ -104,6 +178,22 @@ private:
     // Read the XResolution/YResolution and PixelAspectRatio metadata, store
     // in density fields m_cinfo.X_density,Y_density.
     void resmeta_to_density();
+
+    // How many scanlines go in each band when encoding in parallel, or 0
+    // if we shouldn't. Called once m_cinfo's parameters are set.
+    int parallel_band_rows();
+
+    // Compress the full bands in m_band_pixels (and the partial one at the
+    // end, if flush is true), in parallel, appending them to m_bands.
+    void encode_bands(bool flush);
+
+    // Compress nrows native scanlines with the same parameters as m_cinfo,
+    // as a stand-alone JPEG stream.
+    void encode_band(const unsigned char* pixels, int nrows,
+                     std::vector<unsigned char>& out) const;
+
+    // Write the header and the encoded bands to the file.
+    bool write_bands();
 };
 
 
@@ -218,6 +308,16 @@ JpgOutput::open(const std::string& name, const ImageSpec& newspec,
         }
         DBG std::cout << "out open: set_colorspace\n";
 
+        int restart = m_spec.get_int_attribute("jpeg:restart", 0);
+        if (restart > 0) {
+            // Restart markers every that many MCU rows, which also lets
+            // us compress bands of the image in parallel.
+            m_cinfo.restart_in_rows = std::min(restart, 65535);
+            m_band_rows             = parallel_band_rows();
+            if (m_band_rows)
+                vec_dest(&m_cinfo, &m_header_dest, &m_header);
+        }
+
         jpeg_start_compress(&m_cinfo, TRUE);  // start working
         DBG std::cout << "out open: start_compress\n";
     }
@@ -364,6 +464,33 @@ JpgOutput::resmeta_to_density()
 
 
 
+int
+JpgOutput::parallel_band_rows()
+{
+    int multithread = OIIO::get_int_attribute("jpeg:multithread");
+    if (default_thread_pool()->size() <= 1
+        || !m_spec.get_int_attribute("jpeg:multithread", multithread))
+        return 0;
+    int hsamp = 1, vsamp = 1;
+    for (int c = 0; c < m_cinfo.num_components; ++c) {
+        hsamp = std::max(hsamp, m_cinfo.comp_info[c].h_samp_factor);
+        vsamp = std::max(vsamp, m_cinfo.comp_info[c].v_samp_factor);
+    }
+    if (m_cinfo.num_components == 1)  // non-interleaved: 1 block per MCU
+        hsamp = vsamp = 1;
+    int mcus_per_row = (m_spec.width + DCTSIZE * hsamp - 1) / (DCTSIZE * hsamp);
+    if (m_cinfo.restart_in_rows * mcus_per_row > 65535)
+        return 0;  // libjpeg would clamp the restart interval
+    // Each band is a multiple of 8 restart intervals, so that every band
+    // starts after an RST7 marker and its own RST markers, numbered from
+    // RST0, need no renumbering. Make them at least 256 scanlines.
+    int rows = 8 * m_cinfo.restart_in_rows * DCTSIZE * vsamp;
+    rows *= std::max(1, (256 + rows - 1) / rows);
+    return m_spec.height > rows ? rows : 0;
+}
+
+
+
 bool
 JpgOutput::write_scanline(int y, int z, TypeDesc format, const void* data,
                           stride_t xstride)
@@ -378,7 +505,7 @@ JpgOutput::write_scanline(int y, int z, TypeDesc format, const void* data,
         error("Attempt to write too many scanlines to %s", m_filename.c_str());
         return false;
     }
-    assert(y == (int)m_cinfo.next_scanline);
+    assert(m_band_rows || y == (int)m_cinfo.next_scanline);
 
     // Here's where we do the dirty work of conforming to JFIF's limitation
     // of 1 or 3 channels, by temporarily doctoring the spec so that
@@ -397,6 +524,16 @@ JpgOutput::write_scanline(int y, int z, TypeDesc format, const void* data,
     data = to_native_scanline(format, data, xstride, m_scratch, m_dither, y, z);
     m_spec.nchannels = save_nchannels;
 
+    if (m_band_rows) {
+        // Encoding in parallel: save the scanline for when its band fills.
+        const unsigned char* p = (const unsigned char*)data;
+        m_band_pixels.insert(m_band_pixels.end(), p,
+                             p + m_spec.width * m_cinfo.input_components);
+        ++m_next_scanline;
+        encode_bands(false);
+        return true;
+    }
+
     jpeg_write_scanlines(&m_cinfo, (JSAMPLE**)&data, 1);
     ++m_next_scanline;
 
@@ -405,6 +542,208 @@ JpgOutput::write_scanline(int y, int z, TypeDesc format, const void* data,
 
 
 
+bool
+JpgOutput::write_scanlines(int ybegin, int yend, int z, TypeDesc format,
+                           const void* data, stride_t xstride, stride_t ystride)
+{
+    if (!m_band_rows)
+        return ImageOutput::write_scanlines(ybegin, yend, z, format, data,
+                                            xstride, ystride);
+
+    if (ybegin - m_spec.y != m_next_scanline) {
+        error("Attempt to write scanlines out of order to %s",
+              m_filename.c_str());
+        return false;
+    }
+    if (yend - m_spec.y > m_spec.height) {
+        error("Attempt to write too many scanlines to %s", m_filename.c_str());
+        return false;
+    }
+    if (ybegin >= yend)
+        return true;
+
+    // Convert and contiguize the first 1 or 3 channels of the whole range
+    // at once, doctoring the spec just as write_scanline does.
+    if (format == TypeDesc::UNKNOWN)
+        format = m_spec.format;
+    stride_t zstride = AutoStride;
+    m_spec.auto_stride(xstride, ystride, zstride, format, m_spec.nchannels,
+                       m_spec.width, yend - ybegin);
+    int save_nchannels = m_spec.nchannels;
+    m_spec.nchannels   = m_cinfo.input_components;
+    std::vector<unsigned char> nativebuf;
+    data = to_native_rectangle(m_spec.x, m_spec.x + m_spec.width, ybegin, yend,
+                               z, z + 1, format, data, xstride, ystride,
+                               zstride, nativebuf, m_dither, m_spec.x,
+                               m_spec.y, m_spec.z);
+    m_spec.nchannels = save_nchannels;
+
+    const unsigned char* p = (const unsigned char*)data;
+    m_band_pixels.insert(m_band_pixels.end(), p,
+                         p + size_t(yend - ybegin) * m_spec.width
+                                 * m_cinfo.input_components);
+    m_next_scanline += yend - ybegin;
+    encode_bands(false);
+    return true;
+}
+
+
+
+void
+JpgOutput::encode_bands(bool flush)
+{
+    size_t rowbytes  = size_t(m_spec.width) * m_cinfo.input_components;
+    size_t bandbytes = rowbytes * m_band_rows;
+    size_t total     = m_band_pixels.size();
+    size_t nbands    = flush ? (total + bandbytes - 1) / bandbytes
+                             : total / bandbytes;
+    if (!nbands)
+        return;
+    size_t first = m_bands.size();
+    m_bands.resize(first + nbands);
+    task_set tasks(default_thread_pool());
+    for (size_t b = 0; b < nbands; ++b) {
+        tasks.submit([&, b](int /*id*/) {
+            size_t begin = b * bandbytes;
+            int nrows    = int(std::min(bandbytes, total - begin) / rowbytes);
+            encode_band(&m_band_pixels[begin], nrows, m_bands[first + b]);
+        });
+    }
+    tasks.wait();
+    m_band_pixels.erase(m_band_pixels.begin(),
+                        m_band_pixels.begin()
+                            + std::min(nbands * bandbytes, total));
+}
+
+
+
+void
+JpgOutput::encode_band(const unsigned char* pixels, int nrows,
+                       std::vector<unsigned char>& out) const
+{
+    struct jpeg_compress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+    vector_dest_mgr dest;
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_compress(&cinfo);
+    vec_dest(&cinfo, &dest, &out);
+
+    // Same parameters as m_cinfo, but no JFIF/Adobe markers (only the
+    // tables, frame and scan headers are used from the first band).
+    cinfo.image_width      = m_cinfo.image_width;
+    cinfo.image_height     = nrows;
+    cinfo.input_components = m_cinfo.input_components;
+    cinfo.in_color_space   = m_cinfo.in_color_space;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_colorspace(&cinfo, m_cinfo.jpeg_color_space);
+    for (int c = 0; c < cinfo.num_components; ++c) {
+        cinfo.comp_info[c].h_samp_factor = m_cinfo.comp_info[c].h_samp_factor;
+        cinfo.comp_info[c].v_samp_factor = m_cinfo.comp_info[c].v_samp_factor;
+        cinfo.comp_info[c].quant_tbl_no  = m_cinfo.comp_info[c].quant_tbl_no;
+    }
+    for (int t = 0; t < NUM_QUANT_TBLS; ++t) {
+        if (!m_cinfo.quant_tbl_ptrs[t])
+            continue;
+        if (!cinfo.quant_tbl_ptrs[t])
+            cinfo.quant_tbl_ptrs[t] = jpeg_alloc_quant_table(
+                (j_common_ptr)&cinfo);
+        memcpy(cinfo.quant_tbl_ptrs[t]->quantval,
+               m_cinfo.quant_tbl_ptrs[t]->quantval,
+               sizeof(m_cinfo.quant_tbl_ptrs[t]->quantval));
+    }
+    cinfo.dct_method         = m_cinfo.dct_method;
+    cinfo.restart_in_rows    = m_cinfo.restart_in_rows;
+    cinfo.write_JFIF_header  = FALSE;
+    cinfo.write_Adobe_marker = FALSE;
+
+    jpeg_start_compress(&cinfo, TRUE);
+    size_t rowbytes = size_t(m_spec.width) * m_cinfo.input_components;
+    std::vector<JSAMPROW> rows(nrows);
+    for (int y = 0; y < nrows; ++y)
+        rows[y] = (JSAMPROW)(pixels + y * rowbytes);
+    while (cinfo.next_scanline < cinfo.image_height)
+        jpeg_write_scanlines(&cinfo, &rows[cinfo.next_scanline],
+                             cinfo.image_height - cinfo.next_scanline);
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+}
+
+
+
+// Return the offset of the entropy coded data in a JPEG stream written by
+// libjpeg (just past the SOS marker segment), and of the frame height.
+static size_t
+scan_data_offset(const std::vector<unsigned char>& stream, size_t& sof_height)
+{
+    size_t pos = 2;  // skip SOI
+    while (pos + 4 <= stream.size() && stream[pos] == 0xFF) {
+        int marker = stream[pos + 1];
+        size_t len = (size_t(stream[pos + 2]) << 8) + stream[pos + 3];
+        if (marker == 0xC0 || marker == 0xC1)
+            sof_height = pos + 5;
+        pos += 2 + len;
+        if (marker == 0xDA)  // SOS
+            return pos;
+    }
+    return 0;
+}
+
+
+
+bool
+JpgOutput::write_bands()
+{
+    // Fill in any scanlines that weren't written, to avoid errors, and
+    // compress what's left.
+    size_t rowbytes = size_t(m_spec.width) * m_cinfo.input_components;
+    if (m_next_scanline < m_spec.height)
+        m_band_pixels.resize(m_band_pixels.size()
+                                 + (m_spec.height - m_next_scanline)
+                                       * rowbytes,
+                             0);
+    encode_bands(true);
+
+    // The file header that m_cinfo wrote, then the first band's tables
+    // and frame and scan headers, with the height of the whole image.
+    size_t sof_height = 0;
+    size_t sos        = scan_data_offset(m_bands[0], sof_height);
+    if (!sos || !sof_height) {
+        error("JPEG failed to assemble bands for %s", m_filename.c_str());
+        return false;
+    }
+    std::vector<unsigned char> tables(m_bands[0].begin() + 2,
+                                      m_bands[0].begin() + sos);
+    tables[sof_height - 2]     = (unsigned char)(m_spec.height >> 8);
+    tables[sof_height - 2 + 1] = (unsigned char)(m_spec.height & 0xff);
+    size_t header = m_header.size() - m_header_dest.pub.free_in_buffer;
+    bool ok       = fwrite(m_header.data(), 1, header, m_fd) == header;
+    ok &= fwrite(tables.data(), 1, tables.size(), m_fd) == tables.size();
+
+    // Then the entropy coded data of each band, without its EOI, joined
+    // by RST7 markers.
+    static const unsigned char rst7[2] = { 0xFF, 0xD7 };
+    static const unsigned char eoi[2]  = { 0xFF, JPEG_EOI };
+    for (size_t b = 0; b < m_bands.size(); ++b) {
+        const std::vector<unsigned char>& band(m_bands[b]);
+        size_t begin = b ? scan_data_offset(band, sof_height) : sos;
+        if (!begin || band.size() < begin + 2) {
+            ok = false;
+            break;
+        }
+        if (b)
+            ok &= fwrite(rst7, 1, 2, m_fd) == 2;
+        ok &= fwrite(&band[begin], 1, band.size() - 2 - begin, m_fd)
+              == band.size() - 2 - begin;
+        std::vector<unsigned char>().swap(m_bands[b]);  // free it
+    }
+    ok &= fwrite(eoi, 1, 2, m_fd) == 2;
+    if (!ok)
+        error("JPEG failed to write %s", m_filename.c_str());
+    return ok;
+}
+
+
+
 bool
 JpgOutput::write_tile(int x, int y, int z, TypeDesc format, const void* data,
                       stride_t xstride, stride_t ystride, stride_t zstride)
@@ -434,7 +773,8 @@ JpgOutput::close()
         std::vector<unsigned char>().swap(m_tilebuffer);  // free it
     }
 
-    if (m_next_scanline < spec().height && m_copy_coeffs == NULL) {
+    if (m_next_scanline < spec().height && m_copy_coeffs == NULL
+        && !m_band_rows) {
         // But if we've only written some scanlines, write the rest to avoid
         // errors
         std::vector<char> buf(spec().scanline_bytes(), 0);
@@ -446,7 +786,12 @@ JpgOutput::close()
         }
     }
 
-    if (m_next_scanline >= spec().height || m_copy_coeffs) {
+    if (m_band_rows) {
+        // We've been compressing bands in parallel, and m_cinfo only
+        // wrote the file header.
+        ok &= write_bands();
+        jpeg_abort_compress(&m_cinfo);
+    } else if (m_next_scanline >= spec().height || m_copy_coeffs) {
         DBG std::cout << "out close: about to finish_compress\n";
         jpeg_finish_compress(&m_cinfo);
         DBG std::cout << "out close: finish_compress\n";
@@ -490,6 +835,9 @@ JpgOutput::copy_image(ImageInput* in)
         // Re-open the output
         std::string out_name    = m_filename;
         ImageSpec orig_out_spec = spec();
+        // Nothing was written to the bands of a parallel write, so don't
+        // let close() compress and emit them.
+        m_band_rows = 0;
         close();
         m_copy_coeffs       = (jvirt_barray_ptr*)jpg_in->coeffs();
         m_copy_decompressor = &jpg_in->m_cinfo;
@@ -1126,6 +1126,38 @@ static spin_mutex colorconfig_mutex;
 
 
 
+// Make the processor for a conversion between named color spaces, using
+// the default ColorConfig if none is given. On failure, return an empty
+// handle and set err.
+static ColorProcessorHandle
+named_color_processor(ColorConfig* colorconfig, string_view from,
+                      string_view to, string_view context_key,
+                      string_view context_value, std::string& err)
+{
+    if (from.empty() || to.empty()) {
+        err = "Unknown color space name";
+        return ColorProcessorHandle();
+    }
+    spin_lock lock(colorconfig_mutex);
+    if (!colorconfig)
+        colorconfig = default_colorconfig.get();
+    if (!colorconfig)
+        default_colorconfig.reset(colorconfig = new ColorConfig);
+    ColorProcessorHandle processor
+        = colorconfig->createColorProcessor(from, to, context_key,
+                                            context_value);
+    if (!processor) {
+        if (colorconfig->error())
+            err = colorconfig->geterror();
+        else
+            err = Strutil::sprintf(
+                "Could not construct the color transform %s -> %s", from, to);
+    }
+    return processor;
+}
+
+
+
 bool
 ImageBufAlgo::colorconvert(ImageBuf& dst, const ImageBuf& src, string_view from,
                            string_view to, bool unpremult,
@@ -1136,28 +1168,14 @@ ImageBufAlgo::colorconvert(ImageBuf& dst, const ImageBuf& src, string_view from,
     if (from.empty() || from == "current") {
         from = src.spec().get_string_attribute("oiio:Colorspace", "Linear");
     }
-    if (from.empty() || to.empty()) {
-        dst.error("Unknown color space name");
+    std::string err;
+    ColorProcessorHandle processor
+        = named_color_processor(colorconfig, from, to, context_key,
+                                context_value, err);
+    if (!processor) {
+        dst.error("%s", err);
         return false;
     }
-    ColorProcessorHandle processor;
-    {
-        spin_lock lock(colorconfig_mutex);
-        if (!colorconfig)
-            colorconfig = default_colorconfig.get();
-        if (!colorconfig)
-            default_colorconfig.reset(colorconfig = new ColorConfig);
-        processor = colorconfig->createColorProcessor(from, to, context_key,
-                                                      context_value);
-        if (!processor) {
-            if (colorconfig->error())
-                dst.error("%s", colorconfig->geterror());
-            else
-                dst.error("Could not construct the color transform %s -> %s",
-                          from, to);
-            return false;
-        }
-    }
 
     logtime.stop();  // transition to other colorconvert
     bool ok = colorconvert(dst, src, processor.get(), unpremult, roi, nthreads);
@@ -1376,6 +1394,27 @@ ImageBufAlgo::colorconvert(const ImageBuf& src, const ColorProcessor* processor,
 
 
 
+ImageBufAlgo::ImageExpr&
+ImageBufAlgo::ImageExpr::colorconvert(string_view from, string_view to,
+                                      bool unpremult, string_view context_key,
+                                      string_view context_value,
+                                      ColorConfig* colorconfig)
+{
+    if (from.empty() || from == "current")
+        from = spec().get_string_attribute("oiio:Colorspace", "Linear");
+    std::string err;
+    ColorProcessorHandle processor
+        = named_color_processor(colorconfig, from, to, context_key,
+                                context_value, err);
+    if (!processor) {
+        error(err);
+        return *this;
+    }
+    return colorconvert(processor, unpremult, to);
+}
+
+
+
 bool
 ImageBufAlgo::ociolook(ImageBuf& dst, const ImageBuf& src, string_view looks,
                        string_view from, string_view to, bool inverse,
@@ -53,6 +53,16 @@ OIIO_NAMESPACE_BEGIN
 // need to lock the mutex. As long as capacity is not changing, threads may
 // change number of samples (inserting or deleting) as well as altering
 // data, simultaneously, as long as they are working on separate pixels.
+//
+// The default Interleaved layout keeps every sample of every pixel in one
+// buffer, m_data, as [p][s][c], with m_cumcapacity[p] giving the number of
+// samples allocated before pixel p. The Planar layout instead groups the
+// pixels into chunks of (1<<chunk_shift) pixels, each with its own buffer
+// in m_chunkdata laid out channel by channel, [c][p][s], and with
+// m_cumcapacity[p] counting only the samples before p within its chunk.
+// Channel c of chunk k starts at m_chunkcapacity[k]*m_channeloffsets[c],
+// and chunk capacities are kept to a multiple of chunk_align samples so
+// that each channel's array is suitably aligned for SIMD access.
 
 
 
@@ -68,6 +78,8 @@ public:
     std::vector<unsigned int>
         m_cumcapacity;         // cumulative capacity before pixel [p]
     std::vector<char> m_data;  // for each sample [p][s][c]
+    std::vector<std::vector<char>> m_chunkdata;  // Planar: [k][c][p][s]
+    std::vector<size_t> m_chunkcapacity;  // Planar: samples alloc'd in [k]
     std::vector<std::string> m_channelnames;  // For each channel[c]
     std::vector<int> m_myalphachannel;        // For each channel[c], its alpha
         // myalphachannel[c] gives the alpha channel corresponding to channel
@@ -80,10 +92,14 @@ public:
     int m_AG_channel;
     int m_AB_channel;
     bool m_allocated;
+    bool m_planar;
     spin_mutex m_mutex;
 
+    enum { chunk_shift = 8, chunk_align = 16 };
+
     Impl()
         : m_allocated(false)
+        , m_planar(false)
     {
         clear();
     }
@@ -97,6 +113,8 @@ public:
         m_capacity.clear();
         m_cumcapacity.clear();
         m_data.clear();
+        m_chunkdata.clear();
+        m_chunkcapacity.clear();
         m_channelnames.clear();
         m_myalphachannel.clear();
         m_samplesize    = 0;
@@ -107,6 +125,39 @@ public:
         m_AG_channel    = -1;
         m_AB_channel    = -1;
         m_allocated     = false;
+        m_planar        = false;
+    }
+
+    size_t nchunks() const
+    {
+        return (m_capacity.size() + (1 << chunk_shift) - 1) >> chunk_shift;
+    }
+
+    // Range of pixels [begin,end) belonging to Planar chunk k.
+    size_t chunk_begin(size_t k) const { return k << chunk_shift; }
+    size_t chunk_end(size_t k) const
+    {
+        return std::min((k + 1) << chunk_shift, m_capacity.size());
+    }
+
+    // Number of samples of Planar chunk k that are claimed by its pixels.
+    size_t chunk_used(size_t k) const
+    {
+        size_t last = chunk_end(k) - 1;
+        return m_cumcapacity[last] + m_capacity[last];
+    }
+
+    static size_t round_chunk_capacity(size_t samps)
+    {
+        return (samps + chunk_align - 1) & ~size_t(chunk_align - 1);
+    }
+
+    // Allocate the Planar buffer of chunk k to hold at least samps
+    // samples, without initializing the cumulative capacities.
+    void alloc_chunk(size_t k, size_t samps)
+    {
+        m_chunkcapacity[k] = round_chunk_capacity(samps);
+        m_chunkdata[k].assign(m_chunkcapacity[k] * m_samplesize, 0);
     }
 
     // If not already done, allocate data and cumcapacity
@@ -115,33 +166,154 @@ public:
         if (!m_allocated) {
             spin_lock lock(m_mutex);
             if (!m_allocated) {
-                // m_cumcapacity.resize (npixels);
-                size_t totalcapacity = 0;
-                for (size_t i = 0; i < npixels; ++i) {
-                    m_cumcapacity[i] = totalcapacity;
-                    totalcapacity += m_capacity[i];
+                if (m_planar) {
+                    m_chunkdata.resize(nchunks());
+                    m_chunkcapacity.resize(nchunks());
+                    for (size_t k = 0, n = nchunks(); k < n; ++k) {
+                        size_t chunkcapacity = 0;
+                        for (size_t i = chunk_begin(k); i < chunk_end(k); ++i) {
+                            m_cumcapacity[i] = chunkcapacity;
+                            chunkcapacity += m_capacity[i];
+                        }
+                        alloc_chunk(k, chunkcapacity);
+                    }
+                } else {
+                    // m_cumcapacity.resize (npixels);
+                    size_t totalcapacity = 0;
+                    for (size_t i = 0; i < npixels; ++i) {
+                        m_cumcapacity[i] = totalcapacity;
+                        totalcapacity += m_capacity[i];
+                    }
+                    m_data.resize(totalcapacity * m_samplesize);
                 }
-                m_data.resize(totalcapacity * m_samplesize);
                 m_allocated = true;
             }
         }
     }
 
-    size_t data_offset(int pixel, int channel, int sample)
+    // Byte offset of the given sample within its buffer (m_data for
+    // Interleaved, m_chunkdata[pixel>>chunk_shift] for Planar).
+    size_t data_offset(int pixel, int channel, int sample) const
     {
         DASSERT(int(m_cumcapacity.size()) > pixel);
         DASSERT(m_capacity[pixel] >= m_nsamples[pixel]);
+        if (m_planar)
+            return m_chunkcapacity[pixel >> chunk_shift]
+                       * m_channeloffsets[channel]
+                   + (m_cumcapacity[pixel] + sample) * m_channelsizes[channel];
         return (m_cumcapacity[pixel] + sample) * m_samplesize
                + m_channeloffsets[channel];
     }
 
-    void* data_ptr(int pixel, int channel, int sample)
+    char* data_ptr(int pixel, int channel, int sample)
     {
         size_t offset = data_offset(pixel, channel, sample);
+        if (m_planar) {
+            DASSERT(offset < m_chunkdata[pixel >> chunk_shift].size());
+            return &m_chunkdata[pixel >> chunk_shift][offset];
+        }
         DASSERT(offset < m_data.size());
         return &m_data[offset];
     }
 
+    const char* data_ptr(int pixel, int channel, int sample) const
+    {
+        return const_cast<Impl*>(this)->data_ptr(pixel, channel, sample);
+    }
+
+    // Bytes between successive samples of one channel.
+    size_t sample_stride(int channel) const
+    {
+        return m_planar ? m_channelsizes[channel] : m_samplesize;
+    }
+
+    // If the channel's samples for the pixel are a contiguous float array
+    // (a FLOAT channel in the Planar layout), return it, else NULL.
+    const float* float_samples(int pixel, int channel) const
+    {
+        if (!m_planar || !m_allocated || channel < 0 || pixel < 0
+            || pixel >= int(m_nsamples.size()) || !m_nsamples[pixel]
+            || m_channeltypes[channel] != TypeDesc::FLOAT)
+            return NULL;
+        return (const float*)data_ptr(pixel, channel, 0);
+    }
+
+    // Grow the capacity of pixel p by toadd samples. The caller holds
+    // m_mutex, and the data has been allocated.
+    void grow_capacity(int pixel, int toadd)
+    {
+        if (m_planar) {
+            // Only this pixel's chunk changes: shift the later pixels'
+            // samples of each channel up in place if the chunk has room,
+            // otherwise repack the chunk into a larger buffer.
+            size_t k      = pixel >> chunk_shift;
+            size_t used   = chunk_used(k);
+            size_t split  = m_cumcapacity[pixel] + m_capacity[pixel];
+            size_t nchans = m_channelsizes.size();
+            if (used + toadd <= m_chunkcapacity[k]) {
+                char* base = m_chunkdata[k].data();
+                for (size_t c = 0; c < nchans; ++c) {
+                    char* plane = base
+                                  + m_chunkcapacity[k] * m_channeloffsets[c];
+                    size_t sz = m_channelsizes[c];
+                    memmove(plane + (split + toadd) * sz, plane + split * sz,
+                            (used - split) * sz);
+                    memset(plane + split * sz, 0, toadd * sz);
+                }
+            } else {
+                std::vector<char> old;
+                old.swap(m_chunkdata[k]);
+                size_t oldcapacity = m_chunkcapacity[k];
+                alloc_chunk(k, std::max(used + toadd, oldcapacity * 3 / 2));
+                char* base = m_chunkdata[k].data();
+                for (size_t c = 0; c < nchans; ++c) {
+                    const char* src = old.data()
+                                      + oldcapacity * m_channeloffsets[c];
+                    char* dst = base + m_chunkcapacity[k] * m_channeloffsets[c];
+                    size_t sz = m_channelsizes[c];
+                    memcpy(dst, src, split * sz);
+                    memcpy(dst + (split + toadd) * sz, src + split * sz,
+                           (used - split) * sz);
+                }
+            }
+            for (size_t p = pixel + 1, e = chunk_end(k); p < e; ++p)
+                m_cumcapacity[p] += toadd;
+        } else {
+            if (m_data.empty()) {
+                size_t newtotal = (total_capacity() + toadd);
+                m_data.resize(newtotal * m_samplesize);
+            } else {
+                size_t offset = data_offset(pixel, 0, m_capacity[pixel]);
+                m_data.insert(m_data.begin() + offset, toadd * m_samplesize,
+                              0);
+            }
+            // Adjust the cumulative prefix sum of samples for subsequent
+            // pixels
+            for (size_t p = pixel + 1, e = m_capacity.size(); p < e; ++p)
+                m_cumcapacity[p] += toadd;
+        }
+        m_capacity[pixel] += toadd;
+    }
+
+    // Move samples [begin,end) of the pixel by delta sample positions,
+    // within the pixel's capacity.
+    void move_samples(int pixel, int begin, int end, int delta)
+    {
+        if (begin >= end || !delta)
+            return;
+        if (m_planar) {
+            for (size_t c = 0, n = m_channelsizes.size(); c < n; ++c) {
+                size_t sz = m_channelsizes[c];
+                char* src = data_ptr(pixel, c, begin);
+                memmove(src + delta * ptrdiff_t(sz), src, (end - begin) * sz);
+            }
+        } else {
+            char* src = data_ptr(pixel, 0, begin);
+            memmove(src + delta * ptrdiff_t(m_samplesize), src,
+                    (end - begin) * m_samplesize);
+        }
+    }
+
     size_t total_capacity() const
     {
         return m_cumcapacity.back() + m_capacity.back();
@@ -155,7 +327,20 @@ public:
         int npixels = int(m_capacity.size());
         ASSERT(m_nsamples.size() == m_capacity.size());
         ASSERT(m_cumcapacity.size() == m_capacity.size());
-        if (m_allocated) {
+        if (m_allocated && m_planar) {
+            ASSERT(m_chunkdata.size() == nchunks());
+            for (size_t k = 0, n = nchunks(); k < n; ++k) {
+                size_t chunkcapacity = 0;
+                for (size_t p = chunk_begin(k); p < chunk_end(k); ++p) {
+                    ASSERT(m_cumcapacity[p] == chunkcapacity);
+                    chunkcapacity += m_capacity[p];
+                    ASSERT(m_capacity[p] >= m_nsamples[p]);
+                }
+                ASSERT(chunkcapacity <= m_chunkcapacity[k]);
+                ASSERT(m_chunkcapacity[k] * m_samplesize
+                       == m_chunkdata[k].size());
+            }
+        } else if (m_allocated) {
             size_t totalcapacity = 0;
             for (int p = 0; p < npixels; ++p) {
                 ASSERT(m_cumcapacity[p] == totalcapacity);
@@ -325,6 +510,70 @@ DeepData::samplesize() const
 
 
 
+size_t
+DeepData::sample_stride(int c) const
+{
+    DASSERT(m_impl);
+    return (c >= 0 && c < m_nchannels) ? m_impl->sample_stride(c) : 0;
+}
+
+
+
+DeepData::Layout
+DeepData::layout() const
+{
+    return (m_impl && m_impl->m_planar) ? Planar : Interleaved;
+}
+
+
+
+void
+DeepData::set_layout(Layout layout)
+{
+    ASSERT(m_impl);
+    bool planar = (layout == Planar);
+    if (planar == m_impl->m_planar)
+        return;
+    if (!m_impl->m_allocated) {
+        // Nothing to move yet, alloc() will lay it out when needed.
+        m_impl->m_planar = planar;
+        return;
+    }
+    // Repack the samples currently in use into freshly allocated storage
+    // of the other layout. Capacities shrink to the used sample counts.
+    // The sample buffers are set aside while copying the rest of the Impl.
+    std::vector<char> data;
+    std::vector<std::vector<char>> chunkdata;
+    data.swap(m_impl->m_data);
+    chunkdata.swap(m_impl->m_chunkdata);
+    Impl* newimpl = new Impl(*m_impl);
+    m_impl->m_data.swap(data);
+    m_impl->m_chunkdata.swap(chunkdata);
+    newimpl->m_chunkcapacity.clear();
+    newimpl->m_capacity  = newimpl->m_nsamples;
+    newimpl->m_planar    = planar;
+    newimpl->m_allocated = false;
+    newimpl->alloc(m_npixels);
+    for (int p = 0; p < m_npixels; ++p) {
+        int n = int(m_impl->m_nsamples[p]);
+        if (!n)
+            continue;
+        for (int c = 0; c < m_nchannels; ++c) {
+            size_t sz        = m_impl->m_channelsizes[c];
+            size_t srcstride = m_impl->sample_stride(c);
+            size_t dststride = newimpl->sample_stride(c);
+            const char* src  = m_impl->data_ptr(p, c, 0);
+            char* dst        = newimpl->data_ptr(p, c, 0);
+            for (int s = 0; s < n; ++s, src += srcstride, dst += dststride)
+                memcpy(dst, src, sz);
+        }
+    }
+    delete m_impl;
+    m_impl = newimpl;
+}
+
+
+
 // Is name the same as suffix, or does it end in ".suffix"?
 inline bool
 is_or_endswithdot(string_view name, string_view suffix)
@@ -501,21 +750,8 @@ DeepData::set_capacity(int pixel, int samps)
         // Data already allocated. Expand capacity if necessary, don't
         // contract. (FIXME?)
         int n = (int)capacity(pixel);
-        if (samps > n) {
-            int toadd = samps - n;
-            if (m_impl->m_data.empty()) {
-                size_t newtotal = (m_impl->total_capacity() + toadd);
-                m_impl->m_data.resize(newtotal * samplesize());
-            } else {
-                size_t offset = m_impl->data_offset(pixel, 0, n);
-                m_impl->m_data.insert(m_impl->m_data.begin() + offset,
-                                      toadd * samplesize(), 0);
-            }
-            // Adjust the cumulative prefix sum of samples for subsequent pixels
-            for (int p = pixel + 1; p < m_npixels; ++p)
-                m_impl->m_cumcapacity[p] += toadd;
-            m_impl->m_capacity[pixel] = samps;
-        }
+        if (samps > n)
+            m_impl->grow_capacity(pixel, samps - n);
     } else {
         m_impl->m_capacity[pixel] = samps;
     }
@@ -587,13 +823,7 @@ DeepData::insert_samples(int pixel, int samplepos, int n)
     // in play, they are working on separate pixels.
     if (m_impl->m_allocated) {
         // Move the data
-        if (samplepos < oldsamps) {
-            size_t offset = m_impl->data_offset(pixel, 0, samplepos);
-            size_t end    = m_impl->data_offset(pixel, 0, oldsamps);
-            std::copy_backward(m_impl->m_data.begin() + offset,
-                               m_impl->m_data.begin() + end,
-                               m_impl->m_data.begin() + end + n * samplesize());
-        }
+        m_impl->move_samples(pixel, samplepos, oldsamps, n);
     }
     // Add to this pixel's sample count
     m_impl->m_nsamples[pixel] += n;
@@ -610,12 +840,8 @@ DeepData::erase_samples(int pixel, int samplepos, int n)
     n = std::min(n, int(m_impl->m_nsamples[pixel]));
     if (m_impl->m_allocated) {
         // Move the data
-        int oldsamps  = samples(pixel);
-        size_t offset = m_impl->data_offset(pixel, 0, samplepos);
-        size_t end    = m_impl->data_offset(pixel, 0, oldsamps);
-        std::copy(m_impl->m_data.begin() + offset + n * samplesize(),
-                  m_impl->m_data.begin() + end,
-                  m_impl->m_data.begin() + offset);
+        int oldsamps = samples(pixel);
+        m_impl->move_samples(pixel, samplepos + n, oldsamps, -n);
     }
     m_impl->m_nsamples[pixel] -= n;
 }
@@ -638,7 +864,7 @@ const void*
 DeepData::data_ptr(int pixel, int channel, int sample) const
 {
     if (pixel < 0 || pixel >= m_npixels || channel < 0 || channel >= m_nchannels
-        || !m_impl || !m_impl->m_data.size() || sample < 0
+        || !m_impl || !m_impl->m_allocated || sample < 0
         || sample >= int(m_impl->m_nsamples[pixel]))
         return NULL;
     return m_impl->data_ptr(pixel, channel, sample);
@@ -835,6 +1061,8 @@ DeepData::all_data() const
 {
     ASSERT(m_impl);
     m_impl->alloc(m_npixels);
+    if (m_impl->m_planar)
+        return cspan<char>();
     return m_impl->m_data;
 }
 
@@ -842,18 +1070,38 @@ DeepData::all_data() const
 
 void
 DeepData::get_pointers(std::vector<void*>& pointers) const
+{
+    get_pointers(pointers, 0, m_npixels);
+}
+
+
+
+void
+DeepData::get_pointers(std::vector<void*>& pointers, int pixelbegin,
+                       int pixelend) const
 {
     ASSERT(m_impl);
     m_impl->alloc(m_npixels);
-    pointers.resize(pixels() * channels());
-    for (int i = 0; i < m_npixels; ++i) {
-        if (m_impl->m_nsamples[i])
+    pixelbegin = clamp(pixelbegin, 0, m_npixels);
+    pixelend   = clamp(pixelend, pixelbegin, m_npixels);
+    pointers.resize(size_t(pixelend - pixelbegin) * m_nchannels);
+    char* data         = m_impl->m_data.data();
+    const size_t* offs = m_impl->m_channeloffsets.data();
+    void** out         = pointers.data();
+    for (int i = pixelbegin; i < pixelend; ++i, out += m_nchannels) {
+        if (m_impl->m_nsamples[i] && m_impl->m_planar) {
             for (int c = 0; c < m_nchannels; ++c)
-                pointers[i * m_nchannels + c] = (void*)m_impl->data_ptr(i, c,
-                                                                        0);
-        else
+                out[c] = m_impl->data_ptr(i, c, 0);
+        } else if (m_impl->m_nsamples[i]) {
+            char* pixeldata = data
+                              + size_t(m_impl->m_cumcapacity[i])
+                                    * m_impl->m_samplesize;
+            for (int c = 0; c < m_nchannels; ++c)
+                out[c] = pixeldata + offs[c];
+        } else {
             for (int c = 0; c < m_nchannels; ++c)
-                pointers[i * m_nchannels + c] = NULL;
+                out[c] = NULL;
+        }
     }
 }
 
@@ -910,10 +1158,25 @@ DeepData::copy_deep_pixel(int pixel, const DeepData& src, int srcpixel)
     if (sametypes)
         for (int c = 0; c < nchans; ++c)
             sametypes &= (channeltype(c) == src.channeltype(c));
-    if (sametypes)
+    if (sametypes && layout() == Interleaved
+        && src.layout() == Interleaved) {
         memcpy(data_ptr(pixel, 0, 0), src.data_ptr(srcpixel, 0, 0),
                samplesize() * nsamples);
-    else {
+    } else if (sametypes) {
+        for (int c = 0; c < nchans; ++c) {
+            size_t sz        = channelsize(c);
+            size_t dststride = sample_stride(c);
+            size_t srcstride = src.sample_stride(c);
+            char* dst        = (char*)data_ptr(pixel, c, 0);
+            const char* s    = (const char*)src.data_ptr(srcpixel, c, 0);
+            if (dststride == sz && srcstride == sz)
+                memcpy(dst, s, sz * nsamples);
+            else
+                for (int i = 0; i < nsamples;
+                     ++i, dst += dststride, s += srcstride)
+                    memcpy(dst, s, sz);
+        }
+    } else {
         for (int c = 0; c < nchans; ++c) {
             if (channeltype(c) == TypeDesc::UINT32
                 && src.channeltype(c) == TypeDesc::UINT32)
@@ -1007,35 +1270,28 @@ DeepData::split(int pixel, float depth)
 
 namespace {
 
-// Comparitor functor for depth sorting sample indices of a deep pixel.
+// Comparitor functor for depth sorting sample indices of a deep pixel,
+// given contiguous arrays of the samples' z and zback values.
 class SampleComparator {
 public:
-    SampleComparator(const DeepData& dd, int pixel, int zchan, int zbackchan)
-        : deepdata(dd)
-        , pixel(pixel)
-        , zchan(zchan)
-        , zbackchan(zbackchan)
+    SampleComparator(const float* z, const float* zback)
+        : z(z)
+        , zback(zback)
     {
     }
     bool operator()(int i, int j) const
     {
         // If either has a lower z, that's the lower
-        float iz = deepdata.deep_value(pixel, zchan, i);
-        float jz = deepdata.deep_value(pixel, zchan, j);
-        if (iz < jz)
+        if (z[i] < z[j])
             return true;
-        if (iz > jz)
+        if (z[i] > z[j])
             return false;
         // If both z's are equal, sort based on zback
-        float izb = deepdata.deep_value(pixel, zbackchan, i);
-        float jzb = deepdata.deep_value(pixel, zbackchan, j);
-        return izb < jzb;
+        return zback[i] < zback[j];
     }
 
 private:
-    const DeepData& deepdata;
-    int pixel;
-    int zchan, zbackchan;
+    const float *z, *zback;
 };
 
 }  // namespace
@@ -1048,24 +1304,75 @@ DeepData::sort(int pixel)
     int zchan = m_impl->m_z_channel;
     if (zchan < 0)
         return;  // No channel labeled Z -- we don't know what to do
-    int zbackchan = m_impl->m_z_channel;
+    int zbackchan = m_impl->m_zback_channel;
     if (zbackchan < 0)
         zbackchan = zchan;
     int nsamples = samples(pixel);
     if (nsamples < 2)
         return;  // 0 or 1 samples -- no sort necessary
 
+    // Compare contiguous depth arrays rather than decoding strided samples
+    // for every comparison. The Planar layout already stores float depths
+    // that way; otherwise gather them once.
+    const float* z = m_impl->float_samples(pixel, zchan);
+    if (!z) {
+        float* zbuf = OIIO_ALLOCA(float, nsamples);
+        for (int s = 0; s < nsamples; ++s)
+            zbuf[s] = deep_value(pixel, zchan, s);
+        z = zbuf;
+    }
+    const float* zback = z;
+    if (zbackchan != zchan) {
+        zback = m_impl->float_samples(pixel, zbackchan);
+        if (!zback) {
+            float* zbuf = OIIO_ALLOCA(float, nsamples);
+            for (int s = 0; s < nsamples; ++s)
+                zbuf[s] = deep_value(pixel, zbackchan, s);
+            zback = zbuf;
+        }
+    }
+    SampleComparator compare(z, zback);
+
+    // Pixels are frequently already in order (merge_deep_pixels sorts
+    // repeatedly), so check before moving anything.
+    int s = 1;
+    while (s < nsamples && !compare(s, s - 1))
+        ++s;
+    if (s == nsamples)
+        return;
+
     // Ick, std::sort and friends take a custom comparator, but not a custom
     // swapper, so there's no way to std::sort a data type whose size is not
     // known at compile time. So we just sort the indices!
     int* sample_indices = OIIO_ALLOCA(int, nsamples);
     std::iota(sample_indices, sample_indices + nsamples, 0);
-    std::stable_sort(sample_indices, sample_indices + nsamples,
-                     SampleComparator(*this, pixel, zchan, zbackchan));
+    if (nsamples <= 16) {
+        // The usual handful of samples: a stable insertion sort is cheaper
+        // than std::stable_sort's setup and temporary buffer.
+        for (int i = 1; i < nsamples; ++i) {
+            int v = sample_indices[i], j = i;
+            for (; j > 0 && compare(v, sample_indices[j - 1]); --j)
+                sample_indices[j] = sample_indices[j - 1];
+            sample_indices[j] = v;
+        }
+    } else {
+        std::stable_sort(sample_indices, sample_indices + nsamples, compare);
+    }
 
     // Now copy around using a temp buffer
     size_t samplebytes = samplesize();
     char* tmppixel     = OIIO_ALLOCA(char, samplebytes* nsamples);
+    if (layout() == Planar) {
+        // One channel at a time, each is contiguous.
+        for (int c = 0; c < m_nchannels; ++c) {
+            size_t sz  = channelsize(c);
+            char* data = (char*)data_ptr(pixel, c, 0);
+            memcpy(tmppixel, data, sz * nsamples);
+            for (int i = 0; i < nsamples; ++i)
+                memcpy(data + sz * i, tmppixel + sz * sample_indices[i], sz);
+        }
+        return;
+    }
     memcpy(tmppixel, data_ptr(pixel, 0, 0), samplebytes * nsamples);
     for (int i = 0; i < nsamples; ++i)
         memcpy(data_ptr(pixel, 0, i),
@@ -1216,9 +1523,12 @@ DeepData::opaque_z(int pixel) const
 
     // There are samples, Z, and alpha channels. Figure out where it gets
     // opaque.
+    const float* a = m_impl->float_samples(pixel, cA);
     for (int s = 0; s < nsamples; ++s) {
         float alpha;
-        if (cA >= 0)
+        if (a)
+            alpha = a[s];
+        else if (cA >= 0)
             alpha = deep_value(pixel, cA, s);
         else {
             alpha = (deep_value(pixel, cAR, s) + deep_value(pixel, cAG, s)
@@ -1242,9 +1552,10 @@ DeepData::occlusion_cull(int pixel)
     int alpha_channel = m_impl->m_alpha_channel;
     if (alpha_channel < 0)
         return;  // If there isn't a definitive alpha channel, never mind
-    int nsamples = samples(pixel);
+    int nsamples   = samples(pixel);
+    const float* a = m_impl->float_samples(pixel, alpha_channel);
     for (int s = 0; s < nsamples; ++s) {
-        if (deep_value(pixel, alpha_channel, s) >= 1.0f) {
+        if ((a ? a[s] : deep_value(pixel, alpha_channel, s)) >= 1.0f) {
             // We hit an opaque sample. Cull everything farther.
             set_samples(pixel, s + 1);
             break;
@@ -0,0 +1,326 @@
+/*
+  Copyright 2018 Larry Gritz and the other authors and contributors.
+  All Rights Reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+  * Redistributions of source code must retain the above copyright
+  notice, this list of conditions and the following disclaimer.
+  * Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+  * Neither the name of the software's owners nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  (This is the Modified BSD License)
+*/
+
+
+#include <OpenImageIO/deepdata.h>
+#include <OpenImageIO/imageio.h>
+#include <OpenImageIO/typedesc.h>
+#include <OpenImageIO/unittest.h>
+
+#include <iostream>
+
+using namespace OIIO;
+
+
+// Enough pixels to span several chunks of the Planar layout (256 pixels
+// each), with a partial chunk at the end.
+static const int npixels = 700;
+
+
+
+// Set all channels of one sample to values derived from key, so that
+// samples can be told apart after they have been moved around. The R
+// channel is half, so keep its values small integers.
+static void
+set_sample(DeepData& dd, int pixel, int sample, int key)
+{
+    dd.set_deep_value(pixel, 0, sample, float(key % 64));
+    dd.set_deep_value(pixel, 1, sample, 0.5f);
+    dd.set_deep_value(pixel, 2, sample, 1.0f + key);
+    dd.set_deep_value(pixel, 3, sample, 1.5f + key);
+    dd.set_deep_value(pixel, 4, sample, uint32_t(key));
+}
+
+
+
+// Channels of mixed sizes, so that the Planar channel arrays don't all
+// have the same stride, with pixel p holding p%5 samples.
+static void
+make_deep(DeepData& dd, DeepData::Layout layout)
+{
+    TypeDesc types[] = { TypeDesc::HALF, TypeDesc::FLOAT, TypeDesc::FLOAT,
+                         TypeDesc::FLOAT, TypeDesc::UINT32 };
+    std::string names[] = { "R", "A", "Z", "Zback", "id" };
+    dd.init(npixels, 5, types, names);
+    dd.set_layout(layout);
+    for (int p = 0; p < npixels; ++p)
+        dd.set_samples(p, p % 5);
+    for (int p = 0; p < npixels; ++p)
+        for (int s = 0; s < dd.samples(p); ++s)
+            set_sample(dd, p, s, p * 8 + s);
+}
+
+
+
+// Do a and b hold the same samples with the same values, whatever their
+// layouts?
+static bool
+same_deep(const DeepData& a, const DeepData& b)
+{
+    if (a.pixels() != b.pixels() || a.channels() != b.channels())
+        return false;
+    for (int p = 0; p < a.pixels(); ++p) {
+        if (a.samples(p) != b.samples(p))
+            return false;
+        for (int c = 0; c < a.channels(); ++c)
+            for (int s = 0; s < a.samples(p); ++s)
+                if (a.deep_value(p, c, s) != b.deep_value(p, c, s)
+                    || a.deep_value_uint(p, c, s) != b.deep_value_uint(p, c, s))
+                    return false;
+    }
+    return true;
+}
+
+
+
+void
+test_layout_repack()
+{
+    std::cout << "test_layout_repack\n";
+    DeepData inter;
+    make_deep(inter, DeepData::Interleaved);
+    OIIO_CHECK_EQUAL(inter.layout(), DeepData::Interleaved);
+    OIIO_CHECK_EQUAL(inter.sample_stride(2), inter.samplesize());
+
+    // Planar from the start, before anything is allocated
+    DeepData planar;
+    make_deep(planar, DeepData::Planar);
+    OIIO_CHECK_EQUAL(planar.layout(), DeepData::Planar);
+    OIIO_CHECK_ASSERT(same_deep(inter, planar));
+    for (int c = 0; c < planar.channels(); ++c)
+        OIIO_CHECK_EQUAL(planar.sample_stride(c), planar.channelsize(c));
+    OIIO_CHECK_EQUAL(planar.all_data().size(), 0);
+    // Successive samples of a channel are adjacent
+    OIIO_CHECK_EQUAL((const char*)planar.data_ptr(3, 2, 1),
+                     (const char*)planar.data_ptr(3, 2, 0) + sizeof(float));
+
+    // Repack allocated data Interleaved -> Planar -> Interleaved
+    DeepData d(inter);
+    d.set_layout(DeepData::Planar);
+    OIIO_CHECK_EQUAL(d.layout(), DeepData::Planar);
+    OIIO_CHECK_ASSERT(same_deep(inter, d));
+    d.set_layout(DeepData::Interleaved);
+    OIIO_CHECK_EQUAL(d.layout(), DeepData::Interleaved);
+    OIIO_CHECK_ASSERT(same_deep(inter, d));
+    OIIO_CHECK_ASSERT(d.all_data() == inter.all_data());
+
+    // Planar -> Interleaved gives the same contiguous block
+    planar.set_layout(DeepData::Interleaved);
+    OIIO_CHECK_ASSERT(planar.all_data() == inter.all_data());
+
+    // Copies keep the layout
+    DeepData pcopy(d);
+    pcopy.set_layout(DeepData::Planar);
+    DeepData pcopy2 = pcopy;
+    OIIO_CHECK_EQUAL(pcopy2.layout(), DeepData::Planar);
+    OIIO_CHECK_ASSERT(same_deep(inter, pcopy2));
+}
+
+
+
+void
+test_insert_erase()
+{
+    std::cout << "test_insert_erase\n";
+    // Apply the same edits to both layouts and make sure they agree. The
+    // first insertions into a chunk outgrow its buffer and reallocate it,
+    // later ones fit in the slack and shift the following pixels in place.
+    DeepData inter, planar;
+    make_deep(inter, DeepData::Interleaved);
+    make_deep(planar, DeepData::Planar);
+    auto edit = [](DeepData& dd) {
+        // Last pixel of a chunk, first pixel of the next, and the middle
+        for (int p : { 255, 256, 300, 511, 699 }) {
+            int n = dd.samples(p);
+            dd.insert_samples(p, n / 2, 3);
+            for (int s = n / 2; s < n / 2 + 3; ++s)
+                set_sample(dd, p, s, 10000 + p * 8 + s);
+        }
+        dd.erase_samples(256, 1, 2);
+        dd.erase_samples(4, 0, 4);
+        // Grow one pixel well beyond its chunk's slack
+        dd.set_capacity(10, 60);
+        OIIO_CHECK_EQUAL(dd.capacity(10), 60);
+        int n = dd.samples(10);
+        dd.set_samples(10, 50);
+        for (int s = n; s < 50; ++s)
+            set_sample(dd, 10, s, 20000 + s);
+        // Samples appended at the end of a pixel
+        dd.insert_samples(257, dd.samples(257), 2);
+        set_sample(dd, 257, dd.samples(257) - 2, 30000);
+        set_sample(dd, 257, dd.samples(257) - 1, 30001);
+    };
+    edit(inter);
+    edit(planar);
+    OIIO_CHECK_EQUAL(planar.samples(10), 50);
+    OIIO_CHECK_EQUAL(planar.samples(4), 0);
+    OIIO_CHECK_EQUAL(planar.deep_value_uint(10, 4, 49), 20049);
+    OIIO_CHECK_EQUAL(planar.deep_value_uint(255, 4, 1), 10000 + 255 * 8 + 1);
+    OIIO_CHECK_ASSERT(same_deep(inter, planar));
+
+    // Untouched pixels keep their values
+    DeepData orig;
+    make_deep(orig, DeepData::Interleaved);
+    for (int p : { 9, 11, 254, 258, 512, 698 })
+        for (int s = 0; s < orig.samples(p); ++s)
+            OIIO_CHECK_EQUAL(planar.deep_value_uint(p, 4, s),
+                             orig.deep_value_uint(p, 4, s));
+
+    // And the edited data still repacks correctly
+    DeepData repacked(planar);
+    repacked.set_layout(DeepData::Interleaved);
+    OIIO_CHECK_ASSERT(same_deep(inter, repacked));
+}
+
+
+
+void
+test_sort()
+{
+    std::cout << "test_sort\n";
+    for (auto layout : { DeepData::Interleaved, DeepData::Planar }) {
+        TypeDesc types[]    = { TypeDesc::FLOAT, TypeDesc::FLOAT,
+                             TypeDesc::UINT32 };
+        std::string names[] = { "Z", "Zback", "id" };
+        DeepData dd;
+        dd.init(3, 3, types, names);
+        dd.set_layout(layout);
+        // Equal Z values are ordered by Zback
+        float z[]     = { 2.0f, 1.0f, 1.0f, 2.0f };
+        float zback[] = { 3.0f, 4.0f, 2.0f, 2.5f };
+        dd.set_samples(0, 4);
+        for (int s = 0; s < 4; ++s) {
+            dd.set_deep_value(0, 0, s, z[s]);
+            dd.set_deep_value(0, 1, s, zback[s]);
+            dd.set_deep_value(0, 2, s, uint32_t(s));
+        }
+        dd.sort(0);
+        uint32_t expected[] = { 2, 1, 3, 0 };
+        for (int s = 0; s < 4; ++s)
+            OIIO_CHECK_EQUAL(dd.deep_value_uint(0, 2, s), expected[s]);
+        OIIO_CHECK_EQUAL(dd.deep_value(0, 0, 0), 1.0f);
+        OIIO_CHECK_EQUAL(dd.deep_value(0, 1, 0), 2.0f);
+
+        // Enough samples to take the general sort path, in reverse order
+        dd.set_samples(1, 40);
+        for (int s = 0; s < 40; ++s) {
+            dd.set_deep_value(1, 0, s, float(40 - s));
+            dd.set_deep_value(1, 1, s, float(41 - s));
+            dd.set_deep_value(1, 2, s, uint32_t(s));
+        }
+        dd.sort(1);
+        for (int s = 0; s < 40; ++s) {
+            OIIO_CHECK_EQUAL(dd.deep_value(1, 0, s), float(s + 1));
+            OIIO_CHECK_EQUAL(dd.deep_value_uint(1, 2, s), uint32_t(39 - s));
+        }
+
+        // Already sorted pixels are left alone
+        dd.set_samples(2, 2);
+        dd.set_deep_value(2, 0, 0, 1.0f);
+        dd.set_deep_value(2, 0, 1, 1.0f);
+        dd.set_deep_value(2, 1, 0, 2.0f);
+        dd.set_deep_value(2, 1, 1, 2.0f);
+        dd.set_deep_value(2, 2, 0, uint32_t(7));
+        dd.set_deep_value(2, 2, 1, uint32_t(8));
+        dd.sort(2);
+        OIIO_CHECK_EQUAL(dd.deep_value_uint(2, 2, 0), 7);
+        OIIO_CHECK_EQUAL(dd.deep_value_uint(2, 2, 1), 8);
+    }
+
+    // Without a Zback channel, samples with equal Z keep their order
+    TypeDesc types[]    = { TypeDesc::FLOAT, TypeDesc::UINT32 };
+    std::string names[] = { "Z", "id" };
+    DeepData dd;
+    dd.init(1, 2, types, names);
+    dd.set_samples(0, 3);
+    float z[] = { 1.0f, 0.0f, 1.0f };
+    for (int s = 0; s < 3; ++s) {
+        dd.set_deep_value(0, 0, s, z[s]);
+        dd.set_deep_value(0, 1, s, uint32_t(s));
+    }
+    dd.sort(0);
+    uint32_t expected[] = { 1, 0, 2 };
+    for (int s = 0; s < 3; ++s)
+        OIIO_CHECK_EQUAL(dd.deep_value_uint(0, 1, s), expected[s]);
+}
+
+
+
+void
+test_copy_deep_pixel()
+{
+    std::cout << "test_copy_deep_pixel\n";
+    DeepData inter, planar;
+    make_deep(inter, DeepData::Interleaved);
+    make_deep(planar, DeepData::Planar);
+    for (int p = 0; p < npixels; ++p)
+        planar.set_samples(p, 0);
+
+    // Interleaved -> Planar, and back into a fresh Interleaved
+    for (int p = 0; p < npixels; ++p)
+        OIIO_CHECK_ASSERT(planar.copy_deep_pixel(p, inter, p));
+    OIIO_CHECK_ASSERT(same_deep(inter, planar));
+    DeepData back;
+    make_deep(back, DeepData::Interleaved);
+    for (int p = 0; p < npixels; ++p)
+        back.set_samples(p, 0);
+    for (int p = 0; p < npixels; ++p)
+        OIIO_CHECK_ASSERT(back.copy_deep_pixel(p, planar, p));
+    OIIO_CHECK_ASSERT(same_deep(inter, back));
+
+    // Planar -> Planar, into a pixel with a different sample count
+    OIIO_CHECK_ASSERT(planar.copy_deep_pixel(1, planar, 259));
+    OIIO_CHECK_EQUAL(planar.samples(1), 4);
+    OIIO_CHECK_EQUAL(planar.deep_value_uint(1, 4, 3), 259 * 8 + 3);
+
+    // Differing channel types convert value by value
+    TypeDesc types[]    = { TypeDesc::FLOAT, TypeDesc::FLOAT, TypeDesc::FLOAT,
+                         TypeDesc::FLOAT, TypeDesc::UINT32 };
+    std::string names[] = { "R", "A", "Z", "Zback", "id" };
+    DeepData wide;
+    wide.init(npixels, 5, types, names);
+    wide.set_layout(DeepData::Planar);
+    for (int p = 0; p < npixels; ++p)
+        OIIO_CHECK_ASSERT(wide.copy_deep_pixel(p, inter, p));
+    OIIO_CHECK_ASSERT(same_deep(inter, wide));
+}
+
+
+
+int
+main(int argc, char* argv[])
+{
+    test_layout_repack();
+    test_insert_erase();
+    test_sort();
+    test_copy_deep_pixel();
+
+    return unit_test_failures;
+}
@@ -284,6 +284,8 @@ private:
     size_t m_channel_bytes;
     ImageCache* m_imagecache;        ///< ImageCache to use
     TypeDesc m_cachedpixeltype;      ///< Data type stored in the cache
+    int m_cachedchbegin;             ///< Channel range of the cache tiles
+    int m_cachedchend;               ///<   we use (if IMAGECACHE)
     DeepData m_deepdata;             ///< Deep data
     size_t m_allocated_size;         ///< How much memory we've allocated
     std::vector<char> m_blackpixel;  ///< Pixel-sized zero bytes
@@ -326,6 +328,8 @@ ImageBufImpl::ImageBufImpl(string_view filename, int subimage, int miplevel,
     , m_plane_bytes(0)
     , m_channel_bytes(0)
     , m_imagecache(imagecache)
+    , m_cachedchbegin(0)
+    , m_cachedchend(-1)
     , m_allocated_size(0)
     , m_write_format(TypeDesc::UNKNOWN)
     , m_write_tile_width(0)
@@ -388,6 +392,8 @@ ImageBufImpl::ImageBufImpl(const ImageBufImpl& src)
     , m_channel_bytes(src.m_channel_bytes)
     , m_imagecache(src.m_imagecache)
     , m_cachedpixeltype(src.m_cachedpixeltype)
+    , m_cachedchbegin(src.m_cachedchbegin)
+    , m_cachedchend(src.m_cachedchend)
     , m_deepdata(src.m_deepdata)
     , m_allocated_size(0)
     ,  // gets fixed up in the body vvv
@@ -626,6 +632,8 @@ ImageBufImpl::clear()
     m_plane_bytes    = 0;
     m_channel_bytes  = 0;
     m_imagecache     = NULL;
+    m_cachedchbegin  = 0;
+    m_cachedchend    = -1;
     m_deepdata.free();
     m_blackpixel.clear();
     m_write_format      = TypeDesc::UNKNOWN;
@@ -851,7 +859,11 @@ ImageBufImpl::read(int subimage, int miplevel, int chbegin, int chend,
         return true;
 
     if (m_pixels_valid && !force && subimage == m_current_subimage
-        && miplevel == m_current_miplevel)
+        && miplevel == m_current_miplevel
+        && (!cachedpixels()
+            || (chbegin == m_cachedchbegin
+                && (chend < 0 ? m_nativespec.nchannels : chend)
+                       == m_cachedchend)))
         return true;
 
     if (!init_spec(m_name.string(), subimage, miplevel)) {
@@ -865,6 +877,12 @@ ImageBufImpl::read(int subimage, int miplevel, int chbegin, int chend,
     if (chend < 0 || chend > nativespec().nchannels)
         chend = nativespec().nchannels;
     bool use_channel_subset = (chbegin != 0 || chend != nativespec().nchannels);
+    if (m_spec.nchannels != m_nativespec.nchannels && !m_spec.deep) {
+        // An earlier read of this subimage narrowed the channels, and
+        // init_spec() didn't need to refresh the spec. Start over from the
+        // full set of channels.
+        m_imagecache->get_imagespec(m_name, m_spec, subimage, miplevel);
+    }
 
     if (m_spec.deep) {
         auto input = ImageInput::open(m_name.string(), m_configspec.get());
@@ -892,8 +910,28 @@ ImageBufImpl::read(int subimage, int miplevel, int chbegin, int chend,
     m_imagecache->get_image_info(m_name, subimage, miplevel,
                                  ustring("cachedpixeltype"), TypeInt, &peltype);
     m_cachedpixeltype = TypeDesc((TypeDesc::BASETYPE)peltype);
-    if (!m_localpixels && !force && !use_channel_subset
+
+    if (use_channel_subset) {
+        // Some adjustments because we are reading a channel subset
+        m_spec.nchannels = chend - chbegin;
+        m_spec.channelnames.resize(m_spec.nchannels);
+        for (int c = 0; c < m_spec.nchannels; ++c)
+            m_spec.channelnames[c] = m_nativespec.channelnames[c + chbegin];
+        if (m_nativespec.channelformats.size()) {
+            m_spec.channelformats.resize(m_spec.nchannels);
+            for (int c = 0; c < m_spec.nchannels; ++c)
+                m_spec.channelformats[c]
+                    = m_nativespec.channelformats[c + chbegin];
+        }
+    }
+
+    if (!m_localpixels && !force
         && (convert == m_cachedpixeltype || convert == TypeDesc::UNKNOWN)) {
+        // Pixels will be served from cache tiles holding just the channel
+        // range we want, so for a channel subset of a file with many
+        // channels, none of the others are decoded or stored.
+        m_cachedchbegin  = chbegin;
+        m_cachedchend    = chend;
         m_spec.format    = m_cachedpixeltype;
         m_pixel_bytes    = m_spec.pixel_bytes();
         m_scanline_bytes = m_spec.scanline_bytes();
@@ -911,20 +949,8 @@ ImageBufImpl::read(int subimage, int miplevel, int chbegin, int chend,
         return true;
     }
 
-    if (use_channel_subset) {
-        // Some adjustments because we are reading a channel subset
-        force            = true;
-        m_spec.nchannels = chend - chbegin;
-        m_spec.channelnames.resize(m_spec.nchannels);
-        for (int c = 0; c < m_spec.nchannels; ++c)
-            m_spec.channelnames[c] = m_nativespec.channelnames[c + chbegin];
-        if (m_nativespec.channelformats.size()) {
-            m_spec.channelformats.resize(m_spec.nchannels);
-            for (int c = 0; c < m_spec.nchannels; ++c)
-                m_spec.channelformats[c]
-                    = m_nativespec.channelformats[c + chbegin];
-        }
-    }
+    if (use_channel_subset)
+        force = true;
 
     if (convert != TypeDesc::UNKNOWN)
         m_spec.format = convert;
@@ -1148,8 +1174,9 @@ ImageBuf::write(string_view _filename, TypeDesc dtype, string_view _fileformat,
     // backed IB, be sure we have completely read the file into memory so we
     // don't clobber the file before we've fully read it.
     if (filename == name() && storage() == IMAGECACHE) {
-        m_impl->read(subimage(), miplevel(), 0, -1, true /*force*/,
-                     spec().format, nullptr, nullptr);
+        m_impl->read(subimage(), miplevel(), m_impl->m_cachedchbegin,
+                     m_impl->m_cachedchend, true /*force*/, spec().format,
+                     nullptr, nullptr);
         if (storage() != LOCALBUFFER) {
             error("ImageBuf overwriting %s but could not force read", name());
             return false;
@@ -1215,7 +1242,8 @@ bool
 ImageBuf::make_writeable(bool keep_cache_type)
 {
     if (storage() == IMAGECACHE) {
-        return read(subimage(), miplevel(), 0, -1, true /*force*/,
+        return read(subimage(), miplevel(), impl()->m_cachedchbegin,
+                    impl()->m_cachedchend, true /*force*/,
                     keep_cache_type ? impl()->m_cachedpixeltype : TypeDesc());
     }
     return true;
@@ -1284,6 +1312,14 @@ ImageBuf::nativespec() const
 
 
 
+const ImageSpec*
+ImageBuf::configspec() const
+{
+    return impl()->m_configspec.get();
+}
+
+
+
 string_view
 ImageBuf::name(void) const
 {
@@ -2458,7 +2494,8 @@ ImageBufImpl::retile(int x, int y, int z, ImageCache::Tile*& tile,
         tilezbegin = m_spec.z + ztile * td;
         tilexend   = tilexbegin + tw;
         tile       = m_imagecache->get_tile(m_name, m_current_subimage,
-                                      m_current_miplevel, x, y, z);
+                                      m_current_miplevel, x, y, z,
+                                      m_cachedchbegin, m_cachedchend);
         if (!tile) {
             // Even though tile is NULL, ensure valid black pixel data
             std::string e = m_imagecache->geterror();
@@ -28,8 +28,10 @@
   (This is the Modified BSD License)
 */
 
+#include <algorithm>
 #include <cmath>
 #include <memory>
+#include <vector>
 
 #include <OpenEXR/half.h>
 
@@ -39,6 +41,7 @@
 #include <OpenImageIO/imagebufalgo.h>
 #include <OpenImageIO/imagebufalgo_util.h>
 #include <OpenImageIO/platform.h>
+#include <OpenImageIO/simd.h>
 #include <OpenImageIO/thread.h>
 
 #include "imageio_pvt.h"
@@ -91,6 +94,36 @@
 OIIO_NAMESPACE_BEGIN
 
 
+void
+pvt::read_float_row(const ImageBuf& img, ROI row, float* buf)
+{
+    ROI r         = img.roi();
+    int nchannels = row.nchannels();
+    int x0        = std::max(row.xbegin, r.xbegin);
+    int x1        = std::min(row.xend, r.xend);
+    int chend     = std::min(row.chend, img.nchannels());
+    int y = row.ybegin, z = row.zbegin;
+    bool inside = (y >= r.ybegin && y < r.yend && z >= r.zbegin && z < r.zend
+                   && x0 < x1 && chend > row.chbegin);
+    if (!inside || x0 != row.xbegin || x1 != row.xend
+        || chend != row.chend)
+        std::fill(buf, buf + size_t(row.width()) * nchannels, 0.0f);
+    if (!inside)
+        return;
+    float* out = buf + size_t(x0 - row.xbegin) * nchannels;
+    if (img.localpixels())
+        convert_image(chend - row.chbegin, x1 - x0, 1, 1,
+                      img.pixeladdr(x0, y, z, row.chbegin), img.spec().format,
+                      img.pixel_stride(), AutoStride, AutoStride, out,
+                      TypeFloat, nchannels * sizeof(float), AutoStride,
+                      AutoStride);
+    else
+        img.get_pixels(ROI(x0, x1, y, y + 1, z, z + 1, row.chbegin, chend),
+                       TypeFloat, out, nchannels * sizeof(float));
+}
+
+
+
 bool
 ImageBufAlgo::IBAprep(ROI& roi, ImageBuf* dst, const ImageBuf* A,
                       const ImageBuf* B, const ImageBuf* C,
@@ -401,7 +434,8 @@ convolve_(ImageBuf& dst, const ImageBuf& src, const ImageBuf& kernel,
           bool normalize, ROI roi, int nthreads)
 {
     using namespace ImageBufAlgo;
-    parallel_image(roi, nthreads, [&](ROI roi) {
+    auto opt = neighborhood_parallel_options(src, nthreads);
+    parallel_image(roi, opt, [&](ROI roi) {
         ASSERT(kernel.spec().format == TypeDesc::FLOAT && kernel.localpixels()
                && "kernel should be float and in local memory");
         ROI kroi   = kernel.roi();
@@ -439,6 +473,255 @@ convolve_(ImageBuf& dst, const ImageBuf& src, const ImageBuf& kernel,
 
 
 
+// Separable convolution: filter the source rows needed by each block
+// horizontally with xk into a float strip, then the strip vertically
+// with yk. The result is the same as convolve_ with the rank-1 kernel
+// yk * xk (including the clamping at the image edges), but costs kw+kh
+// rather than kw*kh multiplies per pixel.
+template<typename DSTTYPE, typename SRCTYPE>
+static bool
+convolve_separable_(ImageBuf& dst, const ImageBuf& src,
+                    const std::vector<float>& xk, const std::vector<float>& yk,
+                    ROI kroi, float scale, ROI roi, int nthreads)
+{
+    using namespace ImageBufAlgo;
+    parallel_image(roi, nthreads, [&](ROI roi) {
+        const int kw = kroi.width(), kh = kroi.height();
+        const int nc        = roi.nchannels();
+        const int width     = roi.width();
+        const int rowfloats = width * nc;
+        const int srcymin = src.ybegin(), srcymax = src.yend() - 1;
+        int stripbegin = clamp(roi.ybegin + kroi.ybegin, srcymin, srcymax);
+        int stripend   = clamp(roi.yend - 1 + kroi.yend - 1, srcymin, srcymax)
+                       + 1;
+        // Source span of one row of the horizontal pass
+        ROI rowroi(roi.xbegin + kroi.xbegin, roi.xend + kroi.xend - 1, 0, 1,
+                   roi.zbegin, roi.zend, roi.chbegin, roi.chend);
+        std::vector<float> rowbuf(rowroi.width() * nc);
+        std::vector<float> strip(size_t(stripend - stripbegin) * rowfloats);
+        std::vector<float> accum(rowfloats);
+
+        // Horizontal pass
+        for (int r = stripbegin; r < stripend; ++r) {
+            rowroi.ybegin = r;
+            rowroi.yend   = r + 1;
+            float* rp     = &rowbuf[0];
+            for (ImageBuf::ConstIterator<SRCTYPE> s(src, rowroi,
+                                                    ImageBuf::WrapClamp);
+                 !s.done(); ++s)
+                for (int c = roi.chbegin; c < roi.chend; ++c)
+                    *rp++ = s[c];
+            float* h = &strip[size_t(r - stripbegin) * rowfloats];
+            for (int x = 0; x < width; ++x, h += nc) {
+                const float* p = &rowbuf[x * nc];
+                for (int c = 0; c < nc; ++c)
+                    h[c] = 0.0f;
+                for (int i = 0; i < kw; ++i, p += nc) {
+                    float w = xk[i];
+                    if (w != 0.0f)
+                        for (int c = 0; c < nc; ++c)
+                            h[c] += w * p[c];
+                }
+            }
+        }
+
+        // Vertical pass
+        ImageBuf::Iterator<DSTTYPE> d(dst, roi);
+        for (int y = roi.ybegin; y < roi.yend; ++y) {
+            float* acc = &accum[0];
+            std::fill(accum.begin(), accum.end(), 0.0f);
+            for (int j = 0; j < kh; ++j) {
+                float w = yk[j];
+                if (w == 0.0f)
+                    continue;
+                int r = clamp(y + kroi.ybegin + j, srcymin, srcymax);
+                const float* h = &strip[size_t(r - stripbegin) * rowfloats];
+                simd::vfloat4 w4(w);
+                int k = 0;
+                for (; k + 4 <= rowfloats; k += 4) {
+                    simd::vfloat4 a(acc + k);
+                    (a + w4 * simd::vfloat4(h + k)).store(acc + k);
+                }
+                for (; k < rowfloats; ++k)
+                    acc[k] += w * h[k];
+            }
+            for (int x = 0; x < width; ++x, ++d, acc += nc)
+                for (int c = 0; c < nc; ++c)
+                    d[c + roi.chbegin] = scale * acc[c];
+        }
+    });
+    return true;
+}
+
+
+
+// Is the (2D, float, local) kernel the outer product of a column and a
+// row vector? If so, return them in yk and xk.
+static bool
+kernel_is_separable(const ImageBuf& kernel, std::vector<float>& xk,
+                    std::vector<float>& yk)
+{
+    ROI kroi = kernel.roi();
+    int kw = kroi.width(), kh = kroi.height(), kchans = kernel.nchannels();
+    if (kroi.depth() != 1)
+        return false;
+    std::vector<float> K(kw * kh);
+    const float* k = (const float*)kernel.localpixels();
+    for (int i = 0; i < kw * kh; ++i, k += kchans)
+        K[i] = k[0];
+    // Factor around the largest element, then verify every element
+    int big = 0;
+    for (int i = 1; i < kw * kh; ++i)
+        if (fabsf(K[i]) > fabsf(K[big]))
+            big = i;
+    float kmax = fabsf(K[big]);
+    if (kmax == 0.0f)
+        return false;
+    int bx = big % kw, by = big / kw;
+    xk.resize(kw);
+    yk.resize(kh);
+    for (int x = 0; x < kw; ++x)
+        xk[x] = K[by * kw + x] / K[big];
+    for (int y = 0; y < kh; ++y)
+        yk[y] = K[y * kw + bx];
+    const float eps = 1.0e-6f * kmax;
+    for (int y = 0; y < kh; ++y)
+        for (int x = 0; x < kw; ++x)
+            if (fabsf(yk[y] * xk[x] - K[y * kw + x]) > eps)
+                return false;
+    return true;
+}
+
+
+
+// Copy the srcroi region of src (with edge pixels clamped where srcroi
+// extends past the data window) to the origin of float image dst.
+template<typename SRCTYPE>
+static bool
+copy_clamped_(ImageBuf& dst, const ImageBuf& src, ROI srcroi, int nthreads)
+{
+    ROI roi(0, srcroi.width(), 0, srcroi.height(), 0, 1, 0,
+            srcroi.nchannels());
+    ImageBufAlgo::parallel_image(roi, nthreads, [&](ROI roi) {
+        ROI sroi(roi.xbegin + srcroi.xbegin, roi.xend + srcroi.xbegin,
+                 roi.ybegin + srcroi.ybegin, roi.yend + srcroi.ybegin,
+                 srcroi.zbegin, srcroi.zbegin + 1, srcroi.chbegin,
+                 srcroi.chend);
+        ImageBuf::ConstIterator<SRCTYPE> s(src, sroi, ImageBuf::WrapClamp);
+        for (ImageBuf::Iterator<float> d(dst, roi); !d.done(); ++d, ++s)
+            for (int c = 0; c < roi.chend; ++c)
+                d[c] = s[c + srcroi.chbegin];
+    });
+    return true;
+}
+
+
+
+// Smallest n' >= n whose only prime factors are 2, 3, and 5, which
+// kissfft handles efficiently.
+static int
+fft_good_size(int n)
+{
+    for (;; ++n) {
+        int m = n;
+        for (int f : { 2, 3, 5 })
+            while (m % f == 0)
+                m /= f;
+        if (m == 1)
+            return n;
+    }
+}
+
+
+
+// Convolution via the FFT, for large non-separable kernels. The source
+// region under the kernel (edge-clamped) is zero padded to an FFT-friendly
+// size big enough that the circular correlation doesn't wrap into the
+// part of the result we keep.
+static bool
+convolve_fft(ImageBuf& dst, const ImageBuf& src, const ImageBuf& kernel,
+             float scale, ROI roi, int nthreads)
+{
+    using namespace ImageBufAlgo;
+    ROI kroi = kernel.roi();
+    ROI proi(roi.xbegin + kroi.xbegin, roi.xend + kroi.xend - 1,
+             roi.ybegin + kroi.ybegin, roi.yend + kroi.yend - 1, roi.zbegin,
+             roi.zbegin + 1, roi.chbegin, roi.chend);
+    int fw = fft_good_size(proi.width()), fh = fft_good_size(proi.height());
+    ROI froi(0, fw, 0, fh, 0, 1, 0, 1);
+
+    // Padded kernel, with its first pixel at the origin
+    ImageBuf Kpad(ImageSpec(fw, fh, 1, TypeDesc::FLOAT));
+    zero(Kpad);
+    {
+        ImageBuf::Iterator<float> d(Kpad, ROI(0, kroi.width(), 0,
+                                              kroi.height(), 0, 1, 0, 1));
+        for (ImageBuf::ConstIterator<float> k(kernel); !k.done(); ++k, ++d)
+            d[0] = k[0];
+    }
+
+    // The correlation theorem: result = IFFT(FFT(P) * conj(FFT(K))). Our
+    // FFTs are unitary, so the product needs an extra factor of
+    // sqrt(fw*fh), which we fold into the kernel along with the scale.
+    ImageBuf KF = fft(Kpad, froi, nthreads);
+    if (KF.has_error()) {
+        dst.error("%s", KF.geterror());
+        return false;
+    }
+    float kscale = scale * sqrtf(float(fw) * float(fh));
+    for (ImageBuf::Iterator<float> k(KF); !k.done(); ++k) {
+        k[0] = kscale * k[0];
+        k[1] = -kscale * k[1];
+    }
+
+    // One channel at a time: padded source, transform, multiply, and
+    // transform back.
+    ImageBuf P(ImageSpec(fw, fh, 1, TypeDesc::FLOAT));
+    zero(P);
+    for (int c = 0; c < roi.nchannels(); ++c) {
+        bool ok;
+        proi.chbegin = roi.chbegin + c;
+        proi.chend   = proi.chbegin + 1;
+        OIIO_DISPATCH_TYPES(ok, "convolve", copy_clamped_, src.spec().format,
+                            P, src, proi, nthreads);
+        if (!ok) {
+            dst.error("%s", P.geterror());
+            return false;
+        }
+        ImageBuf PF = fft(P, froi, nthreads);
+        if (PF.has_error()) {
+            dst.error("%s", PF.geterror());
+            return false;
+        }
+        parallel_image(get_roi(PF.spec()), nthreads, [&](ROI r) {
+            ImageBuf::ConstIterator<float> k(KF, r);
+            for (ImageBuf::Iterator<float> p(PF, r); !p.done(); ++p, ++k) {
+                float a = p[0], b = p[1], kr = k[0], ki = k[1];
+                p[0]    = a * kr - b * ki;
+                p[1]    = a * ki + b * kr;
+            }
+        });
+        ImageBuf R = ifft(PF, ROI::All(), nthreads);
+        if (R.has_error()) {
+            dst.error("%s", R.geterror());
+            return false;
+        }
+        if (!paste(dst, roi.xbegin, roi.ybegin, roi.zbegin, roi.chbegin + c, R,
+                   ROI(0, roi.width(), 0, roi.height(), 0, 1, 0, 1),
+                   nthreads))
+            return false;
+    }
+    return true;
+}
+
+
+
+// Kernels with more pixels than this that aren't separable are convolved
+// with the FFT, whose cost doesn't depend on the kernel size.
+static const int fft_convolve_min_kernel_pixels = 16 * 16;
+
+
+
 bool
 ImageBufAlgo::convolve(ImageBuf& dst, const ImageBuf& src,
                        const ImageBuf& kernel, bool normalize, ROI roi,
@@ -455,6 +738,31 @@ ImageBufAlgo::convolve(ImageBuf& dst, const ImageBuf& src,
         Ktmp.copy(kernel, TypeDesc::FLOAT);
         K = &Ktmp;
     }
+
+    // 2D images get fast paths: two 1D passes for separable kernels (such
+    // as all those from make_kernel except the laplacian), or the FFT for
+    // other large kernels.
+    ROI kroi = K->roi();
+    if (src.spec().depth == 1 && dst.spec().depth == 1 && kroi.depth() == 1) {
+        float scale = 1.0f;
+        if (normalize) {
+            scale = 0.0f;
+            for (ImageBuf::ConstIterator<float> k(*K); !k.done(); ++k)
+                scale += k[0];
+            scale = 1.0f / scale;
+        }
+        std::vector<float> xk, yk;
+        if (kernel_is_separable(*K, xk, yk)) {
+            OIIO_DISPATCH_COMMON_TYPES2(ok, "convolve", convolve_separable_,
+                                        dst.spec().format, src.spec().format,
+                                        dst, src, xk, yk, kroi, scale, roi,
+                                        nthreads);
+            return ok;
+        }
+        if (int(kroi.npixels()) > fft_convolve_min_kernel_pixels)
+            return convolve_fft(dst, src, *K, scale, roi, nthreads);
+    }
+
     OIIO_DISPATCH_COMMON_TYPES2(ok, "convolve", convolve_, dst.spec().format,
                                 src.spec().format, dst, src, *K, normalize, roi,
                                 nthreads);
@@ -679,48 +987,390 @@ ImageBufAlgo::laplacian(const ImageBuf& src, ROI roi, int nthreads)
 
 
 
-template<class Rtype, class Atype>
-static bool
-median_filter_impl(ImageBuf& R, const ImageBuf& A, int width, int height,
-                   ROI roi, int nthreads)
+// Running summaries of a median filter window, driven by median_sweep()
+// below. Each one is told which rows [wy0,wy1) of A are inside the window
+// for the current output row, then sees whole columns enter and leave the
+// window as it slides right, and median(c,k) returns element k of the
+// sorted values of channel c in the window. Columns are always inside the
+// data window of A.
+namespace {
+
+// 8 bit sources: Perreault & Hebert, "Median Filtering in Constant Time"
+// (2007). Every column of A keeps a histogram of its pixels in the window
+// rows, which is moved down by one pixel per output row, and the window
+// histogram is the sum of its column histograms, so sliding right is one
+// histogram add and one subtract no matter how big the window is. Each
+// histogram has 16 coarse bins (the high nibble) ahead of the 256 fine
+// ones so that the median search visits at most 32 bins.
+struct MedianHist8 {
+    enum { hsize = 16 + 256 };
+    typedef unsigned char value_t;
+
+    MedianHist8(const ImageBuf& A, int nc, int z, int cxbegin, int cxend)
+        : A(A)
+        , nc(nc)
+        , z(z)
+        , cxbegin(cxbegin)
+        , cxend(cxend)
+        , colhist(size_t(cxend - cxbegin) * nc * hsize, 0)
+        , kernel(nc * hsize, 0)
+    {
+    }
+
+    void begin_row(int wy0, int wy1)
+    {
+        if (m_wy0 >= m_wy1 || wy0 >= m_wy1 || wy1 <= m_wy0) {
+            // First row, or no overlap with the previous one: start over
+            std::fill(colhist.begin(), colhist.end(), 0);
+            update_columns(wy0, wy1, 1);
+        } else {
+            // The window only moves down, drop the rows above and pick up
+            // the ones below.
+            update_columns(m_wy0, wy0, -1);
+            update_columns(m_wy1, wy1, 1);
+        }
+        m_wy0 = wy0;
+        m_wy1 = wy1;
+        std::fill(kernel.begin(), kernel.end(), 0);
+    }
+
+    void end_row() {}
+
+    void add_column(int x)
+    {
+        const uint16_t* h = column(x);
+        for (int i = 0, e = nc * hsize; i < e; ++i)
+            kernel[i] += h[i];
+    }
+
+    void remove_column(int x)
+    {
+        const uint16_t* h = column(x);
+        for (int i = 0, e = nc * hsize; i < e; ++i)
+            kernel[i] -= h[i];
+    }
+
+    float median(int c, uint32_t k) const
+    {
+        const uint32_t* h = &kernel[c * hsize];
+        uint32_t sum      = 0;
+        int v             = 0;
+        while (sum + h[v] <= k)
+            sum += h[v++];
+        const uint32_t* fine = h + 16;
+        v *= 16;
+        while (sum + fine[v] <= k)
+            sum += fine[v++];
+        return convert_type<value_t, float>(value_t(v));
+    }
+
+private:
+    uint16_t* column(int x)
+    {
+        return &colhist[size_t(x - cxbegin) * nc * hsize];
+    }
+
+    // Add (delta = 1) or subtract (delta = -1) rows [ybegin,yend) of A to
+    // the column histograms.
+    void update_columns(int ybegin, int yend, int delta)
+    {
+        if (ybegin >= yend || cxbegin >= cxend)
+            return;
+        ROI rows(cxbegin, cxend, ybegin, yend, z, z + 1);
+        for (ImageBuf::ConstIterator<value_t> a(A, rows); !a.done(); ++a) {
+            const value_t* v = (const value_t*)a.rawptr();
+            uint16_t* h      = column(a.x());
+            for (int c = 0; c < nc; ++c, h += hsize) {
+                h[v[c] >> 4] += delta;
+                h[16 + v[c]] += delta;
+            }
+        }
+    }
+
+    const ImageBuf& A;
+    int nc, z, cxbegin, cxend;
+    int m_wy0 = 0, m_wy1 = 0;
+    std::vector<uint16_t> colhist;
+    std::vector<uint32_t> kernel;
+};
+
+
+
+// Copy the pixels of A in roi (all inside its data window) to buf as
+// channel-interleaved values of type T, converted the same way the
+// ImageBuf iterators would.
+template<class Atype, class T>
+static void
+median_read_band(const ImageBuf& A, ROI roi, std::vector<T>& buf)
 {
-    ImageBufAlgo::parallel_image(roi, nthreads, [&](ROI roi) {
-        if (width < 1)
-            width = 1;
-        if (height < 1)
-            height = width;
-        int w_2        = std::max(1, width / 2);
-        int h_2        = std::max(1, height / 2);
-        int windowsize = width * height;
-        int nchannels  = R.nchannels();
-        float** chans  = OIIO_ALLOCA(float*, nchannels);
-        for (int c = 0; c < nchannels; ++c)
-            chans[c] = OIIO_ALLOCA(float, windowsize);
+    const int nc = A.nchannels();
+    buf.resize(roi.npixels() * nc);
+    T* p = buf.data();
+    for (ImageBuf::ConstIterator<Atype> a(A, roi); !a.done(); ++a) {
+        const Atype* v = (const Atype*)a.rawptr();
+        for (int c = 0; c < nc; ++c)
+            *p++ = convert_type<Atype, T>(v[c]);
+    }
+}
 
-        ImageBuf::ConstIterator<Atype> a(A, roi);
-        for (ImageBuf::Iterator<Rtype> r(R, roi); !r.done(); ++r) {
-            a.rerange(r.x() - w_2, r.x() - w_2 + width, r.y() - h_2,
-                      r.y() - h_2 + height, r.z(), r.z() + 1,
-                      ImageBuf::WrapClamp);
-            int n = 0;
-            for (; !a.done(); ++a) {
-                if (a.exists()) {
-                    for (int c = 0; c < nchannels; ++c)
-                        chans[c][n] = a[c];
-                    ++n;
-                }
+
+
+// 16 bit sources: column histograms would need 64k bins each, so instead
+// only the window keeps a two-level histogram (256 coarse bins for the
+// high byte, 256 fine bins under each of them), updated pixel by pixel as
+// columns come and go (Huang's algorithm). Sliding right costs O(height)
+// and the median search visits at most 512 bins.
+struct MedianHist16 {
+    enum { hsize = 256 + 65536 };
+    typedef unsigned short value_t;
+
+    MedianHist16(const ImageBuf& A, int nc, int z, int cxbegin, int cxend)
+        : A(A)
+        , nc(nc)
+        , z(z)
+        , cxbegin(cxbegin)
+        , cxend(cxend)
+        , kernel(nc * hsize, 0)
+    {
+    }
+
+    void begin_row(int wy0, int wy1)
+    {
+        nrows = wy1 - wy0;
+        if (nrows > 0 && cxbegin < cxend)
+            median_read_band<value_t>(A, ROI(cxbegin, cxend, wy0, wy1, z,
+                                             z + 1),
+                                      band);
+    }
+
+    // Empty the histogram column by column rather than clearing all of it
+    void end_row()
+    {
+        for (int x : live)
+            update_column(x, -1);
+        live.clear();
+    }
+
+    void add_column(int x)
+    {
+        update_column(x, 1);
+        live.push_back(x);
+    }
+
+    void remove_column(int x)
+    {
+        update_column(x, -1);
+        live.erase(std::find(live.begin(), live.end(), x));
+    }
+
+    float median(int c, uint32_t k) const
+    {
+        const uint32_t* h = &kernel[c * hsize];
+        uint32_t sum      = 0;
+        int v             = 0;
+        while (sum + h[v] <= k)
+            sum += h[v++];
+        const uint32_t* fine = h + 256;
+        v *= 256;
+        while (sum + fine[v] <= k)
+            sum += fine[v++];
+        return convert_type<value_t, float>(value_t(v));
+    }
+
+private:
+    void update_column(int x, int delta)
+    {
+        const size_t stride = size_t(cxend - cxbegin) * nc;
+        const value_t* v    = &band[size_t(x - cxbegin) * nc];
+        for (int y = 0; y < nrows; ++y, v += stride) {
+            uint32_t* h = &kernel[0];
+            for (int c = 0; c < nc; ++c, h += hsize) {
+                h[v[c] >> 8] += delta;
+                h[256 + v[c]] += delta;
+            }
+        }
+    }
+
+    const ImageBuf& A;
+    int nc, z, cxbegin, cxend;
+    int nrows = 0;
+    std::vector<value_t> band;
+    std::vector<uint32_t> kernel;
+    std::vector<int> live;  // columns currently in the histogram
+};
+
+
+
+// Everything else (float, half): keep a sorted copy of the window per
+// channel, removing the leaving column and inserting the entering one by
+// binary search, which beats re-sorting the whole window for every pixel.
+template<class Atype> struct MedianSorted {
+    typedef float value_t;
+
+    MedianSorted(const ImageBuf& A, int nc, int z, int cxbegin, int cxend)
+        : A(A)
+        , nc(nc)
+        , z(z)
+        , cxbegin(cxbegin)
+        , cxend(cxend)
+        , sorted(nc)
+    {
+    }
+
+    void begin_row(int wy0, int wy1)
+    {
+        nrows = wy1 - wy0;
+        if (nrows > 0 && cxbegin < cxend)
+            median_read_band<Atype>(A, ROI(cxbegin, cxend, wy0, wy1, z,
+                                           z + 1),
+                                    band);
+        for (auto& s : sorted)
+            s.clear();
+        building = true;
+    }
+
+    void end_row() {}
+
+    void add_column(int x)
+    {
+        const float* v = column(x);
+        for (int y = 0; y < nrows; ++y, v += stride()) {
+            for (int c = 0; c < nc; ++c) {
+                std::vector<float>& s(sorted[c]);
+                if (building)  // sorted all at once by median()
+                    s.push_back(v[c]);
+                else
+                    s.insert(std::upper_bound(s.begin(), s.end(), v[c]),
+                             v[c]);
             }
-            if (n) {
-                int mid = n / 2;
-                for (int c = 0; c < nchannels; ++c) {
-                    std::sort(chans[c] + 0, chans[c] + n);
-                    r[c] = chans[c][mid];
+        }
+    }
+
+    void remove_column(int x)
+    {
+        finish_building();
+        const float* v = column(x);
+        for (int y = 0; y < nrows; ++y, v += stride()) {
+            for (int c = 0; c < nc; ++c) {
+                std::vector<float>& s(sorted[c]);
+                auto i = std::lower_bound(s.begin(), s.end(), v[c]);
+                if (i == s.end() || !(*i == v[c]))  // NaN: look for it
+                    i = std::find_if(s.begin(), s.end(), [](float f) {
+                        return std::isnan(f);
+                    });
+                if (i != s.end())
+                    s.erase(i);
+            }
+        }
+    }
+
+    float median(int c, uint32_t k)
+    {
+        finish_building();
+        return sorted[c][k];
+    }
+
+private:
+    size_t stride() const { return size_t(cxend - cxbegin) * nc; }
+    const float* column(int x) const
+    {
+        return &band[size_t(x - cxbegin) * nc];
+    }
+
+    void finish_building()
+    {
+        if (building) {
+            for (auto& s : sorted)
+                std::sort(s.begin(), s.end());
+            building = false;
+        }
+    }
+
+    const ImageBuf& A;
+    int nc, z, cxbegin, cxend;
+    int nrows = 0;
+    bool building = false;
+    std::vector<float> band;
+    std::vector<std::vector<float>> sorted;
+};
+
+}  // namespace
+
+
+
+// Median filter one parallel block, row by row, sliding a Window summary
+// from left to right. The window of pixel (x,y) is
+// [x-w_2, x-w_2+width) x [y-h_2, y-h_2+height) cropped to the data window
+// of A, and its median is element n/2 of the n sorted values (0 if the
+// window misses A entirely). Each z slice is filtered on its own.
+template<class Rtype, class Window>
+static void
+median_sweep(ImageBuf& R, const ImageBuf& A, int width, int height, int w_2,
+             int h_2, ROI roi)
+{
+    const int nc      = R.nchannels();
+    const int cxbegin = std::max(roi.xbegin - w_2, A.xbegin());
+    const int cxend   = std::max(cxbegin,
+                               std::min(roi.xend - w_2 + width, A.xend()));
+    for (int z = roi.zbegin; z < roi.zend; ++z) {
+        Window win(A, nc, z, cxbegin, cxend);
+        for (int y = roi.ybegin; y < roi.yend; ++y) {
+            int wy0   = std::max(y - h_2, A.ybegin());
+            int wy1   = std::max(wy0, std::min(y - h_2 + height, A.yend()));
+            int nrows = wy1 - wy0;
+            win.begin_row(wy0, wy1);
+            int wx0 = std::max(roi.xbegin - w_2, cxbegin);
+            int wx1 = std::min(roi.xbegin - w_2 + width, cxend);
+            for (int x = wx0; x < wx1; ++x)
+                win.add_column(x);
+            int ncols = std::max(0, wx1 - wx0);
+            ImageBuf::Iterator<Rtype> r(R, ROI(roi.xbegin, roi.xend, y,
+                                               y + 1, z, z + 1));
+            for (int x = roi.xbegin; x < roi.xend; ++x, ++r) {
+                if (x > roi.xbegin) {
+                    int xout = x - 1 - w_2, xin = x - 1 - w_2 + width;
+                    if (xout >= cxbegin && xout < cxend) {
+                        win.remove_column(xout);
+                        --ncols;
+                    }
+                    if (xin >= cxbegin && xin < cxend) {
+                        win.add_column(xin);
+                        ++ncols;
+                    }
                 }
-            } else {
-                for (int c = 0; c < nchannels; ++c)
-                    r[c] = 0.0f;
+                uint32_t n = uint32_t(nrows) * uint32_t(ncols);
+                for (int c = 0; c < nc; ++c)
+                    r[c] = n ? win.median(c, n / 2) : 0.0f;
             }
+            win.end_row();
         }
+    }
+}
+
+
+
+template<class Rtype, class Atype>
+static bool
+median_filter_impl(ImageBuf& R, const ImageBuf& A, int width, int height,
+                   ROI roi, int nthreads)
+{
+    if (width < 1)
+        width = 1;
+    if (height < 1)
+        height = width;
+    int w_2 = std::max(1, width / 2);
+    int h_2 = std::max(1, height / 2);
+    ImageBufAlgo::parallel_image(roi, nthreads, [&](ROI roi) {
+        // The 8 bit column histograms count up to `height` pixels each
+        if (std::is_same<Atype, unsigned char>::value && height <= 65535)
+            median_sweep<Rtype, MedianHist8>(R, A, width, height, w_2, h_2,
+                                             roi);
+        else if (std::is_same<Atype, unsigned short>::value)
+            median_sweep<Rtype, MedianHist16>(R, A, width, height, w_2, h_2,
+                                              roi);
+        else
+            median_sweep<Rtype, MedianSorted<Atype>>(R, A, width, height,
+                                                     w_2, h_2, roi);
     });
     return true;
 }
@@ -760,48 +1410,156 @@ ImageBufAlgo::median_filter(const ImageBuf& src, int width, int height, ROI roi,
 
 enum MorphOp { MorphDilate, MorphErode };
 
+// dst[i] = max (dilate) or min (erode) of a[i] and b[i], for len floats.
+template<MorphOp op>
+inline void
+morph_combine(float* dst, const float* a, const float* b, int len)
+{
+    int i = 0;
+    for (; i + 4 <= len; i += 4) {
+        simd::vfloat4 va(a + i), vb(b + i);
+        (op == MorphDilate ? max(va, vb) : min(va, vb)).store(dst + i);
+    }
+    for (; i < len; ++i)
+        dst[i] = op == MorphDilate ? std::max(a[i], b[i])
+                                   : std::min(a[i], b[i]);
+}
+
+
+
+// van Herk / Gil-Werman running max or min over a window of k elements.
+// The input is n elements of len contiguous floats each, stride floats
+// apart; out[i] = op(in[i], ..., in[i+k-1]) for the n-k+1 complete
+// windows. The input is cut into blocks of k elements and g accumulates
+// forward within each block while h accumulates backward, so that every
+// window is the combination of one h and one g: three combines per
+// element no matter how large k is. g and h are n*stride floats of
+// scratch space.
+template<MorphOp op>
+static void
+morph_vhgw(float* out, const float* in, int n, int k, int len, size_t stride,
+           float* g, float* h)
+{
+    for (int i = 0; i < n; ++i) {
+        if (i % k == 0)
+            std::copy(in + i * stride, in + i * stride + len, g + i * stride);
+        else
+            morph_combine<op>(g + i * stride, g + (i - 1) * stride,
+                              in + i * stride, len);
+    }
+    for (int i = n - 1; i >= 0; --i) {
+        if (i == n - 1 || (i + 1) % k == 0)
+            std::copy(in + i * stride, in + i * stride + len, h + i * stride);
+        else
+            morph_combine<op>(h + i * stride, h + (i + 1) * stride,
+                              in + i * stride, len);
+    }
+    for (int i = 0; i + k <= n; ++i)
+        morph_combine<op>(out + i * stride, h + i * stride,
+                          g + (i + k - 1) * stride, len);
+}
+
+
+
+// Rectangular dilate/erode of one tile of output pixels, as a horizontal
+// van Herk/Gil-Werman pass over the source rows the tile needs followed
+// by a vertical pass that combines whole rows at a time. Pixels outside
+// the data window of A (and NaNs) are replaced by the identity of the
+// operation, so each result is over just the window pixels that exist,
+// and is the identity itself if there are none.
+template<class Rtype, class Atype, MorphOp op>
+static void
+morph_tile(ImageBuf& R, const ImageBuf& A, int width, int height, int w_2,
+           int h_2, ROI roi, std::vector<float>& scratch)
+{
+    const float ident = op == MorphDilate ? -std::numeric_limits<float>::max()
+                                          : std::numeric_limits<float>::max();
+    const int nc      = R.nchannels();
+    const int z       = roi.zbegin;
+    const int tw      = roi.width();
+    const int th      = roi.height();
+    const int nx      = tw + width - 1;   // source pixels per row
+    const int ny      = th + height - 1;  // source rows
+    const size_t rowlen = size_t(tw) * nc;
+    const size_t srclen = size_t(nx) * nc;
+    scratch.resize(srclen * 3 + rowlen * size_t(ny) * 3);
+    float* src  = &scratch[0];
+    float* g    = src + srclen;
+    float* h    = g + srclen;
+    float* rows = h + srclen;  // horizontal results, then vertical results
+    float* vg   = rows + rowlen * ny;
+    float* vh   = vg + rowlen * ny;
+
+    // Horizontal pass into rows[], for each source row
+    const int x0 = roi.xbegin - w_2, y0 = roi.ybegin - h_2;
+    for (int j = 0; j < ny; ++j) {
+        float* row = rows + j * rowlen;
+        int y      = y0 + j;
+        if (y < A.ybegin() || y >= A.yend()) {
+            std::fill(row, row + rowlen, ident);
+            continue;
+        }
+        std::fill(src, src + srclen, ident);
+        int ax0 = std::max(x0, A.xbegin());
+        int ax1 = std::min(x0 + nx, A.xend());
+        if (ax0 < ax1) {
+            float* s = src + (ax0 - x0) * nc;
+            ROI span(ax0, ax1, y, y + 1, z, z + 1);
+            for (ImageBuf::ConstIterator<Atype> a(A, span); !a.done(); ++a) {
+                for (int c = 0; c < nc; ++c, ++s) {
+                    float v = a[c];
+                    *s      = std::isnan(v) ? ident : v;
+                }
+            }
+        }
+        morph_vhgw<op>(row, src, nx, width, nc, nc, g, h);
+    }
+
+    // Vertical pass, combining all the channels of a row at once
+    morph_vhgw<op>(rows, rows, ny, height, rowlen, rowlen, vg, vh);
+
+    const float* v = rows;
+    for (ImageBuf::Iterator<Rtype> r(R, roi); !r.done(); ++r)
+        for (int c = 0; c < nc; ++c)
+            r[c] = *v++;
+}
+
+
+
 template<class Rtype, class Atype>
 static bool
 morph_impl(ImageBuf& R, const ImageBuf& A, int width, int height, MorphOp op,
            ROI roi, int nthreads)
 {
+    if (width < 1)
+        width = 1;
+    if (height < 1)
+        height = width;
+    int w_2 = std::max(1, width / 2);
+    int h_2 = std::max(1, height / 2);
+    // Work on tiles of output pixels so that the scratch rows stay small
+    // for wide images and tall windows, while the extra border each tile
+    // needs stays cheap compared to the tile itself.
+    const int tilew = std::max(512, 4 * width);
+    const int tileh = std::max(64, 4 * height);
     ImageBufAlgo::parallel_image(roi, nthreads, [&](ROI roi) {
-        if (width < 1)
-            width = 1;
-        if (height < 1)
-            height = width;
-        int w_2       = std::max(1, width / 2);
-        int h_2       = std::max(1, height / 2);
-        int nchannels = R.nchannels();
-        float* vals   = OIIO_ALLOCA(float, nchannels);
-        ImageBuf::ConstIterator<Atype> a(A, roi);
-        for (ImageBuf::Iterator<Rtype> r(R, roi); !r.done(); ++r) {
-            a.rerange(r.x() - w_2, r.x() - w_2 + width, r.y() - h_2,
-                      r.y() - h_2 + height, r.z(), r.z() + 1,
-                      ImageBuf::WrapClamp);
-            if (op == MorphDilate) {
-                for (int c = 0; c < nchannels; ++c)
-                    vals[c] = -std::numeric_limits<float>::max();
-                for (; !a.done(); ++a) {
-                    if (a.exists()) {
-                        for (int c = 0; c < nchannels; ++c)
-                            vals[c] = std::max(vals[c], a[c]);
-                    }
-                }
-            } else if (op == MorphErode) {
-                for (int c = 0; c < nchannels; ++c)
-                    vals[c] = std::numeric_limits<float>::max();
-                for (; !a.done(); ++a) {
-                    if (a.exists()) {
-                        for (int c = 0; c < nchannels; ++c)
-                            vals[c] = std::min(vals[c], a[c]);
-                    }
+        std::vector<float> scratch;
+        for (int z = roi.zbegin; z < roi.zend; ++z) {
+            for (int y = roi.ybegin; y < roi.yend; y += tileh) {
+                for (int x = roi.xbegin; x < roi.xend; x += tilew) {
+                    ROI tile(x, std::min(x + tilew, roi.xend), y,
+                             std::min(y + tileh, roi.yend), z, z + 1, 0,
+                             R.nchannels());
+                    if (op == MorphDilate)
+                        morph_tile<Rtype, Atype, MorphDilate>(R, A, width,
+                                                              height, w_2, h_2,
+                                                              tile, scratch);
+                    else
+                        morph_tile<Rtype, Atype, MorphErode>(R, A, width,
+                                                             height, w_2, h_2,
+                                                             tile, scratch);
                 }
-            } else {
-                ASSERT(0 && "Unknown morphological operator");
             }
-            for (int c = 0; c < nchannels; ++c)
-                r[c] = vals[c];
         }
     });
     return true;
@@ -37,12 +37,14 @@
 #include <cmath>
 #include <iostream>
 #include <limits>
+#include <vector>
 
 #include <OpenImageIO/dassert.h>
 #include <OpenImageIO/deepdata.h>
 #include <OpenImageIO/imagebuf.h>
 #include <OpenImageIO/imagebufalgo.h>
 #include <OpenImageIO/imagebufalgo_util.h>
+#include <OpenImageIO/simd.h>
 
 #include "imageio_pvt.h"
 
@@ -50,12 +52,41 @@
 OIIO_NAMESPACE_BEGIN
 
 
+// Row kernels for the contiguous_rows() fast paths: r[i] = a[i] op b[i]
+static void
+add_row(float* r, const float* a, const float* b, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+        (simd::vfloat4(a + i) + simd::vfloat4(b + i)).store(r + i);
+    for (; i < n; ++i)
+        r[i] = a[i] + b[i];
+}
+
+
+static void
+sub_row(float* r, const float* a, const float* b, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+        (simd::vfloat4(a + i) - simd::vfloat4(b + i)).store(r + i);
+    for (; i < n; ++i)
+        r[i] = a[i] - b[i];
+}
+
+
+
 template<class Rtype, class Atype, class Btype>
 static bool
 add_impl(ImageBuf& R, const ImageBuf& A, const ImageBuf& B, ROI roi,
          int nthreads)
 {
     ImageBufAlgo::parallel_image(roi, nthreads, [&](ROI roi) {
+        if (ImageBufAlgo::contiguous_rows(roi, R, A, B)) {
+            ImageBufAlgo::contiguous_rows_apply<Rtype, Atype, Btype>(
+                R, A, B, roi, add_row);
+            return;
+        }
         ImageBuf::Iterator<Rtype> r(R, roi);
         ImageBuf::ConstIterator<Atype> a(A, roi);
         ImageBuf::ConstIterator<Btype> b(B, roi);
@@ -73,6 +104,15 @@ static bool
 add_impl(ImageBuf& R, const ImageBuf& A, cspan<float> b, ROI roi, int nthreads)
 {
     ImageBufAlgo::parallel_image(roi, nthreads, [&](ROI roi) {
+        if (ImageBufAlgo::contiguous_rows(roi, R, A)) {
+            std::vector<float> brow
+                = ImageBufAlgo::constant_row(b, R.nchannels(), roi.width());
+            ImageBufAlgo::contiguous_rows_apply<Rtype, Atype>(
+                R, A, roi, [&](float* r, const float* a, size_t n) {
+                    add_row(r, a, brow.data(), n);
+                });
+            return;
+        }
         ImageBuf::Iterator<Rtype> r(R, roi);
         ImageBuf::ConstIterator<Atype> a(A, roi);
         for (; !r.done(); ++r, ++a)
@@ -185,6 +225,11 @@ sub_impl(ImageBuf& R, const ImageBuf& A, const ImageBuf& B, ROI roi,
          int nthreads)
 {
     ImageBufAlgo::parallel_image(roi, nthreads, [&](ROI roi) {
+        if (ImageBufAlgo::contiguous_rows(roi, R, A, B)) {
+            ImageBufAlgo::contiguous_rows_apply<Rtype, Atype, Btype>(
+                R, A, B, roi, sub_row);
+            return;
+        }
         ImageBuf::Iterator<Rtype> r(R, roi);
         ImageBuf::ConstIterator<Atype> a(A, roi);
         ImageBuf::ConstIterator<Btype> b(B, roi);
@@ -37,6 +37,7 @@
 
 #include <cmath>
 #include <iostream>
+#include <vector>
 
 #include <OpenImageIO/deepdata.h>
 #include <OpenImageIO/imagebuf.h>
@@ -57,6 +58,36 @@ channels_(ImageBuf& dst, const ImageBuf& src, cspan<int> channelorder,
 {
     ImageBufAlgo::parallel_image(roi, nthreads, [&](ROI roi) {
         int nchannels = src.nchannels();
+        ROI srcroi    = roi;
+        srcroi.chend  = nchannels;
+        if (ImageBufAlgo::contiguous_rows(roi, dst)
+            && ImageBufAlgo::contiguous_rows(srcroi, src)
+            && src.spec().format == dst.spec().format) {
+            // Shuffle the raw values directly, no conversions needed
+            int nc = roi.chend;
+            std::vector<DSTTYPE> fill(nc);
+            for (int c = 0; c < nc; ++c)
+                if (channelvalues.size() > c)
+                    fill[c] = convert_type<float, DSTTYPE>(channelvalues[c]);
+            for (int z = roi.zbegin; z < roi.zend; ++z) {
+                for (int y = roi.ybegin; y < roi.yend; ++y) {
+                    DSTTYPE* d = (DSTTYPE*)dst.pixeladdr(roi.xbegin, y, z);
+                    const DSTTYPE* s
+                        = (const DSTTYPE*)src.pixeladdr(roi.xbegin, y, z);
+                    for (int x = roi.xbegin; x < roi.xend;
+                         ++x, d += nc, s += nchannels) {
+                        for (int c = 0; c < nc; ++c) {
+                            int cc = channelorder[c];
+                            if (cc >= 0 && cc < nchannels)
+                                d[c] = s[cc];
+                            else if (channelvalues.size() > c)
+                                d[c] = fill[c];
+                        }
+                    }
+                }
+            }
+            return;
+        }
         ImageBuf::ConstIterator<DSTTYPE> s(src, roi);
         ImageBuf::Iterator<DSTTYPE> d(dst, roi);
         for (; !s.done(); ++s, ++d) {
@@ -34,15 +34,18 @@
 
 #include <OpenEXR/half.h>
 
+#include <algorithm>
 #include <cmath>
 #include <iostream>
 #include <limits>
+#include <vector>
 
 #include <OpenImageIO/SHA1.h>
 #include <OpenImageIO/dassert.h>
 #include <OpenImageIO/imagebuf.h>
 #include <OpenImageIO/imagebufalgo.h>
 #include <OpenImageIO/imagebufalgo_util.h>
+#include <OpenImageIO/simd.h>
 #include <OpenImageIO/thread.h>
 
 #include "imageio_pvt.h"
@@ -144,6 +147,77 @@ finalize(ImageBufAlgo::PixelStats& p)
 
 
 
+// Add npixels contiguous pixels of nch floats at v to the stats p, channel
+// c of each pixel counting toward channel chbegin+c of p (channels past the
+// end of p are skipped). A group of 4 pixels is nch vfloat4's, and lane k
+// of the j-th one always holds channel (4*j+k) % nch, so every lane
+// accumulates a single channel. Sums are Kahan-compensated in float along
+// the row, then added to the double totals of p, which keeps them precise
+// for huge images.
+static void
+stats_row(ImageBufAlgo::PixelStats& p, int chbegin, const float* v,
+          int npixels, int nch)
+{
+    using namespace simd;
+    const vfloat4 inf(std::numeric_limits<float>::infinity());
+    const vfloat4 ninf(-std::numeric_limits<float>::infinity());
+    const vfloat4 zero(0.0f), one(1.0f);
+    vfloat4* acc = OIIO_ALLOCA(vfloat4, 8 * nch);
+    vfloat4 *mn = acc, *mx = acc + nch, *sum = acc + 2 * nch;
+    vfloat4 *sumc = acc + 3 * nch, *sum2 = acc + 4 * nch;
+    vfloat4 *sum2c = acc + 5 * nch, *nfinite = acc + 6 * nch;
+    vfloat4* nnan = acc + 7 * nch;
+    for (int j = 0; j < nch; ++j) {
+        mn[j] = inf;
+        mx[j] = ninf;
+        sum[j] = sumc[j] = sum2[j] = sum2c[j] = nfinite[j] = nnan[j] = zero;
+    }
+    const int ngroups = npixels / 4;
+    for (int g = 0; g < ngroups; ++g, v += 4 * nch) {
+        for (int j = 0; j < nch; ++j) {
+            vfloat4 x(v + 4 * j);
+            vbool4 finite = abs(x) < inf;
+            vfloat4 fx    = select(finite, x, zero);
+            vfloat4 y     = fx - sumc[j];
+            vfloat4 t     = sum[j] + y;
+            sumc[j]       = (t - sum[j]) - y;
+            sum[j]        = t;
+            y             = fx * fx - sum2c[j];
+            t             = sum2[j] + y;
+            sum2c[j]      = (t - sum2[j]) - y;
+            sum2[j]       = t;
+            mn[j]         = min(mn[j], select(finite, x, inf));
+            mx[j]         = max(mx[j], select(finite, x, ninf));
+            nfinite[j] += select(finite, one, zero);
+            nnan[j] += select(x != x, one, zero);
+        }
+    }
+    for (int j = 0; j < nch; ++j) {
+        for (int k = 0; k < 4; ++k) {
+            int c = chbegin + (4 * j + k) % nch;
+            if (c >= int(p.min.size()))
+                continue;
+            imagesize_t nf = imagesize_t(nfinite[j][k]);
+            imagesize_t nn = imagesize_t(nnan[j][k]);
+            p.min[c]       = std::min(p.min[c], mn[j][k]);
+            p.max[c]       = std::max(p.max[c], mx[j][k]);
+            p.sum[c] += double(sum[j][k]) - double(sumc[j][k]);
+            p.sum2[c] += double(sum2[j][k]) - double(sum2c[j][k]);
+            p.finitecount[c] += nf;
+            p.nancount[c] += nn;
+            p.infcount[c] += ngroups - nf - nn;
+        }
+    }
+    // The last few pixels
+    for (int i = 0, n = (npixels - 4 * ngroups) * nch; i < n; ++i) {
+        int c = chbegin + i % nch;
+        if (c < int(p.min.size()))
+            val(p, c, v[i]);
+    }
+}
+
+
+
 template<class T>
 static bool
 computePixelStats_(const ImageBuf& src, ImageBufAlgo::PixelStats& stats,
@@ -183,21 +257,24 @@ computePixelStats_(const ImageBuf& src, ImageBufAlgo::PixelStats& stats,
         });
 
     } else {  // Non-deep case
+        // Convert each scanline to float and reduce it with SIMD
         parallel_for_chunked(roi.ybegin, roi.yend, 64,
                              [&](int id, int64_t ybegin, int64_t yend) {
-            ROI subroi(roi.xbegin, roi.xend, ybegin, yend, roi.zbegin,
-                       roi.zend, roi.chbegin, roi.chend);
             ImageBufAlgo::PixelStats tmp(nchannels);
-            for (ImageBuf::ConstIterator<T> s(src, subroi); !s.done();
-                 ++s) {
-                for (int c = subroi.chbegin; c < subroi.chend; ++c) {
-                    float value = s[c];
-                    val(tmp, c, value);
+            std::vector<float> row(roi.width() * roi.nchannels());
+            for (int z = roi.zbegin; z < roi.zend; ++z) {
+                for (int y = ybegin; y < yend; ++y) {
+                    pvt::read_float_row(src, ROI(roi.xbegin, roi.xend, y,
+                                                 y + 1, z, z + 1,
+                                                 roi.chbegin, roi.chend),
+                                        row.data());
+                    stats_row(tmp, roi.chbegin, row.data(), roi.width(),
+                              roi.nchannels());
                 }
             }
             std::lock_guard<OIIO::spin_mutex> lock(mutex);
             stats.merge(tmp);
-        });
+        }, parallel_options(nthreads));
     }
 
     // Compute final results
@@ -245,10 +322,9 @@ ImageBufAlgo::computePixelStats(PixelStats& stats, const ImageBuf& src, ROI roi,
 
 
 
-template<class BUFT>
 inline void
-compare_value(ImageBuf::ConstIterator<BUFT, float>& a, int chan, float aval,
-              float bval, ImageBufAlgo::CompareResults& result, float& maxval,
+compare_value(int x, int y, int z, int chan, float aval, float bval,
+              ImageBufAlgo::CompareResults& result, float& maxval,
               double& batcherror, double& batch_sqrerror, bool& failed,
               bool& warned, float failthresh, float warnthresh)
 {
@@ -258,9 +334,9 @@ compare_value(ImageBuf::ConstIterator<BUFT, float>& a, int chan, float aval,
         if (isfinite(result.maxerror)) {
             // non-finite errors trump finite ones
             result.maxerror = std::numeric_limits<float>::infinity();
-            result.maxx     = a.x();
-            result.maxy     = a.y();
-            result.maxz     = a.z();
+            result.maxx     = x;
+            result.maxy     = y;
+            result.maxz     = z;
             result.maxc     = chan;
             return;
         }
@@ -274,9 +350,9 @@ compare_value(ImageBuf::ConstIterator<BUFT, float>& a, int chan, float aval,
     // return false).
     if (!(f <= result.maxerror)) {
         result.maxerror = f;
-        result.maxx     = a.x();
-        result.maxy     = a.y();
-        result.maxz     = a.z();
+        result.maxx     = x;
+        result.maxy     = y;
+        result.maxz     = z;
         result.maxc     = chan;
     }
     if (!warned && !(f <= warnthresh)) {
@@ -291,15 +367,15 @@ compare_value(ImageBuf::ConstIterator<BUFT, float>& a, int chan, float aval,
 
 
 
+// Deep images are compared sample by sample.
 template<class Atype, class Btype>
 static bool
-compare_(const ImageBuf& A, const ImageBuf& B, float failthresh,
-         float warnthresh, ImageBufAlgo::CompareResults& result, ROI roi,
-         int nthreads)
+compare_deep_(const ImageBuf& A, const ImageBuf& B, float failthresh,
+              float warnthresh, ImageBufAlgo::CompareResults& result, ROI roi,
+              int nthreads)
 {
     imagesize_t npels = roi.npixels();
     imagesize_t nvals = npels * roi.nchannels();
-    int Achannels = A.nchannels(), Bchannels = B.nchannels();
 
     // Compare the two images.
     //
@@ -312,33 +388,21 @@ compare_(const ImageBuf& A, const ImageBuf& B, float failthresh,
 
     ImageBuf::ConstIterator<Atype> a(A, roi, ImageBuf::WrapBlack);
     ImageBuf::ConstIterator<Btype> b(B, roi, ImageBuf::WrapBlack);
-    bool deep = A.deep();
     // Break up into batches to reduce cancelation errors as the error
     // sums become too much larger than the error for individual pixels.
     const int batchsize = 4096;  // As good a guess as any
     for (; !a.done();) {
         double batcherror     = 0;
         double batch_sqrerror = 0;
-        if (deep) {
-            for (int i = 0; i < batchsize && !a.done(); ++i, ++a, ++b) {
-                bool warned = false, failed = false;  // For this pixel
-                for (int c = roi.chbegin; c < roi.chend; ++c)
-                    for (int s = 0, e = a.deep_samples(); s < e; ++s) {
-                        compare_value(a, c, a.deep_value(c, s),
-                                      b.deep_value(c, s), result, maxval,
-                                      batcherror, batch_sqrerror, failed,
-                                      warned, failthresh, warnthresh);
-                    }
-            }
-        } else {  // non-deep
-            for (int i = 0; i < batchsize && !a.done(); ++i, ++a, ++b) {
-                bool warned = false, failed = false;  // For this pixel
-                for (int c = roi.chbegin; c < roi.chend; ++c)
-                    compare_value(a, c, c < Achannels ? a[c] : 0.0f,
-                                  c < Bchannels ? b[c] : 0.0f, result, maxval,
+        for (int i = 0; i < batchsize && !a.done(); ++i, ++a, ++b) {
+            bool warned = false, failed = false;  // For this pixel
+            for (int c = roi.chbegin; c < roi.chend; ++c)
+                for (int s = 0, e = a.deep_samples(); s < e; ++s) {
+                    compare_value(a.x(), a.y(), a.z(), c, a.deep_value(c, s),
+                                  b.deep_value(c, s), result, maxval,
                                   batcherror, batch_sqrerror, failed, warned,
                                   failthresh, warnthresh);
-            }
+                }
         }
         totalerror += batcherror;
         totalsqrerror += batch_sqrerror;
@@ -351,6 +415,205 @@ compare_(const ImageBuf& A, const ImageBuf& B, float failthresh,
 
 
 
+// The partial results of comparing a band of scanlines
+struct CompareBand {
+    ImageBufAlgo::CompareResults r;  // maxerror & location, nwarn, nfail
+    double totalerror    = 0;
+    double totalsqrerror = 0;
+    float maxval         = 1.0f;  // max possible value
+};
+
+
+
+// Compare scanline (y,z) of A and B, given as nch floats per pixel for
+// channels [roi.chbegin,roi.chend) of pixels [roi.xbegin,roi.xend), adding
+// to band. The error sums and the largest difference are computed with
+// SIMD over the whole row; only rows with a difference over a threshold or
+// over the maximum so far, or with non-finite values, then need to be
+// examined pixel by pixel.
+static void
+compare_row(const float* a, const float* b, ROI roi, int y, int z,
+            float failthresh, float warnthresh, CompareBand& band)
+{
+    using namespace simd;
+    const int nch   = roi.nchannels();
+    const size_t n  = size_t(roi.width()) * nch;
+    const vfloat4 inf(std::numeric_limits<float>::infinity());
+    const vfloat4 ninf(-std::numeric_limits<float>::infinity());
+    const vfloat4 zero(0.0f);
+    vfloat4 sum(0.0f), sumc(0.0f), sum2(0.0f), sum2c(0.0f);
+    vfloat4 vmaxval(ninf), vmaxerr(zero);
+    bool allfinite = true;
+    size_t i       = 0;
+    for (; i + 4 <= n; i += 4) {
+        vfloat4 va(a + i), vb(b + i);
+        vbool4 finite = (abs(va) < inf) & (abs(vb) < inf);
+        allfinite &= all(finite);
+        vfloat4 f = select(finite, abs(va - vb), zero);
+        vfloat4 d = f - sumc;
+        vfloat4 t = sum + d;
+        sumc      = (t - sum) - d;
+        sum       = t;
+        d         = f * f - sum2c;
+        t         = sum2 + d;
+        sum2c     = (t - sum2) - d;
+        sum2      = t;
+        vmaxval   = max(vmaxval, select(finite, max(va, vb), ninf));
+        vmaxerr   = max(vmaxerr, f);
+    }
+    float maxerr = 0.0f;
+    for (int k = 0; k < 4; ++k) {
+        band.maxval = std::max(band.maxval, vmaxval[k]);
+        maxerr      = std::max(maxerr, vmaxerr[k]);
+    }
+    for (size_t j = i; j < n; ++j) {
+        allfinite &= (isfinite(a[j]) && isfinite(b[j]));
+        maxerr = std::max(maxerr, fabsf(a[j] - b[j]));
+    }
+
+    double rowerror = 0.0, row_sqrerror = 0.0;
+    if (!allfinite) {
+        // The rare row with NaN or Inf: take it slowly, exactly as for
+        // deep images.
+        for (int x = roi.xbegin; x < roi.xend; ++x) {
+            bool warned = false, failed = false;  // For this pixel
+            for (int c = roi.chbegin; c < roi.chend; ++c, ++a, ++b)
+                compare_value(x, y, z, c, *a, *b, band.r, band.maxval,
+                              rowerror, row_sqrerror, failed, warned,
+                              failthresh, warnthresh);
+        }
+    } else {
+        for (int k = 0; k < 4; ++k) {
+            rowerror += double(sum[k]) - double(sumc[k]);
+            row_sqrerror += double(sum2[k]) - double(sum2c[k]);
+        }
+        for (size_t j = i; j < n; ++j) {
+            band.maxval = std::max(band.maxval, std::max(a[j], b[j]));
+            double f    = fabs(a[j] - b[j]);
+            rowerror += f;
+            row_sqrerror += f * f;
+        }
+        if (maxerr > band.r.maxerror || !(maxerr <= warnthresh)
+            || !(maxerr <= failthresh)) {
+            for (int x = roi.xbegin; x < roi.xend; ++x) {
+                bool warned = false, failed = false;  // For this pixel
+                for (int c = roi.chbegin; c < roi.chend; ++c, ++a, ++b) {
+                    float f = fabsf(*a - *b);
+                    if (f > band.r.maxerror) {
+                        band.r.maxerror = f;
+                        band.r.maxx     = x;
+                        band.r.maxy     = y;
+                        band.r.maxz     = z;
+                        band.r.maxc     = c;
+                    }
+                    warned |= !(f <= warnthresh);
+                    failed |= !(f <= failthresh);
+                }
+                band.r.nwarn += warned;
+                band.r.nfail += failed;
+            }
+        }
+    }
+    band.totalerror += rowerror;
+    band.totalsqrerror += row_sqrerror;
+}
+
+
+
+// Compare A and B (both not deep) over roi, a band of scanlines per task,
+// and if Astats or Bstats are not null, also accumulate into them the
+// stats of the part of each image's data window within roi.
+static bool
+compare_(const ImageBuf& A, const ImageBuf& B, float failthresh,
+         float warnthresh, ImageBufAlgo::CompareResults& result,
+         ImageBufAlgo::PixelStats* Astats, ImageBufAlgo::PixelStats* Bstats,
+         ROI roi, int nthreads)
+{
+    imagesize_t npels = roi.npixels();
+    imagesize_t nvals = npels * roi.nchannels();
+    const int nch     = roi.nchannels();
+    // Scanlines are numbered in the order the iterators would visit them
+    // (all of the first slice, then the next), and split into bands. Keep
+    // each band's results and combine them in that order, so that the
+    // results, including which of equal maximum errors is reported, don't
+    // depend on how the threads were scheduled.
+    const int64_t nrows = int64_t(roi.height()) * roi.depth();
+    const int bandsize  = 64;
+    std::vector<CompareBand> bands((nrows + bandsize - 1) / bandsize);
+    OIIO::spin_mutex mutex;  // protect the shared stats when merging
+    parallel_for_chunked(0, nrows, bandsize,
+                         [&](int id, int64_t begin, int64_t end) {
+        CompareBand& band(bands[begin / bandsize]);
+        band.r.maxerror = 0;
+        band.r.maxx = 0, band.r.maxy = 0, band.r.maxz = 0, band.r.maxc = 0;
+        band.r.nfail = 0, band.r.nwarn = 0;
+        ImageBufAlgo::PixelStats as(Astats ? A.nchannels() : 0);
+        ImageBufAlgo::PixelStats bs(Bstats ? B.nchannels() : 0);
+        std::vector<float> arow(roi.width() * nch), brow(roi.width() * nch);
+        for (int64_t r = begin; r < end; ++r) {
+            int y = roi.ybegin + int(r % roi.height());
+            int z = roi.zbegin + int(r / roi.height());
+            ROI rowroi(roi.xbegin, roi.xend, y, y + 1, z, z + 1, roi.chbegin,
+                       roi.chend);
+            pvt::read_float_row(A, rowroi, arow.data());
+            pvt::read_float_row(B, rowroi, brow.data());
+            compare_row(arow.data(), brow.data(), roi, y, z, failthresh,
+                        warnthresh, band);
+            // Stats of the pixels of the row within each data window
+            ROI win = roi_intersection(A.roi(), rowroi);
+            if (Astats && win.defined() && win.npixels())
+                stats_row(as, roi.chbegin,
+                          arow.data() + (win.xbegin - roi.xbegin) * nch,
+                          win.width(), nch);
+            win = roi_intersection(B.roi(), rowroi);
+            if (Bstats && win.defined() && win.npixels())
+                stats_row(bs, roi.chbegin,
+                          brow.data() + (win.xbegin - roi.xbegin) * nch,
+                          win.width(), nch);
+        }
+        if (Astats || Bstats) {
+            std::lock_guard<OIIO::spin_mutex> lock(mutex);
+            if (Astats)
+                Astats->merge(as);
+            if (Bstats)
+                Bstats->merge(bs);
+        }
+    }, parallel_options(nthreads));
+
+    double totalerror    = 0;
+    double totalsqrerror = 0;
+    float maxval         = 1.0f;
+    result.maxerror      = 0;
+    result.maxx = 0, result.maxy = 0, result.maxz = 0, result.maxc = 0;
+    result.nfail = 0, result.nwarn = 0;
+    for (auto& band : bands) {
+        totalerror += band.totalerror;
+        totalsqrerror += band.totalsqrerror;
+        maxval = std::max(maxval, band.maxval);
+        result.nwarn += band.r.nwarn;
+        result.nfail += band.r.nfail;
+        // Same test as compare_value(), so the earliest of equal maximum
+        // errors is the one reported.
+        if (!(band.r.maxerror <= result.maxerror)) {
+            result.maxerror = band.r.maxerror;
+            result.maxx     = band.r.maxx;
+            result.maxy     = band.r.maxy;
+            result.maxz     = band.r.maxz;
+            result.maxc     = band.r.maxc;
+        }
+    }
+    result.meanerror = totalerror / nvals;
+    result.rms_error = sqrt(totalsqrerror / nvals);
+    result.PSNR      = 20.0 * log10(maxval / result.rms_error);
+    if (Astats)
+        finalize(*Astats);
+    if (Bstats)
+        finalize(*Bstats);
+    return result.nfail == 0;
+}
+
+
+
 ImageBufAlgo::CompareResults
 ImageBufAlgo::compare(const ImageBuf& A, const ImageBuf& B, float failthresh,
                       float warnthresh, ROI roi, int nthreads)
@@ -372,12 +635,85 @@ ImageBufAlgo::compare(const ImageBuf& A, const ImageBuf& B, float failthresh,
     }
 
     bool ok;
-    OIIO_DISPATCH_COMMON_TYPES2_CONST(ok, "compare", compare_, A.spec().format,
-                                      B.spec().format, A, B, failthresh,
-                                      warnthresh, result, roi, nthreads);
-    // FIXME - The nthreads argument is for symmetry with the rest of
-    // ImageBufAlgo and for future expansion. But for right now, we
-    // don't actually split by threads.  Maybe later.
+    if (A.deep()) {
+        OIIO_DISPATCH_COMMON_TYPES2_CONST(ok, "compare", compare_deep_,
+                                          A.spec().format, B.spec().format, A,
+                                          B, failthresh, warnthresh, result,
+                                          roi, nthreads);
+    } else {
+        ok = compare_(A, B, failthresh, warnthresh, result, nullptr, nullptr,
+                      roi, nthreads);
+    }
+    result.error = !ok;
+    return result;
+}
+
+
+
+// Print one per-channel statistic of two images side by side.
+template<typename T>
+static void
+print_values(std::ostream& out, const char* label, const std::vector<T>& v0,
+             const std::vector<T>& v1)
+{
+    out << "  " << label << " = ";
+    for (size_t c = 0; c < v0.size(); ++c)
+        out << (c ? ", " : "") << v0[c];
+    out << " vs ";
+    for (size_t c = 0; c < v1.size(); ++c)
+        out << (c ? ", " : "") << v1[c];
+    out << "\n";
+}
+
+
+
+void
+ImageBufAlgo::print_stats_comparison(std::ostream& out,
+                                     const PixelStats& Astats,
+                                     const PixelStats& Bstats)
+{
+    print_values(out, "Min values", Astats.min, Bstats.min);
+    print_values(out, "Max values", Astats.max, Bstats.max);
+    print_values(out, "Avg values", Astats.avg, Bstats.avg);
+    auto nonzero = [](const std::vector<imagesize_t>& v) {
+        return std::any_of(v.begin(), v.end(),
+                           [](imagesize_t n) { return n != 0; });
+    };
+    if (nonzero(Astats.nancount) || nonzero(Bstats.nancount))
+        print_values(out, "NaN count ", Astats.nancount, Bstats.nancount);
+    if (nonzero(Astats.infcount) || nonzero(Bstats.infcount))
+        print_values(out, "Inf count ", Astats.infcount, Bstats.infcount);
+}
+
+
+
+ImageBufAlgo::CompareResults
+ImageBufAlgo::compare(const ImageBuf& A, const ImageBuf& B, float failthresh,
+                      float warnthresh, PixelStats& Astats, PixelStats& Bstats,
+                      ROI roi, int nthreads)
+{
+    if (A.deep() || B.deep()) {
+        // No single-pass version for deep images
+        CompareResults result = compare(A, B, failthresh, warnthresh, roi,
+                                        nthreads);
+        if (!roi.defined())
+            roi = roi_union(get_roi(A.spec()), get_roi(B.spec()));
+        Astats = computePixelStats(A, roi_intersection(roi, A.roi()),
+                                   nthreads);
+        Bstats = computePixelStats(B, roi_intersection(roi, B.roi()),
+                                   nthreads);
+        return result;
+    }
+    pvt::LoggedTimer logtimer("IBA::compare");
+    ImageBufAlgo::CompareResults result;
+    result.error = true;
+    if (!roi.defined())
+        roi = roi_union(get_roi(A.spec()), get_roi(B.spec()));
+    roi.chend = std::min(roi.chend, std::max(A.nchannels(), B.nchannels()));
+    Astats.reset(A.nchannels());
+    Bstats.reset(B.nchannels());
+    bool ok = compare_(A, B, failthresh, warnthresh, result, &Astats, &Bstats,
+                       roi, nthreads);
     result.error = !ok;
     return result;
 }
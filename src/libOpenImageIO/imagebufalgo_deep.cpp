@@ -71,10 +71,27 @@ flatten_(ImageBuf& dst, const ImageBuf& src, ROI roi, int nthreads)
         float& ARval(val[AR_channel]);
         float& AGval(val[AG_channel]);
         float& ABval(val[AB_channel]);
+        // Resolve per channel, once, which accumulated alpha attenuates it
+        // (index into the avals[] below) and whether it's a depth, so the
+        // per-sample loop has no channel name comparisons.
+        int* chanalpha = ALLOCA(int, nc);
+        bool* chanisz  = ALLOCA(bool, nc);
+        for (int c = 0; c < nc; ++c) {
+            if (c == R_channel)
+                chanalpha[c] = 1;
+            else if (c == G_channel)
+                chanalpha[c] = 2;
+            else if (c == B_channel)
+                chanalpha[c] = 3;
+            else
+                chanalpha[c] = 0;
+            chanisz[c] = (c == Z_channel || c == Zback_channel);
+        }
 
         for (ImageBuf::Iterator<DSTTYPE> r(dst, roi); !r.done(); ++r) {
             int x = r.x(), y = r.y(), z = r.z();
-            int samps = src.deep_samples(x, y, z);
+            int pixel = src.pixelindex(x, y, z, true);
+            int samps = dd->samples(pixel);
             // Clear accumulated values for this pixel (0 for colors, big for Z)
             memset(val, 0, nc * sizeof(float));
             if (Z_channel >= 0 && samps == 0)
@@ -86,20 +103,12 @@ flatten_(ImageBuf& dst, const ImageBuf& src, ROI roi, int nthreads)
                 float alpha = (AR + AG + AB) / 3.0f;
                 if (alpha >= 1.0f)
                     break;
+                float avals[4] = { alpha, AR, AG, AB };
                 for (int c = 0; c < nc; ++c) {
-                    float v = src.deep_value(x, y, z, c, s);
-                    if (c == Z_channel || c == Zback_channel)
+                    float v = dd->deep_value(pixel, c, s);
+                    if (chanisz[c])
                         val[c] *= alpha;  // because Z are not premultiplied
-                    float a;
-                    if (c == R_channel)
-                        a = AR;
-                    else if (c == G_channel)
-                        a = AG;
-                    else if (c == B_channel)
-                        a = AB;
-                    else
-                        a = alpha;
-                    val[c] += (1.0f - a) * v;
+                    val[c] += (1.0f - avals[chanalpha[c]]) * v;
                 }
             }
 
@@ -284,92 +293,66 @@ ImageBufAlgo::deep_merge(ImageBuf& dst, const ImageBuf& A, const ImageBuf& B,
 
     // First, set the capacity of the dst image to reserve enough space for
     // the segments of both source images, including any splits that may
-    // occur.
+    // occur. Each sample can be split at most once at every sample
+    // boundary that lies strictly inside it, so counting those gives an
+    // upper bound, and the merge below never has to reallocate, which is
+    // what makes it safe to merge separate pixels in parallel.
     DeepData& dstdd(*dst.deepdata());
     const DeepData& Add(*A.deepdata());
     const DeepData& Bdd(*B.deepdata());
-    int Azchan     = Add.Z_channel();
-    int Azbackchan = Add.Zback_channel();
-    int Bzchan     = Bdd.Z_channel();
-    int Bzbackchan = Bdd.Zback_channel();
-    for (int z = roi.zbegin; z < roi.zend; ++z)
-        for (int y = roi.ybegin; y < roi.yend; ++y)
-            for (int x = roi.xbegin; x < roi.xend; ++x) {
-                int dstpixel            = dst.pixelindex(x, y, z, true);
-                int Apixel              = A.pixelindex(x, y, z, true);
-                int Bpixel              = B.pixelindex(x, y, z, true);
-                int Asamps              = Add.samples(Apixel);
-                int Bsamps              = Bdd.samples(Bpixel);
-                int nsplits             = 0;
-                int self_overlap_splits = 0;
-                for (int s = 0; s < Asamps; ++s) {
-                    float src_z     = Add.deep_value(Apixel, Azchan, s);
-                    float src_zback = Add.deep_value(Apixel, Azbackchan, s);
-                    for (int d = 0; d < Bsamps; ++d) {
-                        float dst_z     = Bdd.deep_value(Bpixel, Bzchan, d);
-                        float dst_zback = Bdd.deep_value(Bpixel, Bzbackchan, d);
-                        if (src_z > dst_z && src_z < dst_zback)
-                            ++nsplits;
-                        if (src_zback > dst_z && src_zback < dst_zback)
-                            ++nsplits;
-                        if (dst_z > src_z && dst_z < src_zback)
-                            ++nsplits;
-                        if (dst_zback > src_z && dst_zback < src_zback)
-                            ++nsplits;
+    ImageBufAlgo::parallel_image(roi, nthreads, [&](ROI roi) {
+        int Azchan     = Add.Z_channel();
+        int Azbackchan = Add.Zback_channel();
+        int Bzchan     = Bdd.Z_channel();
+        int Bzbackchan = Bdd.Zback_channel();
+        std::vector<float> zf, zb;  // z front & back of A's, then B's samples
+        for (int z = roi.zbegin; z < roi.zend; ++z)
+            for (int y = roi.ybegin; y < roi.yend; ++y)
+                for (int x = roi.xbegin; x < roi.xend; ++x) {
+                    int dstpixel = dst.pixelindex(x, y, z, true);
+                    int Apixel   = A.pixelindex(x, y, z, true);
+                    int Bpixel   = B.pixelindex(x, y, z, true);
+                    int Asamps   = Add.samples(Apixel);
+                    int Bsamps   = Bdd.samples(Bpixel);
+                    int nsamps   = Asamps + Bsamps;
+                    zf.resize(nsamps);
+                    zb.resize(nsamps);
+                    for (int s = 0; s < Asamps; ++s) {
+                        zf[s] = Add.deep_value(Apixel, Azchan, s);
+                        zb[s] = Add.deep_value(Apixel, Azbackchan, s);
                     }
-                    // Check for splits src vs src -- in case they overlap!
-                    for (int ss = s; ss < Asamps; ++ss) {
-                        float src_z2     = Add.deep_value(Apixel, Azchan, ss);
-                        float src_zback2 = Add.deep_value(Apixel, Azbackchan,
-                                                          ss);
-                        if (src_z2 > src_z && src_z2 < src_zback)
-                            ++self_overlap_splits;
-                        if (src_zback2 > src_z && src_zback2 < src_zback)
-                            ++self_overlap_splits;
-                        if (src_z > src_z2 && src_z < src_zback2)
-                            ++self_overlap_splits;
-                        if (src_zback > src_z2 && src_zback < src_zback2)
-                            ++self_overlap_splits;
+                    for (int s = 0; s < Bsamps; ++s) {
+                        zf[Asamps + s] = Bdd.deep_value(Bpixel, Bzchan, s);
+                        zb[Asamps + s] = Bdd.deep_value(Bpixel, Bzbackchan, s);
                     }
-                }
-                // Check for splits dst vs dst -- in case they overlap!
-                for (int d = 0; d < Bsamps; ++d) {
-                    float dst_z     = Bdd.deep_value(Bpixel, Bzchan, d);
-                    float dst_zback = Bdd.deep_value(Bpixel, Bzbackchan, d);
-                    for (int dd = d; dd < Bsamps; ++dd) {
-                        float dst_z2     = Bdd.deep_value(Bpixel, Bzchan, dd);
-                        float dst_zback2 = Bdd.deep_value(Bpixel, Bzbackchan,
-                                                          dd);
-                        if (dst_z2 > dst_z && dst_z2 < dst_zback)
-                            ++self_overlap_splits;
-                        if (dst_zback2 > dst_z && dst_zback2 < dst_zback)
-                            ++self_overlap_splits;
-                        if (dst_z > dst_z2 && dst_z < dst_zback2)
-                            ++self_overlap_splits;
-                        if (dst_zback > dst_z2 && dst_zback < dst_zback2)
-                            ++self_overlap_splits;
+                    int nsplits = 0;
+                    for (int i = 0; i < nsamps; ++i) {
+                        float f = zf[i], b = zb[i];
+                        for (int j = 0; j < nsamps; ++j)
+                            nsplits += int(zf[j] > f && zf[j] < b)
+                                       + int(zb[j] > f && zb[j] < b);
                     }
+                    dstdd.set_capacity(dstpixel, nsamps + nsplits);
                 }
-
-                dstdd.set_capacity(dstpixel, Asamps + Bsamps + nsplits
-                                                 + self_overlap_splits);
-            }
+    });
 
     bool ok = ImageBufAlgo::copy(dst, A, TypeDesc::UNKNOWN, roi, nthreads);
 
-    for (int z = roi.zbegin; z < roi.zend; ++z)
-        for (int y = roi.ybegin; y < roi.yend; ++y)
-            for (int x = roi.xbegin; x < roi.xend; ++x) {
-                int dstpixel = dst.pixelindex(x, y, z, true);
-                int Bpixel   = B.pixelindex(x, y, z, true);
-                DASSERT(dstpixel >= 0);
-                // OIIO_UNUSED_OK int oldcap = dstdd.capacity (dstpixel);
-                dstdd.merge_deep_pixels(dstpixel, Bdd, Bpixel);
-                // DASSERT (oldcap == dstdd.capacity(dstpixel) &&
-                //          "Broken: we did not preallocate enough capacity");
-                if (occlusion_cull)
-                    dstdd.occlusion_cull(dstpixel);
-            }
+    ImageBufAlgo::parallel_image(roi, nthreads, [&](ROI roi) {
+        for (int z = roi.zbegin; z < roi.zend; ++z)
+            for (int y = roi.ybegin; y < roi.yend; ++y)
+                for (int x = roi.xbegin; x < roi.xend; ++x) {
+                    int dstpixel = dst.pixelindex(x, y, z, true);
+                    int Bpixel   = B.pixelindex(x, y, z, true);
+                    DASSERT(dstpixel >= 0);
+                    OIIO_UNUSED_OK int oldcap = dstdd.capacity(dstpixel);
+                    dstdd.merge_deep_pixels(dstpixel, Bdd, Bpixel);
+                    DASSERT(oldcap == dstdd.capacity(dstpixel)
+                            && "Broken: did not preallocate enough capacity");
+                    if (occlusion_cull)
+                        dstdd.occlusion_cull(dstpixel);
+                }
+    });
     return ok;
 }
 
@@ -406,53 +389,71 @@ ImageBufAlgo::deep_holdout(ImageBuf& dst, const ImageBuf& src,
 
     DeepData& dstdd(*dst.deepdata());
     const DeepData& srcdd(*src.deepdata());
-    // First, reserve enough space in dst, to reduce the number of
-    // allocations we'll do later.
-    for (int z = roi.zbegin; z < roi.zend; ++z)
-        for (int y = roi.ybegin; y < roi.yend; ++y)
-            for (int x = roi.xbegin; x < roi.xend; ++x) {
-                int dstpixel = dst.pixelindex(x, y, z, true);
-                int srcpixel = src.pixelindex(x, y, z, true);
-                if (dstpixel >= 0 && srcpixel >= 0)
-                    dstdd.set_capacity(dstpixel, srcdd.capacity(srcpixel));
-            }
+    const DeepData& threshdd(*thresh.deepdata());
+    int Zchan     = dstdd.Z_channel();
+    int Zbackchan = dstdd.Zback_channel();
+    // First, reserve enough space in dst: the src samples, plus one for
+    // each sample that straddles the threshold depth and will be split.
+    // With that, the pass below never reallocates, so separate pixels can
+    // be processed in parallel.
+    ImageBufAlgo::parallel_image(roi, nthreads, [&](ROI roi) {
+        for (int z = roi.zbegin; z < roi.zend; ++z)
+            for (int y = roi.ybegin; y < roi.yend; ++y)
+                for (int x = roi.xbegin; x < roi.xend; ++x) {
+                    int dstpixel = dst.pixelindex(x, y, z, true);
+                    int srcpixel = src.pixelindex(x, y, z, true);
+                    if (dstpixel < 0 || srcpixel < 0)
+                        continue;
+                    int threshpixel = thresh.pixelindex(x, y, z, true);
+                    float zthresh   = threshdd.opaque_z(threshpixel);
+                    int nsamps      = srcdd.samples(srcpixel);
+                    int nsplits     = 0;
+                    for (int s = 0; s < nsamps; ++s)
+                        nsplits += int(
+                            srcdd.deep_value(srcpixel, Zchan, s) < zthresh
+                            && srcdd.deep_value(srcpixel, Zbackchan, s)
+                                   > zthresh);
+                    dstdd.set_capacity(dstpixel,
+                                       std::max(srcdd.capacity(srcpixel),
+                                                nsamps + nsplits));
+                }
+    });
     // Now we compute each pixel: We copy the src pixel to dst, then split
     // any samples that span the opaque threshold, and then delete any
     // samples that lie beyond the threshold.
-    int Zchan     = dstdd.Z_channel();
-    int Zbackchan = dstdd.Zback_channel();
-    const DeepData& threshdd(*thresh.deepdata());
-    for (ImageBuf::Iterator<float> r(dst, roi); !r.done(); ++r) {
-        int x = r.x(), y = r.y(), z = r.z();
-        int srcpixel = src.pixelindex(x, y, z, true);
-        if (srcpixel < 1)
-            continue;  // Nothing in this pixel
-        int dstpixel = dst.pixelindex(x, y, z, true);
-        dstdd.copy_deep_pixel(dstpixel, srcdd, srcpixel);
-        int threshpixel = thresh.pixelindex(x, y, z, true);
-        if (threshpixel < 0)
-            continue;  // No threshold mask for this pixel
-        float zthresh = threshdd.opaque_z(threshpixel);
-        // Eliminate the samples that are entirely beyond the depth
-        // threshold. Do this before the split; that makes it less
-        // likely that the split will force a re-allocation.
-        for (int s = 0, n = dstdd.samples(dstpixel); s < n; ++s) {
-            if (dstdd.deep_value(dstpixel, Zchan, s) > zthresh) {
-                dstdd.set_samples(dstpixel, s);
-                break;
-            }
-        }
-        // Now split any samples that straddle the z.
-        if (dstdd.split(dstpixel, zthresh)) {
-            // If a split did occur, do anohter discard pass.
+    ImageBufAlgo::parallel_image(roi, nthreads, [&](ROI roi) {
+        for (ImageBuf::Iterator<float> r(dst, roi); !r.done(); ++r) {
+            int x = r.x(), y = r.y(), z = r.z();
+            int srcpixel = src.pixelindex(x, y, z, true);
+            if (srcpixel < 1)
+                continue;  // Nothing in this pixel
+            int dstpixel = dst.pixelindex(x, y, z, true);
+            dstdd.copy_deep_pixel(dstpixel, srcdd, srcpixel);
+            int threshpixel = thresh.pixelindex(x, y, z, true);
+            if (threshpixel < 0)
+                continue;  // No threshold mask for this pixel
+            float zthresh = threshdd.opaque_z(threshpixel);
+            // Eliminate the samples that are entirely beyond the depth
+            // threshold. Do this before the split; that makes it less
+            // likely that the split will force a re-allocation.
             for (int s = 0, n = dstdd.samples(dstpixel); s < n; ++s) {
-                if (dstdd.deep_value(dstpixel, Zbackchan, s) > zthresh) {
+                if (dstdd.deep_value(dstpixel, Zchan, s) > zthresh) {
                     dstdd.set_samples(dstpixel, s);
                     break;
                 }
             }
+            // Now split any samples that straddle the z.
+            if (dstdd.split(dstpixel, zthresh)) {
+                // If a split did occur, do anohter discard pass.
+                for (int s = 0, n = dstdd.samples(dstpixel); s < n; ++s) {
+                    if (dstdd.deep_value(dstpixel, Zbackchan, s) > zthresh) {
+                        dstdd.set_samples(dstpixel, s);
+                        break;
+                    }
+                }
+            }
         }
-    }
+    });
     return true;
 }
 
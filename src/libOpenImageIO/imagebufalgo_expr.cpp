@@ -0,0 +1,880 @@
+/*
+  Copyright 2019 Larry Gritz and the other authors and contributors.
+  All Rights Reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+  * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+  * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+  * Neither the name of the software's owners nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  (This is the Modified BSD License)
+*/
+
+/// \file
+/// Implementation of ImageBufAlgo::ImageExpr, which records chains of
+/// point-wise operations and evaluates them in a single fused pass.
+
+#include <algorithm>
+#include <cmath>
+#include <future>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include <OpenImageIO/color.h>
+#include <OpenImageIO/dassert.h>
+#include <OpenImageIO/imagebuf.h>
+#include <OpenImageIO/imagebufalgo.h>
+#include <OpenImageIO/imagebufalgo_util.h>
+#include <OpenImageIO/imagecache.h>
+#include <OpenImageIO/simd.h>
+#include <OpenImageIO/thread.h>
+
+#include "imageio_pvt.h"
+
+
+OIIO_NAMESPACE_BEGIN
+
+
+struct ImageBufAlgo::ImageExpr::Impl {
+    enum Op {
+        Add,
+        Sub,
+        Mul,
+        Mad,
+        Pow,
+        Abs,
+        Clamp,
+        Premult,
+        Unpremult,
+        ColorConvert,
+        Over
+    };
+
+    // One recorded stage. Constant operands are stored expanded to the
+    // source's number of channels; image operands are only referenced.
+    struct Stage {
+        Op op;
+        const ImageBuf* B = nullptr;
+        const ImageBuf* C = nullptr;
+        std::vector<float> b, c;
+        bool flag = false;  // clampalpha01, or unpremult for ColorConvert
+        const ColorProcessor* processor = nullptr;
+        ColorProcessorHandle processor_handle;  // owned, if by name
+
+        Stage(Op op)
+            : op(op)
+        {
+        }
+    };
+
+    const ImageBuf* m_src;
+    ImageSpec m_spec;  // what eval() will produce
+    std::vector<Stage> m_stages;
+    std::string m_err;
+    std::string m_write_err;  // why the last write() failed
+    bool m_set_unassociated = false;  // stages changed oiio:UnassociatedAlpha
+    bool m_set_colorspace   = false;  // stages changed oiio:ColorSpace
+
+    Impl(const ImageBuf& src)
+        : m_src(&src)
+        , m_spec(src.spec())
+    {
+    }
+
+    int nchannels() const { return m_spec.nchannels; }
+
+    // Per-channel constants, with the last value replicated for missing
+    // channels (or def for all channels if none were given).
+    std::vector<float> perchan(cspan<float> vals, float def) const
+    {
+        std::vector<float> r(nchannels(), vals.size() ? vals.back() : def);
+        for (int c = 0, e = std::min(nchannels(), int(vals.size())); c < e;
+             ++c)
+            r[c] = vals[c];
+        return r;
+    }
+
+    // Record an image or constant operand, keeping the first error.
+    void operand(Image_or_Const X, const ImageBuf*& img,
+                 std::vector<float>& vals)
+    {
+        const char* err = nullptr;
+        if (X.is_img()) {
+            if (!X.img().initialized())
+                err = "Uninitialized input image";
+            else if (X.img().deep())
+                err = "deep images not supported";
+            img = X.imgptr();
+        } else if (X.is_val()) {
+            vals = perchan(X.val(), 0.0f);
+        } else {
+            err = "missing operand";
+        }
+        if (err && m_err.empty())
+            m_err = err;
+    }
+
+    void append(Op op, Image_or_Const B,
+                Image_or_Const C = Image_or_Const::None())
+    {
+        Stage st(op);
+        operand(B, st.B, st.b);
+        if (!C.is_empty())
+            operand(C, st.C, st.c);
+        m_stages.push_back(std::move(st));
+    }
+
+    // Per-thread scratch space for computing scanlines of a given width:
+    // one row per image operand, constants expanded to whole rows so that
+    // image and constant operands share the same loops, and RGBA rows for
+    // colorconvert stages.
+    struct Scratch {
+        std::vector<std::vector<float>> brows, crows;
+        std::vector<simd::vfloat4> scanline, alphas;
+        Scratch(const Impl& expr, int width);
+    };
+
+    // Compute every stage on r, which holds all the channels of scanline
+    // rowroi of the source as floats, in place.
+    void apply(float* r, ROI rowroi, Scratch& scratch) const;
+};
+
+
+
+ImageBufAlgo::ImageExpr::ImageExpr(const ImageBuf& src)
+    : m_impl(new Impl(src))
+{
+}
+
+
+
+ImageBufAlgo::ImageExpr::ImageExpr(const ImageExpr& other)
+    : m_impl(new Impl(*other.m_impl))
+{
+}
+
+
+
+ImageBufAlgo::ImageExpr::~ImageExpr() {}
+
+
+
+const ImageBufAlgo::ImageExpr&
+ImageBufAlgo::ImageExpr::operator=(const ImageExpr& other)
+{
+    if (this != &other)
+        *m_impl = *other.m_impl;
+    return *this;
+}
+
+
+
+ImageBufAlgo::ImageExpr&
+ImageBufAlgo::ImageExpr::add(Image_or_Const B)
+{
+    m_impl->append(Impl::Add, B);
+    return *this;
+}
+
+
+
+ImageBufAlgo::ImageExpr&
+ImageBufAlgo::ImageExpr::sub(Image_or_Const B)
+{
+    m_impl->append(Impl::Sub, B);
+    return *this;
+}
+
+
+
+ImageBufAlgo::ImageExpr&
+ImageBufAlgo::ImageExpr::mul(Image_or_Const B)
+{
+    m_impl->append(Impl::Mul, B);
+    return *this;
+}
+
+
+
+ImageBufAlgo::ImageExpr&
+ImageBufAlgo::ImageExpr::mad(Image_or_Const B, Image_or_Const C)
+{
+    if (C.is_empty()) {
+        error("missing operand");
+        return *this;
+    }
+    m_impl->append(Impl::Mad, B, C);
+    return *this;
+}
+
+
+
+ImageBufAlgo::ImageExpr&
+ImageBufAlgo::ImageExpr::pow(cspan<float> b)
+{
+    m_impl->append(Impl::Pow, b);
+    return *this;
+}
+
+
+
+ImageBufAlgo::ImageExpr&
+ImageBufAlgo::ImageExpr::abs()
+{
+    m_impl->m_stages.emplace_back(Impl::Abs);
+    return *this;
+}
+
+
+
+ImageBufAlgo::ImageExpr&
+ImageBufAlgo::ImageExpr::clamp(cspan<float> min, cspan<float> max,
+                               bool clampalpha01)
+{
+    const float big = std::numeric_limits<float>::max();
+    Impl::Stage st(Impl::Clamp);
+    st.b    = m_impl->perchan(min, -big);
+    st.c    = m_impl->perchan(max, big);
+    st.flag = clampalpha01;
+    m_impl->m_stages.push_back(std::move(st));
+    return *this;
+}
+
+
+
+ImageBufAlgo::ImageExpr&
+ImageBufAlgo::ImageExpr::premult()
+{
+    // Like premult(), this is a no-op for images without alpha.
+    if (m_impl->m_spec.alpha_channel < 0)
+        return *this;
+    m_impl->m_stages.emplace_back(Impl::Premult);
+    m_impl->m_spec.erase_attribute("oiio:UnassociatedAlpha");
+    m_impl->m_set_unassociated = true;
+    return *this;
+}
+
+
+
+ImageBufAlgo::ImageExpr&
+ImageBufAlgo::ImageExpr::unpremult()
+{
+    if (m_impl->m_spec.alpha_channel < 0)
+        return *this;
+    m_impl->m_stages.emplace_back(Impl::Unpremult);
+    m_impl->m_spec.attribute("oiio:UnassociatedAlpha", 1);
+    m_impl->m_set_unassociated = true;
+    return *this;
+}
+
+
+
+ImageBufAlgo::ImageExpr&
+ImageBufAlgo::ImageExpr::colorconvert(const ColorProcessor* processor,
+                                      bool unpremult)
+{
+    if (!processor) {
+        error(
+            "Passed NULL ColorProcessor to colorconvert() [probable application bug]");
+        return *this;
+    }
+    if (processor->isNoOp())
+        return *this;
+    const ImageSpec& spec(m_impl->m_spec);
+    if (unpremult && spec.alpha_channel >= 0
+        && spec.get_int_attribute("oiio:UnassociatedAlpha") != 0) {
+        // Already unassociated by this point in the chain: don't do a
+        // redundant unpremult step.
+        unpremult = false;
+    }
+    Impl::Stage st(Impl::ColorConvert);
+    st.processor = processor;
+    st.flag      = unpremult;
+    m_impl->m_stages.push_back(std::move(st));
+    return *this;
+}
+
+
+
+ImageBufAlgo::ImageExpr&
+ImageBufAlgo::ImageExpr::colorconvert(ColorProcessorHandle processor,
+                                      bool unpremult, string_view tospace)
+{
+    size_t nstages = m_impl->m_stages.size();
+    colorconvert(processor.get(), unpremult);
+    if (m_impl->m_stages.size() > nstages)
+        m_impl->m_stages.back().processor_handle = processor;
+    if (m_impl->m_err.empty()) {
+        m_impl->m_spec.attribute("oiio:ColorSpace", tospace);
+        m_impl->m_set_colorspace = true;
+    }
+    return *this;
+}
+
+
+
+ImageBufAlgo::ImageExpr&
+ImageBufAlgo::ImageExpr::over(const ImageBuf& B)
+{
+    if (!B.initialized()) {
+        error("Uninitialized input image");
+        return *this;
+    }
+    if (m_impl->m_spec.alpha_channel < 0 || B.spec().alpha_channel < 0) {
+        error("images must have alpha channels");
+        return *this;
+    }
+    if (B.nchannels() != m_impl->nchannels()) {
+        error("images must have the same number of channels");
+        return *this;
+    }
+    m_impl->append(Impl::Over, &B);
+    return *this;
+}
+
+
+
+const ImageBuf&
+ImageBufAlgo::ImageExpr::source() const
+{
+    return *m_impl->m_src;
+}
+
+
+
+const ImageSpec&
+ImageBufAlgo::ImageExpr::spec() const
+{
+    return m_impl->m_spec;
+}
+
+
+
+int
+ImageBufAlgo::ImageExpr::nstages() const
+{
+    return int(m_impl->m_stages.size());
+}
+
+
+
+bool
+ImageBufAlgo::ImageExpr::has_error() const
+{
+    return !m_impl->m_err.empty();
+}
+
+
+
+std::string
+ImageBufAlgo::ImageExpr::geterror() const
+{
+    return m_impl->m_err.size() ? m_impl->m_err : m_impl->m_write_err;
+}
+
+
+
+void
+ImageBufAlgo::ImageExpr::error(string_view message)
+{
+    // Keep the first error, it's the one that explains the rest.
+    if (m_impl->m_err.empty())
+        m_impl->m_err = message;
+}
+
+
+
+ImageBufAlgo::ImageExpr::Impl::Scratch::Scratch(const Impl& expr, int width)
+{
+    const int nc = expr.m_src->nchannels();
+    bool has_colorconvert = false;
+    for (const Stage& st : expr.m_stages) {
+        brows.push_back(st.B ? std::vector<float>(size_t(width) * nc)
+                             : constant_row(st.b, nc, width));
+        crows.push_back(st.C ? std::vector<float>(size_t(width) * nc)
+                             : constant_row(st.c, nc, width));
+        has_colorconvert |= (st.op == ColorConvert);
+    }
+    if (has_colorconvert) {
+        scanline.resize(width);
+        alphas.resize(width);
+    }
+}
+
+
+
+void
+ImageBufAlgo::ImageExpr::Impl::apply(float* r, ROI rowroi,
+                                     Scratch& scratch) const
+{
+    using namespace simd;
+    const int nc      = m_src->nchannels();
+    const int alpha   = m_src->spec().alpha_channel;
+    const int zchan   = m_src->spec().z_channel;
+    const int width   = rowroi.width();
+    const size_t n    = size_t(width) * nc;
+    const size_t nst  = m_stages.size();
+    vfloat4* scanline = scratch.scanline.data();
+    vfloat4* alphas   = scratch.alphas.data();
+    for (size_t s = 0; s < nst; ++s) {
+        const Stage& st(m_stages[s]);
+        float* b = scratch.brows[s].data();
+        float* c = scratch.crows[s].data();
+        if (st.B)
+            pvt::read_float_row(*st.B, rowroi, b);
+        if (st.C)
+            pvt::read_float_row(*st.C, rowroi, c);
+        size_t i = 0;
+        switch (st.op) {
+        case Impl::Add:
+            for (; i + 4 <= n; i += 4)
+                (vfloat4(r + i) + vfloat4(b + i)).store(r + i);
+            for (; i < n; ++i)
+                r[i] = r[i] + b[i];
+            break;
+        case Impl::Sub:
+            for (; i + 4 <= n; i += 4)
+                (vfloat4(r + i) - vfloat4(b + i)).store(r + i);
+            for (; i < n; ++i)
+                r[i] = r[i] - b[i];
+            break;
+        case Impl::Mul:
+            for (; i + 4 <= n; i += 4)
+                (vfloat4(r + i) * vfloat4(b + i)).store(r + i);
+            for (; i < n; ++i)
+                r[i] = r[i] * b[i];
+            break;
+        case Impl::Mad:
+            for (; i + 4 <= n; i += 4)
+                (vfloat4(r + i) * vfloat4(b + i) + vfloat4(c + i))
+                    .store(r + i);
+            for (; i < n; ++i)
+                r[i] = r[i] * b[i] + c[i];
+            break;
+        case Impl::Pow:
+            for (; i < n; ++i)
+                r[i] = std::pow(r[i], b[i]);
+            break;
+        case Impl::Abs:
+            for (; i < n; ++i)
+                r[i] = std::abs(r[i]);
+            break;
+        case Impl::Clamp:
+            // Same NaN handling as the scalar OIIO::clamp
+            for (; i + 4 <= n; i += 4) {
+                vfloat4 v(r + i), lo(b + i), hi(c + i);
+                v = select(v >= lo, select(v <= hi, v, hi), lo);
+                v.store(r + i);
+            }
+            for (; i < n; ++i)
+                r[i] = OIIO::clamp(r[i], b[i], c[i]);
+            if (st.flag && alpha >= 0)
+                for (i = alpha; i < n; i += nc)
+                    r[i] = OIIO::clamp(r[i], 0.0f, 1.0f);
+            break;
+        case Impl::Premult:
+            for (; i < n; i += nc) {
+                float a = r[i + alpha];
+                for (int ch = 0; ch < nc; ++ch)
+                    if (ch != alpha && ch != zchan)
+                        r[i + ch] *= a;
+            }
+            break;
+        case Impl::Unpremult:
+            for (; i < n; i += nc) {
+                float a = r[i + alpha];
+                if (a == 0.0f || a == 1.0f)
+                    continue;
+                for (int ch = 0; ch < nc; ++ch)
+                    if (ch != alpha && ch != zchan)
+                        r[i + ch] = r[i + ch] / a;
+            }
+            break;
+        case Impl::ColorConvert: {
+            // Same steps as colorconvert(): only the first 4
+            // channels, through an RGBA scanline.
+            int ncc   = std::min(4, nc);
+            bool unpm = st.flag && ncc == 4;
+            const float fltmin = std::numeric_limits<float>::min();
+            for (int x = 0; x < width; ++x) {
+                vfloat4 v(0.0f);
+                for (int ch = 0; ch < ncc; ++ch)
+                    v[ch] = r[size_t(x) * nc + ch];
+                scanline[x] = v;
+            }
+            if (unpm) {
+                for (int x = 0; x < width; ++x) {
+                    vfloat4 a = shuffle<3>(scanline[x]);
+                    a = select(a >= fltmin, a, vfloat4::One());
+                    alphas[x] = a;
+                    scanline[x] *= rcp_fast(a);
+                }
+            }
+            st.processor->apply((float*)scanline, width, 1, 4,
+                                sizeof(float), 4 * sizeof(float),
+                                width * 4 * sizeof(float));
+            if (unpm)
+                for (int x = 0; x < width; ++x)
+                    scanline[x] *= alphas[x];
+            for (int x = 0; x < width; ++x)
+                for (int ch = 0; ch < ncc; ++ch)
+                    r[size_t(x) * nc + ch] = scanline[x][ch];
+            break;
+        }
+        case Impl::Over:
+            for (; i < n; i += nc) {
+                float a = OIIO::clamp(r[i + alpha], 0.0f, 1.0f);
+                float one_minus_alpha = 1.0f - a;
+                float zval            = 0.0f;
+                if (zchan >= 0)
+                    zval = (a != 0.0f) ? r[i + zchan]
+                                       : b[i + zchan];
+                for (int ch = 0; ch < nc; ++ch)
+                    r[i + ch] = r[i + ch]
+                                + one_minus_alpha * b[i + ch];
+                if (zchan >= 0)
+                    r[i + zchan] = zval;
+            }
+            break;
+        }
+    }
+}
+
+
+
+// Write channels [roi.chbegin,roi.chend) of the nchannels-per-pixel floats
+// in buf to scanline (y,z) of img.
+static void
+write_row(ImageBuf& img, ROI roi, int y, int z, int nchannels,
+          const float* buf)
+{
+    convert_image(roi.nchannels(), roi.width(), 1, 1, buf + roi.chbegin,
+                  TypeFloat, nchannels * sizeof(float), AutoStride, AutoStride,
+                  img.pixeladdr(roi.xbegin, y, z, roi.chbegin),
+                  img.spec().format, img.pixel_stride(), AutoStride,
+                  AutoStride);
+}
+
+
+
+bool
+ImageBufAlgo::ImageExpr::eval(ImageBuf& dst, ROI roi, int nthreads) const
+{
+    pvt::LoggedTimer logtime("IBA::ImageExpr::eval");
+    const Impl& expr(*m_impl);
+    const ImageBuf& src(*expr.m_src);
+    if (expr.m_err.size()) {
+        dst.error("%s", expr.m_err);
+        return false;
+    }
+    if (!IBAprep(roi, &dst, &src))
+        return false;
+    ASSERT(dst.localpixels());
+    if (expr.m_set_unassociated) {
+        if (expr.m_spec.get_int_attribute("oiio:UnassociatedAlpha"))
+            dst.specmod().attribute("oiio:UnassociatedAlpha", 1);
+        else
+            dst.specmod().erase_attribute("oiio:UnassociatedAlpha");
+    }
+    if (expr.m_set_colorspace)
+        dst.specmod().attribute("oiio:ColorSpace",
+                                expr.m_spec.get_string_attribute(
+                                    "oiio:ColorSpace"));
+
+    // The stages run on all the source channels (so that alpha and z are
+    // available), but only roi's channels are written.
+    const int nc = src.nchannels();
+    roi.chend    = std::min(roi.chend, nc);
+    if (roi.chbegin >= roi.chend)
+        return true;
+
+    parallel_image(roi, nthreads, [&](ROI roi) {
+        std::vector<float> row(size_t(roi.width()) * nc);
+        Impl::Scratch scratch(expr, roi.width());
+        for (int z = roi.zbegin; z < roi.zend; ++z) {
+            for (int y = roi.ybegin; y < roi.yend; ++y) {
+                ROI rowroi(roi.xbegin, roi.xend, y, y + 1, z, z + 1, 0, nc);
+                pvt::read_float_row(src, rowroi, row.data());
+                expr.apply(row.data(), rowroi, scratch);
+                write_row(dst, roi, y, z, nc, row.data());
+            }
+        }
+    });
+    return true;
+}
+
+
+
+ImageBuf
+ImageBufAlgo::ImageExpr::eval(ROI roi, int nthreads) const
+{
+    ImageBuf result;
+    bool ok = eval(result, roi, nthreads);
+    if (!ok && !result.has_error())
+        result.error("ImageExpr::eval() error");
+    return result;
+}
+
+
+
+static int
+gcd(int a, int b)
+{
+    while (b) {
+        int t = a % b;
+        a     = b;
+        b     = t;
+    }
+    return a;
+}
+
+
+
+bool
+ImageBufAlgo::ImageExpr::write(ImageOutput* out, int nthreads) const
+{
+    pvt::LoggedTimer logtime("IBA::ImageExpr::write");
+    const Impl& expr(*m_impl);
+    const ImageBuf& src(*expr.m_src);
+    m_impl->m_write_err.clear();
+    if (has_error())
+        return false;
+    if (!out) {
+        m_impl->m_write_err = "ImageExpr::write() called with no ImageOutput";
+        return false;
+    }
+    const ImageSpec& outspec(out->spec());
+    if (get_roi(outspec) != src.roi()) {
+        m_impl->m_write_err = "ImageExpr::write(): output opened with a "
+                              "different resolution or number of channels";
+        return false;
+    }
+    if (outspec.tile_width && outspec.tile_depth > 1) {
+        // Volume tiles would need bands of whole slices; not worth
+        // streaming, just compute it all and write it.
+        ImageBuf result = eval(ROI(), nthreads);
+        if (result.has_error() || !result.write(out)) {
+            m_impl->m_write_err = result.geterror();
+            return false;
+        }
+        return true;
+    }
+
+    // If the source is still just a view of its file through the
+    // ImageCache, fetch it a band at a time in the background, rather than
+    // a pixel at a time by each thread computing. Tiled files are read
+    // through the cache, which keeps the ImageBuf's configuration hints and
+    // the cache's own settings, such as "unassociatedalpha". But unless the
+    // cache is set to "autotile", it holds a scanline file as one tile of
+    // the whole image, so those are read directly, a band of scanlines at
+    // a time, honoring the same hints and settings as the cache would.
+    ImageCache* ic = nullptr;
+    std::unique_ptr<ImageInput> in;
+    ustring srcname(src.name());
+    ImageSpec inspec;
+    if (!src.localpixels() && src.storage() == ImageBuf::IMAGECACHE
+        && src.imagecache()) {
+        ic = src.imagecache();
+        if (!ic->get_imagespec(srcname, inspec, src.subimage(),
+                               src.miplevel())) {
+            (void)ic->geterror();  // Not an error, just slower
+            ic = nullptr;
+        } else if (get_roi(inspec) != src.roi() || inspec.tile_depth > 1
+                   || inspec.deep) {
+            ic = nullptr;
+        } else if (!src.nativespec().tile_width) {
+            ImageSpec config;
+            if (src.configspec())
+                config = *src.configspec();
+            int unassoc = 0;
+            if (ic->getattribute("unassociatedalpha", unassoc))
+                config.attribute("oiio:UnassociatedAlpha", unassoc);
+            in = ImageInput::open(srcname.string(), &config);
+            ImageSpec filespec;
+            if (!in
+                || !in->seek_subimage(src.subimage(), src.miplevel(),
+                                      filespec)
+                || get_roi(filespec) != src.roi()) {
+                (void)OIIO::geterror();  // Not an error, just slower
+                in.reset();
+                ic = nullptr;
+            }
+        }
+    }
+
+    // Bands are whole rows of output tiles (and input tiles, if the input
+    // is tiled too), with up to a fixed budget of float pixels each.
+    const int nc           = src.nchannels();
+    const size_t rowfloats = size_t(outspec.width) * nc;
+    const size_t budget    = 16 * 1024 * 1024;  // bytes per band
+    int align              = 1;
+    if (ic && !in && inspec.tile_width)
+        align = inspec.tile_height;
+    if (outspec.tile_width)
+        align = align / gcd(align, outspec.tile_height) * outspec.tile_height;
+    int bandheight = OIIO::clamp(int(budget / (rowfloats * sizeof(float))),
+                                 1, outspec.height);
+    bandheight     = round_to_multiple(bandheight, align);
+    struct Band {
+        int ybegin, yend, z;
+    };
+    std::vector<Band> bands;
+    for (int z = outspec.z; z < outspec.z + outspec.depth; ++z)
+        for (int y = outspec.y; y < outspec.y + outspec.height;
+             y += bandheight)
+            bands.push_back(
+                { y, std::min(y + bandheight, outspec.y + outspec.height),
+                  z });
+
+    auto readband = [&](const Band& b, float* buf) -> bool {
+        if (in)
+            return in->read_scanlines(src.subimage(), src.miplevel(),
+                                      b.ybegin, b.yend, b.z, 0, nc, TypeFloat,
+                                      buf);
+        return ic->get_pixels(srcname, src.subimage(), src.miplevel(),
+                              inspec.x, inspec.x + inspec.width, b.ybegin,
+                              b.yend, b.z, b.z + 1, 0, nc, TypeFloat, buf);
+    };
+    auto computeband = [&](const Band& b, float* buf) {
+        parallel_for_chunked(b.ybegin, b.yend, 0,
+                             [&](int id, int64_t ybegin, int64_t yend) {
+            Impl::Scratch scratch(expr, outspec.width);
+            for (int y = ybegin; y < yend; ++y) {
+                float* r = buf + (y - b.ybegin) * rowfloats;
+                ROI rowroi(outspec.x, outspec.x + outspec.width, y, y + 1,
+                           b.z, b.z + 1, 0, nc);
+                if (!ic)
+                    pvt::read_float_row(src, rowroi, r);
+                expr.apply(r, rowroi, scratch);
+            }
+        }, parallel_options(nthreads));
+    };
+    auto writeband = [&](const Band& b, const float* buf) -> bool {
+        if (outspec.tile_width)
+            return out->write_tiles(outspec.x, outspec.x + outspec.width,
+                                    b.ybegin, b.yend, b.z, b.z + 1, TypeFloat,
+                                    buf);
+        return out->write_scanlines(b.ybegin, b.yend, b.z, TypeFloat, buf);
+    };
+
+    // Three band buffers rotate through the pipeline: while band k is
+    // computed, band k+1 is being read and band k-1 written, each by a
+    // task on the thread pool.
+    std::vector<float> bufs[3];
+    for (size_t i = 0; i < std::min(bands.size(), size_t(3)); ++i)
+        bufs[i].resize(bandheight * rowfloats);
+    thread_pool* pool = default_thread_pool();
+    std::future<bool> reading, writing;
+    auto startread = [&](size_t k) {
+        if (ic)
+            reading = pool->push([&, k](int) {
+                return readband(bands[k], bufs[k % 3].data());
+            });
+    };
+    bool ok = true;
+    if (bands.size())
+        startread(0);
+    for (size_t k = 0; k < bands.size(); ++k) {
+        if (ic && !reading.get()) {
+            m_impl->m_write_err = in ? in->geterror() : ic->geterror();
+            ok = false;
+            break;
+        }
+        if (k + 1 < bands.size())
+            startread(k + 1);
+        computeband(bands[k], bufs[k % 3].data());
+        if (writing.valid() && !writing.get()) {
+            ok = false;
+            break;
+        }
+        writing = pool->push([&, k](int) {
+            return writeband(bands[k], bufs[k % 3].data());
+        });
+    }
+    // Don't leave with tasks still using the buffers
+    if (reading.valid())
+        reading.wait();
+    if (writing.valid() && !writing.get())
+        ok = false;
+    if (!ok && m_impl->m_write_err.empty())
+        m_impl->m_write_err = out->geterror();
+    return ok;
+}
+
+
+
+bool
+ImageBufAlgo::ImageExpr::write(string_view filename, TypeDesc dtype,
+                               string_view fileformat, int nthreads) const
+{
+    const ImageBuf& src(*m_impl->m_src);
+    m_impl->m_write_err.clear();
+    if (has_error())
+        return false;
+    if (filename == src.name()) {
+        // Writing over the file being streamed in would clobber pixels
+        // not yet read; compute the whole image first.
+        ImageBuf result = eval(ROI(), nthreads);
+        if (result.has_error()
+            || !result.write(filename, dtype, fileformat)) {
+            m_impl->m_write_err = result.geterror();
+            return false;
+        }
+        return true;
+    }
+    // As ImageBuf::write() does, make sure no ImageCache holds stale
+    // pixels (or an open handle) for the file we're about to write.
+    ustring ufilename(filename);
+    ImageCache::create(true)->invalidate(ufilename);
+    if (src.imagecache())
+        src.imagecache()->invalidate(ufilename);
+
+    auto out = ImageOutput::create(fileformat.size() ? fileformat : filename);
+    if (!out) {
+        m_impl->m_write_err = OIIO::geterror();
+        return false;
+    }
+    // Scanlines, in the source's native data format unless dtype says
+    // otherwise, as ImageBuf::write() would do.
+    ImageSpec spec  = m_impl->m_spec;
+    spec.tile_width = spec.tile_height = spec.tile_depth = 0;
+    if (dtype != TypeUnknown) {
+        spec.set_format(dtype);
+        spec.channelformats.clear();
+    } else {
+        spec.set_format(src.nativespec().format);
+        spec.channelformats = src.nativespec().channelformats;
+    }
+    if (!out->open(filename, spec)) {
+        m_impl->m_write_err = out->geterror();
+        return false;
+    }
+    bool ok = write(out.get(), nthreads);
+    if (!out->close() && ok) {
+        m_impl->m_write_err = out->geterror();
+        ok = false;
+    }
+    return ok;
+}
+
+
+OIIO_NAMESPACE_END
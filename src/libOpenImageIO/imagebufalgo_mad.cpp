@@ -37,11 +37,13 @@
 #include <cmath>
 #include <iostream>
 #include <limits>
+#include <vector>
 
 #include <OpenImageIO/dassert.h>
 #include <OpenImageIO/imagebuf.h>
 #include <OpenImageIO/imagebufalgo.h>
 #include <OpenImageIO/imagebufalgo_util.h>
+#include <OpenImageIO/simd.h>
 
 #include "imageio_pvt.h"
 
@@ -50,62 +52,42 @@ OIIO_NAMESPACE_BEGIN
 
 
 
+// Row kernel for the contiguous_rows() fast paths: r[i] = a[i]*b[i] + c[i]
+static void
+mad_row(float* r, const float* a, const float* b, const float* c, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        simd::vfloat4 a_simd(a + i), b_simd(b + i), c_simd(c + i);
+        (a_simd * b_simd + c_simd).store(r + i);
+    }
+    for (; i < n; ++i)
+        r[i] = a[i] * b[i] + c[i];
+}
+
+
+
 template<class Rtype, class ABCtype>
 static bool
 mad_impl(ImageBuf& R, const ImageBuf& A, const ImageBuf& B, const ImageBuf& C,
          ROI roi, int nthreads)
 {
     ImageBufAlgo::parallel_image(roi, nthreads, [&](ROI roi) {
-        if ((is_same<Rtype, float>::value || is_same<Rtype, half>::value)
-            && (is_same<ABCtype, float>::value || is_same<ABCtype, half>::value)
-            // && R.localpixels() // has to be, because it's writeable
-            && A.localpixels() && B.localpixels()
-            && C.localpixels()
-            // && R.contains_roi(roi)  // has to be, because IBAPrep
-            && A.contains_roi(roi) && B.contains_roi(roi) && C.contains_roi(roi)
-            && roi.chbegin == 0 && roi.chend == R.nchannels()
-            && roi.chend == A.nchannels() && roi.chend == B.nchannels()
-            && roi.chend == C.nchannels()) {
-            // Special case when all inputs are either float or half, with in-
-            // memory contiguous data and we're operating on the full channel
-            // range: skip iterators: For these circumstances, we can operate on
-            // the raw memory very efficiently. Otherwise, we will need the
-            // magic of the the Iterators (and pay the price).
-            int nxvalues = roi.width() * R.nchannels();
-            for (int z = roi.zbegin; z < roi.zend; ++z)
-                for (int y = roi.ybegin; y < roi.yend; ++y) {
-                    Rtype* rraw = (Rtype*)R.pixeladdr(roi.xbegin, y, z);
-                    const ABCtype* araw
-                        = (const ABCtype*)A.pixeladdr(roi.xbegin, y, z);
-                    const ABCtype* braw
-                        = (const ABCtype*)B.pixeladdr(roi.xbegin, y, z);
-                    const ABCtype* craw
-                        = (const ABCtype*)C.pixeladdr(roi.xbegin, y, z);
-                    DASSERT(araw && braw && craw);
-                    // The straightforward loop auto-vectorizes very well,
-                    // there's no benefit to using explicit SIMD here.
-                    for (int x = 0; x < nxvalues; ++x)
-                        rraw[x] = araw[x] * braw[x] + craw[x];
-                    // But if you did want to explicitly vectorize, this is
-                    // how it would look:
-                    // int simdend = nxvalues & (~3); // how many float4's?
-                    // for (int x = 0; x < simdend; x += 4) {
-                    //     simd::float4 a_simd(araw+x), b_simd(braw+x), c_simd(craw+x);
-                    //     simd::float4 r_simd = a_simd * b_simd + c_simd;
-                    //     r_simd.store (rraw+x);
-                    // }
-                    // for (int x = simdend; x < nxvalues; ++x)
-                    //     rraw[x] = araw[x] * braw[x] + craw[x];
-                }
-        } else {
-            ImageBuf::Iterator<Rtype> r(R, roi);
-            ImageBuf::ConstIterator<ABCtype> a(A, roi);
-            ImageBuf::ConstIterator<ABCtype> b(B, roi);
-            ImageBuf::ConstIterator<ABCtype> c(C, roi);
-            for (; !r.done(); ++r, ++a, ++b, ++c) {
-                for (int ch = roi.chbegin; ch < roi.chend; ++ch)
-                    r[ch] = a[ch] * b[ch] + c[ch];
-            }
+        if (ImageBufAlgo::contiguous_rows(roi, R, A, B, C)) {
+            // Skip the iterators and operate on the raw rows, converted
+            // to float only if they aren't float already.
+            ImageBufAlgo::contiguous_rows_apply<Rtype, ABCtype, ABCtype,
+                                                ABCtype>(R, A, B, C, roi,
+                                                         mad_row);
+            return;
+        }
+        ImageBuf::Iterator<Rtype> r(R, roi);
+        ImageBuf::ConstIterator<ABCtype> a(A, roi);
+        ImageBuf::ConstIterator<ABCtype> b(B, roi);
+        ImageBuf::ConstIterator<ABCtype> c(C, roi);
+        for (; !r.done(); ++r, ++a, ++b, ++c) {
+            for (int ch = roi.chbegin; ch < roi.chend; ++ch)
+                r[ch] = a[ch] * b[ch] + c[ch];
         }
     });
     return true;
@@ -119,6 +101,16 @@ mad_impl_ici(ImageBuf& R, const ImageBuf& A, cspan<float> b, const ImageBuf& C,
              ROI roi, int nthreads)
 {
     ImageBufAlgo::parallel_image(roi, nthreads, [&](ROI roi) {
+        if (ImageBufAlgo::contiguous_rows(roi, R, A, C)) {
+            std::vector<float> brow
+                = ImageBufAlgo::constant_row(b, R.nchannels(), roi.width());
+            ImageBufAlgo::contiguous_rows_apply<Rtype, ABCtype, ABCtype>(
+                R, A, C, roi,
+                [&](float* r, const float* a, const float* c, size_t n) {
+                    mad_row(r, a, brow.data(), c, n);
+                });
+            return;
+        }
         ImageBuf::Iterator<Rtype> r(R, roi);
         ImageBuf::ConstIterator<ABCtype> a(A, roi);
         ImageBuf::ConstIterator<ABCtype> c(C, roi);
@@ -138,6 +130,16 @@ mad_impl_icc(ImageBuf& R, const ImageBuf& A, cspan<float> b, cspan<float> c,
              ROI roi, int nthreads)
 {
     ImageBufAlgo::parallel_image(roi, nthreads, [&](ROI roi) {
+        if (ImageBufAlgo::contiguous_rows(roi, R, A)) {
+            int nc = R.nchannels(), w = roi.width();
+            std::vector<float> brow = ImageBufAlgo::constant_row(b, nc, w);
+            std::vector<float> crow = ImageBufAlgo::constant_row(c, nc, w);
+            ImageBufAlgo::contiguous_rows_apply<Rtype, Atype>(
+                R, A, roi, [&](float* r, const float* a, size_t n) {
+                    mad_row(r, a, brow.data(), crow.data(), n);
+                });
+            return;
+        }
         ImageBuf::Iterator<Rtype> r(R, roi);
         ImageBuf::ConstIterator<Atype> a(A, roi);
         for (; !r.done(); ++r, ++a)
@@ -155,6 +157,16 @@ mad_impl_iic(ImageBuf& R, const ImageBuf& A, const ImageBuf& B, cspan<float> c,
              ROI roi, int nthreads)
 {
     ImageBufAlgo::parallel_image(roi, nthreads, [&](ROI roi) {
+        if (ImageBufAlgo::contiguous_rows(roi, R, A, B)) {
+            std::vector<float> crow
+                = ImageBufAlgo::constant_row(c, R.nchannels(), roi.width());
+            ImageBufAlgo::contiguous_rows_apply<Rtype, Atype, Atype>(
+                R, A, B, roi,
+                [&](float* r, const float* a, const float* b, size_t n) {
+                    mad_row(r, a, b, crow.data(), n);
+                });
+            return;
+        }
         ImageBuf::Iterator<Rtype> r(R, roi);
         ImageBuf::ConstIterator<Atype> a(A, roi);
         ImageBuf::ConstIterator<Atype> b(B, roi);
@@ -37,6 +37,7 @@
 #include <cmath>
 #include <iostream>
 #include <limits>
+#include <vector>
 
 #include <OpenImageIO/color.h>
 #include <OpenImageIO/dassert.h>
@@ -58,12 +59,33 @@ clamp_(ImageBuf& dst, const ImageBuf& src, const float* min, const float* max,
        bool clampalpha01, ROI roi, int nthreads)
 {
     ImageBufAlgo::parallel_image(roi, nthreads, [&](ROI roi) {
+        int nc = dst.nchannels(), a = src.spec().alpha_channel;
+        if (ImageBufAlgo::contiguous_rows(roi, dst, src)) {
+            std::vector<float> lo, hi;
+            lo = ImageBufAlgo::constant_row({ min, nc }, nc, roi.width());
+            hi = ImageBufAlgo::constant_row({ max, nc }, nc, roi.width());
+            bool alpha01 = clampalpha01 && a >= 0 && a < nc;
+            ImageBufAlgo::contiguous_rows_apply<D, S>(
+                dst, src, roi, [&](float* r, const float* s, size_t n) {
+                    using namespace simd;
+                    size_t i = 0;
+                    for (; i + 4 <= n; i += 4) {
+                        // Same NaN handling as the scalar OIIO::clamp
+                        vfloat4 v(s + i), l(&lo[i]), h(&hi[i]);
+                        select(v >= l, select(v <= h, v, h), l).store(r + i);
+                    }
+                    for (; i < n; ++i)
+                        r[i] = OIIO::clamp(s[i], lo[i], hi[i]);
+                    for (i = a; alpha01 && i < n; i += nc)
+                        r[i] = OIIO::clamp(r[i], 0.0f, 1.0f);
+                });
+            return;
+        }
         ImageBuf::ConstIterator<S> s(src, roi);
         for (ImageBuf::Iterator<D> d(dst, roi); !d.done(); ++d, ++s) {
             for (int c = roi.chbegin; c < roi.chend; ++c)
                 d[c] = OIIO::clamp<float>(s[c], min[c], max[c]);
         }
-        int a = src.spec().alpha_channel;
         if (clampalpha01 && a >= roi.chbegin && a < roi.chend) {
             for (ImageBuf::Iterator<D> d(dst, roi); !d.done(); ++d)
                 d[a] = OIIO::clamp<float>(d[a], 0.0f, 1.0f);
@@ -648,6 +670,30 @@ premult_(ImageBuf& R, const ImageBuf& A, ROI roi, int nthreads)
     ImageBufAlgo::parallel_image(roi, nthreads, [&](ROI roi) {
         int alpha_channel = A.spec().alpha_channel;
         int z_channel     = A.spec().z_channel;
+        int nc            = R.nchannels();
+        if (ImageBufAlgo::contiguous_rows(roi, R, A)) {
+            ImageBufAlgo::contiguous_rows_apply<Rtype, Atype>(
+                R, A, roi, [&](float* r, const float* a, size_t n) {
+                    if (nc == 4 && alpha_channel == 3 && z_channel < 0) {
+                        // RGBA: one SIMD multiply per pixel
+                        for (size_t i = 0; i < n; i += 4) {
+                            simd::vfloat4 p(a + i);
+                            float alpha = a[i + 3];
+                            (p * simd::shuffle<3>(p)).store(r + i);
+                            r[i + 3] = alpha;
+                        }
+                        return;
+                    }
+                    for (size_t i = 0; i < n; i += nc) {
+                        float alpha = a[i + alpha_channel];
+                        for (int c = 0; c < nc; ++c)
+                            r[i + c] = (c != alpha_channel && c != z_channel)
+                                           ? a[i + c] * alpha
+                                           : a[i + c];
+                    }
+                });
+            return;
+        }
         if (&R == &A) {
             for (ImageBuf::Iterator<Rtype> r(R, roi); !r.done(); ++r) {
                 float alpha = r[alpha_channel];
@@ -1272,6 +1318,39 @@ over_impl(ImageBuf& R, const ImageBuf& A, const ImageBuf& B, bool zcomp,
     bool has_z = (z_channel >= 0);
 
     ImageBufAlgo::parallel_image(roi, nthreads, [=, &R, &A, &B](ROI roi) {
+        if ((!zcomp || !has_z) && ImageBufAlgo::contiguous_rows(roi, R, A, B)) {
+            // Plain A over B on contiguous rows. Use SIMD for the common
+            // RGBA case.
+            ImageBufAlgo::contiguous_rows_apply<Rtype, Atype, Btype>(
+                R, A, B, roi,
+                [&](float* r, const float* a, const float* b, size_t n) {
+                    using namespace simd;
+                    if (nchannels == 4 && alpha_channel == 3 && !has_z) {
+                        vfloat4 zero = vfloat4::Zero();
+                        vfloat4 one  = vfloat4::One();
+                        for (size_t i = 0; i < n; i += 4) {
+                            vfloat4 a_simd(a + i), b_simd(b + i);
+                            vfloat4 alpha = clamp(shuffle<3>(a_simd), zero,
+                                                  one);
+                            (a_simd + (one - alpha) * b_simd).store(r + i);
+                        }
+                        return;
+                    }
+                    for (size_t i = 0; i < n; i += nchannels) {
+                        float alpha = clamp(a[i + alpha_channel], 0.0f, 1.0f);
+                        float one_minus_alpha = 1.0f - alpha;
+                        float z = 0.0f;
+                        if (has_z)
+                            z = (alpha != 0.0f) ? a[i + z_channel]
+                                                : b[i + z_channel];
+                        for (int c = 0; c < nchannels; ++c)
+                            r[i + c] = a[i + c] + one_minus_alpha * b[i + c];
+                        if (has_z)
+                            r[i + z_channel] = z;
+                    }
+                });
+            return;
+        }
         ImageBuf::ConstIterator<Atype> a(A, roi);
         ImageBuf::ConstIterator<Btype> b(B, roi);
         ImageBuf::Iterator<Rtype> r(R, roi);
@@ -1313,44 +1392,6 @@ over_impl(ImageBuf& R, const ImageBuf& A, const ImageBuf& B, bool zcomp,
 
 
 
-// Special case -- 4 channel RGBA float, in-memory buffer, no wrapping.
-// Use loops and SIMD.
-static bool
-over_impl_rgbafloat(ImageBuf& R, const ImageBuf& A, const ImageBuf& B, ROI roi,
-                    int nthreads)
-{
-    using namespace simd;
-    ASSERT(A.localpixels() && B.localpixels() && A.spec().format == TypeFloat
-           && A.nchannels() == 4 && B.spec().format == TypeFloat
-           && B.nchannels() == 4 && A.spec().alpha_channel == 3
-           && A.spec().z_channel < 0 && B.spec().alpha_channel == 3
-           && B.spec().z_channel < 0);
-    // const int nchannels = 4, alpha_channel = 3;
-    ImageBufAlgo::parallel_image(roi, nthreads, [=, &R, &A, &B](ROI roi) {
-        vfloat4 zero = vfloat4::Zero();
-        vfloat4 one  = vfloat4::One();
-        int w        = roi.width();
-        for (int z = roi.zbegin; z < roi.zend; ++z) {
-            for (int y = roi.ybegin; y < roi.yend; ++y) {
-                float* r       = (float*)R.pixeladdr(roi.xbegin, y, z);
-                const float* a = (const float*)A.pixeladdr(roi.xbegin, y, z);
-                const float* b = (const float*)B.pixeladdr(roi.xbegin, y, z);
-                for (int x = 0; x < w; ++x, r += 4, a += 4, b += 4) {
-                    vfloat4 a_simd(a);
-                    vfloat4 b_simd(b);
-                    vfloat4 alpha           = shuffle<3>(a_simd);
-                    vfloat4 one_minus_alpha = one - clamp(alpha, zero, one);
-                    vfloat4 result          = a_simd + one_minus_alpha * b_simd;
-                    result.store(r);
-                }
-            }
-        }
-    });
-    return true;
-}
-
-
-
 bool
 ImageBufAlgo::over(ImageBuf& dst, const ImageBuf& A, const ImageBuf& B, ROI roi,
                    int nthreads)
@@ -1360,19 +1401,6 @@ ImageBufAlgo::over(ImageBuf& dst, const ImageBuf& A, const ImageBuf& B, ROI roi,
                  IBAprep_REQUIRE_ALPHA | IBAprep_REQUIRE_SAME_NCHANNELS))
         return false;
 
-    if (A.localpixels() && B.localpixels() && A.spec().format == TypeFloat
-        && A.nchannels() == 4 && B.spec().format == TypeFloat
-        && B.nchannels() == 4 && A.spec().alpha_channel == 3
-        && A.spec().z_channel < 0 && B.spec().alpha_channel == 3
-        && B.spec().z_channel < 0 && A.roi().contains(roi)
-        && B.roi().contains(roi) && roi.chbegin == 0 && roi.chend == 4) {
-        // Easy case -- both buffers are float, 4 channels, alpha is
-        // channel[3], no special z channel, and pixel data windows
-        // completely cover the roi. This reduces to a simpler case we can
-        // handle without iterators and taking advantage of SIMD.
-        return over_impl_rgbafloat(dst, A, B, roi, nthreads);
-    }
-
     bool ok;
     OIIO_DISPATCH_COMMON_TYPES3(ok, "over", over_impl, dst.spec().format,
                                 A.spec().format, B.spec().format, dst, A, B,
@@ -0,0 +1,159 @@
+/*
+  Copyright 2019 Larry Gritz and the other authors and contributors.
+  All Rights Reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+  * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+  * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+  * Neither the name of the software's owners nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  (This is the Modified BSD License)
+*/
+
+
+//
+// Benchmark the ImageBufAlgo per-pixel operations that have direct row
+// fast paths for in-memory images (see contiguous_rows() in
+// imagebufalgo_util.h): add, sub, mul, mad, over, channels, copy, clamp,
+// premult. Run it on builds before and after a change to compare, or use
+// --offset-b to force the general iterator path for comparison.
+//
+
+
+#include <iostream>
+
+#include <OpenImageIO/argparse.h>
+#include <OpenImageIO/benchmark.h>
+#include <OpenImageIO/imagebuf.h>
+#include <OpenImageIO/imagebufalgo.h>
+#include <OpenImageIO/strutil.h>
+#include <OpenImageIO/sysutil.h>
+#include <OpenImageIO/unittest.h>
+
+using namespace OIIO;
+
+static int iterations = 10;
+static int numthreads = Sysutil::hardware_concurrency();
+static int ntrials    = 5;
+static int xres = 1920, yres = 1080;
+static int offsetb = 0;
+static std::string typenames = "float,half,uint8";
+
+
+
+static void
+getargs(int argc, char* argv[])
+{
+    bool help = false;
+    ArgParse ap;
+    // clang-format off
+    ap.options(
+        "imagebufalgo_speed_test\n" OIIO_INTRO_STRING "\n"
+        "Usage:  imagebufalgo_speed_test [options]",
+        "--help", &help, "Print help message",
+        "--threads %d", &numthreads,
+            ustring::sprintf("Number of threads (default: %d)", numthreads).c_str(),
+        "--iterations %d", &iterations,
+            ustring::sprintf("Number of iterations (default: %d)", iterations).c_str(),
+        "--trials %d", &ntrials, "Number of trials",
+        "--res %d %d", &xres, &yres, "Resolution of the test images",
+        "--types %s", &typenames, "Comma-separated pixel types to test",
+        "--offset-b %d", &offsetb,
+            "Offset the data window of the second input by this many "
+            "pixels (forces the iterator path)",
+        nullptr);
+    // clang-format on
+    if (ap.parse(argc, (const char**)argv) < 0) {
+        std::cerr << ap.geterror() << std::endl;
+        ap.usage();
+        exit(EXIT_FAILURE);
+    }
+    if (help) {
+        ap.usage();
+        exit(EXIT_FAILURE);
+    }
+}
+
+
+
+static void
+time_ops(TypeDesc type, int nthreads)
+{
+    std::cout << "\n" << type << " RGBA " << xres << "x" << yres << ", "
+              << nthreads << " thread" << (nthreads == 1 ? "" : "s") << ":\n";
+    ImageSpec spec(xres, yres, 4, type);
+    spec.alpha_channel = 3;
+    ImageBuf A(spec), B(spec), C(spec), R(spec), S;
+    ImageBufAlgo::zero(A);
+    ImageBufAlgo::noise(A, "uniform", 0.0f, 1.0f);
+    ImageBufAlgo::copy(B, A);
+    ImageBufAlgo::copy(C, A);
+
+    // Shifting B's data window means the ROI is no longer inside it, so
+    // every operation involving B has to take the iterator path.
+    ROI roi = A.roi();
+    if (offsetb > 0) {
+        ImageSpec bspec = spec;
+        bspec.x         = offsetb;
+        B.reset(bspec);
+        ImageBufAlgo::zero(B);
+        ImageBufAlgo::noise(B, "uniform", 0.0f, 1.0f);
+    }
+
+    Benchmarker bench;
+    bench.iterations(iterations);
+    bench.trials(ntrials);
+    bench.work(size_t(xres) * yres);
+    bench.units(Benchmarker::Unit::ms);
+
+    const float lo[] = { 0.1f, 0.1f, 0.1f, 0.1f };
+    const float hi[] = { 0.9f, 0.9f, 0.9f, 0.9f };
+    const int order[] = { 2, 1, 0, 3 };
+    bench("  add", [&]() { ImageBufAlgo::add(R, A, B, roi, nthreads); });
+    bench("  add const",
+          [&]() { ImageBufAlgo::add(R, A, hi, roi, nthreads); });
+    bench("  sub", [&]() { ImageBufAlgo::sub(R, A, B, roi, nthreads); });
+    bench("  mul", [&]() { ImageBufAlgo::mul(R, A, B, roi, nthreads); });
+    bench("  mul const",
+          [&]() { ImageBufAlgo::mul(R, A, hi, roi, nthreads); });
+    bench("  mad", [&]() { ImageBufAlgo::mad(R, A, B, C, roi, nthreads); });
+    bench("  over", [&]() { ImageBufAlgo::over(R, A, B, roi, nthreads); });
+    bench("  channels", [&]() {
+        ImageBufAlgo::channels(S, A, 4, order, {}, {}, false, nthreads);
+    });
+    bench("  copy", [&]() { ImageBufAlgo::copy(R, A, type, roi, nthreads); });
+    bench("  clamp",
+          [&]() { ImageBufAlgo::clamp(R, A, lo, hi, false, roi, nthreads); });
+    bench("  premult",
+          [&]() { ImageBufAlgo::premult(R, A, roi, nthreads); });
+}
+
+
+
+int
+main(int argc, char* argv[])
+{
+    getargs(argc, argv);
+    for (auto t : Strutil::splits(typenames, ","))
+        for (int nt : { 1, numthreads })
+            time_ops(TypeDesc(t), nt);
+    return unit_test_failures;
+}
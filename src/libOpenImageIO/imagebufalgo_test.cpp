@@ -29,9 +29,13 @@
 */
 
 
+#include <algorithm>
+#include <atomic>
 #include <cstdio>
+#include <functional>
 #include <iomanip>
 #include <iostream>
+#include <sstream>
 #include <string>
 
 #if USE_OPENCV
@@ -40,9 +44,12 @@
 
 #include <OpenImageIO/argparse.h>
 #include <OpenImageIO/benchmark.h>
+#include <OpenImageIO/filesystem.h>
+#include <OpenImageIO/filter.h>
 #include <OpenImageIO/imagebuf.h>
 #include <OpenImageIO/imagebufalgo.h>
 #include <OpenImageIO/imagebufalgo_util.h>
+#include <OpenImageIO/imagecache.h>
 #include <OpenImageIO/imageio.h>
 #include <OpenImageIO/timer.h>
 #include <OpenImageIO/unittest.h>
@@ -615,6 +622,34 @@ test_compare()
     OIIO_CHECK_EQUAL(comp.maxx, 9);
     OIIO_CHECK_EQUAL(comp.maxy, 0);
     OIIO_CHECK_EQUAL_THRESH(comp.meanerror, 0.0045, 1.0e-8);
+
+    // Compare and compute stats at once, with B's data window smaller
+    // than A's, and check against separate calls.
+    ImageBuf C;
+    ImageBufAlgo::crop(C, B, ROI(2, 7, 1, 9));
+    ImageBufAlgo::PixelStats Astats, Cstats;
+    ImageBufAlgo::CompareResults comp2;
+    comp  = ImageBufAlgo::compare(A, C, failthresh, warnthresh);
+    comp2 = ImageBufAlgo::compare(A, C, failthresh, warnthresh, Astats,
+                                  Cstats);
+    OIIO_CHECK_EQUAL(comp2.nfail, comp.nfail);
+    OIIO_CHECK_EQUAL(comp2.nwarn, comp.nwarn);
+    OIIO_CHECK_EQUAL(comp2.maxerror, comp.maxerror);
+    OIIO_CHECK_EQUAL(comp2.maxx, comp.maxx);
+    OIIO_CHECK_EQUAL(comp2.maxy, comp.maxy);
+    OIIO_CHECK_EQUAL_THRESH(comp2.meanerror, comp.meanerror, 1.0e-8);
+    ImageBufAlgo::PixelStats Aref = ImageBufAlgo::computePixelStats(A);
+    ImageBufAlgo::PixelStats Cref = ImageBufAlgo::computePixelStats(C);
+    for (int c = 0; c < CHANNELS; ++c) {
+        OIIO_CHECK_EQUAL(Astats.min[c], Aref.min[c]);
+        OIIO_CHECK_EQUAL(Astats.max[c], Aref.max[c]);
+        OIIO_CHECK_EQUAL_THRESH(Astats.avg[c], Aref.avg[c], 1.0e-6);
+        OIIO_CHECK_EQUAL(Astats.finitecount[c], Aref.finitecount[c]);
+        OIIO_CHECK_EQUAL(Cstats.min[c], Cref.min[c]);
+        OIIO_CHECK_EQUAL(Cstats.max[c], Cref.max[c]);
+        OIIO_CHECK_EQUAL_THRESH(Cstats.avg[c], Cref.avg[c], 1.0e-6);
+        OIIO_CHECK_EQUAL(Cstats.finitecount[c], 5 * 8);
+    }
 }
 
 
@@ -736,6 +771,48 @@ test_computePixelStats()
         OIIO_CHECK_EQUAL(stats.infcount[c], 0);
         OIIO_CHECK_EQUAL(stats.finitecount[c], 4);
     }
+
+    // A width that doesn't fill whole SIMD groups, an odd number of
+    // channels, and some NaN and Inf values, checked against stats
+    // accumulated one value at a time.
+    const int w = 11, h = 5, nc = 5;
+    ImageBuf big(ImageSpec(w, h, nc, TypeDesc::FLOAT));
+    std::vector<float> vmin(nc, 1e30f), vmax(nc, -1e30f);
+    std::vector<double> vsum(nc, 0.0);
+    std::vector<int> nfinite(nc, 0), nnan(nc, 0), ninf(nc, 0);
+    for (int y = 0; y < h; ++y) {
+        for (int x = 0; x < w; ++x) {
+            float pixel[nc];
+            for (int c = 0; c < nc; ++c) {
+                float v = 0.25f * x - 0.5f * y + c;
+                if ((x + y + c) % 13 == 0)
+                    v = std::numeric_limits<float>::quiet_NaN();
+                else if ((x * y + c) % 17 == 3)
+                    v = -std::numeric_limits<float>::infinity();
+                pixel[c] = v;
+                if (std::isnan(v)) {
+                    ++nnan[c];
+                } else if (std::isinf(v)) {
+                    ++ninf[c];
+                } else {
+                    ++nfinite[c];
+                    vsum[c] += v;
+                    vmin[c] = std::min(vmin[c], v);
+                    vmax[c] = std::max(vmax[c], v);
+                }
+            }
+            big.setpixel(x, y, pixel);
+        }
+    }
+    stats = ImageBufAlgo::computePixelStats(big);
+    for (int c = 0; c < nc; ++c) {
+        OIIO_CHECK_EQUAL(stats.min[c], vmin[c]);
+        OIIO_CHECK_EQUAL(stats.max[c], vmax[c]);
+        OIIO_CHECK_EQUAL_THRESH(stats.avg[c], vsum[c] / nfinite[c], 1e-5);
+        OIIO_CHECK_EQUAL(stats.nancount[c], (imagesize_t)nnan[c]);
+        OIIO_CHECK_EQUAL(stats.infcount[c], (imagesize_t)ninf[c]);
+        OIIO_CHECK_EQUAL(stats.finitecount[c], (imagesize_t)nfinite[c]);
+    }
 }
 
 
@@ -820,6 +897,609 @@ test_maketx_from_imagebuf()
 
 
 
+// Test that update mode's record of the source file's hash survives a
+// round trip through a TIFF texture (which keeps it in the
+// ImageDescription), is not mistaken for the pixel hash, and lets a
+// merely touched source skip the rebuild.
+void
+test_maketx_updatemode()
+{
+    std::cout << "test make_texture update mode\n";
+    const int WIDTH = 16, HEIGHT = 16, CHANNELS = 3;
+    ImageBuf A(ImageSpec(WIDTH, HEIGHT, CHANNELS, TypeDesc::UINT8));
+    float pink[] = { 0.5f, 0.3f, 0.3f }, green[] = { 0.1f, 0.5f, 0.1f };
+    ImageBufAlgo::checker(A, 4, 4, 4, pink, green);
+    const char* srcname = "oiio-update-src.tif";
+    const char* txname  = "oiio-update.tx";
+    A.write(srcname);
+
+    for (int hash : { 1, 0 }) {
+        remove(txname);
+        ImageSpec configspec;
+        configspec.attribute("maketx:updatemode", 1);
+        configspec.attribute("maketx:hash", hash);
+        configspec.attribute("maketx:full_command_line",
+                             "maketx -u oiio-update-src.tif");
+        configspec.attribute("Software", "maketx -u oiio-update-src.tif");
+        bool ok = ImageBufAlgo::make_texture(ImageBufAlgo::MakeTxTexture,
+                                             srcname, txname, configspec);
+        OIIO_CHECK_ASSERT(ok);
+
+        auto in = ImageInput::open(txname);
+        OIIO_CHECK_ASSERT(in);
+        if (!in)
+            continue;
+        ImageSpec spec = in->spec();
+        in.reset();
+        std::string desc = spec.get_string_attribute("ImageDescription");
+        size_t pos       = desc.find("oiio:SourceSHA-1=");
+        OIIO_CHECK_ASSERT(pos != std::string::npos);
+        std::string sourcehash = desc.substr(pos + 17, 40);
+        OIIO_CHECK_EQUAL(sourcehash.size(), 40);
+        std::string pixelhash = spec.get_string_attribute("oiio:SHA-1");
+        if (hash) {
+            OIIO_CHECK_EQUAL(pixelhash.size(), 40);
+            OIIO_CHECK_NE(pixelhash, sourcehash);
+        } else {
+            OIIO_CHECK_EQUAL(pixelhash, "");
+        }
+
+        // Touch the source: the recorded hash should show it's unchanged.
+        Filesystem::last_write_time(srcname,
+                                    Filesystem::last_write_time(srcname)
+                                        + 10);
+        std::ostringstream out;
+        ok = ImageBufAlgo::make_texture(ImageBufAlgo::MakeTxTexture, srcname,
+                                        txname, configspec, &out);
+        OIIO_CHECK_ASSERT(ok);
+        OIIO_CHECK_ASSERT(out.str().find("no update required")
+                          != std::string::npos);
+    }
+    remove(srcname);  // clean up
+    remove(txname);
+}
+
+
+
+// Brute force reference for a resize with a separable filter: the full
+// 2D window of normalized x and y weights around each output pixel, with
+// source lookups clamped to the data window.
+static void
+resize_reference(ImageBuf& dst, const ImageBuf& src, Filter2D* filter)
+{
+    const ImageSpec &srcspec(src.spec()), &dstspec(dst.spec());
+    int nc       = srcspec.nchannels;
+    float xratio = float(dstspec.full_width) / float(srcspec.full_width);
+    float yratio = float(dstspec.full_height) / float(srcspec.full_height);
+    int radi     = (int)ceilf(filter->width() / 2.0f / xratio);
+    int radj     = (int)ceilf(filter->width() / 2.0f / yratio);
+    std::vector<float> wx(2 * radi + 1), wy(2 * radj + 1), pel(nc), sp(nc);
+    for (ImageBuf::Iterator<float> out(dst); !out.done(); ++out) {
+        float src_xf = (out.x() + 0.5f) / dstspec.full_width
+                       * srcspec.full_width;
+        float src_yf = (out.y() + 0.5f) / dstspec.full_height
+                       * srcspec.full_height;
+        int src_x = (int)floorf(src_xf), src_y = (int)floorf(src_yf);
+        float xfrac = src_xf - src_x, yfrac = src_yf - src_y;
+        float totx = 0.0f, toty = 0.0f;
+        for (int i = 0; i <= 2 * radi; ++i) {
+            wx[i] = filter->xfilt(xratio * (i - radi - (xfrac - 0.5f)));
+            totx += wx[i];
+        }
+        for (int j = 0; j <= 2 * radj; ++j) {
+            wy[j] = filter->yfilt(yratio * (j - radj - (yfrac - 0.5f)));
+            toty += wy[j];
+        }
+        std::fill(pel.begin(), pel.end(), 0.0f);
+        for (int j = 0; j <= 2 * radj; ++j) {
+            for (int i = 0; i <= 2 * radi; ++i) {
+                int x = clamp(src_x - radi + i, 0, srcspec.width - 1);
+                int y = clamp(src_y - radj + j, 0, srcspec.height - 1);
+                src.getpixel(x, y, &sp[0]);
+                for (int c = 0; c < nc; ++c)
+                    pel[c] += (wx[i] / totx) * (wy[j] / toty) * sp[c];
+            }
+        }
+        for (int c = 0; c < nc; ++c)
+            out[c] = pel[c];
+    }
+}
+
+
+
+// Test ImageBufAlgo::resize with separable filters against a brute force
+// 2D filter evaluation, for both downsizing and upsizing.
+void
+test_resize()
+{
+    std::cout << "test resize\n";
+    for (int nc : { 1, 3, 4, 5 }) {
+        ImageBuf src(ImageSpec(37, 29, nc, TypeDesc::FLOAT));
+        for (ImageBuf::Iterator<float> p(src); !p.done(); ++p)
+            for (int c = 0; c < nc; ++c)
+                p[c] = 0.5f + 0.5f * sinf(0.7f * p.x() + 1.3f * p.y() + c);
+        struct {
+            const char* filter;
+            int w, h;
+        } cases[] = { { "lanczos3", 11, 9 }, { "blackman-harris", 50, 41 } };
+        for (auto& t : cases) {
+            float xr = float(t.w) / 37, yr = float(t.h) / 29;
+            Filter2D* filter = Filter2D::create(t.filter,
+                                                3.0f * std::max(1.0f, xr),
+                                                3.0f * std::max(1.0f, yr));
+            OIIO_CHECK_ASSERT(filter->separable());
+            ImageBuf A(ImageSpec(t.w, t.h, nc, TypeDesc::FLOAT));
+            ImageBuf B(ImageSpec(t.w, t.h, nc, TypeDesc::FLOAT));
+            ImageBufAlgo::resize(A, src, filter);
+            resize_reference(B, src, filter);
+            auto comp = ImageBufAlgo::compare(A, B, 1.0e-5f, 1.0e-5f);
+            OIIO_CHECK_EQUAL(comp.nfail, 0);
+            Filter2D::destroy(filter);
+        }
+    }
+}
+
+
+
+// Brute force reference for convolve, clamping at the edges.
+static void
+convolve_reference(ImageBuf& dst, const ImageBuf& src, const ImageBuf& K,
+                   bool normalize)
+{
+    int nc = src.nchannels();
+    std::vector<float> pel(nc), sp(nc);
+    float ksum = 0.0f;
+    for (ImageBuf::ConstIterator<float> k(K); !k.done(); ++k)
+        ksum += k[0];
+    if (!normalize)
+        ksum = 1.0f;
+    for (ImageBuf::Iterator<float> out(dst); !out.done(); ++out) {
+        std::fill(pel.begin(), pel.end(), 0.0f);
+        for (ImageBuf::ConstIterator<float> k(K); !k.done(); ++k) {
+            int x = clamp(out.x() + k.x(), src.xbegin(), src.xend() - 1);
+            int y = clamp(out.y() + k.y(), src.ybegin(), src.yend() - 1);
+            src.getpixel(x, y, &sp[0]);
+            for (int c = 0; c < nc; ++c)
+                pel[c] += k[0] * sp[c];
+        }
+        for (int c = 0; c < nc; ++c)
+            out[c] = pel[c] / ksum;
+    }
+}
+
+
+
+// The affine warp fast path should match the general per-pixel path, which
+// a negligible perspective term in the matrix forces.
+void
+test_warp()
+{
+    std::cout << "test warp\n";
+    for (int nc : { 1, 4, 5 }) {
+        ImageSpec spec(53, 41, nc, TypeDesc::FLOAT);
+        spec.x = 3;
+        spec.y = -2;
+        ImageBuf src(spec);
+        ImageBufAlgo::zero(src);
+        ImageBufAlgo::noise(src, "uniform", 0.0f, 1.0f, false, nc);
+        Imath::M33f M;
+        M.setTranslation(Imath::V2f(-30.0f, -19.0f));
+        M *= Imath::M33f().setRotation(0.3f);
+        M *= Imath::M33f().setScale(Imath::V2f(0.8f, 1.3f));
+        M *= Imath::M33f().setTranslation(Imath::V2f(32.0f, 17.0f));
+        Imath::M33f Mpersp(M);
+        Mpersp[0][2] = 1.0e-9f;
+        for (auto filtername : { "lanczos3", "box", "gaussian" }) {
+            for (auto wrap : { ImageBuf::WrapBlack, ImageBuf::WrapPeriodic }) {
+                ImageBuf A = ImageBufAlgo::warp(src, M, filtername, 0.0f,
+                                                true, wrap);
+                ImageBuf B = ImageBufAlgo::warp(src, Mpersp, filtername, 0.0f,
+                                                true, wrap);
+                OIIO_CHECK_EQUAL(A.roi(), B.roi());
+                auto comp = ImageBufAlgo::compare(A, B, 1.0e-3f, 1.0e-3f);
+                OIIO_CHECK_EQUAL(comp.nfail, 0);
+            }
+        }
+    }
+}
+
+
+
+// Test ImageBufAlgo::convolve for kernels taking each of its paths:
+// separable, FFT, and the direct 2D sum.
+void
+test_convolve()
+{
+    std::cout << "test convolve\n";
+    ImageBuf src(ImageSpec(53, 41, 3, TypeDesc::FLOAT));
+    for (ImageBuf::Iterator<float> p(src); !p.done(); ++p)
+        for (int c = 0; c < 3; ++c)
+            p[c] = 0.5f + 0.5f * sinf(0.7f * p.x() + 1.3f * p.y() + c);
+    struct {
+        const char* kernel;
+        float width;
+        bool normalize;
+    } cases[] = { { "gaussian", 7, true },
+                  { "disk", 21, true },
+                  { "laplacian", 3, false } };
+    for (auto& t : cases) {
+        ImageBuf K = ImageBufAlgo::make_kernel(t.kernel, t.width, t.width);
+        ImageBuf A(src.spec()), B(src.spec());
+        ImageBufAlgo::convolve(A, src, K, t.normalize);
+        convolve_reference(B, src, K, t.normalize);
+        auto comp = ImageBufAlgo::compare(A, B, 1.0e-4f, 1.0e-4f);
+        std::cout << "  " << t.kernel << " max error " << comp.maxerror
+                  << "\n";
+        OIIO_CHECK_EQUAL(comp.nfail, 0);
+    }
+}
+
+
+
+// Brute force median filter: element n/2 of the sorted values of the
+// pixels of the window that lie within src.
+static void
+median_reference(ImageBuf& dst, const ImageBuf& src, int width, int height)
+{
+    int nc = src.nchannels(), w_2 = width / 2, h_2 = height / 2;
+    std::vector<float> sp(nc);
+    std::vector<std::vector<float>> vals(nc);
+    for (ImageBuf::Iterator<float> out(dst); !out.done(); ++out) {
+        for (auto& v : vals)
+            v.clear();
+        for (int y = out.y() - h_2; y < out.y() - h_2 + height; ++y) {
+            for (int x = out.x() - w_2; x < out.x() - w_2 + width; ++x) {
+                if (x < src.xbegin() || x >= src.xend() || y < src.ybegin()
+                    || y >= src.yend())
+                    continue;
+                src.getpixel(x, y, &sp[0]);
+                for (int c = 0; c < nc; ++c)
+                    vals[c].push_back(sp[c]);
+            }
+        }
+        for (int c = 0; c < nc; ++c) {
+            std::sort(vals[c].begin(), vals[c].end());
+            out[c] = vals[c][vals[c].size() / 2];
+        }
+    }
+}
+
+
+
+// Test ImageBufAlgo::median_filter for each of its paths: the 8 and 16
+// bit histograms and the sorted window used for float and half.
+void
+test_median_filter()
+{
+    std::cout << "test median_filter\n";
+    TypeDesc types[] = { TypeDesc::UINT8, TypeDesc::UINT16, TypeDesc::HALF,
+                         TypeDesc::FLOAT };
+    for (TypeDesc t : types) {
+        ImageBuf src(ImageSpec(47, 31, 3, t));
+        for (ImageBuf::Iterator<float> p(src); !p.done(); ++p)
+            for (int c = 0; c < 3; ++c)
+                p[c] = float(((p.x() * 7919 + p.y() * 104729 + c * 13) >> 3)
+                             & 1023)
+                       / 1023.0f;
+        for (int w = 3; w <= 8; w += 5) {
+            ImageBuf A, B(ImageSpec(47, 31, 3, TypeDesc::FLOAT));
+            ImageBufAlgo::median_filter(A, src, w, w - 1);
+            median_reference(B, src, w, w - 1);
+            auto comp = ImageBufAlgo::compare(A, B, 1.0e-6f, 1.0e-6f);
+            OIIO_CHECK_EQUAL(comp.nfail, 0);
+        }
+    }
+}
+
+
+
+// Brute force dilate/erode over the window pixels that lie within src.
+static void
+morph_reference(ImageBuf& dst, const ImageBuf& src, int width, int height,
+                bool dilate)
+{
+    int nc = src.nchannels(), w_2 = width / 2, h_2 = height / 2;
+    std::vector<float> sp(nc);
+    for (ImageBuf::Iterator<float> out(dst); !out.done(); ++out) {
+        for (int c = 0; c < nc; ++c)
+            out[c] = dilate ? -1.0e30f : 1.0e30f;
+        for (int y = out.y() - h_2; y < out.y() - h_2 + height; ++y) {
+            for (int x = out.x() - w_2; x < out.x() - w_2 + width; ++x) {
+                if (x < src.xbegin() || x >= src.xend() || y < src.ybegin()
+                    || y >= src.yend())
+                    continue;
+                src.getpixel(x, y, &sp[0]);
+                for (int c = 0; c < nc; ++c)
+                    out[c] = dilate ? std::max(float(out[c]), sp[c])
+                                    : std::min(float(out[c]), sp[c]);
+            }
+        }
+    }
+}
+
+
+
+// Test ImageBufAlgo::dilate and erode, including windows much larger than
+// the van Herk/Gil-Werman blocks and wider than the image.
+void
+test_morph()
+{
+    std::cout << "test dilate/erode\n";
+    ImageBuf src(ImageSpec(61, 37, 3, TypeDesc::FLOAT));
+    for (ImageBuf::Iterator<float> p(src); !p.done(); ++p)
+        for (int c = 0; c < 3; ++c)
+            p[c] = sinf(0.37f * p.x() * (c + 1)) * cosf(0.23f * p.y());
+    int sizes[][2] = { { 3, 3 }, { 8, 5 }, { 25, 2 }, { 80, 41 } };
+    for (auto& s : sizes) {
+        for (int d = 0; d < 2; ++d) {
+            ImageBuf A, B(src.spec());
+            if (d)
+                ImageBufAlgo::dilate(A, src, s[0], s[1]);
+            else
+                ImageBufAlgo::erode(A, src, s[0], s[1]);
+            morph_reference(B, src, s[0], s[1], d);
+            auto comp = ImageBufAlgo::compare(A, B, 0.0f, 0.0f);
+            OIIO_CHECK_EQUAL(comp.nfail, 0);
+        }
+    }
+}
+
+
+
+// The contiguous_rows() fast paths of the per-pixel operations must give
+// the same results as the iterator paths, which we force by processing
+// one channel at a time.
+void
+test_contiguous_rows()
+{
+    std::cout << "test contiguous row fast paths\n";
+    TypeDesc types[] = { TypeDesc::UINT8, TypeDesc::HALF, TypeDesc::FLOAT };
+    for (TypeDesc t : types) {
+        ImageSpec spec(37, 13, 4, t);
+        spec.alpha_channel = 3;
+        ImageBuf A(spec), B(spec), C(spec);
+        ImageBufAlgo::zero(A);
+        ImageBufAlgo::zero(B);
+        ImageBufAlgo::zero(C);
+        ImageBufAlgo::noise(A, "uniform", 0.0f, 1.0f, false, 1);
+        ImageBufAlgo::noise(B, "uniform", 0.0f, 1.0f, false, 2);
+        ImageBufAlgo::noise(C, "uniform", -0.5f, 1.5f, false, 3);
+        const float k[] = { 0.25f, 0.5f, 0.75f, 0.125f };
+        auto check = [&](const char* name,
+                         std::function<bool(ImageBuf&, ROI)> op) {
+            ImageBuf fast(spec), slow(spec);
+            op(fast, A.roi());
+            for (int c = 0; c < spec.nchannels; ++c) {
+                ROI roi    = A.roi();
+                roi.chbegin = c;
+                roi.chend   = c + 1;
+                op(slow, roi);
+            }
+            auto comp = ImageBufAlgo::compare(fast, slow, 0.0f, 0.0f);
+            if (comp.nfail)
+                std::cout << "  " << t << " " << name << " differs\n";
+            OIIO_CHECK_EQUAL(comp.nfail, 0);
+        };
+        using namespace ImageBufAlgo;
+        check("add", [&](ImageBuf& R, ROI roi) { return add(R, A, B, roi); });
+        check("add const",
+              [&](ImageBuf& R, ROI roi) { return add(R, A, k, roi); });
+        check("sub", [&](ImageBuf& R, ROI roi) { return sub(R, A, B, roi); });
+        check("mul", [&](ImageBuf& R, ROI roi) { return mul(R, A, B, roi); });
+        check("mul const",
+              [&](ImageBuf& R, ROI roi) { return mul(R, A, k, roi); });
+        check("mad",
+              [&](ImageBuf& R, ROI roi) { return mad(R, A, B, C, roi); });
+        check("mad ici",
+              [&](ImageBuf& R, ROI roi) { return mad(R, A, k, C, roi); });
+        check("mad icc",
+              [&](ImageBuf& R, ROI roi) { return mad(R, A, k, k, roi); });
+        check("over", [&](ImageBuf& R, ROI roi) { return over(R, A, B, roi); });
+        check("clamp", [&](ImageBuf& R, ROI roi) {
+            return clamp(R, C, k, 1.0f, true, roi);
+        });
+        check("premult",
+              [&](ImageBuf& R, ROI roi) { return premult(R, C, roi); });
+    }
+}
+
+
+
+// A fused ImageExpr must give exactly the result of making the same IBA
+// calls one at a time with float intermediates.
+void
+test_image_expr()
+{
+    std::cout << "test ImageExpr\n";
+    using namespace ImageBufAlgo;
+    TypeDesc types[] = { TypeDesc::UINT8, TypeDesc::HALF, TypeDesc::FLOAT };
+    for (TypeDesc t : types) {
+        ImageSpec spec(37, 13, 4, t);
+        spec.alpha_channel = 3;
+        ImageSpec bspec    = spec;  // B only covers part of A
+        bspec.x            = 5;
+        bspec.width        = 20;
+        ImageBuf A(spec), B(bspec), C(spec);
+        zero(A);
+        zero(B);
+        zero(C);
+        noise(A, "uniform", 0.0f, 1.0f, false, 1);
+        noise(B, "uniform", 0.0f, 1.0f, false, 2);
+        noise(C, "uniform", -0.5f, 0.5f, false, 3);
+        std::vector<float> k { 1.5f, 0.5f, 2.0f, 1.0f };
+
+        ImageExpr expr(A);
+        expr.mad(k, C).clamp(0.0f, 1.0f, true).pow(0.5f).premult();
+        expr.colorconvert("linear", "sRGB").over(B).sub(0.25f).abs();
+        OIIO_CHECK_EQUAL(expr.nstages(), 8);
+        ImageBuf fused = expr.eval();
+        OIIO_CHECK_ASSERT(!fused.has_error());
+        OIIO_CHECK_EQUAL(fused.spec().format, t);
+        OIIO_CHECK_EQUAL(fused.spec().get_string_attribute("oiio:ColorSpace"),
+                         "sRGB");
+
+        ImageSpec fspec = spec;
+        fspec.set_format(TypeFloat);
+        ImageBuf Af(fspec);
+        Af.copy_pixels(A);
+        ImageBuf r1 = mad(Af, k, C);
+        ImageBuf r2 = clamp(r1, 0.0f, 1.0f, true);
+        ImageBuf r3 = pow(r2, 0.5f);
+        ImageBuf r4 = premult(r3);
+        ImageBuf r5 = colorconvert(r4, "linear", "sRGB");
+        ImageBuf r6 = over(r5, B, A.roi());
+        ImageBuf r7 = sub(r6, 0.25f);
+        ImageBuf r8 = abs(r7);
+        ImageBuf expected(spec);
+        expected.copy_pixels(r8);
+        auto comp = compare(fused, expected, 0.0f, 0.0f);
+        if (comp.nfail)
+            std::cout << "  " << t << " fused result differs\n";
+        OIIO_CHECK_EQUAL(comp.nfail, 0);
+
+        // In place, over a sub-region
+        ROI roi(3, 20, 2, 9, 0, 1, 0, 4);
+        ImageBuf inplace(spec);
+        inplace.copy_pixels(A);
+        ImageExpr(inplace).mul(0.5f).add(C).eval(inplace, roi);
+        ImageBuf expected2(spec);
+        expected2.copy_pixels(A);
+        ImageBuf half = mul(Af, 0.5f, roi);
+        add(half, half, C, roi);
+        paste(expected2, roi.xbegin, roi.ybegin, 0, 0, half);
+        comp = compare(inplace, expected2, 0.0f, 0.0f);
+        OIIO_CHECK_EQUAL(comp.nfail, 0);
+    }
+
+    // Errors are reported by eval()
+    ImageBuf rgb(ImageSpec(8, 8, 3, TypeFloat)), rgba(ImageSpec(8, 8, 4));
+    ImageExpr bad(rgb);
+    bad.over(rgba);
+    OIIO_CHECK_ASSERT(bad.has_error());
+    ImageBuf R;
+    OIIO_CHECK_ASSERT(!bad.eval(R));
+    OIIO_CHECK_ASSERT(R.has_error());
+}
+
+
+
+// ImageExpr::write() must stream out exactly what eval() computes, for
+// sources in memory or still in their tiled or scanline file, and for
+// scanline or tiled output. A scanline file must be read a band at a time,
+// not pulled into the ImageCache as one tile of the whole image.
+void
+test_image_expr_write()
+{
+    std::cout << "test ImageExpr::write\n";
+    using namespace ImageBufAlgo;
+    ImageSpec spec(67, 301, 4, TypeDesc::FLOAT);
+    spec.alpha_channel = 3;
+    ImageBuf A(spec);
+    zero(A);
+    noise(A, "uniform", 0.0f, 1.0f, false, 1);
+    const char* srcname  = "oiio-exprsrc.tif";
+    const char* scanname = "oiio-exprsrc-scan.tif";
+    const char* outname  = "oiio-exprout.tif";
+    A.write(scanname);
+    A.set_write_tiles(16, 16);
+    A.write(srcname);
+    ImageBuf S(srcname), L(scanname);
+    S.read(0, 0, false, TypeFloat);  // stays in the ImageCache
+    L.read(0, 0, false, TypeFloat);
+    OIIO_CHECK_EQUAL(S.storage(), ImageBuf::IMAGECACHE);
+    OIIO_CHECK_EQUAL(L.storage(), ImageBuf::IMAGECACHE);
+
+    ImageExpr refexpr(A);
+    refexpr.mul(0.5f).add(0.25f).premult();
+    ImageBuf expected = refexpr.eval();
+    for (const ImageBuf* src : { &A, &S, &L }) {
+        for (int tile : { 0, 24 }) {
+            ImageExpr expr(*src);
+            expr.mul(0.5f).add(0.25f).premult();
+            ImageSpec outspec = expr.spec();
+            outspec.tile_width = outspec.tile_height = tile;
+            outspec.tile_depth                       = tile ? 1 : 0;
+            auto out = ImageOutput::create(outname);
+            OIIO_CHECK_ASSERT(out && out->open(outname, outspec));
+            OIIO_CHECK_ASSERT(expr.write(out.get()));
+            out->close();
+            if (src == &L) {
+                long long tilesread = -1;
+                L.imagecache()->get_image_info(ustring(scanname), 0, 0,
+                                               ustring("stat:tilesread"),
+                                               TypeDesc::INT64, &tilesread);
+                OIIO_CHECK_EQUAL(tilesread, 0);
+            }
+            ImageCache::create()->invalidate(ustring(outname));
+            ImageBuf R(outname);
+            auto comp = compare(R, expected, 0.0f, 0.0f);
+            OIIO_CHECK_EQUAL(comp.nfail, 0);
+        }
+    }
+
+    // Writing by filename, with a data type conversion
+    ImageExpr expr(S);
+    expr.sub(0.5f).abs();
+    OIIO_CHECK_ASSERT(expr.write(outname, TypeDesc::HALF));
+    ImageCache::create()->invalidate(ustring(outname));
+    ImageBuf R(outname);
+    OIIO_CHECK_EQUAL(R.spec().format, TypeDesc::HALF);
+    auto comp = compare(R, expr.eval(), 1.0e-3f, 1.0e-3f);
+    OIIO_CHECK_EQUAL(comp.nfail, 0);
+    remove(srcname);
+    remove(scanname);
+    remove(outname);
+}
+
+
+
+// Split_Tile parallel_image tasks must cover the ROI exactly once, each
+// lying within one tile of the requested grid.
+void
+test_parallel_image_tiles()
+{
+    std::cout << "test parallel_image Split_Tile\n";
+    ROI roi(-13, 290, 7, 201);
+    std::vector<std::atomic<int>> visits(roi.npixels());
+    for (auto& v : visits)
+        v = 0;
+    std::atomic<int> misaligned(0);
+    ImageBufAlgo::parallel_image_options opt(4, Split_Tile);
+    opt.minitems    = 64;
+    opt.tilewidth   = 64;
+    opt.tileheight  = 32;
+    opt.tilexorigin = 5;
+    opt.tileyorigin = -3;
+    ImageBufAlgo::parallel_image(roi, opt, [&](ROI r) {
+        int tx = (r.xbegin - opt.tilexorigin + 1024) / opt.tilewidth;
+        int ty = (r.ybegin - opt.tileyorigin + 1024) / opt.tileheight;
+        if ((r.xend - 1 - opt.tilexorigin + 1024) / opt.tilewidth != tx
+            || (r.yend - 1 - opt.tileyorigin + 1024) / opt.tileheight != ty)
+            ++misaligned;
+        for (int y = r.ybegin; y < r.yend; ++y)
+            for (int x = r.xbegin; x < r.xend; ++x)
+                ++visits[(y - roi.ybegin) * roi.width() + (x - roi.xbegin)];
+    });
+    OIIO_CHECK_EQUAL(misaligned, 0);
+    bool once = std::all_of(visits.begin(), visits.end(),
+                            [](const std::atomic<int>& v) { return v == 1; });
+    OIIO_CHECK_ASSERT(once);
+
+    // Left to choose, the tiles should be about the minimum task size.
+    ImageBufAlgo::parallel_image_options autoopt(4, Split_Tile);
+    int widest = 0, tallest = 0;
+    spin_mutex mutex;
+    ImageBufAlgo::parallel_image(ROI(0, 700, 0, 500), autoopt, [&](ROI r) {
+        spin_lock lock(mutex);
+        widest  = std::max(widest, r.width());
+        tallest = std::max(tallest, r.height());
+    });
+    OIIO_CHECK_EQUAL(widest, 128);
+    OIIO_CHECK_EQUAL(tallest, 128);
+}
+
+
+
 // Test various IBAprep features
 void
 test_IBAprep()
@@ -1018,8 +1698,18 @@ main(int argc, char** argv)
     test_isConstantChannel();
     test_isMonochrome();
     test_computePixelStats();
+    test_resize();
+    test_warp();
+    test_convolve();
+    test_median_filter();
+    test_morph();
+    test_contiguous_rows();
+    test_image_expr();
+    test_image_expr_write();
+    test_parallel_image_tiles();
     histogram_computation_test();
     test_maketx_from_imagebuf();
+    test_maketx_updatemode();
     test_IBAprep();
     test_opencv();
 
@@ -36,8 +36,11 @@
 #include <OpenEXR/ImathMatrix.h>
 #include <OpenEXR/half.h>
 
+#include <algorithm>
 #include <cmath>
+#include <limits>
 #include <memory>
+#include <vector>
 
 #include "imageio_pvt.h"
 #include <OpenImageIO/dassert.h>
@@ -45,6 +48,7 @@
 #include <OpenImageIO/imagebuf.h>
 #include <OpenImageIO/imagebufalgo.h>
 #include <OpenImageIO/imagebufalgo_util.h>
+#include <OpenImageIO/simd.h>
 #include <OpenImageIO/thread.h>
 
 OIIO_NAMESPACE_BEGIN
@@ -197,6 +201,100 @@ filtered_sample(const ImageBuf& src, float s, float t, float dsdx, float dtdx,
             result[c] = 0.0f;
 }
 
+
+
+// In an affine warp, the filter footprint is the same size at every output
+// pixel, so for a separable filter the normalized weights along each axis
+// depend only on where the footprint starts within a source pixel.
+// WarpTaps tabulates one axis's weights for evenly spaced phases and
+// interpolates between them, which matches evaluating the filter over the
+// same source pixels as filtered_sample() to well under 1e-4. Filters that
+// jump at the edge of their support (box, the truncated gaussian) can't be
+// interpolated, so for those the weights are evaluated for each pixel,
+// which still costs one filter call per tap of each axis rather than per
+// tap of the 2D footprint.
+class WarpTaps {
+public:
+    enum { phases = 256 };
+
+    // d is the footprint scale along this axis (in source pixels per
+    // output pixel), as in filtered_sample().
+    WarpTaps(const Filter2D* filter, float d, bool yaxis)
+        : m_filter(filter)
+        , m_yaxis(yaxis)
+    {
+        d        = std::max(1.0f, d);
+        m_d_inv  = 1.0f / d;
+        m_radius = 0.5f * d * filter->width();
+        m_ntaps  = int(ceilf(2.0f * m_radius)) + 1;
+        float edge = 0.5f * filter->width() * (1.0f - 1.0f / phases);
+        float peak = fabsf(filt(0.0f));
+        m_exact    = (fabsf(filt(edge)) > 0.01f * peak
+                   || fabsf(filt(-edge)) > 0.01f * peak);
+        m_weights.assign((phases + 1) * m_ntaps, 0.0f);
+        for (int p = 0; p <= phases; ++p) {
+            // The footprint starts f of the way into its first pixel, and
+            // so covers ceil(f + 2*radius) pixels.
+            float f     = float(p) / phases;
+            int n       = std::min(m_ntaps, int(ceilf(f + 2.0f * m_radius)));
+            float* w    = &m_weights[p * m_ntaps];
+            float total = 0.0f;
+            for (int k = 0; k < n; ++k) {
+                w[k] = filt(m_d_inv * (k + 0.5f - f - m_radius));
+                total += w[k];
+            }
+            if (total != 0.0f)
+                for (int k = 0; k < n; ++k)
+                    w[k] /= total;
+        }
+    }
+
+    int ntaps() const { return m_ntaps; }
+    float radius() const { return m_radius; }
+
+    // Compute the ntaps() weights w[] of the footprint centered at source
+    // coordinate a, and set first to the source pixel of w[0].
+    void weights(float a, int& first, float* w) const
+    {
+        float lo = a - m_radius;
+        float fl = floorf(lo);
+        first    = int(fl);
+        if (m_exact) {
+            int n = std::min(m_ntaps, int(ceilf(a + m_radius)) - first);
+            float total = 0.0f;
+            for (int k = 0; k < m_ntaps; ++k) {
+                w[k] = k < n ? filt(m_d_inv * (first + k + 0.5f - a)) : 0.0f;
+                total += w[k];
+            }
+            if (total != 0.0f)
+                for (int k = 0; k < n; ++k)
+                    w[k] /= total;
+            return;
+        }
+        float pos       = (lo - fl) * phases;
+        int p           = std::min(int(pos), phases - 1);
+        float t         = pos - p;
+        const float* w0 = &m_weights[p * m_ntaps];
+        const float* w1 = w0 + m_ntaps;
+        for (int k = 0; k < m_ntaps; ++k)
+            w[k] = w0[k] + t * (w1[k] - w0[k]);
+    }
+
+private:
+    const Filter2D* m_filter;
+    bool m_yaxis;
+    bool m_exact;
+    float m_d_inv;
+    float m_radius;
+    int m_ntaps;
+    std::vector<float> m_weights;
+
+    float filt(float x) const
+    {
+        return m_yaxis ? m_filter->yfilt(x) : m_filter->xfilt(x);
+    }
+};
+
 }  // namespace
 
 
@@ -206,7 +304,10 @@ static bool
 resize_(ImageBuf& dst, const ImageBuf& src, Filter2D* filter, ROI roi,
         int nthreads)
 {
-    ImageBufAlgo::parallel_image(roi, nthreads, [&](ROI roi) {
+    // Filter footprints make neighboring output pixels read overlapping
+    // source pixels, so split into tiles rather than strips.
+    ImageBufAlgo::parallel_image_options opt(nthreads, Split_Tile);
+    ImageBufAlgo::parallel_image(roi, opt, [&](ROI roi) {
         const ImageSpec& srcspec(src.spec());
         const ImageSpec& dstspec(dst.spec());
         int nchannels = dstspec.nchannels;
@@ -314,16 +415,101 @@ resize_(ImageBuf& dst, const ImageBuf& src, Filter2D* filter, ROI roi,
         //
         // Separate cases for separable and non-separable filters.
         if (separable) {
+            // Two-pass separable filtering: first filter the source rows
+            // needed by this block horizontally into a float strip, then
+            // filter the strip vertically into the output. That's
+            // xtaps+ytaps multiplies per output pixel instead of
+            // xtaps*ytaps, and the vertical pass runs over contiguous
+            // floats. All source lookups clamp to the data window, exactly
+            // like the WrapClamp iterators used for non-separable filters.
+            const int width     = roi.width();
+            const int rowfloats = width * nchannels;
+            const int srcz      = src.zbegin();
+            const int srcxmin = src.xbegin(), srcxmax = src.xend() - 1;
+            const int srcymin = src.ybegin(), srcymax = src.yend() - 1;
+
+            // Clamped source column of each horizontal tap, relative to
+            // the first source column we need to read.
+            std::vector<int> xtapcol(xtaps * width);
+            std::vector<bool> xzero(width);
+            int rx0 = std::numeric_limits<int>::max(), rx1 = 0;
+            for (int x = roi.xbegin; x < roi.xend; ++x) {
+                float s     = (x - dstfx + 0.5f) * dstpixelwidth;
+                int src_x   = ifloor(srcfx + s * srcfw);
+                int* tapcol = &xtapcol[(x - roi.xbegin) * xtaps];
+                const float* xfiltval = xfiltval_all
+                                        + (x - roi.xbegin) * xtaps;
+                float totalweight_x = 0.0f;
+                for (int i = 0; i < xtaps; ++i) {
+                    tapcol[i] = clamp(src_x - radi + i, srcxmin, srcxmax);
+                    totalweight_x += xfiltval[i];
+                }
+                xzero[x - roi.xbegin] = (totalweight_x == 0.0f);
+                rx0 = std::min(rx0, tapcol[0]);
+                rx1 = std::max(rx1, tapcol[xtaps - 1] + 1);
+            }
+            for (auto& col : xtapcol)
+                col = (col - rx0) * nchannels;
+
+            // Source row of each output row, and the range of source rows
+            // the whole block needs.
+            std::vector<int> ysrc(roi.height());
+            for (int y = roi.ybegin; y < roi.yend; ++y) {
+                float t              = (y - dstfy + 0.5f) * dstpixelheight;
+                ysrc[y - roi.ybegin] = ifloor(srcfy + t * srcfh);
+            }
+            int stripbegin = clamp(ysrc.front() - radj, srcymin, srcymax);
+            int stripend   = clamp(ysrc.back() + radj, srcymin, srcymax) + 1;
+
+            // Per-thread strip and scanline buffers. They are padded so
+            // that the 4-wide loads and stores below may harmlessly spill
+            // past the last pixel when there are fewer than 4 channels.
+            std::vector<float> rowbuf((rx1 - rx0) * nchannels + 4);
+            std::vector<float> strip(size_t(stripend - stripbegin) * rowfloats
+                                     + 4);
+            std::vector<float> accum(rowfloats + 4);
+
+            // Horizontal pass
+            for (int r = stripbegin; r < stripend; ++r) {
+                float* rp = &rowbuf[0];
+                for (ImageBuf::ConstIterator<SRCTYPE> sp(
+                         src, ROI(rx0, rx1, r, r + 1, srcz, srcz + 1));
+                     !sp.done(); ++sp)
+                    for (int c = 0; c < nchannels; ++c)
+                        *rp++ = sp[c];
+                float* h = &strip[size_t(r - stripbegin) * rowfloats];
+                for (int x = 0; x < width; ++x, h += nchannels) {
+                    const float* xfiltval = xfiltval_all + x * xtaps;
+                    const int* tapcol     = &xtapcol[x * xtaps];
+                    if (xzero[x]) {
+                        for (int c = 0; c < nchannels; ++c)
+                            h[c] = 0.0f;
+                    } else if (nchannels <= 4) {
+                        simd::vfloat4 sum(0.0f);
+                        for (int i = 0; i < xtaps; ++i)
+                            sum += xfiltval[i]
+                                   * simd::vfloat4(&rowbuf[tapcol[i]]);
+                        sum.store(h);  // may spill into the next pixel
+                    } else {
+                        for (int c = 0; c < nchannels; ++c)
+                            h[c] = 0.0f;
+                        for (int i = 0; i < xtaps; ++i)
+                            for (int c = 0; c < nchannels; ++c)
+                                h[c] += xfiltval[i] * rowbuf[tapcol[i] + c];
+                    }
+                }
+            }
+
+            // Vertical pass
             ImageBuf::Iterator<DSTTYPE> out(dst, roi);
-            ImageBuf::ConstIterator<SRCTYPE> srcpel(src, ImageBuf::WrapClamp);
             for (int y = roi.ybegin; y < roi.yend; ++y) {
                 float t      = (y - dstfy + 0.5f) * dstpixelheight;
                 float src_yf = srcfy + t * srcfh;
                 int src_y;
                 float src_yf_frac = floorfrac(src_yf, &src_y);
-                // If using separable filters, our vertical set of filter tap
-                // weights will be the same for the whole scanline we're on.  Just
-                // compute and normalize them once.
+                // The vertical filter tap weights are the same for the
+                // whole scanline we're on. Just compute and normalize them
+                // once.
                 float totalweight_y = 0.0f;
                 for (int j = 0; j < ytaps; ++j) {
                     float w = filter->yfilt(
@@ -331,51 +517,30 @@ resize_(ImageBuf& dst, const ImageBuf& src, Filter2D* filter, ROI roi,
                     yfiltval[j] = w;
                     totalweight_y += w;
                 }
-                if (totalweight_y != 0.0f)
-                    for (int i = 0; i < ytaps; ++i)
-                        yfiltval[i] /= totalweight_y;
-
-                for (int x = roi.xbegin; x < roi.xend; ++x, ++out) {
-                    float s      = (x - dstfx + 0.5f) * dstpixelwidth;
-                    float src_xf = srcfx + s * srcfw;
-                    int src_x    = ifloor(src_xf);
-                    for (int c = 0; c < nchannels; ++c)
-                        pel[c] = 0.0f;
-                    const float* xfiltval = xfiltval_all
-                                            + (x - roi.xbegin) * xtaps;
-                    float totalweight_x = 0.0f;
-                    for (int i = 0; i < xtaps; ++i)
-                        totalweight_x += xfiltval[i];
-                    if (totalweight_x != 0.0f) {
-                        srcpel.rerange(src_x - radi, src_x + radi + 1,
-                                       src_y - radj, src_y + radj + 1, 0, 1,
-                                       ImageBuf::WrapClamp);
-                        for (int j = -radj; j <= radj; ++j) {
-                            float wy = yfiltval[j + radj];
-                            if (wy == 0.0f) {
-                                // 0 weight for this y tap -- move to next line
-                                srcpel.pos(srcpel.x(), srcpel.y() + 1,
-                                           srcpel.z());
-                                continue;
-                            }
-                            for (int i = 0; i < xtaps; ++i, ++srcpel) {
-                                float w = wy * xfiltval[i];
-                                if (w)
-                                    for (int c = 0; c < nchannels; ++c)
-                                        pel[c] += w * srcpel[c];
-                            }
+                float* acc = &accum[0];
+                std::fill(accum.begin(), accum.end(), 0.0f);
+                if (totalweight_y != 0.0f) {
+                    for (int j = 0; j < ytaps; ++j) {
+                        float wy = yfiltval[j] / totalweight_y;
+                        if (wy == 0.0f)
+                            continue;
+                        int r = clamp(src_y - radj + j, srcymin, srcymax);
+                        const float* h
+                            = &strip[size_t(r - stripbegin) * rowfloats];
+                        simd::vfloat4 w4(wy);
+                        int k = 0;
+                        for (; k + 4 <= rowfloats; k += 4) {
+                            simd::vfloat4 a(acc + k);
+                            (a + w4 * simd::vfloat4(h + k)).store(acc + k);
                         }
+                        for (; k < rowfloats; ++k)
+                            acc[k] += wy * h[k];
                     }
-                    // Copy the pixel value (already normalized) to the output.
-                    DASSERT(out.x() == x && out.y() == y);
-                    if (totalweight_y == 0.0f) {
-                        // zero it out
-                        for (int c = 0; c < nchannels; ++c)
-                            out[c] = 0.0f;
-                    } else {
-                        for (int c = 0; c < nchannels; ++c)
-                            out[c] = pel[c];
-                    }
+                }
+                for (int x = 0; x < width; ++x, ++out, acc += nchannels) {
+                    DASSERT(out.x() == x + roi.xbegin && out.y() == y);
+                    for (int c = 0; c < nchannels; ++c)
+                        out[c] = acc[c];
                 }
             }
 
@@ -860,16 +1025,142 @@ affine_resample_ (ImageBuf &dst, const ImageBuf &src, const Imath::M33f &Minv,
 
 
 
+// Warp by an affine Minv (dst to src) with a separable filter. The
+// footprint is then the same everywhere, so the filter weights come from
+// WarpTaps, and each block of output pixels gathers from a float
+// copy of the source pixels under it (read with the wrap mode, so there
+// are no edge cases) with SIMD over the channels. Return false, having done
+// nothing, if the warp isn't of that kind, or the footprint is so big that
+// the general path is the better bet.
+template<typename DSTTYPE, typename SRCTYPE>
+static bool
+warp_affine_(ImageBuf& dst, const ImageBuf& src, const Imath::M33f& Minv,
+             const Filter2D* filter, ImageBuf::WrapMode wrap, ROI roi,
+             int nthreads)
+{
+    if (Minv[0][2] != 0.0f || Minv[1][2] != 0.0f || Minv[2][2] == 0.0f
+        || !filter->separable())
+        return false;
+    // s = m00 * x + m10 * y + m20, t = m01 * x + m11 * y + m21
+    float w_inv = 1.0f / Minv[2][2];
+    float m00 = Minv[0][0] * w_inv, m10 = Minv[1][0] * w_inv;
+    float m20 = Minv[2][0] * w_inv;
+    float m01 = Minv[0][1] * w_inv, m11 = Minv[1][1] * w_inv;
+    float m21 = Minv[2][1] * w_inv;
+    // Same isotropic footprint as filtered_sample()
+    float ds = std::max(fabsf(m00), fabsf(m10));
+    float dt = std::max(fabsf(m01), fabsf(m11));
+    WarpTaps xtaps(filter, ds, false);
+    WarpTaps ytaps(filter, dt, true);
+    if (xtaps.ntaps() * ytaps.ntaps() > 1024)
+        return false;
+
+    ImageBufAlgo::parallel_image_options opt(nthreads, Split_Tile);
+    ImageBufAlgo::parallel_image(roi, opt, [&](ROI roi) {
+        const int nc    = src.nchannels();
+        const int ntx   = xtaps.ntaps();
+        const int nty   = ytaps.ntaps();
+        const int block = 64;
+        // Padded so that 4-wide loads may spill past the last pixel
+        std::vector<float> srcbuf;
+        std::vector<float> wx(ntx), wy(nty);
+        float pel[4];
+        for (int by = roi.ybegin; by < roi.yend; by += block) {
+            for (int bx = roi.xbegin; bx < roi.xend; bx += block) {
+                ROI blk(bx, std::min(bx + block, roi.xend), by,
+                        std::min(by + block, roi.yend), roi.zbegin, roi.zend,
+                        roi.chbegin, roi.chend);
+                // The source rectangle under the footprints of the block:
+                // the transformed corners, plus the filter radius and a
+                // pixel of slop for rounding.
+                float smin = std::numeric_limits<float>::max(), smax = -smin;
+                float tmin = smin, tmax = -smin;
+                for (int corner = 0; corner < 4; ++corner) {
+                    float x = (corner & 1) ? blk.xend : blk.xbegin;
+                    float y = (corner & 2) ? blk.yend : blk.ybegin;
+                    float s = m00 * x + m10 * y + m20;
+                    float t = m01 * x + m11 * y + m21;
+                    smin = std::min(smin, s);
+                    smax = std::max(smax, s);
+                    tmin = std::min(tmin, t);
+                    tmax = std::max(tmax, t);
+                }
+                int sx0 = ifloor(smin - xtaps.radius()) - 1;
+                int sx1 = ifloor(smax + xtaps.radius()) + 2;
+                int sy0 = ifloor(tmin - ytaps.radius()) - 1;
+                int sy1 = ifloor(tmax + ytaps.radius()) + 2;
+                int srcw = sx1 - sx0;
+                srcbuf.resize(size_t(srcw) * (sy1 - sy0) * nc + 4);
+                float* sp = &srcbuf[0];
+                for (ImageBuf::ConstIterator<SRCTYPE> it(src, sx0, sx1, sy0,
+                                                         sy1, 0, 1, wrap);
+                     !it.done(); ++it)
+                    for (int c = 0; c < nc; ++c)
+                        *sp++ = it[c];
+
+                ImageBuf::Iterator<DSTTYPE> out(dst, blk);
+                for (; !out.done(); ++out) {
+                    float x = out.x() + 0.5f, y = out.y() + 0.5f;
+                    int x0, y0;
+                    xtaps.weights(m00 * x + m10 * y + m20, x0, &wx[0]);
+                    ytaps.weights(m01 * x + m11 * y + m21, y0, &wy[0]);
+                    DASSERT(x0 >= sx0 && x0 + ntx <= sx1 && y0 >= sy0
+                            && y0 + nty <= sy1);
+                    const float* p = &srcbuf[(size_t(y0 - sy0) * srcw
+                                              + (x0 - sx0))
+                                             * nc];
+                    if (nc <= 4) {
+                        simd::vfloat4 sum(0.0f);
+                        for (int j = 0; j < nty; ++j, p += srcw * nc) {
+                            if (wy[j] == 0.0f)
+                                continue;
+                            simd::vfloat4 row(0.0f);
+                            for (int i = 0; i < ntx; ++i)
+                                row += wx[i] * simd::vfloat4(p + i * nc);
+                            sum += wy[j] * row;
+                        }
+                        sum.store(pel);
+                        for (int c = roi.chbegin; c < roi.chend; ++c)
+                            out[c] = pel[c];
+                    } else {
+                        for (int c = roi.chbegin; c < roi.chend; ++c) {
+                            float sum = 0.0f;
+                            const float* q = p + c;
+                            for (int j = 0; j < nty; ++j, q += srcw * nc) {
+                                float row = 0.0f;
+                                for (int i = 0; i < ntx; ++i)
+                                    row += wx[i] * q[i * nc];
+                                sum += wy[j] * row;
+                            }
+                            out[c] = sum;
+                        }
+                    }
+                }
+            }
+        }
+    });
+    return true;
+}
+
+
+
 template<typename DSTTYPE, typename SRCTYPE>
 static bool
 warp_(ImageBuf& dst, const ImageBuf& src, const Imath::M33f& M,
       const Filter2D* filter, ImageBuf::WrapMode wrap, ROI roi, int nthreads)
 {
-    ImageBufAlgo::parallel_image(roi, nthreads, [&](ROI roi) {
+    Imath::M33f Minv = M.inverse();
+    if (warp_affine_<DSTTYPE, SRCTYPE>(dst, src, Minv, filter, wrap, roi,
+                                       nthreads))
+        return true;
+
+    // The filter footprint varies a lot across a warped image; tiles keep
+    // each task's source reads local, and are small enough to balance.
+    ImageBufAlgo::parallel_image_options opt(nthreads, Split_Tile);
+    ImageBufAlgo::parallel_image(roi, opt, [&](ROI roi) {
         int nc     = dst.nchannels();
         float* pel = ALLOCA(float, nc);
         memset(pel, 0, nc * sizeof(float));
-        Imath::M33f Minv = M.inverse();
         ImageBuf::Iterator<DSTTYPE> out(dst, roi);
         for (; !out.done(); ++out) {
             Dual2 x(out.x() + 0.5f, 1.0f, 0.0f);
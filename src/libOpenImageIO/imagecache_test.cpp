@@ -33,6 +33,7 @@
 #include <OpenImageIO/imagebufalgo.h>
 #include <OpenImageIO/imagecache.h>
 #include <OpenImageIO/imageio.h>
+#include <OpenImageIO/texture.h>
 #include <OpenImageIO/unittest.h>
 
 #include <iostream>
@@ -85,6 +86,45 @@ test_get_pixels_cachechannels(int chbegin = 0, int chend = 4,
 
 
 
+// A cache-backed ImageBuf reading a channel subset of a many-channel image
+// should stay in the cache, with tiles that hold only those channels.
+void
+test_imagebuf_cached_channel_subset()
+{
+    std::cout << "\nTesting cache-backed ImageBuf channel subset\n";
+    ImageCache* imagecache = ImageCache::create(false /*not shared*/);
+
+    ustring filename("tenchannels.tif");
+    const int nchans = 10;
+    ImageBuf A(ImageSpec(64, 64, nchans, TypeDesc::FLOAT));
+    const float pixelvalue[nchans] = { 0.0f, 0.1f, 0.2f, 0.3f, 0.4f,
+                                       0.5f, 0.6f, 0.7f, 0.8f, 0.9f };
+    ImageBufAlgo::fill(A, pixelvalue);
+    A.write(filename);
+
+    ImageBuf B(filename, imagecache);
+    OIIO_CHECK_ASSERT(B.read(0, 0, 6, 9, false /*force*/, TypeDesc::FLOAT));
+    OIIO_CHECK_EQUAL(B.storage(), ImageBuf::IMAGECACHE);
+    OIIO_CHECK_EQUAL(B.nchannels(), 3);
+    OIIO_CHECK_EQUAL(B.spec().channelnames[0], A.spec().channelnames[6]);
+    for (int c = 0; c < 3; ++c)
+        OIIO_CHECK_EQUAL(B.getchannel(17, 42, 0, c), pixelvalue[6 + c]);
+
+    // Only the three requested channels should have been cached
+    long long mem = 0;
+    imagecache->getattribute("stat:cache_memory_used", TypeDesc::INT64, &mem);
+    OIIO_CHECK_ASSERT(mem > 0 && mem < 64 * 64 * 4 * 4);
+
+    // Asking for all channels again brings back the full set
+    OIIO_CHECK_ASSERT(B.read(0, 0, false /*force*/, TypeDesc::FLOAT));
+    OIIO_CHECK_EQUAL(B.nchannels(), nchans);
+    OIIO_CHECK_EQUAL(B.getchannel(17, 42, 0, 9), pixelvalue[9]);
+
+    ImageCache::destroy(imagecache);
+}
+
+
+
 // Wimple wrapper to return a raw "null" ImageInput*.
 static ImageInput*
 NullInputCreator()
@@ -160,6 +200,121 @@ test_app_buffer()
 
 
 
+static long long
+lookup_cache_hits(TextureSystem* ts)
+{
+    long long hits = 0;
+    ts->getattribute("stat:lookup_cache_hits", TypeDesc::INT64, &hits);
+    return hits;
+}
+
+
+
+// Test the TextureSystem's per-thread memo of filtered lookups: exact
+// repeats hit, other coordinates miss, the tolerance merges nearby
+// coordinates, and changing any attribute that affects the results makes
+// the memo stale.
+void
+test_texture_lookup_memo()
+{
+    std::cout << "\nTesting TextureSystem lookup memo\n";
+    // A one channel texture that varies along both s and t
+    ImageBuf A(ImageSpec(64, 64, 1, TypeDesc::FLOAT));
+    for (ImageBuf::Iterator<float> p(A); !p.done(); ++p)
+        p[0] = (p.x() + 2.0f * p.y()) / 192.0f;
+    ustring filename("lookupmemo.tx");
+    ImageSpec config;
+    OIIO_CHECK_ASSERT(ImageBufAlgo::make_texture(ImageBufAlgo::MakeTxTexture,
+                                                 A, filename, config));
+
+    TextureSystem* ts = TextureSystem::create(false /*not shared*/);
+    ts->attribute("lookup_cache_size", 16);
+    TextureOpt opt;
+    const float d = 1.0f / 64;  // derivatives: about one texel
+    float r1[3], r2[3];
+    auto lookup = [&](float s, float t, int nchannels, float* result) {
+        result[0] = result[1] = result[2] = -1.0f;
+        OIIO_CHECK_ASSERT(ts->texture(filename, opt, s, t, d, 0.0f, 0.0f, d,
+                                      nchannels, result));
+    };
+
+    // Exact repeats hit, and return the same answer
+    lookup(0.3f, 0.2f, 1, r1);
+    long long hits = lookup_cache_hits(ts);
+    lookup(0.3f, 0.2f, 1, r2);
+    OIIO_CHECK_EQUAL(lookup_cache_hits(ts), hits + 1);
+    OIIO_CHECK_EQUAL(r2[0], r1[0]);
+    hits = lookup_cache_hits(ts);
+    lookup(0.31f, 0.2f, 1, r2);
+    OIIO_CHECK_EQUAL(lookup_cache_hits(ts), hits);
+    OIIO_CHECK_NE(r2[0], r1[0]);
+
+    // With a tolerance, coordinates in the same quantum hit
+    ts->attribute("lookup_cache_tolerance", 0.01f);
+    lookup(0.3021f, 0.2f, 1, r1);
+    hits = lookup_cache_hits(ts);
+    lookup(0.3029f, 0.2f, 1, r2);
+    OIIO_CHECK_EQUAL(lookup_cache_hits(ts), hits + 1);
+    OIIO_CHECK_EQUAL(r2[0], r1[0]);
+    lookup(0.3121f, 0.2f, 1, r2);
+    OIIO_CHECK_EQUAL(lookup_cache_hits(ts), hits + 1);
+
+    // Changing the tolerance makes the memo stale
+    ts->attribute("lookup_cache_tolerance", 0.0f);
+    lookup(0.3f, 0.2f, 1, r1);
+    hits = lookup_cache_hits(ts);
+
+    // So does flipping t, which must change the answer
+    ts->attribute("flip_t", 1);
+    lookup(0.3f, 0.2f, 1, r2);
+    OIIO_CHECK_EQUAL(lookup_cache_hits(ts), hits);
+    OIIO_CHECK_NE(r2[0], r1[0]);
+    ts->attribute("flip_t", 0);
+    lookup(0.3f, 0.2f, 1, r2);
+    OIIO_CHECK_EQUAL(lookup_cache_hits(ts), hits);
+    OIIO_CHECK_EQUAL(r2[0], r1[0]);
+
+    // ... and gray_to_rgb, which changes the channels beyond the first
+    lookup(0.3f, 0.2f, 3, r1);
+    OIIO_CHECK_EQUAL(r1[1], 0.0f);
+    hits = lookup_cache_hits(ts);
+    ts->attribute("gray_to_rgb", 1);
+    lookup(0.3f, 0.2f, 3, r2);
+    OIIO_CHECK_EQUAL(lookup_cache_hits(ts), hits);
+    OIIO_CHECK_EQUAL(r2[1], r2[0]);
+    OIIO_CHECK_EQUAL(r2[2], r2[0]);
+
+    // ... and resizing the memo
+    lookup(0.3f, 0.2f, 1, r1);
+    hits = lookup_cache_hits(ts);
+    ts->attribute("lookup_cache_size", 32);
+    lookup(0.3f, 0.2f, 1, r2);
+    OIIO_CHECK_EQUAL(lookup_cache_hits(ts), hits);
+    OIIO_CHECK_EQUAL(r2[0], r1[0]);
+
+    // Lookups of more channels than a memo holds are never memoized
+    float wide1[8], wide2[8];
+    OIIO_CHECK_ASSERT(ts->texture(filename, opt, 0.3f, 0.2f, d, 0.0f, 0.0f,
+                                  d, 8, wide1));
+    hits = lookup_cache_hits(ts);
+    OIIO_CHECK_ASSERT(ts->texture(filename, opt, 0.3f, 0.2f, d, 0.0f, 0.0f,
+                                  d, 8, wide2));
+    OIIO_CHECK_EQUAL(lookup_cache_hits(ts), hits);
+    OIIO_CHECK_EQUAL(wide2[0], wide1[0]);
+
+    // Nor are coordinates too large to quantize
+    ts->attribute("lookup_cache_tolerance", 0.01f);
+    lookup(1.0e30f, 0.2f, 1, r1);
+    hits = lookup_cache_hits(ts);
+    lookup(1.0e30f, 0.2f, 1, r2);
+    OIIO_CHECK_EQUAL(lookup_cache_hits(ts), hits);
+
+    TextureSystem::destroy(ts);
+    remove(filename.c_str());
+}
+
+
+
 int
 main(int argc, char** argv)
 {
@@ -170,7 +325,9 @@ main(int argc, char** argv)
     test_get_pixels_cachechannels(6, 9);
     test_get_pixels_cachechannels(6, 9, 6, 9);
 
+    test_imagebuf_cached_channel_subset();
     test_app_buffer();
+    test_texture_lookup_memo();
 
     return unit_test_failures;
 }
@@ -0,0 +1,891 @@
+/*
+  Copyright 2018 Larry Gritz and the other authors and contributors.
+  All Rights Reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+  * Redistributions of source code must retain the above copyright
+  notice, this list of conditions and the following disclaimer.
+  * Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+  * Neither the name of the software's owners nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  (This is the Modified BSD License)
+*/
+
+
+// Round trip tests of individual image format readers and writers.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <OpenImageIO/filesystem.h>
+#include <OpenImageIO/imageio.h>
+#include <OpenImageIO/platform.h>
+#include <OpenImageIO/thread.h>
+#include <OpenImageIO/unittest.h>
+
+#include <png.h>
+#include <tiffio.h>
+
+extern "C" {
+#include "jpeglib.h"
+}
+
+using namespace OIIO;
+
+
+
+// A smooth pattern, which JPEG compresses without much ringing, with
+// values that differ by channel.
+static std::vector<unsigned char>
+make_pattern(int width, int height, int nchannels)
+{
+    std::vector<unsigned char> pixels(size_t(width) * height * nchannels);
+    unsigned char* p = pixels.data();
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x)
+            for (int c = 0; c < nchannels; ++c)
+                *p++ = (unsigned char)(x * 200 / width + y * 40 / height
+                                       + c * 5);
+    return pixels;
+}
+
+
+
+static bool
+write_file(const std::string& filename, const ImageSpec& spec,
+           const void* pixels)
+{
+    auto out = ImageOutput::create(filename);
+    bool ok  = out && out->open(filename, spec)
+              && out->write_image(spec.format, pixels) && out->close();
+    if (!ok)
+        std::cout << "  " << (out ? out->geterror() : OIIO::geterror())
+                  << "\n";
+    return ok;
+}
+
+
+
+// Read the whole image in its native format, with an optional
+// configuration spec.
+static bool
+read_file(const std::string& filename, ImageSpec& spec,
+          std::vector<unsigned char>& pixels,
+          const ImageSpec* config = nullptr)
+{
+    auto in = ImageInput::open(filename, config);
+    if (!in) {
+        std::cout << "  " << OIIO::geterror() << "\n";
+        return false;
+    }
+    spec = in->spec();
+    pixels.resize(spec.image_bytes(true /*native*/));
+    bool ok = in->read_image(TypeDesc::UNKNOWN /*native*/, pixels.data());
+    if (!ok)
+        std::cout << "  " << in->geterror() << "\n";
+    return ok;
+}
+
+
+
+static std::vector<unsigned char>
+file_contents(const std::string& filename)
+{
+    std::vector<unsigned char> bytes(Filesystem::file_size(filename));
+    Filesystem::read_bytes(filename, bytes.data(), bytes.size());
+    return bytes;
+}
+
+
+
+// Largest difference between corresponding bytes of a and b.
+static int
+max_difference(const std::vector<unsigned char>& a,
+               const std::vector<unsigned char>& b)
+{
+    if (a.size() != b.size())
+        return 256;
+    int maxdiff = 0;
+    for (size_t i = 0; i < a.size(); ++i)
+        maxdiff = std::max(maxdiff, std::abs(int(a[i]) - int(b[i])));
+    return maxdiff;
+}
+
+
+
+// Write a CMYK JPEG with libjpeg directly, since the JPEG writer only
+// makes gray and RGB files.
+static bool
+write_cmyk_jpeg(const std::string& filename, int width, int height,
+                const std::vector<unsigned char>& cmyk)
+{
+    FILE* fd = Filesystem::fopen(filename, "wb");
+    if (!fd)
+        return false;
+    jpeg_compress_struct cinfo;
+    jpeg_error_mgr jerr;
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_compress(&cinfo);
+    jpeg_stdio_dest(&cinfo, fd);
+    cinfo.image_width      = width;
+    cinfo.image_height     = height;
+    cinfo.input_components = 4;
+    cinfo.in_color_space   = JCS_CMYK;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, 100, TRUE);
+    jpeg_start_compress(&cinfo, TRUE);
+    while (cinfo.next_scanline < cinfo.image_height) {
+        JSAMPROW row = (JSAMPROW)&cmyk[size_t(cinfo.next_scanline) * width
+                                       * 4];
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+    fclose(fd);
+    return true;
+}
+
+
+
+// A busier pattern of 8 or 16 bit values, to give the PNG filters and
+// deflate something to do.
+static std::vector<unsigned char>
+make_busy_pattern(int width, int height, int nchannels, int bits)
+{
+    size_t n = size_t(width) * height * nchannels;
+    std::vector<unsigned char> pixels(n * bits / 8);
+    unsigned short* p16 = (unsigned short*)pixels.data();
+    size_t i            = 0;
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x)
+            for (int c = 0; c < nchannels; ++c, ++i) {
+                unsigned int v = x * 37 + y * 101 + c * 13 + (x * y) % 17;
+                if (bits == 16)
+                    p16[i] = (unsigned short)(v * 151);
+                else
+                    pixels[i] = (unsigned char)v;
+            }
+    return pixels;
+}
+
+
+
+// Read a PNG with libpng directly, returning its native pixels in host
+// byte order.
+static bool
+libpng_read(const std::string& filename, int& width, int& height,
+            int& nchannels, int& bits, std::vector<unsigned char>& pixels)
+{
+    FILE* fd = Filesystem::fopen(filename, "rb");
+    if (!fd)
+        return false;
+    png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL,
+                                             NULL, NULL);
+    png_infop info  = png_create_info_struct(png);
+    std::vector<png_bytep> rows;
+    if (setjmp(png_jmpbuf(png))) {
+        png_destroy_read_struct(&png, &info, NULL);
+        fclose(fd);
+        return false;
+    }
+    png_init_io(png, fd);
+    png_read_info(png, info);
+    width     = png_get_image_width(png, info);
+    height    = png_get_image_height(png, info);
+    nchannels = png_get_channels(png, info);
+    bits      = png_get_bit_depth(png, info);
+    if (bits == 16 && littleendian())
+        png_set_swap(png);
+    png_set_interlace_handling(png);
+    png_read_update_info(png, info);
+    size_t rowbytes = png_get_rowbytes(png, info);
+    pixels.resize(rowbytes * height);
+    for (int y = 0; y < height; ++y)
+        rows.push_back(&pixels[y * rowbytes]);
+    png_read_image(png, rows.data());
+    png_read_end(png, NULL);
+    png_destroy_read_struct(&png, &info, NULL);
+    fclose(fd);
+    return true;
+}
+
+
+
+// Write an Adam7 interlaced PNG with libpng directly, since the PNG writer
+// doesn't make them.
+static bool
+write_interlaced_png(const std::string& filename, int width, int height,
+                     int nchannels, int bits,
+                     const std::vector<unsigned char>& pixels)
+{
+    FILE* fd = Filesystem::fopen(filename, "wb");
+    if (!fd)
+        return false;
+    png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL,
+                                              NULL, NULL);
+    png_infop info  = png_create_info_struct(png);
+    if (setjmp(png_jmpbuf(png))) {
+        png_destroy_write_struct(&png, &info);
+        fclose(fd);
+        return false;
+    }
+    png_init_io(png, fd);
+    png_set_IHDR(png, info, width, height, bits,
+                 nchannels == 4 ? PNG_COLOR_TYPE_RGB_ALPHA
+                                : PNG_COLOR_TYPE_RGB,
+                 PNG_INTERLACE_ADAM7, PNG_COMPRESSION_TYPE_DEFAULT,
+                 PNG_FILTER_TYPE_DEFAULT);
+    png_write_info(png, info);
+    if (bits == 16 && littleendian())
+        png_set_swap(png);
+    size_t rowbytes = size_t(width) * nchannels * bits / 8;
+    std::vector<png_bytep> rows;
+    for (int y = 0; y < height; ++y)
+        rows.push_back((png_bytep)&pixels[y * rowbytes]);
+    png_write_image(png, rows.data());
+    png_write_end(png, NULL);
+    png_destroy_write_struct(&png, &info);
+    fclose(fd);
+    return true;
+}
+
+
+
+// Smoothly varying values with some busier low bits, as FLOAT or HALF,
+// to give the floating point predictor and LZW something to do.
+static std::vector<unsigned char>
+make_float_pattern(int width, int height, int nchannels, TypeDesc format)
+{
+    size_t n = size_t(width) * height * nchannels;
+    std::vector<float> values(n);
+    size_t i = 0;
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x)
+            for (int c = 0; c < nchannels; ++c, ++i)
+                values[i] = (x * 0.37f + y * 1.01f + c) * 0.125f - 3.0f
+                            + float((x * y + c) % 7) / 64.0f;
+    std::vector<unsigned char> pixels(n * format.size());
+    convert_types(TypeDesc::FLOAT, values.data(), format, pixels.data(),
+                  int(n));
+    return pixels;
+}
+
+
+
+// Write a float or half TIFF with libtiff directly, LZW compressed with
+// the floating point predictor, in strips of 8 rows or in square tiles,
+// with contiguous or separate planes. The pixels are always interleaved.
+static bool
+libtiff_write_float(const std::string& filename, int width, int height,
+                    int nchannels, TypeDesc format, bool separate,
+                    int tilesize, const std::vector<unsigned char>& pixels)
+{
+    TIFF* tif = TIFFOpen(filename.c_str(), "w");
+    if (!tif)
+        return false;
+    int bytes         = int(format.size());
+    size_t pixelbytes = size_t(bytes) * nchannels;
+    size_t chanbytes  = separate ? size_t(bytes) : pixelbytes;
+    int planes        = separate ? nchannels : 1;
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, width);
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH, height);
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, nchannels);
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, bytes * 8);
+    TIFFSetField(tif, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_IEEEFP);
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC,
+                 nchannels >= 3 ? PHOTOMETRIC_RGB : PHOTOMETRIC_MINISBLACK);
+    if (nchannels == 4) {
+        uint16_t extra = EXTRASAMPLE_ASSOCALPHA;
+        TIFFSetField(tif, TIFFTAG_EXTRASAMPLES, 1, &extra);
+    }
+    TIFFSetField(tif, TIFFTAG_PLANARCONFIG,
+                 separate ? PLANARCONFIG_SEPARATE : PLANARCONFIG_CONTIG);
+    TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_LZW);
+    TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_FLOATINGPOINT);
+    if (tilesize) {
+        TIFFSetField(tif, TIFFTAG_TILEWIDTH, tilesize);
+        TIFFSetField(tif, TIFFTAG_TILELENGTH, tilesize);
+    } else {
+        TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, 8);
+    }
+    bool ok = true;
+    for (int p = 0; p < planes && ok; ++p) {
+        if (tilesize) {
+            std::vector<unsigned char> tile(TIFFTileSize(tif));
+            for (int ty = 0; ty < height && ok; ty += tilesize) {
+                for (int tx = 0; tx < width && ok; tx += tilesize) {
+                    std::fill(tile.begin(), tile.end(), 0);
+                    int yend = std::min(ty + tilesize, height);
+                    int xend = std::min(tx + tilesize, width);
+                    for (int y = ty; y < yend; ++y)
+                        for (int x = tx; x < xend; ++x)
+                            memcpy(&tile[((y - ty) * tilesize + (x - tx))
+                                         * chanbytes],
+                                   &pixels[(size_t(y) * width + x) * pixelbytes
+                                           + p * bytes],
+                                   chanbytes);
+                    ok = TIFFWriteTile(tif, tile.data(), tx, ty, 0, p) >= 0;
+                }
+            }
+        } else {
+            std::vector<unsigned char> row(size_t(width) * chanbytes);
+            for (int y = 0; y < height && ok; ++y) {
+                for (int x = 0; x < width; ++x)
+                    memcpy(&row[x * chanbytes],
+                           &pixels[(size_t(y) * width + x) * pixelbytes
+                                   + p * bytes],
+                           chanbytes);
+                ok = TIFFWriteScanline(tif, row.data(), y, p) >= 0;
+            }
+        }
+    }
+    TIFFClose(tif);
+    return ok;
+}
+
+
+
+// Read a TIFF with libtiff directly, returning its native pixels
+// interleaved, whatever its planar configuration, along with its
+// compression and predictor.
+static bool
+libtiff_read(const std::string& filename, int& width, int& height,
+             int& nchannels, int& compression, int& predictor,
+             std::vector<unsigned char>& pixels)
+{
+    TIFF* tif = TIFFOpen(filename.c_str(), "r");
+    if (!tif)
+        return false;
+    uint32_t w = 0, h = 0;
+    uint16_t spp = 1, bps = 8, comp = 1, pred = 1, planar = 1;
+    TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &w);
+    TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &h);
+    TIFFGetFieldDefaulted(tif, TIFFTAG_SAMPLESPERPIXEL, &spp);
+    TIFFGetFieldDefaulted(tif, TIFFTAG_BITSPERSAMPLE, &bps);
+    TIFFGetFieldDefaulted(tif, TIFFTAG_COMPRESSION, &comp);
+    TIFFGetFieldDefaulted(tif, TIFFTAG_PREDICTOR, &pred);
+    TIFFGetFieldDefaulted(tif, TIFFTAG_PLANARCONFIG, &planar);
+    width             = int(w);
+    height            = int(h);
+    nchannels         = spp;
+    compression       = comp;
+    predictor         = pred;
+    bool separate     = (planar == PLANARCONFIG_SEPARATE);
+    int bytes         = bps / 8;
+    size_t pixelbytes = size_t(bytes) * spp;
+    size_t chanbytes  = separate ? size_t(bytes) : pixelbytes;
+    int planes        = separate ? spp : 1;
+    pixels.assign(size_t(w) * h * pixelbytes, 0);
+    bool ok = true;
+    if (TIFFIsTiled(tif)) {
+        uint32_t tw = 0, th = 0;
+        TIFFGetField(tif, TIFFTAG_TILEWIDTH, &tw);
+        TIFFGetField(tif, TIFFTAG_TILELENGTH, &th);
+        std::vector<unsigned char> tile(TIFFTileSize(tif));
+        for (int p = 0; p < planes && ok; ++p) {
+            for (uint32_t ty = 0; ty < h && ok; ty += th) {
+                for (uint32_t tx = 0; tx < w && ok; tx += tw) {
+                    ok = TIFFReadTile(tif, tile.data(), tx, ty, 0, p) >= 0;
+                    uint32_t yend = std::min(ty + th, h);
+                    uint32_t xend = std::min(tx + tw, w);
+                    for (uint32_t y = ty; y < yend; ++y)
+                        for (uint32_t x = tx; x < xend; ++x)
+                            memcpy(&pixels[(size_t(y) * w + x) * pixelbytes
+                                           + p * bytes],
+                                   &tile[((y - ty) * tw + (x - tx))
+                                         * chanbytes],
+                                   chanbytes);
+                }
+            }
+        }
+    } else {
+        std::vector<unsigned char> row(TIFFScanlineSize(tif));
+        for (int p = 0; p < planes && ok; ++p) {
+            for (uint32_t y = 0; y < h && ok; ++y) {
+                ok = TIFFReadScanline(tif, row.data(), y, p) >= 0;
+                for (uint32_t x = 0; x < w; ++x)
+                    memcpy(&pixels[(size_t(y) * w + x) * pixelbytes
+                                   + p * bytes],
+                           &row[x * chanbytes], chanbytes);
+            }
+        }
+    }
+    TIFFClose(tif);
+    return ok;
+}
+
+
+
+// The "jpeg:scale", "jpeg:size" and "jpeg:fastdct" open hints.
+static void
+test_jpeg_decode_hints()
+{
+    std::cout << "test_jpeg_decode_hints\n";
+    const std::string filename = "imageinout_test-hints.jpg";
+    const int width = 256, height = 200;
+    ImageSpec spec(width, height, 3, TypeDesc::UINT8);
+    spec.attribute("CompressionQuality", 100);
+    OIIO_CHECK_ASSERT(write_file(filename, spec,
+                                 make_pattern(width, height, 3).data()));
+    ImageSpec fullspec;
+    std::vector<unsigned char> full;
+    OIIO_CHECK_ASSERT(read_file(filename, fullspec, full));
+    OIIO_CHECK_EQUAL(fullspec.width, width);
+
+    // Reduced decodes are close to box filtering the full decode
+    for (int scale : { 2, 4, 8 }) {
+        ImageSpec config, rspec;
+        config.attribute("jpeg:scale", scale);
+        std::vector<unsigned char> reduced;
+        OIIO_CHECK_ASSERT(read_file(filename, rspec, reduced, &config));
+        OIIO_CHECK_EQUAL(rspec.width, width / scale);
+        OIIO_CHECK_EQUAL(rspec.height, height / scale);
+        if (rspec.width != width / scale || rspec.height != height / scale)
+            continue;
+        std::vector<unsigned char> boxed(reduced.size());
+        const int n = scale * scale;
+        for (int y = 0; y < rspec.height; ++y)
+            for (int x = 0; x < rspec.width; ++x)
+                for (int c = 0; c < 3; ++c) {
+                    int sum = 0;
+                    for (int j = 0; j < scale; ++j) {
+                        const unsigned char* row
+                            = &full[((y * scale + j) * width + x * scale) * 3];
+                        for (int i = 0; i < scale; ++i)
+                            sum += row[i * 3 + c];
+                    }
+                    boxed[(y * rspec.width + x) * 3 + c]
+                        = (unsigned char)((sum + n / 2) / n);
+                }
+        OIIO_CHECK_LE(max_difference(reduced, boxed), 6);
+    }
+
+    // jpeg:size picks the most reduced scale still at least that big
+    struct {
+        int w, h, expectw, expecth;
+    } sizes[] = { { 200, 10, 256, 200 },
+                  { 100, 60, 128, 100 },
+                  { 64, 50, 64, 50 },
+                  { 30, 20, 32, 25 },
+                  { 1, 1, 32, 25 } };
+    for (auto s : sizes) {
+        ImageSpec config, rspec;
+        int size[2] = { s.w, s.h };
+        config.attribute("jpeg:size", TypeDesc(TypeDesc::INT, 2), size);
+        auto in = ImageInput::open(filename, &config);
+        OIIO_CHECK_ASSERT(in);
+        if (in) {
+            OIIO_CHECK_EQUAL(in->spec().width, s.expectw);
+            OIIO_CHECK_EQUAL(in->spec().height, s.expecth);
+        }
+    }
+
+    // The fast integer DCT is full size and nearly the same
+    ImageSpec config, fastspec;
+    config.attribute("jpeg:fastdct", 1);
+    std::vector<unsigned char> fast;
+    OIIO_CHECK_ASSERT(read_file(filename, fastspec, fast, &config));
+    OIIO_CHECK_EQUAL(fastspec.width, width);
+    OIIO_CHECK_EQUAL(fastspec.height, height);
+    OIIO_CHECK_LE(max_difference(fast, full), 4);
+
+    Filesystem::remove(filename);
+}
+
+
+
+// Reading several scanlines at a time, in any order, gives the same
+// pixels as reading them one by one.
+static void
+check_jpeg_scanline_ranges(const std::string& filename)
+{
+    auto in = ImageInput::open(filename);
+    OIIO_CHECK_ASSERT(in);
+    if (!in)
+        return;
+    const ImageSpec spec(in->spec());
+    size_t rowbytes = spec.scanline_bytes(true);
+    std::vector<unsigned char> onebyone(rowbytes * spec.height);
+    for (int y = 0; y < spec.height; ++y)
+        OIIO_CHECK_ASSERT(
+            in->read_native_scanline(0, 0, y, 0, &onebyone[y * rowbytes]));
+
+    in = ImageInput::open(filename);
+    std::vector<unsigned char> buf(rowbytes * spec.height);
+    // Forward in uneven pieces, then backwards, then a single line
+    struct {
+        int ybegin, yend;
+    } ranges[] = { { 0, 37 }, { 37, spec.height }, { 10, 90 }, { 3, 5 },
+                   { 150, 151 } };
+    for (auto r : ranges) {
+        OIIO_CHECK_ASSERT(in->read_native_scanlines(0, 0, r.ybegin, r.yend, 0,
+                                                    buf.data()));
+        OIIO_CHECK_ASSERT(memcmp(buf.data(), &onebyone[r.ybegin * rowbytes],
+                                 (r.yend - r.ybegin) * rowbytes)
+                          == 0);
+    }
+}
+
+
+
+static void
+test_jpeg_read_native_scanlines()
+{
+    std::cout << "test_jpeg_read_native_scanlines\n";
+    const int width = 123, height = 197;
+    const std::string filename = "imageinout_test-scanlines.jpg";
+    ImageSpec spec(width, height, 3, TypeDesc::UINT8);
+    OIIO_CHECK_ASSERT(write_file(filename, spec,
+                                 make_pattern(width, height, 3).data()));
+    check_jpeg_scanline_ranges(filename);
+
+    // CMYK files are converted to RGB as they're read
+    const std::string cmykname = "imageinout_test-cmyk.jpg";
+    std::vector<unsigned char> cmyk = make_pattern(width, height, 4);
+    for (size_t i = 3; i < cmyk.size(); i += 4)
+        cmyk[i] = 255 - (cmyk[i] & 63);
+    OIIO_CHECK_ASSERT(write_cmyk_jpeg(cmykname, width, height, cmyk));
+    ImageSpec rgbspec;
+    std::vector<unsigned char> rgb;
+    OIIO_CHECK_ASSERT(read_file(cmykname, rgbspec, rgb));
+    OIIO_CHECK_EQUAL(rgbspec.nchannels, 3);
+    OIIO_CHECK_EQUAL(rgbspec.get_string_attribute("jpeg:ColorSpace"), "CMYK");
+    if (rgb.size() == size_t(width) * height * 3) {
+        std::vector<unsigned char> expected(rgb.size());
+        for (size_t p = 0; p < size_t(width) * height; ++p)
+            for (int c = 0; c < 3; ++c)
+                expected[p * 3 + c] = (unsigned char)((cmyk[p * 4 + c]
+                                                           * cmyk[p * 4 + 3]
+                                                       + 127)
+                                                      / 255);
+        OIIO_CHECK_LE(max_difference(rgb, expected), 4);
+    }
+    check_jpeg_scanline_ranges(cmykname);
+
+    Filesystem::remove(filename);
+    Filesystem::remove(cmykname);
+}
+
+
+
+// Files with restart markers are compressed, and decoded, in bands in
+// parallel. Make sure that gives exactly the same file, and pixels, as
+// doing it serially.
+static void
+test_jpeg_parallel_bands()
+{
+    std::cout << "test_jpeg_parallel_bands\n";
+    // Bands are at least 256 scanlines, so this height gives a partial
+    // last band.
+    const int width = 333, height = 700;
+    std::vector<unsigned char> pixels = make_pattern(width, height, 3);
+    if (default_thread_pool()->size() < 2)
+        default_thread_pool()->resize(3);
+    int multithread = OIIO::get_int_attribute("jpeg:multithread");
+    const std::string serialname   = "imageinout_test-serial.jpg";
+    const std::string parallelname = "imageinout_test-parallel.jpg";
+    for (const char* subsampling : { "4:2:0", "4:4:4" }) {
+        for (int restart : { 1, 3 }) {
+            ImageSpec spec(width, height, 3, TypeDesc::UINT8);
+            spec.attribute("jpeg:subsampling", subsampling);
+            spec.attribute("jpeg:restart", restart);
+            OIIO::attribute("jpeg:multithread", 0);
+            OIIO_CHECK_ASSERT(write_file(serialname, spec, pixels.data()));
+            OIIO::attribute("jpeg:multithread", 1);
+            OIIO_CHECK_ASSERT(write_file(parallelname, spec, pixels.data()));
+            std::vector<unsigned char> serial = file_contents(serialname);
+            OIIO_CHECK_ASSERT(serial == file_contents(parallelname));
+
+            // Also when the scanlines arrive one at a time
+            auto out = ImageOutput::create(parallelname);
+            OIIO_CHECK_ASSERT(out && out->open(parallelname, spec));
+            for (int y = 0; out && y < height; ++y)
+                OIIO_CHECK_ASSERT(out->write_scanline(
+                    y, 0, TypeDesc::UINT8, &pixels[size_t(y) * width * 3]));
+            OIIO_CHECK_ASSERT(out && out->close());
+            OIIO_CHECK_ASSERT(serial == file_contents(parallelname));
+
+            // Decoding in parallel gives the same pixels
+            ImageSpec rspec;
+            std::vector<unsigned char> serialpixels, parallelpixels;
+            OIIO::attribute("jpeg:multithread", 0);
+            OIIO_CHECK_ASSERT(read_file(serialname, rspec, serialpixels));
+            OIIO::attribute("jpeg:multithread", 1);
+            OIIO_CHECK_ASSERT(read_file(serialname, rspec, parallelpixels));
+            OIIO_CHECK_ASSERT(serialpixels == parallelpixels);
+            OIIO_CHECK_LE(max_difference(parallelpixels, pixels), 16);
+        }
+    }
+
+    // copy_image() reopens the output to copy the input's coefficients
+    // losslessly, which must not be disturbed by its first open having
+    // been set up for a parallel write.
+    auto in = ImageInput::open(serialname);
+    OIIO_CHECK_ASSERT(in);
+    if (in) {
+        ImageSpec spec = in->spec();
+        spec.attribute("jpeg:restart", 1);
+        auto out = ImageOutput::create(parallelname);
+        OIIO_CHECK_ASSERT(out && out->open(parallelname, spec)
+                          && out->copy_image(in.get()) && out->close());
+        in.reset();
+        ImageSpec rspec;
+        std::vector<unsigned char> original, copied;
+        OIIO_CHECK_ASSERT(read_file(serialname, rspec, original));
+        OIIO_CHECK_ASSERT(read_file(parallelname, rspec, copied));
+        OIIO_CHECK_ASSERT(original == copied);
+    }
+
+    OIIO::attribute("jpeg:multithread", multithread);
+    Filesystem::remove(serialname);
+    Filesystem::remove(parallelname);
+}
+
+
+
+// PNG files are deflated in bands in parallel. Whether written in parallel
+// or not, libpng should read back exactly the pixels we wrote.
+static void
+test_png_parallel_write()
+{
+    std::cout << "test_png_parallel_write\n";
+    // Tall enough for several bands of about 256KB each
+    const int width = 301, height = 700;
+    if (default_thread_pool()->size() < 2)
+        default_thread_pool()->resize(3);
+    int multithread            = OIIO::get_int_attribute("png:multithread");
+    const std::string filename = "imageinout_test-parallel.png";
+    for (int bits : { 8, 16 }) {
+        for (int nchannels : { 3, 4 }) {
+            std::vector<unsigned char> pixels
+                = make_busy_pattern(width, height, nchannels, bits);
+            ImageSpec spec(width, height, nchannels,
+                           bits == 16 ? TypeDesc::UINT16 : TypeDesc::UINT8);
+            // Our values are already unassociated, keep them exact
+            spec.attribute("oiio:UnassociatedAlpha", 1);
+            size_t rowbytes = spec.scanline_bytes();
+            for (int mt = 0; mt < 3; ++mt) {
+                OIIO::attribute("png:multithread", mt ? 1 : 0);
+                if (mt < 2) {
+                    OIIO_CHECK_ASSERT(
+                        write_file(filename, spec, pixels.data()));
+                } else {
+                    // Parallel, with scanlines arriving one at a time
+                    auto out = ImageOutput::create(filename);
+                    OIIO_CHECK_ASSERT(out && out->open(filename, spec));
+                    for (int y = 0; out && y < height; ++y)
+                        OIIO_CHECK_ASSERT(
+                            out->write_scanline(y, 0, spec.format,
+                                                &pixels[y * rowbytes]));
+                    OIIO_CHECK_ASSERT(out && out->close());
+                }
+                int w = 0, h = 0, nc = 0, b = 0;
+                std::vector<unsigned char> readback;
+                OIIO_CHECK_ASSERT(
+                    libpng_read(filename, w, h, nc, b, readback));
+                OIIO_CHECK_EQUAL(w, width);
+                OIIO_CHECK_EQUAL(h, height);
+                OIIO_CHECK_EQUAL(nc, nchannels);
+                OIIO_CHECK_EQUAL(b, bits);
+                OIIO_CHECK_ASSERT(readback == pixels);
+            }
+        }
+    }
+    OIIO::attribute("png:multithread", multithread);
+    Filesystem::remove(filename);
+}
+
+
+
+// Reading ranges of scanlines of interlaced and non-interlaced PNG files,
+// including going backwards, gives the right rows.
+static void
+test_png_read_native_scanlines()
+{
+    std::cout << "test_png_read_native_scanlines\n";
+    const int width = 123, height = 197, nchannels = 4;
+    const std::string filename = "imageinout_test-scanlines.png";
+    for (int bits : { 8, 16 }) {
+        std::vector<unsigned char> pixels
+            = make_busy_pattern(width, height, nchannels, bits);
+        for (int interlaced = 0; interlaced < 2; ++interlaced) {
+            ImageSpec spec(width, height, nchannels,
+                           bits == 16 ? TypeDesc::UINT16 : TypeDesc::UINT8);
+            spec.attribute("oiio:UnassociatedAlpha", 1);
+            if (interlaced)
+                OIIO_CHECK_ASSERT(write_interlaced_png(filename, width,
+                                                       height, nchannels,
+                                                       bits, pixels));
+            else
+                OIIO_CHECK_ASSERT(write_file(filename, spec, pixels.data()));
+            // Read back unassociated, so the pixels are just as written
+            ImageSpec config;
+            config.attribute("oiio:UnassociatedAlpha", 1);
+            auto in = ImageInput::open(filename, &config);
+            OIIO_CHECK_ASSERT(in);
+            if (!in)
+                continue;
+            size_t rowbytes = spec.scanline_bytes();
+            std::vector<unsigned char> buf(pixels.size());
+            struct {
+                int ybegin, yend;
+            } ranges[] = { { 0, 37 }, { 37, height }, { 10, 90 }, { 3, 5 },
+                           { 150, 151 }, { 0, height } };
+            for (auto r : ranges) {
+                OIIO_CHECK_ASSERT(in->read_native_scanlines(0, 0, r.ybegin,
+                                                            r.yend, 0,
+                                                            buf.data()));
+                OIIO_CHECK_ASSERT(memcmp(buf.data(),
+                                         &pixels[r.ybegin * rowbytes],
+                                         (r.yend - r.ybegin) * rowbytes)
+                                  == 0);
+            }
+        }
+    }
+    Filesystem::remove(filename);
+}
+
+
+
+// LZW files with the floating point predictor are decoded in parallel,
+// by strip or tile, by our own LZW decoder and predictor undo. Whether
+// contiguous or separate planes, that must give exactly what libtiff does.
+static void
+test_tiff_parallel_lzw_read()
+{
+    std::cout << "test_tiff_parallel_lzw_read\n";
+    // Partial strips and tiles at the right and bottom edges
+    const int width = 97, height = 75;
+    if (default_thread_pool()->size() < 2)
+        default_thread_pool()->resize(3);
+    int multithread            = OIIO::get_int_attribute("tiff:multithread");
+    const std::string filename = "imageinout_test-lzw.tif";
+    for (TypeDesc format : { TypeDesc::FLOAT, TypeDesc::HALF }) {
+        for (int nchannels : { 1, 3, 4 }) {
+            std::vector<unsigned char> pixels
+                = make_float_pattern(width, height, nchannels, format);
+            for (int separate = 0; separate < 2; ++separate) {
+                for (int tilesize : { 0, 16 }) {
+                    OIIO_CHECK_ASSERT(libtiff_write_float(filename, width,
+                                                          height, nchannels,
+                                                          format, separate,
+                                                          tilesize, pixels));
+                    int w = 0, h = 0, nc = 0, comp = 0, pred = 0;
+                    std::vector<unsigned char> expected;
+                    OIIO_CHECK_ASSERT(libtiff_read(filename, w, h, nc, comp,
+                                                   pred, expected));
+                    OIIO_CHECK_EQUAL(comp, COMPRESSION_LZW);
+                    OIIO_CHECK_EQUAL(pred, PREDICTOR_FLOATINGPOINT);
+                    OIIO_CHECK_ASSERT(expected == pixels);
+                    for (int mt = 0; mt < 2; ++mt) {
+                        OIIO::attribute("tiff:multithread", mt);
+                        ImageSpec spec;
+                        std::vector<unsigned char> readback;
+                        OIIO_CHECK_ASSERT(read_file(filename, spec, readback));
+                        OIIO_CHECK_EQUAL(spec.format, format);
+                        OIIO_CHECK_EQUAL(spec.tile_width, tilesize);
+                        OIIO_CHECK_ASSERT(readback == expected);
+                    }
+                }
+            }
+        }
+    }
+    OIIO::attribute("tiff:multithread", multithread);
+    Filesystem::remove(filename);
+}
+
+
+
+// LZW strips and tiles are compressed in parallel by our own encoder,
+// applying the predictor ourselves, then written in order or, with
+// "tiff:write_any_order", as they finish. Either way libtiff must read
+// back exactly the pixels we wrote.
+static void
+test_tiff_parallel_lzw_write()
+{
+    std::cout << "test_tiff_parallel_lzw_write\n";
+    const int width = 97, height = 75;
+    if (default_thread_pool()->size() < 2)
+        default_thread_pool()->resize(3);
+    int multithread            = OIIO::get_int_attribute("tiff:multithread");
+    const std::string filename = "imageinout_test-lzw-write.tif";
+    for (TypeDesc format : { TypeDesc::FLOAT, TypeDesc::HALF,
+                             TypeDesc::UINT16, TypeDesc::UINT8 }) {
+        bool isfloat  = format.is_floating_point();
+        int predictor = isfloat ? PREDICTOR_FLOATINGPOINT
+                                : PREDICTOR_HORIZONTAL;
+        for (int nchannels : { 1, 3, 4 }) {
+            std::vector<unsigned char> pixels
+                = isfloat ? make_float_pattern(width, height, nchannels,
+                                               format)
+                          : make_busy_pattern(width, height, nchannels,
+                                              int(format.size()) * 8);
+            for (int tilesize : { 0, 16 }) {
+                ImageSpec spec(width, height, nchannels, format);
+                spec.attribute("Compression", "lzw");
+                if (tilesize) {
+                    spec.tile_width  = tilesize;
+                    spec.tile_height = tilesize;
+                } else {
+                    spec.attribute("tiff:RowsPerStrip", 8);
+                }
+                // Serial, parallel in order, and parallel in any order
+                for (int mt = 0; mt < 3; ++mt) {
+                    OIIO::attribute("tiff:multithread", mt ? 1 : 0);
+                    spec.attribute("tiff:write_any_order", mt == 2);
+                    OIIO_CHECK_ASSERT(
+                        write_file(filename, spec, pixels.data()));
+                    int w = 0, h = 0, nc = 0, comp = 0, pred = 0;
+                    std::vector<unsigned char> readback;
+                    OIIO_CHECK_ASSERT(libtiff_read(filename, w, h, nc, comp,
+                                                   pred, readback));
+                    OIIO_CHECK_EQUAL(w, width);
+                    OIIO_CHECK_EQUAL(h, height);
+                    OIIO_CHECK_EQUAL(nc, nchannels);
+                    OIIO_CHECK_EQUAL(comp, COMPRESSION_LZW);
+                    OIIO_CHECK_EQUAL(pred, predictor);
+                    OIIO_CHECK_ASSERT(readback == pixels);
+                }
+            }
+        }
+    }
+    OIIO::attribute("tiff:multithread", multithread);
+    Filesystem::remove(filename);
+}
+
+
+
+int
+main(int argc, char* argv[])
+{
+    test_jpeg_decode_hints();
+    test_jpeg_read_native_scanlines();
+    test_jpeg_parallel_bands();
+    test_png_parallel_write();
+    test_png_read_native_scanlines();
+    test_tiff_parallel_lzw_read();
+    test_tiff_parallel_lzw_write();
+
+    return unit_test_failures;
+}
@@ -68,6 +68,8 @@ atomic_int oiio_exr_threads(threads_default());
 atomic_int oiio_read_chunk(256);
 int tiff_half(0);
 int tiff_multithread(1);
+int jpeg_multithread(1);
+int png_multithread(1);
 ustring plugin_searchpath(OIIO_DEFAULT_PLUGIN_SEARCHPATH);
 std::string format_list;         // comma-separated list of all formats
 std::string input_format_list;   // comma-separated list of readable formats
@@ -312,6 +314,14 @@ attribute(string_view name, TypeDesc type, const void* val)
         tiff_multithread = *(const int*)val;
         return true;
     }
+    if (name == "jpeg:multithread" && type == TypeInt) {
+        jpeg_multithread = *(const int*)val;
+        return true;
+    }
+    if (name == "png:multithread" && type == TypeInt) {
+        png_multithread = *(const int*)val;
+        return true;
+    }
     if (name == "debug" && type == TypeInt) {
         oiio_print_debug = *(const int*)val;
         return true;
@@ -383,6 +393,14 @@ getattribute(string_view name, TypeDesc type, void* val)
         *(int*)val = tiff_multithread;
         return true;
     }
+    if (name == "jpeg:multithread" && type == TypeInt) {
+        *(int*)val = jpeg_multithread;
+        return true;
+    }
+    if (name == "png:multithread" && type == TypeInt) {
+        *(int*)val = png_multithread;
+        return true;
+    }
     if (name == "debug" && type == TypeInt) {
         *(int*)val = oiio_print_debug;
         return true;
@@ -31,6 +31,8 @@
 
 #include <OpenImageIO/argparse.h>
 #include <OpenImageIO/benchmark.h>
+#include <OpenImageIO/deepdata.h>
+#include <OpenImageIO/filesystem.h>
 #include <OpenImageIO/imagebuf.h>
 #include <OpenImageIO/imagebufalgo.h>
 #include <OpenImageIO/imageio.h>
@@ -41,6 +43,7 @@
 
 #include <functional>
 #include <iostream>
+#include <sstream>
 #include <vector>
 
 using namespace OIIO;
@@ -52,6 +55,9 @@ static int numthreads    = 0;
 static int autotile_size = 64;
 static bool iter_only    = false;
 static bool no_iter      = false;
+static bool no_mip       = false;
+static bool tiff_bench   = false;
+static bool deep_bench   = false;
 static std::string conversionname;
 static TypeDesc conversion = TypeDesc::UNKNOWN;  // native by default
 static std::vector<ustring> input_filename;
@@ -95,6 +101,9 @@ getargs(int argc, char* argv[])
             ustring::sprintf("Autotile size (when used; default: %d)", autotile_size).c_str(),
         "--iteronly", &iter_only, "Run ImageBuf iteration tests only (not read tests)",
         "--noiter", &no_iter, "Don't run ImageBuf iteration tests",
+        "--nomip", &no_mip, "Don't run MIP-map construction tests",
+        "--tiffbench", &tiff_bench, "Time TIFF encoding and decoding of each compression, data type, and layout (no input files needed)",
+        "--deepbench", &deep_bench, "Time deep OpenEXR writing and reading (no input files needed)",
         "--convert %s", &conversionname, "Convert to named type upon read (default: native)",
         "--cache %f", &cache_size, "Specify ImageCache size, in MB",
         "-o %s", &output_filename, "Test output by writing to this file",
@@ -489,6 +498,214 @@ test_pixel_iteration(const std::string& explanation,
 
 
 
+static void
+test_mipmap(const std::string& explanation, TypeDesc format,
+            ImageBufAlgo::MakeTextureMode mode = ImageBufAlgo::MakeTxTexture)
+{
+    ImageBuf src(input_filename[0].string());
+    src.read(0, 0, true, format);
+    ImageSpec config;
+    config.format = format;
+    config.attribute("maketx:filtername", "box");
+    // Keep half data in half all the way down the pyramid, so that the
+    // 2x downsample runs its half kernels rather than converting to float.
+    // That requires accepting the pixel shift of odd resolutions.
+    config.attribute("maketx:forcefloat", 0);
+    config.attribute("maketx:allow_pixel_shift", 1);
+    // Write uncompressed, so that the time is dominated by building the
+    // MIP levels rather than by the compressor.
+    config.attribute("compression", "none");
+    const std::string filename = "imagespeed_test_mipmap.tx";
+    std::ostringstream errs;
+    bool ok   = true;
+    auto func = [&]() {
+        ok &= ImageBufAlgo::make_texture(mode, src, filename, config, &errs);
+    };
+    double t = time_trial(func, ntrials);
+    Filesystem::remove(filename);
+    if (!ok) {
+        std::cout << "  " << explanation << ": make_texture failed: "
+                  << errs.str() << std::endl;
+        return;
+    }
+    // Bytes of source level pixels read to build the whole pyramid
+    imagesize_t bytes = 0;
+    for (int w = src.spec().width, h = src.spec().height; w > 1 || h > 1;
+         w = std::max(1, w / 2), h = std::max(1, h / 2))
+        bytes += imagesize_t(w) * h * src.spec().nchannels * format.size();
+    std::cout << "  " << explanation << ": "
+              << Strutil::timeintervalformat(t, 2) << " = "
+              << Strutil::sprintf("%5.2f", double(bytes) / t / 1.0e9)
+              << " GB/s" << std::endl;
+}
+
+
+
+// Write a synthetic image as TIFF with each combination of compression,
+// data type, planar layout, and scanline vs tiled that has its own code
+// path, timing both encoding and decoding with libtiff's serial codecs and
+// with the plugin's parallel ones ("tiff:multithread"). Also make sure
+// that all of them give identical pixels.
+static void
+benchmark_tiff()
+{
+    std::cout << "Timing TIFF encoding and decoding, serial vs parallel:\n";
+    ImageBuf src(ImageSpec(2048, 1024, 4, TypeDesc::FLOAT));
+    const float tl[] = { 0.0f, 0.2f, 0.9f, 1.0f };
+    const float tr[] = { 1.0f, 0.5f, 0.1f, 1.0f };
+    const float bl[] = { 0.2f, 1.0f, 0.0f, 0.5f };
+    const float br[] = { 0.7f, 0.0f, 0.5f, 0.8f };
+    ImageBufAlgo::fill(src, tl, tr, bl, br);
+    // A little noise so the compressors have real work to do
+    ImageBufAlgo::noise(src, "gaussian", 0.0f, 0.02f);
+    imagesize_t npixels          = src.spec().image_pixels();
+    const std::string filename[] = { "imagespeed_test_tiffbench0.tif",
+                                     "imagespeed_test_tiffbench1.tif" };
+
+    const char* compressions[] = { "zip", "lzw" };
+    TypeDesc formats[] = { TypeDesc::UINT8, TypeDesc::UINT16, TypeDesc::HALF,
+                           TypeDesc::FLOAT };
+    const char* planarconfigs[] = { "contig", "separate" };
+    std::vector<char> pixels[3];
+    auto readit = [&](const std::string& filename, std::vector<char>& buf) {
+        auto in = ImageInput::open(filename);
+        ASSERT(in);
+        buf.resize(in->spec().image_bytes(true));
+        in->read_image(TypeDesc::UNKNOWN, buf.data());
+    };
+    for (auto compression : compressions) {
+        for (auto format : formats) {
+            for (auto planarconfig : planarconfigs) {
+                for (int tilesize : { 0, 64 }) {
+                    src.specmod().attribute("compression", compression);
+                    src.specmod().attribute("planarconfig", planarconfig);
+                    src.set_write_format(format);
+                    src.set_write_tiles(tilesize, tilesize);
+                    double wrate[2], rrate[2];
+                    bool ok = true;
+                    for (int mt = 0; mt < 2; ++mt) {
+                        OIIO::attribute("tiff:multithread", mt);
+                        auto writeit = [&]() {
+                            ok &= src.write(filename[mt]);
+                        };
+                        wrate[mt] = double(npixels)
+                                    / time_trial(writeit, ntrials);
+                    }
+                    if (!ok) {
+                        std::cout << "  " << src.geterror() << "\n";
+                        continue;
+                    }
+                    // Time reading the serially written file
+                    for (int mt = 0; mt < 2; ++mt) {
+                        OIIO::attribute("tiff:multithread", mt);
+                        auto readserial = [&]() {
+                            readit(filename[0], pixels[mt]);
+                        };
+                        rrate[mt] = double(npixels)
+                                    / time_trial(readserial, ntrials);
+                    }
+                    // libtiff's reading of the parallel written file
+                    OIIO::attribute("tiff:multithread", 0);
+                    readit(filename[1], pixels[2]);
+                    OIIO_CHECK_ASSERT(pixels[0] == pixels[1]);
+                    OIIO_CHECK_ASSERT(pixels[0] == pixels[2]);
+                    std::cout << Strutil::sprintf(
+                        "  %-3s %-6s %-8s %-8s: write %6.1f -> %6.1f Mpel/s "
+                        "(%.1fx), read %6.1f -> %6.1f Mpel/s (%.1fx)\n",
+                        compression, format, planarconfig,
+                        tilesize ? "tiled" : "scanline", wrate[0] / 1.0e6,
+                        wrate[1] / 1.0e6, wrate[1] / wrate[0],
+                        rrate[0] / 1.0e6, rrate[1] / 1.0e6,
+                        rrate[1] / rrate[0]);
+                }
+            }
+        }
+    }
+    OIIO::attribute("tiff:multithread", 1);
+    Filesystem::remove(filename[0]);
+    Filesystem::remove(filename[1]);
+    std::cout << std::endl;
+}
+
+
+
+// Write and read back a synthetic deep image that looks like a typical
+// rendered deep comp element (RGBA half, Z/ZBack float, 0-12 samples per
+// pixel), as scanline and tiled OpenEXR, with OpenEXR's thread pool
+// disabled and enabled. Make sure everything round trips.
+static void
+benchmark_deep()
+{
+    std::cout << "Timing deep OpenEXR writing and reading:\n";
+    ImageSpec spec(1920, 1080, 6, TypeDesc::HALF);
+    spec.channelnames   = { "R", "G", "B", "A", "Z", "ZBack" };
+    spec.channelformats = { TypeDesc::HALF, TypeDesc::HALF,  TypeDesc::HALF,
+                            TypeDesc::HALF, TypeDesc::FLOAT, TypeDesc::FLOAT };
+    spec.alpha_channel  = 3;
+    spec.z_channel      = 4;
+    spec.deep           = true;
+    DeepData src(spec);
+    std::vector<unsigned int> counts(spec.image_pixels());
+    for (size_t p = 0; p < counts.size(); ++p)
+        counts[p] = (unsigned int)(bjhash::bjfinal(p, 17) % 13);
+    src.set_all_samples(counts);
+    for (int p = 0; p < src.pixels(); ++p) {
+        for (int s = 0, n = src.samples(p); s < n; ++s) {
+            float z = 1.0f + s + (p % 7) * 0.125f;
+            for (int c = 0; c < 4; ++c)
+                src.set_deep_value(p, c, s, 0.25f + 0.125f * ((p + s + c) % 5));
+            src.set_deep_value(p, 4, s, z);
+            src.set_deep_value(p, 5, s, z + 0.5f);
+        }
+    }
+    size_t nsamples = 0;
+    for (auto n : counts)
+        nsamples += n;
+
+    const std::string filename = "imagespeed_test_deepbench.exr";
+    for (const char* compression : { "zips", "zip" }) {
+        for (int tilesize : { 0, 64 }) {
+            spec.attribute("compression", compression);
+            spec.tile_width  = tilesize;
+            spec.tile_height = tilesize;
+            double wrate[2], rrate[2];
+            bool ok = true;
+            DeepData result;
+            for (int mt = 0; mt < 2; ++mt) {
+                OIIO::attribute("exr_threads", mt ? numthreads : -1);
+                auto writeit = [&]() {
+                    auto out = ImageOutput::create(filename);
+                    ok &= out && out->open(filename, spec)
+                          && out->write_deep_image(src) && out->close();
+                };
+                wrate[mt] = double(nsamples) / time_trial(writeit, ntrials);
+                auto readit = [&]() {
+                    auto in = ImageInput::open(filename);
+                    ok &= in && in->read_native_deep_image(0, 0, result);
+                };
+                rrate[mt] = double(nsamples) / time_trial(readit, ntrials);
+            }
+            if (!ok) {
+                std::cout << "  " << OIIO::geterror() << "\n";
+                continue;
+            }
+            OIIO_CHECK_ASSERT(result.all_samples() == src.all_samples());
+            OIIO_CHECK_ASSERT(result.all_data() == src.all_data());
+            std::cout << Strutil::sprintf(
+                "  %-4s %-8s: write %6.1f -> %6.1f Msamp/s (%.1fx), "
+                "read %6.1f -> %6.1f Msamp/s (%.1fx)\n",
+                compression, tilesize ? "tiled" : "scanline", wrate[0] / 1.0e6,
+                wrate[1] / 1.0e6, wrate[1] / wrate[0], rrate[0] / 1.0e6,
+                rrate[1] / 1.0e6, rrate[1] / rrate[0]);
+        }
+    }
+    OIIO::attribute("exr_threads", numthreads);
+    Filesystem::remove(filename);
+    std::cout << std::endl;
+}
+
+
+
 static void
 set_dataformat(const std::string& output_format, ImageSpec& outspec)
 {
@@ -515,6 +732,15 @@ int
 main(int argc, char** argv)
 {
     getargs(argc, argv);
+    if (tiff_bench || deep_bench) {
+        OIIO::attribute("threads", numthreads);
+        if (tiff_bench)
+            benchmark_tiff();
+        if (deep_bench)
+            benchmark_deep();
+        if (input_filename.empty())
+            return unit_test_failures;
+    }
     if (input_filename.size() == 0) {
         std::cout << "Error: Must supply a filename.\n";
         return -1;
@@ -647,6 +873,16 @@ main(int argc, char** argv)
         test_pixel_iteration("Iterate over a cache image (incr slave) ",
                              time_iterate_pixels_slave_incr, false, iters);
     }
+
+    if (!no_mip) {
+        std::cout
+            << "Timing texture construction (box filter, uncompressed):\n";
+        test_mipmap("float texture       ", TypeDesc::FLOAT);
+        test_mipmap("half texture        ", TypeDesc::HALF);
+        test_mipmap("float latlong envmap", TypeDesc::FLOAT,
+                    ImageBufAlgo::MakeTxEnvLatl);
+        std::cout << std::endl;
+    }
     if (verbose)
         std::cout << "\n" << imagecache->getstats(2) << "\n";
 
@@ -34,6 +34,7 @@
 #include <iostream>
 #include <iterator>
 #include <limits>
+#include <map>
 #include <memory>
 #include <sstream>
 
@@ -42,6 +43,7 @@
 #include <OpenEXR/ImathMatrix.h>
 #include <OpenEXR/half.h>
 
+#include <OpenImageIO/SHA1.h>
 #include <OpenImageIO/argparse.h>
 #include <OpenImageIO/dassert.h>
 #include <OpenImageIO/filesystem.h>
@@ -51,21 +53,27 @@
 #include <OpenImageIO/imagebufalgo.h>
 #include <OpenImageIO/imagebufalgo_util.h>
 #include <OpenImageIO/imageio.h>
+#include <OpenImageIO/simd.h>
 #include <OpenImageIO/strutil.h>
 #include <OpenImageIO/sysutil.h>
 #include <OpenImageIO/thread.h>
 #include <OpenImageIO/timer.h>
 
 #include "imageio_pvt.h"
+#include "maketexture_pvt.h"
 
 #ifdef USE_BOOST_REGEX
 #    include <boost/regex.hpp>
 using boost::regex;
 using boost::regex_replace;
+using boost::regex_search;
+using boost::smatch;
 #else
 #    include <regex>
 using std::regex;
 using std::regex_replace;
+using std::regex_search;
+using std::smatch;
 #endif
 
 using namespace OIIO;
@@ -75,6 +83,32 @@ static spin_mutex maketx_mutex;  // for anything that needs locking
 
 
 
+// Loading an OCIO config can be expensive, so all make_texture calls in the
+// process share one ColorConfig per config name. This matters a lot when
+// many textures are converted by the same process. The caller must hold
+// colorconfig_mutex while using the returned config, and must call
+// forget_colorconfig if it failed to load, so that the next caller tries
+// again (and sees the error) rather than getting the broken config.
+static std::mutex colorconfig_mutex;
+static std::map<std::string, std::unique_ptr<ColorConfig>> colorconfigs;
+
+static ColorConfig&
+shared_colorconfig(const std::string& name)
+{
+    std::unique_ptr<ColorConfig>& cc(colorconfigs[name]);
+    if (!cc)
+        cc.reset(new ColorConfig(name));
+    return *cc;
+}
+
+static void
+forget_colorconfig(const std::string& name)
+{
+    colorconfigs.erase(name);
+}
+
+
+
 static Filter2D*
 setup_filter(const ImageSpec& dstspec, const ImageSpec& srcspec,
              std::string filtername = std::string())
@@ -272,15 +306,59 @@ resize_block_(ImageBuf& dst, const ImageBuf& src, ROI roi, bool envlatlmode)
 }
 
 
-// Helper function to compute the first bilerp pass into a scanline buffer
+// First bilerp pass into a scanline buffer. The float and half versions,
+// which are what MIP-map builds overwhelmingly use, get the SIMD kernels.
 template<class SRCTYPE>
 static void
 halve_scanline(const SRCTYPE* s, const int nchannels, size_t sw, float* dst)
 {
-    for (size_t i = 0; i < sw; i += 2, s += nchannels) {
-        for (int j = 0; j < nchannels; ++j, ++dst, ++s)
-            *dst = 0.5f * (float)(*s + *(s + nchannels));
-    }
+    pvt::halve_scanline_scalar(s, nchannels, sw, dst);
+}
+
+
+template<>
+void
+halve_scanline<float>(const float* s, const int nchannels, size_t sw,
+                      float* dst)
+{
+    pvt::halve_scanline_simd(s, nchannels, sw, dst);
+}
+
+
+template<>
+void
+halve_scanline<half>(const half* s, const int nchannels, size_t sw, float* dst)
+{
+    pvt::halve_scanline_simd(s, nchannels, sw, dst);
+}
+
+
+
+// Second bilerp pass, likewise.
+template<class SRCTYPE>
+static void
+blend_scanlines(const float* s0, const float* s1, float yfrac, size_t n,
+                SRCTYPE* d)
+{
+    pvt::blend_scanlines_scalar(s0, s1, yfrac, n, d);
+}
+
+
+template<>
+void
+blend_scanlines<float>(const float* s0, const float* s1, float yfrac,
+                       size_t n, float* d)
+{
+    pvt::blend_scanlines_simd(s0, s1, yfrac, n, d);
+}
+
+
+template<>
+void
+blend_scanlines<half>(const float* s0, const float* s1, float yfrac, size_t n,
+                      half* d)
+{
+    pvt::blend_scanlines_simd(s0, s1, yfrac, n, d);
 }
 
 
@@ -290,12 +368,12 @@ halve_scanline(const SRCTYPE* s, const int nchannels, size_t sw, float* dst)
 template<class SRCTYPE>
 static bool
 resize_block_2pass(ImageBuf& dst, const ImageBuf& src, ROI roi,
-                   bool allow_shift)
+                   bool envlatlmode, bool allow_shift)
 {
     // Two-pass filtering introduces a half-pixel shift for odd resolutions.
     // Revert to correct bilerp sampling unless shift is explicitly allowed.
     if (!allow_shift && (src.spec().width % 2 || src.spec().height % 2))
-        return resize_block_<SRCTYPE>(dst, src, roi, false);
+        return resize_block_<SRCTYPE>(dst, src, roi, envlatlmode);
 
     DASSERT(roi.ybegin + roi.height() <= dst.spec().height);
 
@@ -318,16 +396,17 @@ resize_block_2pass(ImageBuf& dst, const ImageBuf& src, ROI roi,
     // Run through destination rows, doing the two-pass bilerp filter
     const size_t dw = roi.width(), dh = roi.height();  // Loop invariants
     const size_t sw = dw * 2;                          // Handle odd res
-    for (size_t y = 0; y < dh; ++y) {                  // For each dst ROI row
+    const float fh  = (float)src.spec().full_height;
+    for (size_t y = 0; y < dh; ++y) {  // For each dst ROI row
         halve_scanline<SRCTYPE>(s, nchannels, sw, &S0[0]);
         s += ystride;
         halve_scanline<SRCTYPE>(s, nchannels, sw, &S1[0]);
         s += ystride;
-        const float *s0 = &S0[0], *s1 = &S1[0];
-        for (size_t x = 0; x < dw; ++x) {  // For each dst ROI col
-            for (int i = 0; i < nchannels; ++i, ++s0, ++s1, ++d)
-                *d = (SRCTYPE)(0.5f * (*s0 + *s1));  // Average vertically
-        }
+        float yfrac = 0.5f;
+        if (envlatlmode)
+            yfrac = pvt::envlatl_halve_yfrac(2 * (roi.ybegin + int(y)), fh);
+        blend_scanlines<SRCTYPE>(&S0[0], &S1[0], yfrac, row_elem, d);
+        d += row_elem;
     }
 
     return true;
@@ -345,17 +424,21 @@ resize_block(ImageBuf& dst, const ImageBuf& src, ROI roi, bool envlatlmode,
     DASSERT(dst.localpixels());
     bool ok;
     if (src.localpixels() &&                     // Not a cached image
-        !envlatlmode &&                          // not latlong wrap mode
         roi.xbegin == 0 &&                       // Region x at origin
         dstspec.width == roi.width() &&          // Full width ROI
         dstspec.width == (srcspec.width / 2) &&  // Src is 2x resize
         dstspec.format == srcspec.format &&      // Same formats
         dstspec.x == 0 && dstspec.y == 0 &&      // Not a crop or overscan
-        srcspec.x == 0 && srcspec.y == 0) {
+        srcspec.x == 0 && srcspec.y == 0 &&
+        (!envlatlmode ||                         // latlong only if exact 2x
+         (srcspec.width % 2 == 0 && srcspec.height % 2 == 0 &&
+          dstspec.height == srcspec.height / 2 &&
+          srcspec.full_y == 0 && srcspec.full_height == srcspec.height))) {
         // If all these conditions are met, we have a special case that
         // can be more highly optimized.
         OIIO_DISPATCH_TYPES(ok, "resize_block_2pass", resize_block_2pass,
-                            srcspec.format, dst, src, roi, allow_shift);
+                            srcspec.format, dst, src, roi, envlatlmode,
+                            allow_shift);
     } else {
         ASSERT(dst.spec().format == TypeFloat);
         OIIO_DISPATCH_TYPES(ok, "resize_block", resize_block_, srcspec.format,
@@ -891,6 +974,528 @@ write_mipmap(ImageBufAlgo::MakeTextureMode mode, std::shared_ptr<ImageBuf>& img,
 
 
 
+// Out-of-core texture construction.
+//
+// Rather than holding the whole image (and a float copy of each MIP level)
+// in memory, pixels are pulled through in bands of scanlines. The top level
+// is streamed straight from the source file to the output, and each lower
+// level is computed band by band from the level above and spooled to a raw
+// float scratch file next to the output, which in turn becomes the source
+// for the following level. Peak memory is governed by "maketx:outofcore_MB"
+// rather than by the image resolution.
+//
+// Only the simple (but, for enormous images, most common) case is handled:
+// an uncropped 2D image, box-filtered MIP levels, and no resizing,
+// sharpening, or channel surgery that would need the whole image at once.
+// Anything else falls back to the in-memory path.
+
+static bool
+outofcore_supported(ImageBufAlgo::MakeTextureMode mode,
+                    const ImageSpec& srcspec, const ImageSpec& configspec,
+                    string_view outputfilename)
+{
+    if (mode != ImageBufAlgo::MakeTxTexture
+        && mode != ImageBufAlgo::MakeTxShadow
+        && mode != ImageBufAlgo::MakeTxEnvLatl)
+        return false;
+    if (srcspec.deep || srcspec.depth != 1 || srcspec.x || srcspec.y
+        || srcspec.z || srcspec.full_x || srcspec.full_y || srcspec.full_z
+        || srcspec.full_width != srcspec.width
+        || srcspec.full_height != srcspec.height)
+        return false;
+    // Anything that would trigger a resize of the top level
+    if (configspec.get_int_attribute("maketx:resize")
+        && mode != ImageBufAlgo::MakeTxShadow
+        && (!ispow2(srcspec.width) || !ispow2(srcspec.height)))
+        return false;
+    if (mode == ImageBufAlgo::MakeTxEnvLatl
+        && (Strutil::iequals(configspec.get_string_attribute(
+                                 "maketx:fileformatname"),
+                             "openexr")
+            || Strutil::iends_with(outputfilename, ".exr")))
+        return false;
+    // Operations that need the whole image, or a wide neighborhood
+    if (configspec.get_string_attribute("maketx:filtername", "box") != "box"
+        || configspec.get_float_attribute("maketx:sharpen") > 0.0f
+        || configspec.get_int_attribute("maketx:highlightcomp")
+        || configspec.get_string_attribute("maketx:mipimages").size()
+        || configspec.get_int_attribute("maketx:constant_color_detect")
+        || configspec.get_int_attribute("maketx:opaque_detect")
+        || configspec.get_int_attribute("maketx:monochrome_detect"))
+        return false;
+    int nchannels = configspec.get_int_attribute("maketx:nchannels", -1);
+    if (nchannels > 0 && nchannels != srcspec.nchannels)
+        return false;
+    std::string fixnan = configspec.get_string_attribute("maketx:fixnan");
+    if (fixnan.size() && fixnan != "none")
+        return false;
+    // The band-wise MIP levels are always box-filtered with the pixel
+    // centers preserved, so the pixel-shifting fast path can't be honored.
+    if (configspec.get_int_attribute("maketx:allow_pixel_shift"))
+        return false;
+    return true;
+}
+
+
+
+// How many scanlines of a float image of the given width to process at
+// once, so that a band of this level plus the band of the next level it
+// produces fit in the memory budget. Always a whole number of tiles.
+static int
+outofcore_band_rows(int width, int nchannels, int tile_height,
+                    imagesize_t budget)
+{
+    tile_height          = std::max(tile_height, 1);
+    imagesize_t rowbytes = imagesize_t(width) * nchannels * sizeof(float);
+    imagesize_t rows     = budget / std::max(rowbytes + rowbytes / 4,
+                                         imagesize_t(1));
+    rows                 = std::max(rows / tile_height, imagesize_t(1))
+           * tile_height;
+    return int(std::min(rows, imagesize_t(std::numeric_limits<int>::max()
+                                          / 2)));
+}
+
+
+
+// Read scanlines [ybegin,yend) of the source as float, handling both
+// scanline and tiled files, and apply the color conversion (if any).
+static bool
+outofcore_read_source(ImageInput* in, int ybegin, int yend, float* buf,
+                      const ColorProcessor* processor, bool unpremult)
+{
+    const ImageSpec& spec(in->spec());
+    int nchannels     = spec.nchannels;
+    size_t rowfloats  = size_t(spec.width) * nchannels;
+    bool ok           = true;
+    if (spec.tile_width) {
+        // Tile reads must start on a tile row boundary and cover whole
+        // tile rows (or stop at the bottom of the image).
+        int tb = ybegin - (ybegin - spec.y) % spec.tile_height;
+        int te = std::min(round_to_multiple(yend - spec.y, spec.tile_height)
+                              + spec.y,
+                          spec.y + spec.height);
+        if (tb == ybegin && te == yend) {
+            ok = in->read_tiles(0, 0, spec.x, spec.x + spec.width, tb, te, 0,
+                                1, 0, nchannels, TypeFloat, buf);
+        } else {
+            std::unique_ptr<float[]> tmp(new float[rowfloats * (te - tb)]);
+            ok = in->read_tiles(0, 0, spec.x, spec.x + spec.width, tb, te, 0,
+                                1, 0, nchannels, TypeFloat, tmp.get());
+            memcpy(buf, tmp.get() + (ybegin - tb) * rowfloats,
+                   (yend - ybegin) * rowfloats * sizeof(float));
+        }
+    } else {
+        ok = in->read_scanlines(0, 0, ybegin, yend, 0, 0, nchannels,
+                                TypeFloat, buf);
+    }
+    if (ok && processor) {
+        ImageSpec bandspec(spec.width, yend - ybegin, nchannels, TypeFloat);
+        bandspec.y             = ybegin;
+        bandspec.channelnames  = spec.channelnames;
+        bandspec.alpha_channel = spec.alpha_channel;
+        ImageBuf band(bandspec, buf);
+        ok = ImageBufAlgo::colorconvert(band, band, processor, unpremult);
+    }
+    return ok;
+}
+
+
+
+// First pass over the source: gather the pixel statistics (of the
+// unconverted pixels, just like the in-memory path), check for nonfinite
+// values, and compute the SHA-1 of the color converted top level exactly as
+// computePixelHashSHA1(toplevel, hashextra, ROI::All(), hashblocksize)
+// would have.
+static bool
+outofcore_scan(ImageInput* in, int bandrows, ImageBufAlgo::PixelStats* stats,
+               bool checknan, const ColorProcessor* processor, bool unpremult,
+               std::string* hash, string_view hashextra, int hashblocksize,
+               std::ostream& outstream)
+{
+    const ImageSpec& spec(in->spec());
+    int nchannels    = spec.nchannels;
+    size_t rowfloats = size_t(spec.width) * nchannels;
+    std::unique_ptr<float[]> buf(new float[rowfloats * bandrows]);
+    if (stats)
+        stats->reset(nchannels);
+
+    bool blocked = (hashblocksize > 0 && hashblocksize < spec.height);
+    CSHA1 sha;
+    sha.Reset();
+    std::string blockdigests;
+    int found_nonfinite = 0;
+    for (int y0 = spec.y; y0 < spec.y + spec.height; y0 += bandrows) {
+        int y1 = std::min(y0 + bandrows, spec.y + spec.height);
+        ImageSpec bandspec(spec.width, y1 - y0, nchannels, TypeFloat);
+        bandspec.y = y0;
+        ImageBuf band(bandspec, buf.get());
+        if (!outofcore_read_source(in, y0, y1, buf.get(), nullptr, false)) {
+            outstream << "maketx ERROR: Could not read \"" << in->geterror()
+                      << "\"\n";
+            return false;
+        }
+        if (stats) {
+            ImageBufAlgo::PixelStats s = ImageBufAlgo::computePixelStats(band);
+            for (int c = 0; c < nchannels; ++c) {
+                if (s.finitecount[c]) {
+                    stats->min[c] = std::min(stats->min[c], s.min[c]);
+                    stats->max[c] = std::max(stats->max[c], s.max[c]);
+                }
+                stats->nancount[c] += s.nancount[c];
+                stats->infcount[c] += s.infcount[c];
+                stats->finitecount[c] += s.finitecount[c];
+                stats->sum[c] += s.sum[c];
+                stats->sum2[c] += s.sum2[c];
+            }
+        }
+        if (checknan)
+            check_nan_block(band, get_roi(bandspec), found_nonfinite);
+        if (processor
+            && !ImageBufAlgo::colorconvert(band, band, processor, unpremult)) {
+            outstream << "Error applying color conversion to image.\n";
+            return false;
+        }
+        if (hash) {
+            for (int y = y0; y < y1; ++y) {
+                sha.Update((const unsigned char*)(buf.get()
+                                                  + (y - y0) * rowfloats),
+                           (unsigned int)(rowfloats * sizeof(float)));
+                if (blocked
+                    && ((y + 1 - spec.y) % hashblocksize == 0
+                        || y + 1 == spec.y + spec.height)) {
+                    sha.Final();
+                    std::string digest;
+                    sha.ReportHashStl(digest, CSHA1::REPORT_HEX_SHORT);
+                    blockdigests += digest;
+                    sha.Reset();
+                }
+            }
+        }
+    }
+    if (found_nonfinite) {
+        if (found_nonfinite > 3)
+            outstream << "maketx ERROR: ...and Nan/Inf at "
+                      << (found_nonfinite - 3) << " other pixels\n";
+        return false;
+    }
+    if (stats) {
+        for (int c = 0; c < nchannels; ++c) {
+            if (stats->finitecount[c]) {
+                double count     = double(stats->finitecount[c]);
+                double davg      = stats->sum[c] / count;
+                stats->avg[c]    = float(davg);
+                stats->stddev[c] = float(
+                    safe_sqrt(stats->sum2[c] / count - davg * davg));
+            } else {
+                stats->min[c] = stats->max[c] = 0.0f;
+            }
+        }
+    }
+    if (hash) {
+        if (blocked)
+            sha.Update((const unsigned char*)blockdigests.c_str(),
+                       (unsigned int)blockdigests.size());
+        if (hashextra.size())
+            sha.Update((const unsigned char*)hashextra.data(),
+                       (unsigned int)hashextra.size());
+        sha.Final();
+        sha.ReportHashStl(*hash, CSHA1::REPORT_HEX_SHORT);
+    }
+    return true;
+}
+
+
+
+// Precomputed sample positions for reducing a level of sw x sh pixels to
+// dw x dh. These use exactly the same arithmetic as resize_block, so the
+// out-of-core MIP levels match the ones built in memory.
+struct OutOfCoreDownsample {
+    int sw, sh, dw, dh;
+    bool halve;  // exact 2x in both directions: two-pass box average
+    std::vector<int> xtexel, xnext, ytexel, ynext;
+    std::vector<float> xfrac, yfrac;
+
+    OutOfCoreDownsample(int sw, int sh, int dw, int dh, bool envlatlmode)
+        : sw(sw)
+        , sh(sh)
+        , dw(dw)
+        , dh(dh)
+        , xtexel(dw)
+        , xnext(dw)
+        , ytexel(dh)
+        , ynext(dh)
+        , xfrac(dw)
+        , yfrac(dh)
+    {
+        halve = (!envlatlmode && sw % 2 == 0 && sh % 2 == 0 && dw == sw / 2
+                 && dh == sh / 2);
+        float xscale = 1.0f / (float)dw;
+        for (int x = 0; x < dw; ++x) {
+            float s = (x + 0.5f) * xscale * static_cast<float>(sw) - 0.5f;
+            int xt;
+            xfrac[x]  = floorfrac(s, &xt);
+            xtexel[x] = clamp(xt, 0, sw - 1);
+            xnext[x]  = clamp(xt + 1, 0, sw - 1);
+        }
+        float yscale = 1.0f / (float)dh;
+        for (int y = 0; y < dh; ++y) {
+            float t = (y + 0.5f) * yscale * static_cast<float>(sh) - 0.5f;
+            int yt;
+            float yf  = floorfrac(t, &yt);
+            ynext[y]  = clamp(yt + 1, 0, sh - 1);
+            ytexel[y] = clamp(yt, 0, sh - 1);
+            if (envlatlmode) {
+                // Area-weight by latitude, as in interppixel_NDC_clamped
+                float w0 = (1.0f - yf)
+                           * sinf((float)M_PI * (ytexel[y] + 0.5f) / (float)sh);
+                float w1 = yf
+                           * sinf((float)M_PI * (ynext[y] + 0.5f) / (float)sh);
+                yf = w1 / (w0 + w1);
+            }
+            yfrac[y] = yf;
+        }
+    }
+
+    // Compute destination row y from the two source rows it samples.
+    void row(int y, const float* r0, const float* r1, int nchannels,
+             float* d) const
+    {
+        if (halve) {
+            const float *a = r0, *b = r1;
+            for (int x = 0; x < dw; ++x, a += nchannels, b += nchannels) {
+                for (int c = 0; c < nchannels; ++c, ++a, ++b, ++d) {
+                    float s0 = 0.5f * (*a + *(a + nchannels));
+                    float s1 = 0.5f * (*b + *(b + nchannels));
+                    *d       = 0.5f * (s0 + s1);
+                }
+            }
+        } else {
+            for (int x = 0; x < dw; ++x, d += nchannels)
+                bilerp(r0 + xtexel[x] * nchannels, r0 + xnext[x] * nchannels,
+                       r1 + xtexel[x] * nchannels, r1 + xnext[x] * nchannels,
+                       xfrac[x], yfrac[y], nchannels, d);
+        }
+    }
+};
+
+
+
+static bool
+write_mipmap_outofcore(ImageBufAlgo::MakeTextureMode mode, ImageInput* in,
+                       const ImageSpec& outspec_template,
+                       std::string outputfilename, ImageOutput* out,
+                       TypeDesc outputdatatype, bool mipmap,
+                       const ImageSpec& configspec,
+                       const ColorProcessor* processor, bool unpremult,
+                       std::ostream& outstream, double& stat_readtime,
+                       double& stat_writetime, double& stat_miptime,
+                       size_t& peak_mem)
+{
+    bool envlatlmode  = (mode == ImageBufAlgo::MakeTxEnvLatl);
+    ImageSpec outspec = outspec_template;
+    outspec.set_format(outputdatatype);
+    int nchannels = outspec.nchannels;
+    imagesize_t budget
+        = imagesize_t(std::max(configspec.get_int_attribute(
+                                   "maketx:outofcore_MB"),
+                               1))
+          * 1024 * 1024;
+
+    if (mipmap && !out->supports("multiimage") && !out->supports("mipmap")) {
+        outstream << "maketx ERROR: \"" << outputfilename
+                  << "\" format does not support multires images\n";
+        return false;
+    }
+    if (!mipmap && !strcmp(out->format_name(), "openexr"))
+        outspec.attribute("openexr:levelmode", 0 /* ONE_LEVEL */);
+    if (mipmap && !strcmp(out->format_name(), "openexr"))
+        outspec.attribute("openexr:roundingmode", 0 /* ROUND_DOWN */);
+
+    bool verbose = configspec.get_int_attribute("maketx:verbose") != 0;
+    if (verbose) {
+        outstream << "  Writing file: " << outputfilename << std::endl;
+        outstream << "  Out-of-core, using at most "
+                  << Strutil::memformat(budget) << " of pixel bands\n";
+        outstream << "  Top level is " << formatres(outspec) << std::endl;
+    }
+
+    // Each level's pixels come either from the source file (top level) or
+    // from the scratch file written while the level above was processed.
+    std::string srcscratch, dstscratch;
+    auto cleanup = [&]() {
+        if (srcscratch.size())
+            Filesystem::remove(srcscratch);
+        if (dstscratch.size())
+            Filesystem::remove(dstscratch);
+    };
+
+    bool ok = true;
+    for (int level = 0; ok; ++level) {
+        int w = outspec.width, h = outspec.height;
+        Timer writetimer;
+        if (level == 0) {
+            ok = out->open(outputfilename.c_str(), outspec);
+        } else {
+            ImageOutput::OpenMode mode = out->supports("mipmap")
+                                             ? ImageOutput::AppendMIPLevel
+                                             : ImageOutput::AppendSubimage;
+            ok = out->open(outputfilename.c_str(), outspec, mode);
+        }
+        if (!ok) {
+            outstream << "maketx ERROR: Could not "
+                      << (level ? "append \"" : "open \"") << outputfilename
+                      << "\" : " << out->geterror() << "\n";
+            break;
+        }
+        stat_writetime += writetimer();
+
+        // Set up the next level down, if there is one
+        bool lastlevel = !mipmap || (w <= 1 && h <= 1);
+        ImageSpec smallspec = outspec;
+        std::unique_ptr<OutOfCoreDownsample> down;
+        FILE* scratch = nullptr;
+        if (!lastlevel) {
+            smallspec.width       = std::max(1, w / 2);
+            smallspec.height      = std::max(1, h / 2);
+            smallspec.full_width  = smallspec.width;
+            smallspec.full_height = smallspec.height;
+            smallspec.x = smallspec.y = smallspec.full_x = smallspec.full_y
+                = 0;
+            down.reset(new OutOfCoreDownsample(w, h, smallspec.width,
+                                               smallspec.height, envlatlmode));
+            dstscratch = Filesystem::unique_path(outputfilename
+                                                 + ".%%%%%%%%.mip");
+            scratch    = Filesystem::fopen(dstscratch, "wb");
+            if (!scratch) {
+                outstream << "maketx ERROR: could not create scratch file \""
+                          << dstscratch << "\"\n";
+                ok = false;
+                break;
+            }
+        }
+
+        // Band buffer: slot 0 carries the last row of the previous band,
+        // which the first rows of the next level may also need.
+        int bandrows = outofcore_band_rows(w, nchannels, outspec.tile_height,
+                                           budget);
+        bandrows     = std::min(bandrows, round_to_multiple(
+                                          h, std::max(outspec.tile_height, 1)));
+        size_t rowfloats      = size_t(w) * nchannels;
+        size_t smallrowfloats = size_t(smallspec.width) * nchannels;
+        std::unique_ptr<float[]> buf(new float[rowfloats * (bandrows + 1)]);
+        std::unique_ptr<float[]> smallbuf(
+            lastlevel ? nullptr
+                      : new float[smallrowfloats * (bandrows / 2 + 2)]);
+        int ynextlevel = 0;  // next row of the smaller level to compute
+
+        for (int y0 = 0; ok && y0 < h; y0 += bandrows) {
+            int y1 = std::min(y0 + bandrows, h);
+            if (y0 > 0)
+                memcpy(buf.get(), buf.get() + bandrows * rowfloats,
+                       rowfloats * sizeof(float));
+            float* band = buf.get() + rowfloats;
+            Timer readtimer;
+            if (level == 0) {
+                ok = outofcore_read_source(in, y0 + in->spec().y,
+                                           y1 + in->spec().y, band, processor,
+                                           unpremult);
+            } else {
+                size_t n = (y1 - y0) * rowfloats * sizeof(float);
+                ok = (Filesystem::read_bytes(srcscratch, band, n,
+                                             y0 * rowfloats * sizeof(float))
+                      == n);
+            }
+            stat_readtime += readtimer();
+            if (!ok) {
+                outstream << "maketx ERROR: Could not read \""
+                          << (level ? srcscratch : in->geterror()) << "\"\n";
+                break;
+            }
+
+            Timer wtimer;
+            if (outspec.tile_width)
+                ok = out->write_tiles(outspec.x, outspec.x + w,
+                                      y0 + outspec.y, y1 + outspec.y,
+                                      outspec.z, outspec.z + 1, TypeFloat,
+                                      band);
+            else
+                ok = out->write_scanlines(y0 + outspec.y, y1 + outspec.y,
+                                          outspec.z, TypeFloat, band);
+            stat_writetime += wtimer();
+            if (!ok) {
+                outstream << "maketx ERROR writing \"" << outputfilename
+                          << "\" : " << out->geterror() << "\n";
+                break;
+            }
+
+            if (lastlevel)
+                continue;
+            // Compute every row of the next level whose source rows are
+            // now available (rows y0-1 .. y1-1).
+            Timer miptimer;
+            int ybegin = ynextlevel;
+            while (ynextlevel < smallspec.height
+                   && down->ynext[ynextlevel] < y1)
+                ++ynextlevel;
+            auto srcrow = [&](int y) -> const float* {
+                return buf.get() + (y - y0 + 1) * rowfloats;
+            };
+            parallel_for(ybegin, ynextlevel, [&](int64_t y) {
+                down->row(int(y), srcrow(down->ytexel[y]),
+                          srcrow(down->ynext[y]), nchannels,
+                          smallbuf.get() + (y - ybegin) * smallrowfloats);
+            });
+            size_t n = (ynextlevel - ybegin) * smallrowfloats;
+            if (fwrite(smallbuf.get(), sizeof(float), n, scratch) != n) {
+                outstream << "maketx ERROR: could not write scratch file \""
+                          << dstscratch << "\"\n";
+                ok = false;
+            }
+            stat_miptime += miptimer();
+        }
+
+        if (scratch)
+            fclose(scratch);
+        if (srcscratch.size())
+            Filesystem::remove(srcscratch);
+        srcscratch = dstscratch;
+        dstscratch.clear();
+        if (!ok || lastlevel)
+            break;
+
+        if (verbose) {
+            size_t mem = Sysutil::memory_used(true);
+            peak_mem   = std::max(peak_mem, mem);
+            if (level == 0)
+                outstream << "  Mipmapping...\n" << std::flush;
+            outstream << Strutil::sprintf("    %-15s (%s)",
+                                          formatres(smallspec),
+                                          Strutil::memformat(mem))
+                      << std::endl;
+        }
+        outspec = smallspec;
+    }
+    cleanup();
+    if (!ok) {
+        out->close();
+        return false;
+    }
+
+    if (verbose)
+        outstream << "  Wrote file: " << outputfilename << "  ("
+                  << Strutil::memformat(Sysutil::memory_used(true)) << ")\n";
+    Timer writetimer;
+    if (!out->close()) {
+        outstream << "maketx ERROR writing \"" << outputfilename
+                  << "\" : " << out->geterror() << "\n";
+        return false;
+    }
+    stat_writetime += writetimer();
+    return true;
+}
+
+
+
 // Deconstruct the command line string, stripping directory names off of
 // any arguments. This is used for "update mode" to not think it's doing
 // a fresh maketx for relative paths and whatnot.
@@ -924,6 +1529,50 @@ strip_cmd_line(string_view cmdline)
 
 
 
+// SHA-1 of the raw bytes of a file. Update mode stores this for the source
+// file, so that a source that has merely been touched (or copied) is
+// recognized as unchanged without decoding it.
+static std::string
+file_content_hash(const std::string& filename)
+{
+    FILE* file = Filesystem::fopen(filename, "rb");
+    if (!file)
+        return std::string();
+    const size_t chunk = 4 * 1024 * 1024;
+    std::unique_ptr<unsigned char[]> buf(new unsigned char[chunk]);
+    CSHA1 sha;
+    sha.Reset();
+    size_t n;
+    while ((n = fread(buf.get(), 1, chunk, file)) > 0)
+        sha.Update(buf.get(), (unsigned int)n);
+    fclose(file);
+    sha.Final();
+    std::string hash_digest;
+    sha.ReportHashStl(hash_digest, CSHA1::REPORT_HEX_SHORT);
+    return hash_digest;
+}
+
+
+
+// Retrieve the source hash stored by update mode, either as its own
+// metadata or (for formats without arbitrary metadata) embedded in the
+// ImageDescription.
+static std::string
+stored_source_hash(const ImageSpec& spec)
+{
+    std::string hash = spec.get_string_attribute("oiio:SourceSHA-1");
+    if (hash.empty()) {
+        std::string desc = spec.get_string_attribute("ImageDescription");
+        smatch match;
+        if (regex_search(desc, match,
+                         regex("oiio:SourceSHA-1=([[:xdigit:]]+)")))
+            hash = match[1];
+    }
+    return hash;
+}
+
+
+
 static bool
 make_texture_impl(ImageBufAlgo::MakeTextureMode mode, const ImageBuf* input,
                   std::string filename, std::string outputfilename,
@@ -1011,22 +1660,40 @@ make_texture_impl(ImageBufAlgo::MakeTextureMode mode, const ImageBuf* input,
         time(&in_time);  // make it look initialized
 
     // When in update mode, skip making the texture if the output already
-    // exists and has the same file modification time as the input file and
-    // was created with identical command line arguments.
+    // exists and was created with identical command line arguments from
+    // the same source: either the output has the same file modification
+    // time as the input file, or the input's contents still match the
+    // hash recorded in the output (i.e., the file was only touched). Only
+    // the header of the output is read.
     bool updatemode = configspec.get_int_attribute("maketx:updatemode");
-    if (updatemode && from_filename && Filesystem::exists(outputfilename)
-        && in_time == Filesystem::last_write_time(outputfilename)) {
-        std::string lastcmdline;
-        if (auto in = ImageInput::open(outputfilename)) {
-            lastcmdline = in->spec().get_string_attribute("Software");
-        }
-        std::string newcmdline = configspec.get_string_attribute(
+    std::string source_hash;
+    if (updatemode && from_filename && Filesystem::exists(outputfilename)) {
+        ImageSpec lastspec;
+        if (auto in = ImageInput::open(outputfilename))
+            lastspec = in->spec();
+        std::string lastcmdline = lastspec.get_string_attribute("Software");
+        std::string newcmdline  = configspec.get_string_attribute(
             "maketx:full_command_line");
         if (lastcmdline.size()
             && strip_cmd_line(lastcmdline) == strip_cmd_line(newcmdline)) {
-            outstream << "maketx: no update required for \"" << outputfilename
-                      << "\"\n";
-            return true;
+            bool unchanged = (in_time
+                              == Filesystem::last_write_time(outputfilename));
+            if (!unchanged) {
+                std::string lasthash = stored_source_hash(lastspec);
+                if (lasthash.size()) {
+                    source_hash = file_content_hash(filename);
+                    unchanged   = (source_hash == lasthash);
+                    // Re-stamp the output so that next time the cheap
+                    // time stamp comparison suffices.
+                    if (unchanged)
+                        Filesystem::last_write_time(outputfilename, in_time);
+                }
+            }
+            if (unchanged) {
+                outstream << "maketx: no update required for \""
+                          << outputfilename << "\"\n";
+                return true;
+            }
         }
     }
 
@@ -1072,10 +1739,35 @@ make_texture_impl(ImageBufAlgo::MakeTextureMode mode, const ImageBuf* input,
     bool read_local     = (src->spec().image_bytes()
                        < imagesize_t(local_mb_thresh * 1024 * 1024));
 
-    bool verbose       = configspec.get_int_attribute("maketx:verbose") != 0;
+    bool verbose = configspec.get_int_attribute("maketx:verbose") != 0;
+
+    // For out-of-core mode, don't read the pixels at all -- they will be
+    // streamed from the file in bands when we write the texture.
+    bool outofcore = false;
+    std::unique_ptr<ImageInput> oocinput;
+    if (from_filename
+        && configspec.get_int_attribute("maketx:outofcore_MB") > 0) {
+        outofcore = outofcore_supported(mode, src->spec(), configspec,
+                                        outputfilename);
+        if (outofcore) {
+            ImageSpec inconfig;
+            if (configspec.get_int_attribute("maketx:ignore_unassoc"))
+                inconfig.attribute("oiio:UnassociatedAlpha", 1);
+            oocinput = ImageInput::open(src->name(), &inconfig);
+            if (!oocinput) {
+                outstream << "maketx ERROR: Could not read \"" << src->name()
+                          << "\" : " << OIIO::geterror() << "\n";
+                return false;
+            }
+        } else if (verbose) {
+            outstream << "  Options require the whole image, "
+                      << "not using out-of-core mode\n";
+        }
+    }
+
     double misc_time_1 = alltime.lap();
     STATUS("prep", misc_time_1);
-    if (from_filename) {
+    if (from_filename && !outofcore) {
         if (verbose)
             outstream << "Reading file: " << src->name() << std::endl;
         if (!src->read(0, 0, read_local)) {
@@ -1137,7 +1829,7 @@ make_texture_impl(ImageBufAlgo::MakeTextureMode mode, const ImageBuf* input,
     ImageBufAlgo::PixelStats pixel_stats;
     bool compute_stats = (constant_color_detect || opaque_detect
                           || compute_average_color);
-    if (compute_stats) {
+    if (compute_stats && !outofcore) {
         ImageBufAlgo::computePixelStats(pixel_stats, *src);
     }
     double stat_pixelstatstime = alltime.lap();
@@ -1149,7 +1841,7 @@ make_texture_impl(ImageBufAlgo::MakeTextureMode mode, const ImageBuf* input,
     // wrap mode at runtime.
     std::vector<float> constantColor(src->nchannels());
     bool isConstantColor = false;
-    if (compute_stats && src->spec().x == 0 && src->spec().y == 0
+    if (compute_stats && !outofcore && src->spec().x == 0 && src->spec().y == 0
         && src->spec().z == 0 && src->spec().full_x == 0
         && src->spec().full_y == 0 && src->spec().full_z == 0
         && src->spec().full_width == src->spec().width
@@ -1408,10 +2100,11 @@ make_texture_impl(ImageBufAlgo::MakeTextureMode mode, const ImageBuf* input,
 
     // If --checknan was used and it's a floating point image, check for
     // nonfinite (NaN or Inf) values and abort if they are found.
-    if (configspec.get_int_attribute("maketx:checknan")
-        && (srcspec.format.basetype == TypeDesc::FLOAT
-            || srcspec.format.basetype == TypeDesc::HALF
-            || srcspec.format.basetype == TypeDesc::DOUBLE)) {
+    bool checknan = configspec.get_int_attribute("maketx:checknan")
+                    && (srcspec.format.basetype == TypeDesc::FLOAT
+                        || srcspec.format.basetype == TypeDesc::HALF
+                        || srcspec.format.basetype == TypeDesc::DOUBLE);
+    if (checknan && !outofcore) {
         int found_nonfinite = 0;
         ImageBufAlgo::parallel_image(get_roi(srcspec),
                                      std::bind(check_nan_block, std::ref(*src),
@@ -1437,6 +2130,8 @@ make_texture_impl(ImageBufAlgo::MakeTextureMode mode, const ImageBuf* input,
         "maketx:incolorspace");
     std::string outcolorspace = configspec.get_string_attribute(
         "maketx:outcolorspace");
+    ColorProcessorHandle oocprocessor;  // out-of-core: applied per band
+    bool oocunpremult = false;
     if (!incolorspace.empty() && !outcolorspace.empty()
         && incolorspace != outcolorspace) {
         if (verbose)
@@ -1447,7 +2142,7 @@ make_texture_impl(ImageBufAlgo::MakeTextureMode mode, const ImageBuf* input,
         // another pointer to the original source.
         std::shared_ptr<ImageBuf> ccSrc(src);  // color-corrected buffer
 
-        if (src->spec().format != TypeDesc::FLOAT) {
+        if (src->spec().format != TypeDesc::FLOAT && !outofcore) {
             // If the original src buffer isn't float, make a scratch space
             // that is float.
             ImageSpec floatSpec = src->spec();
@@ -1455,27 +2150,37 @@ make_texture_impl(ImageBufAlgo::MakeTextureMode mode, const ImageBuf* input,
             ccSrc.reset(new ImageBuf(floatSpec));
         }
 
-        ColorConfig colorconfig(colorconfigname);
-        if (colorconfig.error()) {
-            outstream << "Error Creating ColorConfig\n";
-            outstream << colorconfig.geterror() << std::endl;
-            return false;
-        }
+        ColorProcessorHandle processor;
+        {
+            std::lock_guard<std::mutex> lock(colorconfig_mutex);
+            ColorConfig& colorconfig(shared_colorconfig(colorconfigname));
+            if (colorconfig.error()) {
+                outstream << "Error Creating ColorConfig\n";
+                outstream << colorconfig.geterror() << std::endl;
+                forget_colorconfig(colorconfigname);
+                return false;
+            }
 
-        ColorProcessorHandle processor
-            = colorconfig.createColorProcessor(incolorspace, outcolorspace);
-        if (!processor || colorconfig.error()) {
-            outstream << "Error Creating Color Processor." << std::endl;
-            outstream << colorconfig.geterror() << std::endl;
-            return false;
+            processor = colorconfig.createColorProcessor(incolorspace,
+                                                         outcolorspace);
+            if (!processor || colorconfig.error()) {
+                outstream << "Error Creating Color Processor." << std::endl;
+                outstream << colorconfig.geterror() << std::endl;
+                return false;
+            }
         }
 
         bool unpremult = configspec.get_int_attribute("maketx:unpremult") != 0;
         if (unpremult && verbose)
             outstream << "  Unpremulting image..." << std::endl;
 
-        if (!ImageBufAlgo::colorconvert(*ccSrc, *src, processor.get(),
-                                        unpremult)) {
+        if (outofcore) {
+            // Convert the pixels as they are streamed; the constant and
+            // average colors aren't known until the scan pass.
+            oocprocessor = processor;
+            oocunpremult = unpremult;
+        } else if (!ImageBufAlgo::colorconvert(*ccSrc, *src, processor.get(),
+                                               unpremult)) {
             outstream << "Error applying color conversion to image.\n";
             return false;
         }
@@ -1490,7 +2195,7 @@ make_texture_impl(ImageBufAlgo::MakeTextureMode mode, const ImageBuf* input,
             }
         }
 
-        if (compute_average_color) {
+        if (compute_average_color && !outofcore) {
             if (!ImageBufAlgo::colorconvert(&pixel_stats.avg[0],
                                             static_cast<int>(
                                                 pixel_stats.avg.size()),
@@ -1554,7 +2259,11 @@ make_texture_impl(ImageBufAlgo::MakeTextureMode mode, const ImageBuf* input,
     STATUS("misc3", misc_time_4);
 
     std::shared_ptr<ImageBuf> toplevel;  // Ptr to top level of mipmap
-    if (!do_resize && dstspec.format == src->spec().format) {
+    if (outofcore) {
+        // Pixels are never held in memory
+        ASSERT(!do_resize);
+        toplevel = src;
+    } else if (!do_resize && dstspec.format == src->spec().format) {
         // No resize needed, no format conversion needed -- just stick to
         // the image we've already got
         toplevel = src;
@@ -1604,6 +2313,8 @@ make_texture_impl(ImageBufAlgo::MakeTextureMode mode, const ImageBuf* input,
 
     // Eliminate any SHA-1 or ConstantColor hints in the ImageDescription.
     if (desc.size()) {
+        desc = regex_replace(desc, regex("oiio:SourceSHA-1=[[:xdigit:]]*[ ]*"),
+                             "");
         desc = regex_replace(desc, regex("SHA-1=[[:xdigit:]]*[ ]*"), "");
         static const char* fp_number_pattern
             = "([+-]?((?:(?:[[:digit:]]*\\.)?[[:digit:]]+(?:[eE][+-]?[[:digit:]]+)?)))";
@@ -1635,12 +2346,46 @@ make_texture_impl(ImageBufAlgo::MakeTextureMode mode, const ImageBuf* input,
         addlHashData << "highlightcomp=1 ";
 
     const int sha1_blocksize = 256;
-    std::string hash_digest
-        = configspec.get_int_attribute("maketx:hash", 1)
-              ? ImageBufAlgo::computePixelHashSHA1(*toplevel,
-                                                   addlHashData.str(),
-                                                   ROI::All(), sha1_blocksize)
-              : "";
+    bool compute_hash        = configspec.get_int_attribute("maketx:hash", 1);
+    std::string hash_digest;
+    if (outofcore) {
+        // One streaming pass to gather everything we need to know about
+        // the pixels before the header can be written.
+        int bandrows = outofcore_band_rows(
+            srcspec.width, srcspec.nchannels, dstspec.tile_height,
+            imagesize_t(configspec.get_int_attribute("maketx:outofcore_MB"))
+                * 1024 * 1024);
+        if (!outofcore_scan(oocinput.get(), bandrows,
+                            compute_stats ? &pixel_stats : nullptr, checknan,
+                            oocprocessor.get(), oocunpremult,
+                            compute_hash ? &hash_digest : nullptr,
+                            addlHashData.str(), sha1_blocksize, outstream))
+            return false;
+        if (compute_stats) {
+            isConstantColor = (pixel_stats.min == pixel_stats.max);
+            if (isConstantColor)
+                constantColor = pixel_stats.min;
+            if (oocprocessor
+                && (!ImageBufAlgo::colorconvert(&constantColor[0],
+                                                int(constantColor.size()),
+                                                oocprocessor.get(),
+                                                oocunpremult)
+                    || !ImageBufAlgo::colorconvert(&pixel_stats.avg[0],
+                                                   int(pixel_stats.avg.size()),
+                                                   oocprocessor.get(),
+                                                   oocunpremult))) {
+                outstream
+                    << "Error applying color conversion to average color.\n";
+                return false;
+            }
+        }
+        stat_readtime += alltime.lap();
+    } else if (compute_hash) {
+        hash_digest = ImageBufAlgo::computePixelHashSHA1(*toplevel,
+                                                         addlHashData.str(),
+                                                         ROI::All(),
+                                                         sha1_blocksize);
+    }
     if (hash_digest.length()) {
         if (out->supports("arbitrary_metadata")) {
             dstspec.attribute("oiio:SHA-1", hash_digest);
@@ -1654,6 +2399,24 @@ make_texture_impl(ImageBufAlgo::MakeTextureMode mode, const ImageBuf* input,
         if (verbose)
             outstream << "  SHA-1: " << hash_digest << std::endl;
     }
+
+    // In update mode, also record the hash of the source file itself, so
+    // that future updates can tell whether the source really changed.
+    if (updatemode && from_filename) {
+        if (source_hash.empty())
+            source_hash = file_content_hash(filename);
+        if (source_hash.size()) {
+            if (out->supports("arbitrary_metadata")) {
+                dstspec.attribute("oiio:SourceSHA-1", source_hash);
+            } else {
+                if (desc.length())
+                    desc += " ";
+                desc += "oiio:SourceSHA-1=";
+                desc += source_hash;
+                updatedDesc = true;
+            }
+        }
+    }
     double stat_hashtime = alltime.lap();
     STATUS("SHA-1 hash", stat_hashtime);
 
@@ -1717,10 +2480,19 @@ make_texture_impl(ImageBufAlgo::MakeTextureMode mode, const ImageBuf* input,
 
     // Write out, and compute, the mipmap levels for the speicifed image
     bool nomipmap = configspec.get_int_attribute("maketx:nomipmap") != 0;
-    bool ok = write_mipmap(mode, toplevel, dstspec, tmpfilename, out.get(),
-                           out_dataformat, !shadowmode && !nomipmap, filtername,
-                           configspec, outstream, stat_writetime, stat_miptime,
-                           peak_mem);
+    bool ok;
+    if (outofcore)
+        ok = write_mipmap_outofcore(mode, oocinput.get(), dstspec, tmpfilename,
+                                    out.get(), out_dataformat,
+                                    !shadowmode && !nomipmap, configspec,
+                                    oocprocessor.get(), oocunpremult,
+                                    outstream, stat_readtime, stat_writetime,
+                                    stat_miptime, peak_mem);
+    else
+        ok = write_mipmap(mode, toplevel, dstspec, tmpfilename, out.get(),
+                          out_dataformat, !shadowmode && !nomipmap, filtername,
+                          configspec, outstream, stat_writetime, stat_miptime,
+                          peak_mem);
     out.reset();  // don't need it any more
 
     // If using update mode, stamp the output file with a modification time
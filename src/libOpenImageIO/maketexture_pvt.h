@@ -0,0 +1,196 @@
+/*
+  Copyright 2013 Larry Gritz and the other authors and contributors.
+  All Rights Reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+  * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+  * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+  * Neither the name of the software's owners nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  (This is the Modified BSD License)
+*/
+
+
+
+/// \file
+/// Scanline kernels used by make_texture to build MIP levels, which are
+/// shared with the unit tests so that the SIMD versions can be checked
+/// against the scalar ones.
+
+
+#ifndef OPENIMAGEIO_MAKETEXTURE_PVT_H
+#define OPENIMAGEIO_MAKETEXTURE_PVT_H
+
+#include <cmath>
+#include <cstddef>
+
+#include <OpenEXR/half.h>
+
+#include <OpenImageIO/fmath.h>
+#include <OpenImageIO/simd.h>
+
+
+OIIO_NAMESPACE_BEGIN
+
+namespace pvt {
+
+// First pass of the two-pass box filter: average horizontally adjacent
+// pairs of the sw pixels of a scanline into sw/2 float pixels.
+template<class SRCTYPE>
+inline void
+halve_scanline_scalar(const SRCTYPE* s, const int nchannels, size_t sw,
+                      float* dst)
+{
+    for (size_t i = 0; i < sw; i += 2, s += nchannels) {
+        for (int j = 0; j < nchannels; ++j, ++dst, ++s)
+            *dst = 0.5f * (float)(*s + *(s + nchannels));
+    }
+}
+
+
+
+// SIMD version of halve_scanline_scalar for float and half source data,
+// with hand-shuffled kernels for the common 1-4 channel cases. Horizontally
+// adjacent pixels are averaged with exactly the same arithmetic as the
+// scalar version (except that half values are summed in float).
+template<class T>
+inline void
+halve_scanline_simd(const T* s, const int nchannels, size_t sw, float* dst)
+{
+    using namespace simd;
+    const vfloat4 onehalf(0.5f);
+    size_t i = 0;  // source pixel index
+    if (nchannels == 4) {
+        vfloat4 a, b;
+        for (; i < sw; i += 2, s += 8, dst += 4) {
+            a.load(s);
+            b.load(s + 4);
+            (onehalf * (a + b)).store(dst);
+        }
+    } else if (nchannels == 3) {
+        // Load 4 floats for each pixel (the 4th belongs to the next pixel
+        // and is discarded) and store 4, the extra one being overwritten
+        // by the next output pixel. The last pair is done in scalar, so we
+        // never read or write past the end of a scanline.
+        vfloat4 a, b;
+        for (; i + 2 < sw; i += 2, s += 6, dst += 3) {
+            a.load(s);
+            b.load(s + 3);
+            (onehalf * (a + b)).store(dst);
+        }
+    } else if (nchannels == 2) {
+        // Two output pixels from each 8 input values:
+        // a = (p0 p1), b = (p2 p3)  ->  (p0+p1, p2+p3)
+        vfloat4 a, b;
+        for (; i + 4 <= sw; i += 4, s += 8, dst += 4) {
+            a.load(s);
+            b.load(s + 4);
+            vfloat4 lo = AxyBxy(a, b);
+            vfloat4 hi = AxyBxy(shuffle<2, 3, 0, 1>(a), shuffle<2, 3, 0, 1>(b));
+            (onehalf * (lo + hi)).store(dst);
+        }
+    } else if (nchannels == 1) {
+        // Four output pixels from each 8 input values: average the even
+        // and odd elements.
+        vfloat4 a, b;
+        for (; i + 8 <= sw; i += 8, s += 8, dst += 4) {
+            a.load(s);
+            b.load(s + 4);
+            vfloat4 even = AxyBxy(shuffle<0, 2, 1, 3>(a),
+                                  shuffle<0, 2, 1, 3>(b));
+            vfloat4 odd  = AxyBxy(shuffle<1, 3, 0, 2>(a),
+                                  shuffle<1, 3, 0, 2>(b));
+            (onehalf * (even + odd)).store(dst);
+        }
+    }
+    // Whatever is left (or all of it, for other channel counts)
+    for (; i < sw; i += 2, s += nchannels) {
+        for (int j = 0; j < nchannels; ++j, ++dst, ++s)
+            *dst = 0.5f * (float(*s) + float(*(s + nchannels)));
+    }
+}
+
+
+
+// Second pass: blend two horizontally halved scanlines into n destination
+// values. A yfrac of exactly 0.5 is the box average; other values arise
+// from the latlong area weighting.
+template<class SRCTYPE>
+inline void
+blend_scanlines_scalar(const float* s0, const float* s1, float yfrac,
+                       size_t n, SRCTYPE* d)
+{
+    if (yfrac == 0.5f) {
+        for (size_t i = 0; i < n; ++i)
+            d[i] = (SRCTYPE)(0.5f * (s0[i] + s1[i]));
+    } else {
+        for (size_t i = 0; i < n; ++i)
+            d[i] = (SRCTYPE)((1.0f - yfrac) * s0[i] + yfrac * s1[i]);
+    }
+}
+
+
+
+// SIMD version of blend_scanlines_scalar for float and half destinations.
+// The scanlines are contiguous floats regardless of the channel count, so
+// this just runs 8 wide down the whole row.
+template<class T>
+inline void
+blend_scanlines_simd(const float* s0, const float* s1, float yfrac, size_t n,
+                     T* d)
+{
+    using namespace simd;
+    size_t i = 0;
+    if (yfrac == 0.5f) {
+        const vfloat8 onehalf(0.5f);
+        for (; i + 8 <= n; i += 8)
+            (onehalf * (vfloat8(s0 + i) + vfloat8(s1 + i))).store(d + i);
+        for (; i < n; ++i)
+            d[i] = (T)(0.5f * (s0[i] + s1[i]));
+    } else {
+        const vfloat8 w0(1.0f - yfrac), w1(yfrac);
+        for (; i + 8 <= n; i += 8)
+            (w0 * vfloat8(s0 + i) + w1 * vfloat8(s1 + i)).store(d + i);
+        for (; i < n; ++i)
+            d[i] = (T)((1.0f - yfrac) * s0[i] + yfrac * s1[i]);
+    }
+}
+
+
+
+// The yfrac with which to blend source rows ytexel and ytexel+1 of a
+// latlong environment map of height fh into one row of the next MIP level.
+// Pixels nearer the poles cover less of the sphere, so each row is
+// weighted by sin(t*PI), the same area weighting interppixel_NDC_clamped
+// folds into its bilinear interpolation.
+inline float
+envlatl_halve_yfrac(int ytexel, float fh)
+{
+    float w0 = 0.5f * sinf((float)M_PI * (ytexel + 0.5f) / fh);
+    float w1 = 0.5f * sinf((float)M_PI * (ytexel + 1.5f) / fh);
+    return w1 / (w0 + w1);
+}
+
+}  // namespace pvt
+
+OIIO_NAMESPACE_END
+
+#endif  // OPENIMAGEIO_MAKETEXTURE_PVT_H
@@ -0,0 +1,186 @@
+/*
+  Copyright 2013 Larry Gritz and the other authors and contributors.
+  All Rights Reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+  * Redistributions of source code must retain the above copyright
+  notice, this list of conditions and the following disclaimer.
+  * Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+  * Neither the name of the software's owners nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  (This is the Modified BSD License)
+*/
+
+
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <type_traits>
+#include <vector>
+
+#include <OpenEXR/half.h>
+
+#include <OpenImageIO/fmath.h>
+#include <OpenImageIO/unittest.h>
+
+#include "maketexture_pvt.h"
+
+using namespace OIIO;
+
+
+// Widths (in destination pixels) that exercise both the SIMD loops and
+// their scalar tails, for every channel count.
+static const int widths[] = { 1, 2, 3, 4, 5, 7, 8, 9, 13, 16, 17, 33 };
+
+
+
+// Deterministic values that are exactly representable as half.
+static float
+pattern(size_t i)
+{
+    return float((i * 7919) % 509) / 64.0f - 3.0f;
+}
+
+
+
+template<class T>
+static float
+max_difference(const std::vector<T>& a, const std::vector<T>& b)
+{
+    float maxdiff = 0.0f;
+    for (size_t i = 0; i < a.size(); ++i)
+        maxdiff = std::max(maxdiff, std::abs(float(a[i]) - float(b[i])));
+    return maxdiff;
+}
+
+
+
+// The SIMD halving must give exactly the scalar results, including for
+// channel counts that have no special kernel.
+template<class T>
+static void
+test_halve_scanline(const char* type)
+{
+    std::cout << "test halve_scanline " << type << "\n";
+    for (int nchannels = 1; nchannels <= 5; ++nchannels) {
+        for (int dw : widths) {
+            size_t sw = 2 * size_t(dw);
+            // Exactly sized, so that reading or writing past the end of
+            // the scanline is caught by memory checkers.
+            std::vector<T> src(sw * nchannels);
+            for (size_t i = 0; i < src.size(); ++i)
+                src[i] = T(pattern(i));
+            std::vector<float> scalar(dw * nchannels), simd(dw * nchannels);
+            pvt::halve_scanline_scalar(src.data(), nchannels, sw,
+                                       scalar.data());
+            pvt::halve_scanline_simd(src.data(), nchannels, sw, simd.data());
+            OIIO_CHECK_EQUAL(max_difference(scalar, simd), 0.0f);
+        }
+    }
+}
+
+
+
+// The SIMD blend must match the scalar one exactly for the box average,
+// and up to rounding for other weights.
+template<class T>
+static void
+test_blend_scanlines(const char* type)
+{
+    std::cout << "test blend_scanlines " << type << "\n";
+    const float eps = std::is_same<T, half>::value ? 1.0e-2f : 1.0e-5f;
+    for (int nchannels = 1; nchannels <= 4; ++nchannels) {
+        for (int dw : widths) {
+            size_t n = size_t(dw) * nchannels;
+            std::vector<float> s0(n), s1(n);
+            for (size_t i = 0; i < n; ++i) {
+                s0[i] = pattern(i);
+                s1[i] = pattern(i + n);
+            }
+            for (float yfrac : { 0.5f, 0.3f, 0.75f }) {
+                std::vector<T> scalar(n), simd(n);
+                pvt::blend_scanlines_scalar(s0.data(), s1.data(), yfrac, n,
+                                            scalar.data());
+                pvt::blend_scanlines_simd(s0.data(), s1.data(), yfrac, n,
+                                          simd.data());
+                if (yfrac == 0.5f)
+                    OIIO_CHECK_EQUAL(max_difference(scalar, simd), 0.0f);
+                else
+                    OIIO_CHECK_LE(max_difference(scalar, simd), eps);
+            }
+        }
+    }
+}
+
+
+
+// Halving a latlong map blends each pair of rows with the same area
+// weighting that the general resize applies: the bilinear weights 1/2, 1/2
+// scaled by sin(t*PI) at each row's center. A constant map must stay
+// constant.
+template<class T>
+static void
+test_envlatl_halve(const char* type)
+{
+    std::cout << "test envlatl halving " << type << "\n";
+    const float eps = std::is_same<T, half>::value ? 1.0e-2f : 1.0e-5f;
+    for (int dh : { 1, 2, 5, 8 }) {
+        float fh = float(2 * dh);
+        for (int y = 0; y < dh; ++y) {
+            int ytexel  = 2 * y;
+            float w0    = 0.5f * sinf((float)M_PI * (ytexel + 0.5f) / fh);
+            float w1    = 0.5f * sinf((float)M_PI * (ytexel + 1.5f) / fh);
+            float yfrac = pvt::envlatl_halve_yfrac(ytexel, fh);
+            OIIO_CHECK_EQUAL_THRESH(yfrac, w1 / (w0 + w1), 1.0e-6f);
+
+            size_t n = 4 * 17;
+            std::vector<float> s0(n), s1(n), one(n, 1.0f);
+            for (size_t i = 0; i < n; ++i) {
+                s0[i] = pattern(i);
+                s1[i] = pattern(i + n);
+            }
+            std::vector<T> scalar(n), simd(n), ones(n, T(1.0f));
+            pvt::blend_scanlines_scalar(s0.data(), s1.data(), yfrac, n,
+                                        scalar.data());
+            pvt::blend_scanlines_simd(s0.data(), s1.data(), yfrac, n,
+                                      simd.data());
+            OIIO_CHECK_LE(max_difference(scalar, simd), eps);
+            pvt::blend_scanlines_simd(one.data(), one.data(), yfrac, n,
+                                      simd.data());
+            OIIO_CHECK_LE(max_difference(ones, simd), eps);
+        }
+    }
+}
+
+
+
+int
+main(int argc, char* argv[])
+{
+    test_halve_scanline<float>("float");
+    test_halve_scanline<half>("half");
+    test_blend_scanlines<float>("float");
+    test_blend_scanlines<half>("half");
+    test_envlatl_halve<float>("float");
+    test_envlatl_halve<half>("half");
+
+    return unit_test_failures;
+}
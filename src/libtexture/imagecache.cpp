@@ -183,6 +183,10 @@ ImageCacheStatistics::init()
     cubic_interps       = 0;
     file_retry_success  = 0;
     tile_retry_success  = 0;
+
+    // TextureSystem lookup memo stats:
+    lookup_cache_queries = 0;
+    lookup_cache_hits    = 0;
 }
 
 
@@ -228,6 +232,8 @@ ImageCacheStatistics::merge(const ImageCacheStatistics& s)
     cubic_interps += s.cubic_interps;
     file_retry_success += s.file_retry_success;
     tile_retry_success += s.tile_retry_success;
+    lookup_cache_queries += s.lookup_cache_queries;
+    lookup_cache_hits += s.lookup_cache_hits;
 }
 
 
@@ -844,7 +850,7 @@ ImageCacheFile::read_tile(ImageCachePerThreadInfo* thread_info, int subimage,
     }
 
     if (ok) {
-        size_t b = spec.tile_bytes();
+        size_t b = spec.tile_pixels() * spec.pixel_bytes(chbegin, chend);
         thread_info->m_stats.bytes_read += b;
         m_bytesread += b;
         ++m_tilesread;
@@ -1519,7 +1525,9 @@ ImageCacheTile::read(ImageCachePerThreadInfo* thread_info)
         int64_t bitmask = int64_t(1ULL << (whichtile & 63));
         int64_t oldval  = lev.tiles_read[index].fetch_or(bitmask);
         if (oldval & bitmask)  // Was it previously read?
-            file.register_redundant_tile(lev.spec.tile_bytes());
+            file.register_redundant_tile(lev.spec.tile_pixels()
+                                         * lev.spec.pixel_bytes(m_id.chbegin(),
+                                                                m_id.chend()));
     } else {
         // (! m_valid)
         m_used = false;  // Don't let it hold mem if invalid
@@ -1605,6 +1613,7 @@ ImageCacheImpl::init()
     m_deduplicate          = true;
     m_unassociatedalpha    = false;
     m_failure_retries      = 0;
+    m_max_tile_channels    = 6;
     m_latlong_y_up_default = true;
     m_Mw2c.makeIdentity();
     m_mem_used                = 0;
@@ -1812,6 +1821,7 @@ ImageCacheImpl::getstats(int level) const
         INTOPT(deduplicate);
         INTOPT(unassociatedalpha);
         INTOPT(failure_retries);
+        INTOPT(max_tile_channels);
 #undef BOOLOPT
 #undef INTOPT
 #undef STROPT
@@ -2167,6 +2177,8 @@ ImageCacheImpl::attribute(string_view name, TypeDesc type, const void* val)
         }
     } else if (name == "failure_retries" && type == TypeDesc::INT) {
         m_failure_retries = *(const int*)val;
+    } else if (name == "max_tile_channels" && type == TypeDesc::INT) {
+        m_max_tile_channels = *(const int*)val;
     } else if (name == "latlong_up" && type == TypeDesc::STRING) {
         bool y_up = !strcmp("y", *(const char**)val);
         if (y_up != m_latlong_y_up_default) {
@@ -2211,6 +2223,7 @@ ImageCacheImpl::getattribute(string_view name, TypeDesc type, void* val) const
     ATTR_DECODE("deduplicate", int, m_deduplicate);
     ATTR_DECODE("unassociatedalpha", int, m_unassociatedalpha);
     ATTR_DECODE("failure_retries", int, m_failure_retries);
+    ATTR_DECODE("max_tile_channels", int, m_max_tile_channels);
     ATTR_DECODE("total_files", int, m_files.size());
 
     // The cases that don't fit in the simple ATTR_DECODE scheme
@@ -2950,8 +2963,14 @@ ImageCacheImpl::get_pixels(ImageCacheFile* file,
     int result_nchans = chend - chbegin;
     if (cache_chbegin < 0 || cache_chend < 0 || cache_chbegin > chbegin
         || cache_chend < chend) {
-        cache_chbegin = 0;
-        cache_chend   = spec.nchannels;
+        if (spec.nchannels > m_max_tile_channels) {
+            // For files with many channels, narrow the range we cache
+            cache_chbegin = chbegin;
+            cache_chend   = chend;
+        } else {
+            cache_chbegin = 0;
+            cache_chend   = spec.nchannels;
+        }
     }
     int cache_nchans = cache_chend - cache_chbegin;
     ImageSpec::auto_stride(xstride, ystride, zstride, format, result_nchans,
@@ -3470,6 +3489,7 @@ ImageCacheImpl::get_perthread_info(ImageCachePerThreadInfo* p)
             p->last_filename[i] = ustring();
             p->last_file[i]     = NULL;
         }
+        p->lookup_memo.clear();
     }
     return p;
 }
@@ -134,6 +134,8 @@ struct ImageCacheStatistics {
     long long cubic_interps;
     int file_retry_success;
     int tile_retry_success;
+    long long lookup_cache_queries;
+    long long lookup_cache_hits;
 
     ImageCacheStatistics() { init(); }
     void init();
@@ -741,6 +743,20 @@ public:
     ImageCacheStatistics m_stats;
     bool shared;  // Pointed to both by the IC and the thread_specific_ptr
 
+    // Direct-mapped memo of recent filtered texture lookups, used by the
+    // TextureSystem when its "lookup_cache_size" is nonzero. Cleared along
+    // with the tile microcache when files are invalidated.
+    struct TextureLookupMemo {
+        ImageCacheFile* file = nullptr;  // nullptr means an unused slot
+        int64_t coords[6];  // quantized s, t, dsdx, dtdx, dsdy, dtdy
+        TextureOpt options;
+        int nchannels;
+        bool derivs;
+        float result[4], dresultds[4], dresultdt[4];  // <= 4 channels
+    };
+    std::vector<TextureLookupMemo> lookup_memo;
+    long long lookup_memo_epoch = 0;  // TextureSystem epoch it was made in
+
     ImageCachePerThreadInfo()
         : next_last_file(0)
         , shared(false)
@@ -850,6 +866,7 @@ public:
     bool accept_unmipped() const { return m_accept_unmipped; }
     bool unassociatedalpha() const { return m_unassociatedalpha; }
     int failure_retries() const { return m_failure_retries; }
+    int max_tile_channels() const { return m_max_tile_channels; }
     bool latlong_y_up_default() const { return m_latlong_y_up_default; }
     void get_commontoworld(Imath::M44f& result) const { result = m_Mc2w; }
     int max_errors_per_file() const { return m_max_errors_per_file; }
@@ -1151,6 +1168,7 @@ private:
     bool m_deduplicate;        ///< Detect duplicate files?
     bool m_unassociatedalpha;  ///< Keep unassociated alpha files as they are?
     int m_failure_retries;     ///< Times to re-try disk failures
+    int m_max_tile_channels;   ///< Cache only requested chans above this
     bool m_latlong_y_up_default;  ///< Is +y the default "up" for latlong?
     Imath::M44f m_Mw2c;           ///< world-to-"common" matrix
     Imath::M44f m_Mc2w;           ///< common-to-world matrix
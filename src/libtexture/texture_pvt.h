@@ -559,6 +559,14 @@ private:
                       const ImageCacheFile::LevelInfo& levelinfo,
                       TextureOpt& options, int miplevel, int nchannels);
 
+    /// Set the lookup memo quantization tolerance and the derived
+    /// quantities used to build keys.
+    void set_lookup_cache_tolerance(float tol);
+
+    /// Make every thread's lookup memo stale, because something that
+    /// affects lookup results (but isn't part of the memo key) changed.
+    void invalidate_lookup_memos();
+
     /// Perform short unit tests.
     void unit_test_texture();
 
@@ -586,6 +594,14 @@ private:
     bool m_flip_t;            ///< Flip direction of t coord?
     int m_max_tile_channels;  ///< narrow tile ID channel range when
                               ///<   the file has more channels
+
+    // Per-thread memo of filtered lookups (see "lookup_cache_size")
+    int m_lookup_cache_size;            ///< Entries per thread (0 = off)
+    float m_lookup_cache_tolerance;     ///< Quantization of memo keys
+    double m_lookup_cache_invtol;       ///< 1/tolerance (0 = exact keys)
+    uint32_t m_lookup_cache_derivmask;  ///< Mantissa mask for derivs
+    atomic_ll m_lookup_cache_epoch;     ///< Memos from other epochs are stale
+
     /// Saved error string, per-thread
     ///
     mutable thread_specific_ptr<std::string> m_errormessage;
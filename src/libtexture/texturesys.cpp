@@ -79,6 +79,7 @@ static TextureSystemImpl* shared_texturesys = NULL;
 static spin_mutex shared_texturesys_mutex;
 static bool do_unit_test_texture    = false;
 static float unit_test_texture_blur = 0.0f;
+static atomic_ll lookup_cache_epochs(0);
 
 static EightBitConverter<float> uchar2float;
 static vfloat4 u8scale(1.0f / 255.0f);
@@ -111,6 +112,35 @@ static const OIIO_SIMD4_ALIGN vbool4 channel_masks[5] = {
     vbool4(true, true, true, true),
 };
 
+
+typedef ImageCachePerThreadInfo::TextureLookupMemo TextureLookupMemo;
+
+
+// Do two lookups use options that could produce different results?
+// (Called after the wrap modes and subimage have been resolved.)
+inline bool
+same_lookup_options(const TextureOpt& a, const TextureOpt& b)
+{
+    return a.firstchannel == b.firstchannel && a.subimage == b.subimage
+           && a.swrap == b.swrap && a.twrap == b.twrap
+           && a.mipmode == b.mipmode && a.interpmode == b.interpmode
+           && a.anisotropic == b.anisotropic
+           && a.conservative_filter == b.conservative_filter
+           && a.sblur == b.sblur && a.tblur == b.tblur
+           && a.swidth == b.swidth && a.twidth == b.twidth
+           && a.fill == b.fill && a.time == b.time;
+}
+
+
+inline bool
+same_lookup_key(const TextureLookupMemo& a, const TextureLookupMemo& b)
+{
+    return a.file == b.file && a.nchannels == b.nchannels
+           && a.derivs == b.derivs
+           && !memcmp(a.coords, b.coords, sizeof(a.coords))
+           && same_lookup_options(a.options, b.options);
+}
+
 }  // end anonymous namespace
 
 
@@ -368,6 +398,9 @@ TextureSystemImpl::init()
     m_gray_to_rgb       = false;
     m_flip_t            = false;
     m_max_tile_channels = 6;
+    m_lookup_cache_size = 0;
+    set_lookup_cache_tolerance(0.0f);
+    invalidate_lookup_memos();
     delete hq_filter;
     hq_filter    = Filter1D::create("b-spline", 4);
     m_statslevel = 0;
@@ -416,6 +449,11 @@ TextureSystemImpl::getstats(int level, bool icstats) const
         INTOPT(gray_to_rgb);
         INTOPT(flip_t);
         INTOPT(max_tile_channels);
+        if (m_lookup_cache_size) {
+            INTOPT(lookup_cache_size);
+            opt += Strutil::sprintf("lookup_cache_tolerance=%g ",
+                                    m_lookup_cache_tolerance);
+        }
 #undef BOOLOPT
 #undef INTOPT
 #undef STROPT
@@ -442,6 +480,12 @@ TextureSystemImpl::getstats(int level, bool icstats) const
             out << Strutil::sprintf("  Average anisotropic probes : 0\n");
         out << Strutil::sprintf("  Max anisotropy in the wild : %.3g\n",
                                 stats.max_aniso);
+        if (stats.lookup_cache_queries)
+            out << Strutil::sprintf(
+                "  Lookup cache : %lld queries, %lld hits (%.1f%%)\n",
+                stats.lookup_cache_queries, stats.lookup_cache_hits,
+                100.0 * (double)stats.lookup_cache_hits
+                    / (double)stats.lookup_cache_queries);
         if (icstats)
             out << "\n";
     }
@@ -491,16 +535,30 @@ TextureSystemImpl::attribute(string_view name, TypeDesc type, const void* val)
     }
     if ((name == "gray_to_rgb" || name == "grey_to_rgb") && (type == TypeInt)) {
         m_gray_to_rgb = *(const int*)val;
+        invalidate_lookup_memos();
         return true;
     }
     if (name == "flip_t" && type == TypeInt) {
         m_flip_t = *(const int*)val;
+        invalidate_lookup_memos();
         return true;
     }
     if (name == "m_max_tile_channels" && type == TypeInt) {
         m_max_tile_channels = *(const int*)val;
         return true;
     }
+    if (name == "lookup_cache_size" && type == TypeInt) {
+        // Round up to a power of 2 so the slot is just a mask of the hash
+        int size            = *(const int*)val;
+        m_lookup_cache_size = size > 0 ? pow2roundup(size) : 0;
+        invalidate_lookup_memos();
+        return true;
+    }
+    if (name == "lookup_cache_tolerance" && type == TypeFloat) {
+        set_lookup_cache_tolerance(*(const float*)val);
+        invalidate_lookup_memos();
+        return true;
+    }
     if (name == "statistics:level" && type == TypeInt) {
         m_statslevel = *(const int*)val;
         // DO NOT RETURN! pass the same message to the image cache
@@ -546,6 +604,24 @@ TextureSystemImpl::getattribute(string_view name, TypeDesc type,
         *(int*)val = m_max_tile_channels;
         return true;
     }
+    if (name == "lookup_cache_size" && type == TypeInt) {
+        *(int*)val = m_lookup_cache_size;
+        return true;
+    }
+    if (name == "lookup_cache_tolerance" && type == TypeFloat) {
+        *(float*)val = m_lookup_cache_tolerance;
+        return true;
+    }
+    if ((name == "stat:lookup_cache_queries"
+         || name == "stat:lookup_cache_hits")
+        && type == TypeDesc::INT64) {
+        ImageCacheStatistics stats;
+        m_imagecache->mergestats(stats);
+        *(long long*)val = (name == "stat:lookup_cache_hits")
+                               ? stats.lookup_cache_hits
+                               : stats.lookup_cache_queries;
+        return true;
+    }
 
     // If not one of these, maybe it's an attribute meant for the image cache?
     return m_imagecache->getattribute(name, type, val);
@@ -555,6 +631,35 @@ TextureSystemImpl::getattribute(string_view name, TypeDesc type,
 
 
 
+void
+TextureSystemImpl::set_lookup_cache_tolerance(float tol)
+{
+    // Texture coordinates are quantized to an absolute tolerance, but
+    // derivatives (which may be tiny) are quantized relatively, by
+    // discarding low mantissa bits. Zero means only bitwise identical
+    // queries will match.
+    m_lookup_cache_tolerance = std::max(tol, 0.0f);
+    m_lookup_cache_invtol    = tol > 0.0f ? 1.0 / tol : 0.0;
+    m_lookup_cache_derivmask = 0xffffffff;
+    if (tol > 0.0f) {
+        int keepbits = clamp(int(-log2f(tol)), 0, 23);
+        m_lookup_cache_derivmask = ~((1u << (23 - keepbits)) - 1);
+    }
+}
+
+
+
+void
+TextureSystemImpl::invalidate_lookup_memos()
+{
+    // Epochs are unique across all TextureSystems, so that a thread whose
+    // per-thread info is shared by two of them (through a shared
+    // ImageCache) also never mixes up their memos.
+    m_lookup_cache_epoch = ++lookup_cache_epochs;
+}
+
+
+
 std::string
 TextureSystemImpl::resolve_filename(const std::string& filename) const
 {
@@ -1097,6 +1202,66 @@ TextureSystemImpl::texture(TextureHandle* texture_handle_,
         return true;
     }
 
+    // If the lookup memo is enabled, quantize the query into a key and
+    // see if this thread recently answered the same question. Each memo
+    // only has room for 4 channels, wider lookups are never memoized.
+    TextureLookupMemo* memo = nullptr;
+    TextureLookupMemo memokey;
+    if (m_lookup_cache_size && nchannels <= 4) {
+        ++stats.lookup_cache_queries;
+        memokey.file      = texturefile;
+        memokey.options   = options;
+        memokey.nchannels = nchannels;
+        memokey.derivs    = (dresultds != nullptr);
+        bool keyable      = true;
+        const float st[2] = { s, t };
+        for (int i = 0; i < 2; ++i) {
+            keyable &= isfinite(st[i]);
+            memokey.coords[i] = bit_cast<float, uint32_t>(st[i]);
+            if (m_lookup_cache_invtol > 0.0) {
+                // Coordinates too big (or not finite) to quantize into an
+                // int64 can't be memoized.
+                double q = double(st[i]) * m_lookup_cache_invtol;
+                if (std::abs(q) < 4.0e18)
+                    memokey.coords[i] = (int64_t)std::floor(q);
+                else
+                    keyable = false;
+            }
+        }
+        const float derivs[4] = { dsdx, dtdx, dsdy, dtdy };
+        for (int i = 0; i < 4; ++i)
+            memokey.coords[2 + i] = bit_cast<float, uint32_t>(derivs[i])
+                                    & m_lookup_cache_derivmask;
+        if (keyable) {
+            std::vector<TextureLookupMemo>& cache(thread_info->lookup_memo);
+            long long epoch = m_lookup_cache_epoch;
+            if (cache.size() != size_t(m_lookup_cache_size)
+                || thread_info->lookup_memo_epoch != epoch) {
+                cache.assign(m_lookup_cache_size, TextureLookupMemo());
+                thread_info->lookup_memo_epoch = epoch;
+            }
+            uint64_t h = bjhash::bjfinal64(
+                (uint64_t)(size_t)texturefile,
+                uint64_t(memokey.coords[0]) * 31 + uint64_t(memokey.coords[1]),
+                uint64_t(memokey.coords[2]) * 31 + uint64_t(memokey.coords[3]),
+                uint64_t(memokey.coords[4]) * 31 + uint64_t(memokey.coords[5])
+                    + options.firstchannel);
+            memo = &cache[h & (m_lookup_cache_size - 1)];
+            if (same_lookup_key(*memo, memokey)) {
+                ++stats.lookup_cache_hits;
+                for (int c = 0; c < nchannels; ++c)
+                    result[c] = memo->result[c];
+                if (dresultds) {
+                    for (int c = 0; c < nchannels; ++c) {
+                        dresultds[c] = memo->dresultds[c];
+                        dresultdt[c] = memo->dresultdt[c];
+                    }
+                }
+                return true;
+            }
+        }
+    }
+
     if (m_flip_t) {
         t = 1.0f - t;
         dtdx *= -1.0f;
@@ -1157,6 +1322,18 @@ TextureSystemImpl::texture(TextureHandle* texture_handle_,
             *(vfloat4*)dresultdt = -(*(vfloat4*)dresultdt);
     }
 
+    if (ok && memo) {
+        *memo = memokey;
+        for (int c = 0; c < nchannels; ++c)
+            memo->result[c] = result[c];
+        if (dresultds) {
+            for (int c = 0; c < nchannels; ++c) {
+                memo->dresultds[c] = dresultds[c];
+                memo->dresultdt[c] = dresultdt[c];
+            }
+        }
+    }
+
     return ok;
 }
 
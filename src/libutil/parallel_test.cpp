@@ -151,6 +151,32 @@ test_parallel_for_2D()
 
 
 
+void
+test_parallel_for_chunked_2D_uneven()
+{
+    // Chunks that don't divide the range, with wildly unequal costs, must
+    // still each be run exactly once.
+    const int xsize = 101, ysize = 67;
+    std::vector<atomic_int> vals(xsize * ysize);
+    for (auto& v : vals)
+        v = 0;
+    parallel_for_chunked_2D(
+        0, xsize, 10, 0, ysize, 7,
+        [&](int id, int64_t xb, int64_t xe, int64_t yb, int64_t ye) {
+            if (xb == 0)
+                Sysutil::usleep(200);
+            for (auto y = yb; y < ye; ++y)
+                for (auto x = xb; x < xe; ++x)
+                    vals[y * xsize + x] += 1;
+        },
+        parallel_options(4));
+    bool all_one = std::all_of(vals.cbegin(), vals.cend(),
+                               [](const atomic_int& v) { return v == 1; });
+    OIIO_CHECK_ASSERT(all_one);
+}
+
+
+
 void
 test_thread_pool_recursion()
 {
@@ -213,6 +239,7 @@ main(int argc, char** argv)
 
     test_parallel_for();
     test_parallel_for_2D();
+    test_parallel_for_chunked_2D_uneven();
     time_parallel_for();
     test_thread_pool_recursion();
     test_empty_thread_pool();
@@ -44,6 +44,7 @@
 #    define _ENABLE_ATOMIC_ALIGNMENT_FIX /* Avoid MSVS error, ugh */
 #endif
 
+#include <atomic>
 #include <exception>
 #include <functional>
 #include <future>
@@ -493,12 +494,51 @@ default_thread_pool()
 
 
 
+bool
+task_set::run_own_task(size_t i)
+{
+    auto& claim(m_claims[i]);
+    int unclaimed = 0;
+    if (!claim || !claim->state.compare_exchange_strong(unclaimed, 2))
+        return false;
+    claim->func(-1);
+    // Release the captures now; the queued wrapper that still refers to
+    // the claim will find it taken and do nothing.
+    claim->func = nullptr;
+    return true;
+}
+
+
+
+bool
+task_set::run_own_task()
+{
+    DASSERT(submitter() == std::this_thread::get_id());
+    // Tasks below the hint that were skipped are claimed for good, so the
+    // hint only ever moves down (until the next submit()).
+    while (m_own_hint > 0) {
+        if (run_own_task(--m_own_hint))
+            return true;
+    }
+    return false;
+}
+
+
+
 void
 task_set::wait_for_task(size_t taskindex, bool block)
 {
     DASSERT(submitter() == std::this_thread::get_id());
     if (taskindex >= m_futures.size())
         return;  // nothing to wait for
+    if (m_claims[taskindex]) {
+        // A submit()'ed task: run it ourselves if no pool thread has
+        // started it yet. Otherwise it's already running somewhere, so
+        // it's safe to block on it even from inside the pool.
+        if (run_own_task(taskindex) || ran_by_submitter(taskindex))
+            return;
+        block = true;
+    }
     auto& f(m_futures[taskindex]);
     if (block || m_pool->is_worker(m_submitter_thread)) {
         // Block on completion of all the task and don't try to do any
@@ -536,7 +576,15 @@ task_set::wait(bool block)
 {
     DASSERT(submitter() == std::this_thread::get_id());
     const std::chrono::milliseconds wait_time(0);
-    if (m_pool->is_worker(m_submitter_thread))
+    // Anything submit()'ed that the pool hasn't picked up yet, we run
+    // ourselves. What's left of those is already being run by pool
+    // threads, and may safely be blocked on.
+    while (run_own_task())
+        ;
+    bool any_claims = false;
+    for (auto&& c : m_claims)
+        any_claims |= (c != nullptr);
+    if (any_claims || m_pool->is_worker(m_submitter_thread))
         block = true;  // don't get into recursive work stealing
     if (block == false) {
         int tries = 0;
@@ -583,8 +631,9 @@ task_set::wait(bool block)
     } else {
         // If block is true, just block on completion of all the tasks
         // and don't try to do any of the work with the calling thread.
-        for (auto&& f : m_futures)
-            f.wait();
+        for (size_t i = 0, e = m_futures.size(); i < e; ++i)
+            if (!ran_by_submitter(i))
+                m_futures[i].wait();
     }
 #ifndef NDEBUG
     check_done();
@@ -648,14 +697,31 @@ parallel_for_chunked_2D(
         int64_t nx = std::max(int64_t(1), opt.maxthreads / ny);
         xchunksize = std::max(int64_t(1), (xend - xstart) / nx);
     }
-    task_set ts(opt.pool);
-    for (auto y = ystart; y < yend; y += ychunksize) {
-        int64_t ychunkend = std::min(yend, y + ychunksize);
-        for (auto x = xstart; x < xend; x += xchunksize) {
-            int64_t xchunkend = std::min(xend, x + xchunksize);
-            ts.push(opt.pool->push(task, x, xchunkend, y, ychunkend));
+    int64_t nx      = (xend - xstart + xchunksize - 1) / xchunksize;
+    int64_t ny      = (yend - ystart + ychunksize - 1) / ychunksize;
+    int64_t nchunks = nx * ny;
+
+    // Rather than queueing a job per chunk up front, which leaves threads
+    // idle at the end while others still work through a backlog of
+    // expensive chunks, start one job per thread and have each one claim
+    // the next unclaimed chunk whenever it finishes one. Chunks are
+    // claimed in scanline order, so the ones in flight at any time are
+    // near each other in the image.
+    std::atomic<int64_t> next(0);
+    auto worker = [&](int id) {
+        for (int64_t c = next++; c < nchunks; c = next++) {
+            int64_t x = xstart + (c % nx) * xchunksize;
+            int64_t y = ystart + (c / nx) * ychunksize;
+            task(id, x, std::min(xend, x + xchunksize), y,
+                 std::min(yend, y + ychunksize));
         }
-    }
+    };
+    task_set ts(opt.pool);
+    int64_t njobs = std::min(nchunks, int64_t(opt.maxthreads));
+    for (int64_t j = 1; j < njobs; ++j)
+        ts.push(opt.pool->push(worker));
+    worker(-1);  // The calling thread pitches in, too
+    ts.wait();
 }
 
 
@@ -169,6 +169,40 @@ time_thread_pool()
 
 
 
+// Every pool thread submits and waits on subtasks of its own. With
+// push() + blocking wait this would deadlock as soon as all the pool
+// threads are waiting; submit() must let each of them finish its own
+// subtasks.
+void
+test_nested_submit()
+{
+    std::cout << "\nTesting nested task_set::submit\n";
+    thread_pool* pool(default_thread_pool());
+    pool->resize(4);
+    const int nouter = 16, ninner = 64;
+    std::vector<int> results(nouter * ninner, 0);
+    {
+        task_set outer(pool);
+        for (int o = 0; o < nouter; ++o) {
+            outer.submit([&, o](int /*id*/) {
+                task_set inner(pool);
+                for (int i = 0; i < ninner; ++i)
+                    inner.submit([&, o, i](int /*id*/) {
+                        results[o * ninner + i] += 1;
+                    });
+                // Exercise waiting on an individual task, too.
+                inner.wait_for_task(ninner / 2);
+                inner.wait();
+            });
+        }
+        outer.wait();
+    }
+    OIIO_CHECK_ASSERT(std::all_of(results.begin(), results.end(),
+                                  [](int r) { return r == 1; }));
+}
+
+
+
 int
 main(int argc, char** argv)
 {
@@ -186,6 +220,7 @@ main(int argc, char** argv)
 
     time_thread_group();
     time_thread_pool();
+    test_nested_submit();
 
     return unit_test_failures;
 }
@@ -28,6 +28,8 @@
   (This is the Modified BSD License)
 */
 
+#include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <cstdio>
 #include <cstdlib>
@@ -47,6 +49,7 @@
 #include <OpenImageIO/imagebufalgo.h>
 #include <OpenImageIO/imageio.h>
 #include <OpenImageIO/strutil.h>
+#include <OpenImageIO/sysutil.h>
 #include <OpenImageIO/thread.h>
 #include <OpenImageIO/timer.h>
 
@@ -58,10 +61,19 @@ using namespace OIIO;
 // Basic runtime options
 static std::string full_command_line;
 static std::vector<std::string> filenames;
+static std::vector<const char*> filename_args;  // their argv entries
 static std::string outputfilename;
+static std::string manifestname;
 static bool verbose  = false;
 static bool runstats = false;
 static int nthreads  = 0;  // default: use #cores threads if available
+static int njobs     = 0;  // batch mode: concurrent conversions (0 = auto)
+
+// Batch mode: all the input/output pairs to convert
+struct TextureJob {
+    std::string input, output, cmdline;
+};
+static std::vector<TextureJob> jobs;
 
 // Conversion modes.  If none are true, we just make an ordinary texture.
 static bool mipmapmode     = false;
@@ -131,21 +143,75 @@ colorconvert_help_string()
 static int
 parse_files(int argc, const char* argv[])
 {
-    for (int i = 0; i < argc; i++)
+    for (int i = 0; i < argc; i++) {
         filenames.emplace_back(argv[i]);
+        filename_args.push_back(argv[i]);
+    }
     return 0;
 }
 
 
 
+// Read a batch manifest: one conversion per line, giving the input filename
+// and optionally the output filename (quoted if they contain spaces).
+// Blank lines and lines starting with '#' are ignored.
+static bool
+read_manifest(const std::string& manifest)
+{
+    std::string contents;
+    if (!Filesystem::read_text_file(manifest, contents)) {
+        std::cerr << "maketx ERROR: Could not read manifest \"" << manifest
+                  << "\"\n";
+        return false;
+    }
+    std::vector<std::string> lines;
+    Strutil::split(contents, lines, "\n");
+    for (auto& line : lines) {
+        string_view s = Strutil::strip(line);
+        if (s.empty() || s[0] == '#')
+            continue;
+        string_view in, out;
+        if (!Strutil::parse_string(s, in)) {
+            std::cerr << "maketx ERROR: Malformed manifest line \"" << line
+                      << "\"\n";
+            return false;
+        }
+        Strutil::parse_string(s, out);
+        TextureJob job;
+        job.input  = in;
+        job.output = out;
+        jobs.push_back(job);
+    }
+    return true;
+}
+
+
+
 // Concatenate the command line into one string, optionally filtering out
 // verbose attribute commands. Escape control chars in the arguments, and
-// double-quote any that contain spaces.
+// double-quote any that contain spaces. If sansfiles is true, also omit
+// the input and output filenames and the batch options (so that the
+// command for each texture of a batch can be reconstructed). The inputs are
+// recognized by their position in argv, not by their text, so that an
+// option value that happens to equal an input filename is kept.
 static std::string
-command_line_string(int argc, char* argv[], bool sansattrib)
+command_line_string(int argc, char* argv[], bool sansattrib,
+                    bool sansfiles = false)
 {
     std::string s;
     for (int i = 0; i < argc; ++i) {
+        if (sansfiles) {
+            if (!strcmp(argv[i], "-o") || !strcmp(argv[i], "--manifest")
+                || !strcmp(argv[i], "-manifest") || !strcmp(argv[i], "--jobs")
+                || !strcmp(argv[i], "-jobs")) {
+                ++i;  // also skip the following argument
+                continue;
+            }
+            if (std::find(filename_args.begin(), filename_args.end(),
+                          argv[i])
+                != filename_args.end())
+                continue;
+        }
         if (sansattrib) {
             // skip any filtered attributes
             if (!strcmp(argv[i], "--attrib") || !strcmp(argv[i], "-attrib")
@@ -214,6 +280,7 @@ getargs(int argc, char* argv[], ImageSpec& configspec)
     bool unpremult             = false;
     bool sansattrib            = false;
     float sharpen              = 0.0f;
+    int outofcore_MB           = 0;
     std::string incolorspace;
     std::string outcolorspace;
     std::string colorconfigname;
@@ -233,6 +300,8 @@ getargs(int argc, char* argv[], ImageSpec& configspec)
                   "-v", &verbose, "Verbose status messages",
                   "-o %s", &outputfilename, "Output filename",
                   "--threads %d", &nthreads, "Number of threads (default: #cores)",
+                  "--manifest %s", &manifestname, "Batch mode: read input (and optionally output) filenames from a file, one pair per line",
+                  "--jobs %d", &njobs, "Batch mode: number of textures to convert at once (default: auto)",
                   "-u", &updatemode, "Update mode",
                   "--format %s", &fileformatname, "Specify output file format (default: guess from extension)",
                   "--nchannels %d", &nchannels, "Specify the number of output image channels.",
@@ -278,6 +347,7 @@ getargs(int argc, char* argv[], ImageSpec& configspec)
                   "--no-compute-average %!", &compute_average, "Don't compute and store average color",
                   "--ignore-unassoc", &ignore_unassoc, "Ignore unassociated alpha tags in input (don't autoconvert)",
                   "--runstats", &runstats, "Print runtime statistics",
+                  "--outofcore %d", &outofcore_MB, "Stream the image through in bands using at most this many MB of pixel memory, for images too large to fit in RAM (default: 0 = off)",
                   "--stats", &runstats, "", // DEPRECATED 1.6
                   "--mipimage %L", &mipimages, "Specify an individual MIP level",
                   "<SEPARATOR>", "Basic modes (default is plain texture):",
@@ -308,7 +378,7 @@ getargs(int argc, char* argv[], ImageSpec& configspec)
         ap.usage();
         exit(EXIT_FAILURE);
     }
-    if (filenames.empty()) {
+    if (filenames.empty() && manifestname.empty()) {
         ap.briefusage();
         std::cout << "\nFor detailed help: maketx --help\n";
         exit(EXIT_SUCCESS);
@@ -335,8 +405,24 @@ getargs(int argc, char* argv[], ImageSpec& configspec)
         exit(EXIT_FAILURE);
     }
 
-    if (filenames.size() != 1) {
-        std::cerr << "maketx ERROR: requires exactly one input filename\n";
+    // Multiple input files (on the command line or from a manifest) mean
+    // batch mode, with output names derived from the inputs.
+    if (manifestname.size() && !read_manifest(manifestname))
+        exit(EXIT_FAILURE);
+    for (auto& f : filenames) {
+        TextureJob job;
+        job.input = f;
+        jobs.push_back(job);
+    }
+    if (jobs.size() == 1 && outputfilename.size())
+        jobs[0].output = outputfilename;
+    if (jobs.empty()) {
+        std::cerr << "maketx ERROR: requires at least one input filename\n";
+        exit(EXIT_FAILURE);
+    }
+    if (jobs.size() > 1 && outputfilename.size()) {
+        std::cerr << "maketx ERROR: -o may only be used with a single input "
+                     "file\n";
         exit(EXIT_FAILURE);
     }
 
@@ -400,6 +486,8 @@ getargs(int argc, char* argv[], ImageSpec& configspec)
     configspec.attribute("maketx:highlightcomp",
                          (int)do_highlight_compensation);
     configspec.attribute("maketx:sharpen", sharpen);
+    if (outofcore_MB > 0)
+        configspec.attribute("maketx:outofcore_MB", outofcore_MB);
     if (filtername.size())
         configspec.attribute("maketx:filtername", filtername);
     configspec.attribute("maketx:nchannels", nchannels);
@@ -419,6 +507,24 @@ getargs(int argc, char* argv[], ImageSpec& configspec)
                            command_line_string(argc, argv, sansattrib));
     configspec.attribute("Software", cmdline);
     configspec.attribute("maketx:full_command_line", cmdline);
+    if (jobs.size() > 1) {
+        // Each texture of a batch records the command that would have made
+        // it individually, so that update mode works the same either way.
+        std::string options = Strutil::strip(
+            command_line_string(argc, argv, sansattrib, true));
+        auto quoted = [](const std::string& arg) {
+            std::string a = Strutil::escape_chars(arg);
+            return a.find(' ') == std::string::npos ? a : '\"' + a + '\"';
+        };
+        for (auto& job : jobs) {
+            if (job.output.empty())
+                job.output = Filesystem::replace_extension(job.input, ".tx");
+            job.cmdline = Strutil::sprintf("OpenImageIO %s : %s %s -o %s",
+                                           OIIO_VERSION_STRING, options,
+                                           quoted(job.input),
+                                           quoted(job.output));
+        }
+    }
 
     // Add user-specified string attributes
     for (size_t i = 0; i < string_attrib_names.size(); ++i) {
@@ -460,6 +566,68 @@ getargs(int argc, char* argv[], ImageSpec& configspec)
 
 
 
+// Batch mode: convert many textures in one process, several at once. The
+// conversions are run as tasks in the shared thread pool (which also does
+// any parallel work within a conversion that isn't itself running on a
+// pool thread), and they share the ImageCache and the color configuration,
+// so that small textures keep the cores busy and the per-process startup
+// costs are only paid once.
+static bool
+make_texture_batch(ImageBufAlgo::MakeTextureMode mode,
+                   const ImageSpec& configspec)
+{
+    int nthreads_used = nthreads > 0 ? nthreads
+                                     : Sysutil::hardware_concurrency();
+    int n = njobs > 0 ? njobs : std::max(2, nthreads_used / 2);
+    n     = std::max(1, std::min(n, int(jobs.size())));
+    if (verbose)
+        std::cout << "Converting " << jobs.size() << " textures, " << n
+                  << " at a time\n";
+
+    std::vector<double> times(jobs.size(), 0.0);
+    std::vector<int> succeeded(jobs.size(), 0);
+    std::atomic<int> nextjob(0);
+    std::mutex outmutex;
+    auto driver = [&](int /*id*/) {
+        for (int j = nextjob++; j < int(jobs.size()); j = nextjob++) {
+            ImageSpec config = configspec;
+            config.attribute("Software", jobs[j].cmdline);
+            config.attribute("maketx:full_command_line", jobs[j].cmdline);
+            std::ostringstream out;
+            Timer timer;
+            bool ok      = ImageBufAlgo::make_texture(mode, jobs[j].input,
+                                                 jobs[j].output, config, &out);
+            times[j]     = timer();
+            succeeded[j] = int(ok);
+            // Keep each texture's messages together
+            lock_guard lock(outmutex);
+            if (verbose || runstats)
+                std::cout << "\n" << jobs[j].input << " -> " << jobs[j].output
+                          << "\n";
+            std::cout << out.str() << std::flush;
+        }
+    };
+    {
+        // Each of the n tasks keeps claiming the next unconverted texture.
+        // Any the pool doesn't get to are run by this thread as it waits.
+        task_set tasks(default_thread_pool());
+        for (int t = 0; t < n; ++t)
+            tasks.submit(driver);
+    }
+
+    int nfailed = int(std::count(succeeded.begin(), succeeded.end(), 0));
+    if (runstats) {
+        std::cout << "\nmaketx batch: " << jobs.size() << " textures, "
+                  << nfailed << " failed\n";
+        for (size_t j = 0; j < jobs.size(); ++j)
+            Strutil::printf("  %8.2fs  %s%s\n", times[j], jobs[j].input,
+                            succeeded[j] ? "" : "  (FAILED)");
+    }
+    return nfailed == 0;
+}
+
+
+
 int
 main(int argc, char* argv[])
 {
@@ -490,8 +658,12 @@ main(int argc, char* argv[])
     if (bumpslopesmode)
         mode = ImageBufAlgo::MakeTxBumpWithSlopes;
 
-    bool ok = ImageBufAlgo::make_texture(mode, filenames[0], outputfilename,
-                                         configspec, &std::cout);
+    bool ok;
+    if (jobs.size() == 1)
+        ok = ImageBufAlgo::make_texture(mode, jobs[0].input, jobs[0].output,
+                                        configspec, &std::cout);
+    else
+        ok = make_texture_batch(mode, configspec);
     if (runstats)
         std::cout << "\n" << ic->getstats();
 
@@ -126,14 +126,22 @@ OiioTool::do_action_diff(ImageRec& ir0, ImageRec& ir1, Oiiotool& ot,
             // Compare the two images.
             //
             ImageBufAlgo::CompareResults cr;
+            ImageBufAlgo::PixelStats stats0, stats1;
             int yee_failures = 0;
             switch (perceptual) {
             case 1:
                 yee_failures = ImageBufAlgo::compare_Yee(img0, img1, cr);
                 break;
             default:
-                ImageBufAlgo::compare(img0, img1, ot.diff_failthresh,
-                                      ot.diff_warnthresh, cr);
+                // When verbose, also gather the statistics of each image
+                // in the same pass.
+                if (ot.verbose)
+                    cr = ImageBufAlgo::compare(img0, img1, ot.diff_failthresh,
+                                               ot.diff_warnthresh, stats0,
+                                               stats1);
+                else
+                    ImageBufAlgo::compare(img0, img1, ot.diff_failthresh,
+                                          ot.diff_warnthresh, cr);
                 break;
             }
 
@@ -201,6 +209,9 @@ OiioTool::do_action_diff(ImageRec& ir0, ImageRec& ir1, Oiiotool& ot,
                               << (100.0 * yee_failures / npels)
                               << std::setprecision(precis)
                               << "%) failed the perceptual test\n";
+                if (ot.verbose && perceptual != 1)
+                    ImageBufAlgo::print_stats_comparison(std::cout, stats0,
+                                                         stats1);
             }
         }
     }
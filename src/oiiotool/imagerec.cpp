@@ -110,6 +110,11 @@ ImageRec::ImageRec(ImageRec& img, int subimage_to_copy, int miplevel_to_copy,
                 ib = new ImageBuf(srcspec);
                 if (copy_pixels)
                     ib->copy_pixels(srcib);
+            } else if (srcib.cachedpixels()) {
+                // The other image is not modified and is backed by the
+                // cache, so just share its view of the cache (including
+                // any channel subset it was read with).
+                ib = new ImageBuf(srcib);
             } else {
                 // The other image is not modified, and we don't need to be
                 // writable, either.
@@ -223,11 +228,43 @@ ImageRec::ImageRec(const std::string& name, const ImageSpec& spec,
 
 
 
+ImageRec::ImageRec(const std::string& name,
+                   std::shared_ptr<ImageBufAlgo::ImageExpr> expr,
+                   const std::vector<ImageRecRef>& inputs)
+    : m_name(name)
+    , m_pixels_modified(true)
+    , m_input_dataformat(expr->spec().format)
+    , m_imagecache(inputs.size() ? inputs[0]->m_imagecache : nullptr)
+    , m_expr(expr)
+    , m_expr_inputs(inputs)
+{
+    m_subimages.resize(1);
+    m_subimages[0].m_miplevels.resize(1);
+    m_subimages[0].m_specs.resize(1);
+    m_subimages[0].m_miplevels[0].reset(new ImageBuf);
+    m_subimages[0].m_specs[0] = expr->spec();
+}
+
+
+
 bool
 ImageRec::read(ReadPolicy readpolicy, string_view channel_set)
 {
     if (elaborated())
         return true;
+    if (m_expr) {
+        // Deferred: evaluate the fused expression, then release the
+        // inputs it was holding on to.
+        ImageBuf& ib(*m_subimages[0].m_miplevels[0]);
+        bool ok = m_expr->eval(ib);
+        if (!ok)
+            errorf("%s", ib.geterror());
+        m_subimages[0].m_specs[0] = ib.spec();
+        m_expr.reset();
+        m_expr_inputs.clear();
+        m_elaborated = true;
+        return ok;
+    }
     static ustring u_subimages("subimages"), u_miplevels("miplevels");
     int subimages = 0;
     ustring uname(name());
@@ -281,9 +318,10 @@ ImageRec::read(ReadPolicy readpolicy, string_view channel_set)
                 if (ib->deep())
                     post_channel_set_action = true;
                 if (!post_channel_set_action) {
-                    chbegin   = channel_set_channels.front();
-                    chend     = channel_set_channels.back() + 1;
-                    forceread = true;
+                    // A contiguous channel range can stay in the cache,
+                    // which will then only hold those channels.
+                    chbegin = channel_set_channels.front();
+                    chend   = channel_set_channels.back() + 1;
                 }
             }
 
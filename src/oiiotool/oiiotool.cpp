@@ -178,6 +178,8 @@ Oiiotool::clear_options()
     // maybe we'll turn it back to on by default.
     frame_padding = 0;
     eval_enable   = true;
+    fuse          = false;
+    stream        = false;
     full_command_line.clear();
     printinfo_metamatch.clear();
     printinfo_nometamatch.clear();
@@ -257,6 +259,14 @@ Oiiotool::read(ImageRecRef img, ReadPolicy readpolicy)
     if (img->elaborated())
         return true;
 
+    // A deferred image (--fuse) is computed, not read from disk.
+    if (img->deferred()) {
+        bool ok = img->read(readpolicy);
+        if (!ok)
+            errorf("fuse " + img->name(), "%s", img->geterror());
+        return ok;
+    }
+
     // Cause the ImageRec to get read.  Try to compute how long it took.
     // Subtract out ImageCache time, to avoid double-accounting it later.
     float pre_ic_time, post_ic_time;
@@ -317,6 +327,39 @@ Oiiotool::postpone_callback(int required_images, CallbackFunction func,
 
 
 
+bool
+Oiiotool::defer(ImageRecRef A,
+                const std::function<bool(ImageBufAlgo::ImageExpr&)>& stage,
+                const std::vector<ImageRecRef>& inputs)
+{
+    if (!(fuse || stream) || !A)
+        return false;
+    std::shared_ptr<ImageBufAlgo::ImageExpr> expr;
+    std::vector<ImageRecRef> exprinputs;
+    if (A->deferred()) {
+        // Extend A's chain rather than evaluating A
+        expr.reset(new ImageBufAlgo::ImageExpr(*A->deferred()));
+        exprinputs = A->deferred_inputs();
+    } else {
+        if (!read(A) || (*A)(0, 0).deep())
+            return false;
+        expr.reset(new ImageBufAlgo::ImageExpr((*A)(0, 0)));
+        exprinputs.push_back(A);
+    }
+    for (auto& in : inputs)
+        if (!read(in))
+            return false;
+    if (!stage(*expr) || expr->has_error())
+        return false;
+    exprinputs.insert(exprinputs.end(), inputs.begin(), inputs.end());
+    push(new ImageRec(A->name(), expr, exprinputs));
+    if (debug)
+        Strutil::printf("    deferred, %d fused stages\n", expr->nstages());
+    return true;
+}
+
+
+
 void
 Oiiotool::process_pending()
 {
@@ -1874,13 +1917,8 @@ public:
         string_view contextvalue = options["value"];
         bool strict              = Strutil::from_string<int>(options["strict"]);
         bool unpremult = Strutil::from_string<int>(options["unpremult"]);
-        if (unpremult
-            && img[1]->spec().get_int_attribute("oiio:UnassociatedAlpha")
-            && img[1]->spec().alpha_channel >= 0) {
-            ot.warning(
-                opname(),
-                "Image appears to already be unassociated alpha (un-premultiplied color), beware double unpremult. Don't use --unpremult and also --colorconvert:unpremult=1.");
-        }
+        if (unpremult && unassociated(img[1]->spec()))
+            warn_double_unpremult();
         bool ok = ImageBufAlgo::colorconvert(*img[0], *img[1], fromspace,
                                              tospace, unpremult, contextkey,
                                              contextvalue, &ot.colorconfig);
@@ -1894,9 +1932,35 @@ public:
         }
         return ok;
     }
+    virtual bool fuse(ImageBufAlgo::ImageExpr& expr)
+    {
+        if (fromspace == tospace)
+            return false;  // no-op, handled by setup()
+        bool unpremult = Strutil::from_string<int>(options["unpremult"]);
+        bool warn      = unpremult && unassociated(expr.spec());
+        expr.colorconvert(fromspace, tospace, unpremult, options["key"],
+                          options["value"], &ot.colorconfig);
+        if (expr.has_error())
+            return false;  // let impl() report it, or copy if !strict
+        if (warn)
+            warn_double_unpremult();
+        return true;
+    }
 
 private:
     string_view fromspace, tospace;
+
+    static bool unassociated(const ImageSpec& spec)
+    {
+        return spec.get_int_attribute("oiio:UnassociatedAlpha")
+               && spec.alpha_channel >= 0;
+    }
+    void warn_double_unpremult()
+    {
+        ot.warning(
+            opname(),
+            "Image appears to already be unassociated alpha (un-premultiplied color), beware double unpremult. Don't use --unpremult and also --colorconvert:unpremult=1.");
+    }
 };
 
 OP_CUSTOMCLASS(colorconvert, OpColorConvert, 1);
@@ -2648,6 +2712,11 @@ public:
     {
         return ImageBufAlgo::premult(*img[0], *img[1]);
     }
+    virtual bool fuse(ImageBufAlgo::ImageExpr& expr)
+    {
+        expr.premult();
+        return true;
+    }
 };
 OP_CUSTOMCLASS(premult, OpPremult, 1);
 
@@ -2661,13 +2730,23 @@ public:
     }
     virtual int impl(ImageBuf** img)
     {
-        if (img[1]->spec().get_int_attribute("oiio:UnassociatedAlpha")
-            && img[1]->spec().alpha_channel >= 0) {
+        warn_if_unassociated(img[1]->spec());
+        return ImageBufAlgo::unpremult(*img[0], *img[1]);
+    }
+    virtual bool fuse(ImageBufAlgo::ImageExpr& expr)
+    {
+        warn_if_unassociated(expr.spec());
+        expr.unpremult();
+        return true;
+    }
+    void warn_if_unassociated(const ImageSpec& spec)
+    {
+        if (spec.get_int_attribute("oiio:UnassociatedAlpha")
+            && spec.alpha_channel >= 0) {
             ot.warning(
                 opname(),
                 "Image appears to already be unassociated alpha (un-premultiplied color), beware double unpremult.");
         }
-        return ImageBufAlgo::unpremult(*img[0], *img[1]);
     }
 };
 OP_CUSTOMCLASS(unpremult, OpUnpremult, 1);
@@ -3411,12 +3490,53 @@ OP_CUSTOMCLASS(resample, OpResample, 1);
 
 
 
+// If img is a JPEG file just as it was read, and it's being shrunk to no
+// more than half its size, re-read it with the JPEG reader decoding
+// directly at a reduced scale (via the "jpeg:size" hint) that is still at
+// least width x height. The DCT scaling is nearly free and skips most of
+// the decoding work, though the result differs slightly from resizing the
+// full image, so it's only done when asked for with "prescale=1". Return
+// the reduced image, or an empty reference if this doesn't apply.
+static ImageBufRef
+jpeg_prescaled_source(ImageRec& img, int width, int height)
+{
+    if (img.pixels_modified() || img.deferred() || img.subimages() != 1)
+        return ImageBufRef();
+    const ImageBuf& ib(img(0, 0));
+    const ImageSpec& spec(ib.spec());
+    if (ib.storage() != ImageBuf::IMAGECACHE || ib.file_format_name() != "jpeg"
+        || spec.nchannels != ib.nativespec().nchannels
+        || 2 * width > spec.width || 2 * height > spec.height)
+        return ImageBufRef();
+    ImageSpec config = *img.configspec();
+    int size[2]      = { width, height };
+    config.attribute("jpeg:size", TypeDesc(TypeDesc::INT, 2), size);
+    auto in = ImageInput::open(img.name(), &config);
+    if (!in) {
+        OIIO::geterror();  // Clear the error, just use the full image
+        return ImageBufRef();
+    }
+    ImageSpec reducedspec = in->spec();
+    if (reducedspec.width >= spec.width)
+        return ImageBufRef();
+    ImageBufRef reduced(new ImageBuf(reducedspec));
+    if (!in->read_image(reducedspec.format, reduced->localpixels()))
+        return ImageBufRef();
+    if (ot.debug)
+        std::cout << "  Decoded " << img.name() << " at reduced resolution "
+                  << reducedspec.width << "x" << reducedspec.height << "\n";
+    return reduced;
+}
+
+
+
 class OpResize : public OiiotoolOp {
 public:
     OpResize(Oiiotool& ot, string_view opname, int argc, const char* argv[])
         : OiiotoolOp(ot, opname, argc, argv, 1)
     {
     }
+    virtual void option_defaults() { options["prescale"] = "0"; }
     virtual int compute_subimages() { return 1; }  // just the first one
     virtual bool setup()
     {
@@ -3443,11 +3563,16 @@ public:
         newspec.width  = int(ceilf(Aspec.width * wratio));
         newspec.height = int(ceilf(Aspec.height * hratio));
         (*ir[0])(0, 0).reset(newspec);
+        if (Strutil::from_string<int>(options["prescale"]))
+            m_prescaled = jpeg_prescaled_source(*ir[1], newspec.width,
+                                                newspec.height);
         return true;
     }
     virtual int impl(ImageBuf** img)
     {
         string_view filtername = options["filter"];
+        if (m_prescaled)
+            img[1] = m_prescaled.get();
         if (ot.debug) {
             const ImageSpec& newspec(img[0]->spec());
             const ImageSpec& Aspec(img[1]->spec());
@@ -3460,6 +3585,9 @@ public:
         return ImageBufAlgo::resize(*img[0], *img[1], filtername, 0.0f,
                                     img[0]->roi());
     }
+
+private:
+    ImageBufRef m_prescaled;  // Reduced-resolution decode of the input
 };
 
 OP_CUSTOMCLASS(resize, OpResize, 1);
@@ -3492,17 +3620,27 @@ action_fit(int argc, const char* argv[])
 
     std::map<std::string, std::string> options;
     options["wrap"]         = "black";
+    options["prescale"]     = "0";
     options["allsubimages"] = std::to_string(ot.allsubimages);
     ot.extract_options(options, command);
     bool pad               = Strutil::from_string<int>(options["pad"]);
     string_view filtername = options["filter"];
     bool exact             = Strutil::from_string<int>(options["exact"]);
     bool allsubimages      = Strutil::from_string<int>(options["allsubimages"]);
+    bool prescale          = Strutil::from_string<int>(options["prescale"]);
 
 #if 1
     // New version: use IBA::fit() for the heavy lifting
     int subimages = allsubimages ? A->subimages() : 1;
     ImageRecRef R(new ImageRec(A->name(), subimages));
+    ImageBufRef prescaled;
+    if (prescale && subimages == 1) {
+        // Shrinking a JPEG? Only decode as much of it as the fit needs.
+        float aspect = float(Aspec->full_width) / Aspec->full_height;
+        int w = std::min(fit_full_width, int(fit_full_height * aspect + 0.5f));
+        int h = std::min(fit_full_height, int(fit_full_width / aspect + 0.5f));
+        prescaled = jpeg_prescaled_source(*A, w, h);
+    }
     for (int s = 0; s < subimages; ++s) {
         ImageSpec newspec = (*A)(s, 0).spec();
         newspec.width = newspec.full_width = fit_full_width;
@@ -3510,7 +3648,8 @@ action_fit(int argc, const char* argv[])
         newspec.x = newspec.full_x = fit_full_x;
         newspec.y = newspec.full_y = fit_full_y;
         (*R)(s, 0).reset(newspec);
-        ImageBufAlgo::fit((*R)(s, 0), (*A)(s, 0), filtername, 0.0f, exact);
+        ImageBufAlgo::fit((*R)(s, 0), prescaled ? *prescaled : (*A)(s, 0),
+                          filtername, 0.0f, exact);
         R->update_spec_from_imagebuf(s, 0);
     }
     ot.pop();
@@ -4228,6 +4367,24 @@ action_fill(int argc, const char* argv[])
 
 
 
+// Decode the options of --clamp for an image with nchans channels.
+static void
+clamp_options(string_view command, int nchans, std::vector<float>& min,
+              std::vector<float>& max, bool& clampalpha01)
+{
+    const float big = std::numeric_limits<float>::max();
+    min.assign(nchans, -big);
+    max.assign(nchans, big);
+    std::map<std::string, std::string> options;
+    options["clampalpha"] = "0";  // initialize
+    ot.extract_options(options, command);
+    Strutil::extract_from_list_string(min, options["min"]);
+    Strutil::extract_from_list_string(max, options["max"]);
+    clampalpha01 = Strutil::stoi(options["clampalpha"]);
+}
+
+
+
 static int
 action_clamp(int argc, const char* argv[])
 {
@@ -4237,23 +4394,29 @@ action_clamp(int argc, const char* argv[])
     string_view command = ot.express(argv[0]);
 
     ImageRecRef A = ot.pop();
+    std::vector<float> min, max;
+    bool clampalpha01 = false;
+    if (!ot.allsubimages) {
+        auto stage = [&](ImageBufAlgo::ImageExpr& expr) {
+            clamp_options(command, expr.spec().nchannels, min, max,
+                          clampalpha01);
+            expr.clamp(min, max, clampalpha01);
+            return true;
+        };
+        if (ot.defer(A, stage)) {
+            ot.function_times[command] += timer();
+            return 0;
+        }
+    }
+
     ot.read(A);
     ImageRecRef R(new ImageRec(*A, ot.allsubimages ? -1 : 0,
                                ot.allsubimages ? -1 : 0, true /*writeable*/,
                                false /*copy_pixels*/));
     ot.push(R);
     for (int s = 0, subimages = R->subimages(); s < subimages; ++s) {
-        int nchans      = (*R)(s, 0).nchannels();
-        const float big = std::numeric_limits<float>::max();
-        std::vector<float> min(nchans, -big);
-        std::vector<float> max(nchans, big);
-        std::map<std::string, std::string> options;
-        options["clampalpha"] = "0";  // initialize
-        ot.extract_options(options, command);
-        Strutil::extract_from_list_string(min, options["min"]);
-        Strutil::extract_from_list_string(max, options["max"]);
-        bool clampalpha01 = Strutil::stoi(options["clampalpha"]);
-
+        clamp_options(command, (*R)(s, 0).nchannels(), min, max,
+                      clampalpha01);
         for (int m = 0, miplevels = R->miplevels(s); m < miplevels; ++m) {
             ImageBuf& Rib((*R)(s, m));
             ImageBuf& Aib((*A)(s, m));
@@ -4600,6 +4763,9 @@ input_file(int argc, const char* argv[])
             exit(1);
         }
 
+        // A channel subset must be read now, while we know it, but unless
+        // asked to read now anyway, it may still be backed by the cache.
+        ReadPolicy readpolicy = readnow ? ReadNoCache : ReadDefault;
         if (channel_set.size()) {
             ot.input_channel_set = channel_set;
             readnow              = true;
@@ -4611,7 +4777,7 @@ input_file(int argc, const char* argv[])
         ot.curimg->configspec(ot.input_config);
         ot.curimg->input_dataformat(input_dataformat);
         if (readnow) {
-            ot.curimg->read(ReadNoCache, channel_set);
+            ot.curimg->read(readpolicy, channel_set);
             // If we do not yet have an expected output format, set it based on
             // this image (presumably the first one read.
             if (ot.output_dataformat == TypeDesc::UNKNOWN) {
@@ -4848,7 +5014,9 @@ output_file(int argc, const char* argv[])
     bool supports_displaywindow  = out->supports("displaywindow");
     bool supports_negativeorigin = out->supports("negativeorigin");
     bool supports_tiles = out->supports("tiles") || ot.output_force_tiles;
-    ot.read();
+    // With --stream, a deferred image is computed as it's written, below.
+    if (!ot.stream || !ot.curimg->deferred())
+        ot.read();
     ImageRecRef saveimg = ot.curimg;
     ImageRecRef ir(ot.curimg);
     TypeDesc saved_output_dataformat = ot.output_dataformat;
@@ -4877,6 +5045,7 @@ output_file(int argc, const char* argv[])
     int autotrim = get_value_override(fileoptions["autotrim"],
                                       ot.output_autotrim);
     if (supports_displaywindow && autotrim) {
+        ot.read(ir);
         ROI origroi = get_roi(*ir->spec(0, 0));
         ROI roi     = ImageBufAlgo::nonzero_region((*ir)(0, 0), origroi);
         if (roi.npixels() == 0) {
@@ -4998,6 +5167,14 @@ output_file(int argc, const char* argv[])
     if (ot.debug || ot.verbose)
         std::cout << "Writing " << filename << "\n";
 
+    // Only a deferred image from a simple --stream chain is left unread;
+    // one made deferred by the automatic conversions above must be
+    // computed now unless we're streaming.
+    bool stream = ot.stream && ir->deferred() && !do_tex && !do_latlong
+                  && !do_bumpslopes;
+    if (!stream)
+        ot.read(ir);
+
     // FIXME -- the various automatic transformations above neglect to handle
     // MIPmaps or subimages with full generality.
 
@@ -5087,7 +5264,15 @@ output_file(int argc, const char* argv[])
                         break;
                     }
                 }
-                if (!(*ir)(s, m).write(out.get())) {
+                if (stream) {
+                    // Compute the fused chain a band at a time as it's
+                    // written, never holding the whole image.
+                    if (!ir->deferred()->write(out.get())) {
+                        ot.error(command, ir->deferred()->geterror());
+                        ok = false;
+                        break;
+                    }
+                } else if (!(*ir)(s, m).write(out.get())) {
                     ot.error(command, (*ir)(s, m).geterror());
                     ok = false;
                     break;
@@ -5488,6 +5673,9 @@ getargs(int argc, char* argv[])
                 "--native %@", set_native, &ot.nativeread, "Keep native pixel data type (bypass cache if necessary)",
                 "--cache %@ %d", set_cachesize, &ot.cachesize, "ImageCache size (in MB: default=4096)",
                 "--autotile %@ %d", set_autotile, &ot.autotile, "Autotile size for cached images (default=4096)",
+                "--fuse", &ot.fuse, "Defer chains of per-pixel commands (--addc, --subc, --mulc, --powc, --abs, --clamp, --premult, --unpremult, --colorconvert, --over) and compute each chain in a single pass",
+                "--nofuse %!", &ot.fuse, "Turn off --fuse",
+                "--stream", &ot.stream, "Like --fuse, and write the result of a fused chain to the output file a band of scanlines at a time, also reading the input a band at a time (directly from a scanline file, or through the ImageCache from a tiled one), without ever holding whole images in memory",
                 "<SEPARATOR>", "Commands that read images:",
                 "-i %@ %s", input_file, NULL, "Input file (argument: filename) (options: now=, printinfo=, autocc=, type=, ch=)",
                 "--iconfig %@ %s %s", set_input_attribute, NULL, NULL, "Sets input config attribute (name, value) (options: type=...)",
@@ -5600,8 +5788,8 @@ getargs(int argc, char* argv[])
                 "--transpose %@", action_transpose, NULL, "Transpose the image",
                 "--cshift %@ %s", action_cshift, NULL, "Circular shift the image (e.g.: +20-10)",
                 "--resample %@ %s", action_resample, NULL, "Resample (640x480, 50%) (options: interp=0)",
-                "--resize %@ %s", action_resize, NULL, "Resize (640x480, 50%) (options: filter=%s)",
-                "--fit %@ %s", action_fit, NULL, "Resize to fit within a window size (options: filter=%s, pad=%d, exact=%d)",
+                "--resize %@ %s", action_resize, NULL, "Resize (640x480, 50%) (options: filter=%s, prescale=%d)",
+                "--fit %@ %s", action_fit, NULL, "Resize to fit within a window size (options: filter=%s, pad=%d, exact=%d, prescale=%d)",
                 "--pixelaspect %@ %g", action_pixelaspect, NULL, "Scale up the image's width or height to match the given pixel aspect ratio (options: filter=%s)",
                 "--rotate %@ %g", action_rotate, NULL, "Rotate pixels (argument is degrees clockwise) around the center of the display window (options: filter=%s, center=%f,%f, recompute_roi=%d",
                 "--warp %@ %s", action_warp, NULL, "Warp pixels (argument is a 3x3 matrix, separated by commas) (options: filter=%s, recompute_roi=%d)",
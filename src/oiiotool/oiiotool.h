@@ -31,9 +31,11 @@
 
 #pragma once
 
+#include <functional>
 #include <memory>
 
 #include <OpenImageIO/imagebuf.h>
+#include <OpenImageIO/imagebufalgo.h>
 #include <OpenImageIO/sysutil.h>
 #include <OpenImageIO/timer.h>
 
@@ -86,6 +88,8 @@ public:
     int autotile;
     int frame_padding;
     bool eval_enable;  // Enable evaluation of expressions
+    bool fuse;         // Defer and fuse chains of point-wise ops
+    bool stream;       // Like fuse, and stream fused chains to output
     std::string full_command_line;
     std::string printinfo_metamatch;
     std::string printinfo_nometamatch;
@@ -167,6 +171,18 @@ public:
     // Process any pending commands.
     void process_pending();
 
+    // With --fuse, a point-wise op on image A doesn't compute anything:
+    // it calls stage() to append itself to an ImageExpr on A's pixels
+    // (continuing A's own expression if A is itself deferred), and pushes
+    // a deferred ImageRec that evaluates the whole chain in one pass the
+    // first time its pixels are read.  inputs are any other images that
+    // stage() refers to.  Return false, pushing nothing, if fusing isn't
+    // enabled or stage() declines; the caller should then do the op the
+    // usual way.
+    bool defer(ImageRecRef A,
+               const std::function<bool(ImageBufAlgo::ImageExpr&)>& stage,
+               const std::vector<ImageRecRef>& inputs = {});
+
     CallbackFunction pending_callback() const { return m_pending_callback; }
     const char* pending_callback_name() const { return m_pending_argv[0]; }
 
@@ -355,6 +371,13 @@ public:
     ImageRec(const std::string& name, const ImageSpec& spec,
              ImageCache* imagecache);
 
+    // Initialize a deferred ImageRec, whose only image is the result of
+    // evaluating expr, which refers to the pixels of the ImageRecs in
+    // inputs.  It is evaluated by the first read().
+    ImageRec(const std::string& name,
+             std::shared_ptr<ImageBufAlgo::ImageExpr> expr,
+             const std::vector<ImageRecRef>& inputs);
+
     ImageRec(const ImageRec& copy) = delete;  // Disallow copy ctr
 
     enum WinMerge { WinMergeUnion, WinMergeIntersection, WinMergeA, WinMergeB };
@@ -394,6 +417,14 @@ public:
     // it's lazily kept as name only, without reading the file.)
     bool elaborated() const { return m_elaborated; }
 
+    // For a deferred ImageRec that has not yet been evaluated, the
+    // expression that computes it and the images it refers to.
+    const ImageBufAlgo::ImageExpr* deferred() const { return m_expr.get(); }
+    const std::vector<ImageRecRef>& deferred_inputs() const
+    {
+        return m_expr_inputs;
+    }
+
     bool read(ReadPolicy readpolicy   = ReadDefault,
               string_view channel_set = "");
 
@@ -494,6 +525,8 @@ private:
     ImageCache* m_imagecache = nullptr;
     mutable std::string m_err;
     ImageSpec m_configspec;
+    std::shared_ptr<ImageBufAlgo::ImageExpr> m_expr;
+    std::vector<ImageRecRef> m_expr_inputs;
 
     // Add to the error message
     void append_error(string_view message) const;
@@ -657,6 +690,18 @@ public:
 
         // Read all input images, and reserve (and push) the output image.
         int subimages = compute_subimages();
+
+        // With --fuse, a point-wise op on one subimage may just be
+        // recorded onto its first input's deferred expression.
+        if (nimages() > 1 && subimages == 1) {
+            std::vector<ImageRecRef> others(ir.begin() + 2, ir.end());
+            auto stage = [&](ImageBufAlgo::ImageExpr& e) { return fuse(e); };
+            if (ot.defer(ir[1], stage, others)) {
+                ot.function_times[opname()] += timer();
+                return 0;
+            }
+        }
+
         if (nimages()) {
             // Read the inputs
             for (int i = 1; i < nimages(); ++i)
@@ -726,6 +771,11 @@ public:
     // to defaults. This will be called separate
     virtual void option_defaults() {}
 
+    // Point-wise ops may override this to append their computation, on
+    // subimage 0 of the inputs, to expr and return true, so that --fuse can
+    // defer it. Return false to run impl() as usual.
+    virtual bool fuse(ImageBufAlgo::ImageExpr& expr) { return false; }
+
     // Default subimage logic: if the global -a flag was set or if this command
     // had ":allsubimages=1" option set, then apply the command to all subimages
     // (of the first input image). Otherwise, we'll only apply the command to
@@ -774,6 +824,13 @@ public:
     {
         return opimpl(*img[0], *img[1], ROI(), 0);
     }
+    virtual bool fuse(ImageBufAlgo::ImageExpr& expr)
+    {
+        if (opname() != "abs")
+            return false;
+        expr.abs();
+        return true;
+    }
 
 protected:
     IBLIMPL opimpl;
@@ -792,6 +849,20 @@ public:
     {
         return opimpl(*img[0], *img[1], *img[2], ROI(), 0);
     }
+    virtual bool fuse(ImageBufAlgo::ImageExpr& expr)
+    {
+        // The deferred result keeps A's pixel window and data type, so
+        // only fuse when over() would have produced the same.
+        const ImageBuf& B((*ir[2])(0, 0));
+        const ImageSpec& Aspec(expr.spec());
+        if (opname() != "over" || B.spec().format != Aspec.format
+            || roi_union(B.roi(), get_roi(Aspec)) != get_roi(Aspec)
+            || roi_union(B.roi_full(), get_roi_full(Aspec))
+                   != get_roi_full(Aspec))
+            return false;
+        expr.over(B);
+        return !expr.has_error();
+    }
 
 protected:
     IBLIMPL opimpl;
@@ -810,17 +881,38 @@ public:
     }
     virtual int impl(ImageBuf** img)
     {
-        int nchans = img[1]->spec().nchannels;
-        std::vector<float> val(nchans, defaultval);
-        int nvals = Strutil::extract_from_list_string(val, args[1]);
-        val.resize(nvals);
-        val.resize(nchans, val.size() == 1 ? val.back() : defaultval);
+        std::vector<float> val = values(img[1]->spec().nchannels);
         return opimpl(*img[0], *img[1], &val[0], ROI(), 0);
     }
+    virtual bool fuse(ImageBufAlgo::ImageExpr& expr)
+    {
+        std::vector<float> val = values(expr.spec().nchannels);
+        if (opname() == "addc")
+            expr.add(val);
+        else if (opname() == "subc")
+            expr.sub(val);
+        else if (opname() == "mulc")
+            expr.mul(val);
+        else if (opname() == "powc")
+            expr.pow(val);
+        else
+            return false;
+        return true;
+    }
 
 protected:
     IBLIMPL opimpl;
     float defaultval;
+
+    // The per-channel values of the color argument
+    std::vector<float> values(int nchans) const
+    {
+        std::vector<float> val(nchans, defaultval);
+        int nvals = Strutil::extract_from_list_string(val, args[1]);
+        val.resize(nvals);
+        val.resize(nchans, val.size() == 1 ? val.back() : defaultval);
+        return val;
+    }
 };
 
 
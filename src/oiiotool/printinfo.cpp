@@ -86,6 +86,8 @@ compute_sha1(Oiiotool& ot, ImageInput* input)
             return std::string();
         }
         // Hash both the sample counts and the data block
+        // all_data() is only one contiguous block in the Interleaved layout
+        dd.set_layout(DeepData::Interleaved);
         sha.append(dd.all_samples());
         sha.append(dd.all_data());
     } else {
@@ -348,6 +348,12 @@ set_exr_threads()
 
     // 0 means all threads in OIIO, but single-threaded in OpenEXR
     // -1 means single-threaded in OIIO
+    // OpenEXR decompresses on its own thread pool, not OIIO's, and its
+    // readPixels/readTiles block the caller until that pool is done. That
+    // is why reads issued from OIIO pool threads (e.g. ImageCache tile
+    // loads under a parallel IBA call) still get parallel decompression
+    // without any risk of the nested-submission deadlock, and also why
+    // those decode tasks must not be routed into OIIO's pool.
     if (oiio_threads == 0) {
         oiio_threads = Sysutil::hardware_concurrency();
     } else if (oiio_threads == -1) {
@@ -360,6 +366,24 @@ set_exr_threads()
     }
 }
 
+
+
+// Deep pixels are passed to and from OpenEXR through an array holding a
+// pointer for every channel of every pixel, which for a big deep image is
+// itself hundreds of MB. Instead, deep reads and writes go a band of
+// scanlines at a time, reusing one pointer array. Return how many
+// scanlines per band (a multiple of granularity, which should be the
+// chunk height) keep that array to a modest size, while still giving
+// OpenEXR's thread pool plenty of chunks per band to work on in parallel.
+int
+exr_deep_band_lines(int width, int nchans, int granularity)
+{
+    const size_t maxpointers = size_t(4) << 20;  // 32 MB worth
+    size_t perline           = std::max(size_t(width) * nchans, size_t(1));
+    int chunks = int(maxpointers / (perline * std::max(granularity, 1)));
+    return std::max(chunks, 1) * std::max(granularity, 1);
+}
+
 }  // namespace pvt
 
 
@@ -1351,44 +1375,63 @@ OpenEXRInput::read_native_deep_scanlines(int subimage, int miplevel, int ybegin,
         chend          = clamp(chend, chbegin + 1, m_spec.nchannels);
         int nchans     = chend - chbegin;
 
-        // Set up the count and pointers arrays and the Imf framebuffer
+        // Set up the count array and the Imf framebuffer
         std::vector<TypeDesc> channeltypes;
         m_spec.get_channelformats(channeltypes);
         deepdata.init(npixels, nchans,
                       cspan<TypeDesc>(&channeltypes[chbegin], nchans),
                       m_spec.channelnames);
         std::vector<unsigned int> all_samples(npixels);
-        std::vector<void*> pointerbuf(npixels * nchans);
-        Imf::DeepFrameBuffer frameBuffer;
         Imf::Slice countslice(Imf::UINT,
                               (char*)(&all_samples[0] - m_spec.x
                                       - ybegin * m_spec.width),
                               sizeof(unsigned int),
                               sizeof(unsigned int) * m_spec.width);
-        frameBuffer.insertSampleCountSlice(countslice);
-
-        for (int c = chbegin; c < chend; ++c) {
-            Imf::DeepSlice slice(
-                part.pixeltype[c],
-                (char*)(&pointerbuf[0] + (c - chbegin) - m_spec.x * nchans
-                        - ybegin * m_spec.width * nchans),
-                sizeof(void*) * nchans,  // xstride of pointer array
-                sizeof(void*) * nchans
-                    * m_spec.width,      // ystride of pointer array
-                deepdata.samplesize());  // stride of data sample
-            frameBuffer.insert(m_spec.channelnames[c].c_str(), slice);
+        {
+            Imf::DeepFrameBuffer frameBuffer;
+            frameBuffer.insertSampleCountSlice(countslice);
+            m_deep_scanline_input_part->setFrameBuffer(frameBuffer);
         }
-        m_deep_scanline_input_part->setFrameBuffer(frameBuffer);
 
-        // Get the sample counts for each pixel and compute the total
-        // number of samples and resize the data area appropriately.
+        // Get the sample counts for all the pixels at once, so that the
+        // sample data can be allocated just once, at its exact size.
         m_deep_scanline_input_part->readPixelSampleCounts(ybegin, yend - 1);
         deepdata.set_all_samples(all_samples);
-        deepdata.get_pointers(pointerbuf);
 
-        // Read the pixels
-        m_deep_scanline_input_part->readPixels(ybegin, yend - 1);
-        // deepdata.import_chansamp (pointerbuf);
+        // Read the pixels, a band at a time (see exr_deep_band_lines),
+        // directly into the DeepData. Bands are aligned to the chunks in
+        // the file so that no chunk is decompressed twice.
+        // (Deep files may only use NONE, RLE, ZIPS, or ZIP compression.)
+        int chunklines = m_deep_scanline_input_part->header().compression()
+                                 == Imf::ZIP_COMPRESSION
+                             ? 16
+                             : 1;
+        int bandlines  = pvt::exr_deep_band_lines(m_spec.width, nchans,
+                                                 chunklines);
+        std::vector<void*> pointerbuf;
+        for (int y = ybegin; y < yend;) {
+            int ybandend = std::min(yend, m_spec.y
+                                              + ((y - m_spec.y) / bandlines + 1)
+                                                    * bandlines);
+            deepdata.get_pointers(pointerbuf, (y - ybegin) * m_spec.width,
+                                  (ybandend - ybegin) * m_spec.width);
+            Imf::DeepFrameBuffer frameBuffer;
+            frameBuffer.insertSampleCountSlice(countslice);
+            for (int c = chbegin; c < chend; ++c) {
+                Imf::DeepSlice slice(
+                    part.pixeltype[c],
+                    (char*)(&pointerbuf[0] + (c - chbegin) - m_spec.x * nchans
+                            - y * m_spec.width * nchans),
+                    sizeof(void*) * nchans,  // xstride of pointer array
+                    sizeof(void*) * nchans
+                        * m_spec.width,      // ystride of pointer array
+                    deepdata.sample_stride(c - chbegin));  // sample stride
+                frameBuffer.insert(m_spec.channelnames[c].c_str(), slice);
+            }
+            m_deep_scanline_input_part->setFrameBuffer(frameBuffer);
+            m_deep_scanline_input_part->readPixels(y, ybandend - 1);
+            y = ybandend;
+        }
     } catch (const std::exception& e) {
         error("Failed OpenEXR read: %s", e.what());
         return false;
@@ -1425,30 +1468,21 @@ OpenEXRInput::read_native_deep_tiles(int subimage, int miplevel, int xbegin,
         chend          = clamp(chend, chbegin + 1, m_spec.nchannels);
         int nchans     = chend - chbegin;
 
-        // Set up the count and pointers arrays and the Imf framebuffer
+        // Set up the count array and the Imf framebuffer
         std::vector<TypeDesc> channeltypes;
         m_spec.get_channelformats(channeltypes);
         deepdata.init(npixels, nchans,
                       cspan<TypeDesc>(&channeltypes[chbegin], nchans),
                       m_spec.channelnames);
         std::vector<unsigned int> all_samples(npixels);
-        std::vector<void*> pointerbuf(npixels * nchans);
-        Imf::DeepFrameBuffer frameBuffer;
         Imf::Slice countslice(
             Imf::UINT, (char*)(&all_samples[0] - xbegin - ybegin * width),
             sizeof(unsigned int), sizeof(unsigned int) * width);
-        frameBuffer.insertSampleCountSlice(countslice);
-        for (int c = chbegin; c < chend; ++c) {
-            Imf::DeepSlice slice(
-                part.pixeltype[c],
-                (char*)(&pointerbuf[0] + (c - chbegin) - xbegin * nchans
-                        - ybegin * width * nchans),
-                sizeof(void*) * nchans,          // xstride of pointer array
-                sizeof(void*) * nchans * width,  // ystride of pointer array
-                deepdata.samplesize());          // stride of data sample
-            frameBuffer.insert(m_spec.channelnames[c].c_str(), slice);
+        {
+            Imf::DeepFrameBuffer frameBuffer;
+            frameBuffer.insertSampleCountSlice(countslice);
+            m_deep_tiled_input_part->setFrameBuffer(frameBuffer);
         }
-        m_deep_tiled_input_part->setFrameBuffer(frameBuffer);
 
         int xtiles = round_to_multiple(width, m_spec.tile_width)
                      / m_spec.tile_width;
@@ -1458,19 +1492,45 @@ OpenEXRInput::read_native_deep_tiles(int subimage, int miplevel, int xbegin,
         int firstxtile = (xbegin - m_spec.x) / m_spec.tile_width;
         int firstytile = (ybegin - m_spec.y) / m_spec.tile_height;
 
-        // Get the sample counts for each pixel and compute the total
-        // number of samples and resize the data area appropriately.
+        // Get the sample counts for all the pixels at once, so that the
+        // sample data can be allocated just once, at its exact size.
         m_deep_tiled_input_part->readPixelSampleCounts(firstxtile,
                                                        firstxtile + xtiles - 1,
                                                        firstytile,
                                                        firstytile + ytiles - 1);
         deepdata.set_all_samples(all_samples);
-        deepdata.get_pointers(pointerbuf);
 
-        // Read the pixels
-        m_deep_tiled_input_part->readTiles(firstxtile, firstxtile + xtiles - 1,
-                                           firstytile, firstytile + ytiles - 1,
-                                           m_miplevel, m_miplevel);
+        // Read the pixels, a band of tile rows at a time (see
+        // exr_deep_band_lines), directly into the DeepData.
+        int bandtiles = pvt::exr_deep_band_lines(width, nchans,
+                                                 m_spec.tile_height)
+                        / m_spec.tile_height;
+        std::vector<void*> pointerbuf;
+        for (int ty = 0; ty < ytiles; ty += bandtiles) {
+            int tyend    = std::min(ty + bandtiles, ytiles);
+            int y        = ybegin + ty * m_spec.tile_height;
+            int ybandend = std::min(yend, ybegin + tyend * m_spec.tile_height);
+            deepdata.get_pointers(pointerbuf, (y - ybegin) * width,
+                                  (ybandend - ybegin) * width);
+            Imf::DeepFrameBuffer frameBuffer;
+            frameBuffer.insertSampleCountSlice(countslice);
+            for (int c = chbegin; c < chend; ++c) {
+                Imf::DeepSlice slice(
+                    part.pixeltype[c],
+                    (char*)(&pointerbuf[0] + (c - chbegin) - xbegin * nchans
+                            - y * width * nchans),
+                    sizeof(void*) * nchans,          // xstride of pointer array
+                    sizeof(void*) * nchans * width,  // ystride of pointer array
+                    deepdata.sample_stride(c - chbegin));  // sample stride
+                frameBuffer.insert(m_spec.channelnames[c].c_str(), slice);
+            }
+            m_deep_tiled_input_part->setFrameBuffer(frameBuffer);
+            m_deep_tiled_input_part->readTiles(firstxtile,
+                                               firstxtile + xtiles - 1,
+                                               firstytile + ty,
+                                               firstytile + tyend - 1,
+                                               m_miplevel, m_miplevel);
+        }
     } catch (const std::exception& e) {
         error("Failed OpenEXR read: %s", e.what());
         return false;
@@ -247,6 +247,8 @@ static std::string format_string("openexr");
 namespace pvt {
 void
 set_exr_threads();
+int
+exr_deep_band_lines(int width, int nchans, int granularity);
 
 // format-specific metadata prefixes
 static std::vector<std::string> format_prefixes;
@@ -1580,31 +1582,47 @@ OpenEXROutput::write_deep_scanlines(int ybegin, int yend, int z,
 
     int nchans = m_spec.nchannels;
     try {
-        // Set up the count and pointers arrays and the Imf framebuffer
-        Imf::DeepFrameBuffer frameBuffer;
+        // Set up the count and pointers arrays and the Imf framebuffer.
+        // The samples go straight from the DeepData to OpenEXR, a band of
+        // scanlines at a time so that the pointer array stays small (see
+        // exr_deep_band_lines in exrinput.cpp). OpenEXR compresses the
+        // chunks of each band in parallel on its own thread pool.
         Imf::Slice countslice(Imf::UINT,
                               (char*)(deepdata.all_samples().data() - m_spec.x
                                       - ybegin * m_spec.width),
                               sizeof(unsigned int),
                               sizeof(unsigned int) * m_spec.width);
-        frameBuffer.insertSampleCountSlice(countslice);
+        // (Deep files may only use NONE, RLE, ZIPS, or ZIP compression.)
+        int chunklines = m_deep_scanline_output_part->header().compression()
+                                 == Imf::ZIP_COMPRESSION
+                             ? 16
+                             : 1;
+        int bandlines  = pvt::exr_deep_band_lines(m_spec.width, nchans,
+                                                 chunklines);
         std::vector<void*> pointerbuf;
-        deepdata.get_pointers(pointerbuf);
-        for (int c = 0; c < nchans; ++c) {
-            Imf::DeepSlice slice(
-                m_pixeltype[c],
-                (char*)(&pointerbuf[c] - m_spec.x * nchans
-                        - ybegin * m_spec.width * nchans),
-                sizeof(void*) * nchans,  // xstride of pointer array
-                sizeof(void*) * nchans
-                    * m_spec.width,      // ystride of pointer array
-                deepdata.samplesize());  // stride of data sample
-            frameBuffer.insert(m_spec.channelnames[c].c_str(), slice);
+        for (int y = ybegin; y < yend;) {
+            int ybandend = std::min(yend, m_spec.y
+                                              + ((y - m_spec.y) / bandlines + 1)
+                                                    * bandlines);
+            deepdata.get_pointers(pointerbuf, (y - ybegin) * m_spec.width,
+                                  (ybandend - ybegin) * m_spec.width);
+            Imf::DeepFrameBuffer frameBuffer;
+            frameBuffer.insertSampleCountSlice(countslice);
+            for (int c = 0; c < nchans; ++c) {
+                Imf::DeepSlice slice(
+                    m_pixeltype[c],
+                    (char*)(&pointerbuf[c] - m_spec.x * nchans
+                            - y * m_spec.width * nchans),
+                    sizeof(void*) * nchans,  // xstride of pointer array
+                    sizeof(void*) * nchans
+                        * m_spec.width,      // ystride of pointer array
+                    deepdata.sample_stride(c));  // stride of data sample
+                frameBuffer.insert(m_spec.channelnames[c].c_str(), slice);
+            }
+            m_deep_scanline_output_part->setFrameBuffer(frameBuffer);
+            m_deep_scanline_output_part->writePixels(ybandend - y);
+            y = ybandend;
         }
-        m_deep_scanline_output_part->setFrameBuffer(frameBuffer);
-
-        // Write the pixels
-        m_deep_scanline_output_part->writePixels(yend - ybegin);
     } catch (const std::exception& e) {
         error("Failed OpenEXR write: %s", e.what());
         return false;
@@ -1637,27 +1655,13 @@ OpenEXROutput::write_deep_tiles(int xbegin, int xend, int ybegin, int yend,
     try {
         size_t width = (xend - xbegin);
 
-        // Set up the count and pointers arrays and the Imf framebuffer
-        Imf::DeepFrameBuffer frameBuffer;
+        // Set up the count and pointers arrays and the Imf framebuffer,
+        // and write a band of tile rows at a time, as for scanlines.
         Imf::Slice countslice(Imf::UINT,
                               (char*)(deepdata.all_samples().data() - xbegin
                                       - ybegin * width),
                               sizeof(unsigned int),
                               sizeof(unsigned int) * width);
-        frameBuffer.insertSampleCountSlice(countslice);
-        std::vector<void*> pointerbuf;
-        deepdata.get_pointers(pointerbuf);
-        for (int c = 0; c < nchans; ++c) {
-            Imf::DeepSlice slice(
-                m_pixeltype[c],
-                (char*)(&pointerbuf[c] - xbegin * nchans
-                        - ybegin * width * nchans),
-                sizeof(void*) * nchans,          // xstride of pointer array
-                sizeof(void*) * nchans * width,  // ystride of pointer array
-                deepdata.samplesize());          // stride of data sample
-            frameBuffer.insert(m_spec.channelnames[c].c_str(), slice);
-        }
-        m_deep_tiled_output_part->setFrameBuffer(frameBuffer);
 
         int firstxtile = (xbegin - m_spec.x) / m_spec.tile_width;
         int firstytile = (ybegin - m_spec.y) / m_spec.tile_height;
@@ -1666,12 +1670,35 @@ OpenEXROutput::write_deep_tiles(int xbegin, int xend, int ybegin, int yend,
         int ytiles = round_to_multiple(yend - ybegin, m_spec.tile_height)
                      / m_spec.tile_height;
 
-        // Write the pixels
-        m_deep_tiled_output_part->writeTiles(firstxtile,
-                                             firstxtile + xtiles - 1,
-                                             firstytile,
-                                             firstytile + ytiles - 1,
-                                             m_miplevel, m_miplevel);
+        int bandtiles = pvt::exr_deep_band_lines(int(width), nchans,
+                                                 m_spec.tile_height)
+                        / m_spec.tile_height;
+        std::vector<void*> pointerbuf;
+        for (int ty = 0; ty < ytiles; ty += bandtiles) {
+            int tyend    = std::min(ty + bandtiles, ytiles);
+            int y        = ybegin + ty * m_spec.tile_height;
+            int ybandend = std::min(yend, ybegin + tyend * m_spec.tile_height);
+            deepdata.get_pointers(pointerbuf, int((y - ybegin) * width),
+                                  int((ybandend - ybegin) * width));
+            Imf::DeepFrameBuffer frameBuffer;
+            frameBuffer.insertSampleCountSlice(countslice);
+            for (int c = 0; c < nchans; ++c) {
+                Imf::DeepSlice slice(
+                    m_pixeltype[c],
+                    (char*)(&pointerbuf[c] - xbegin * nchans
+                            - y * width * nchans),
+                    sizeof(void*) * nchans,          // xstride of pointer array
+                    sizeof(void*) * nchans * width,  // ystride of pointer array
+                    deepdata.sample_stride(c));      // stride of data sample
+                frameBuffer.insert(m_spec.channelnames[c].c_str(), slice);
+            }
+            m_deep_tiled_output_part->setFrameBuffer(frameBuffer);
+            m_deep_tiled_output_part->writeTiles(firstxtile,
+                                                 firstxtile + xtiles - 1,
+                                                 firstytile + ty,
+                                                 firstytile + tyend - 1,
+                                                 m_miplevel, m_miplevel);
+        }
     } catch (const std::exception& e) {
         error("Failed OpenEXR write: %s", e.what());
         return false;
@@ -321,6 +321,29 @@ read_next_scanline(png_structp& sp, void* buffer)
 
 
 
+/// Reads the next nrows scanlines from an open (non-interlaced) PNG file
+/// directly into consecutive rows of the indicated buffer.
+/// \return empty string on success, error message on failure.
+///
+inline const std::string
+read_next_scanlines(png_structp& sp, void* buffer, int nrows, size_t rowbytes)
+{
+    std::vector<png_bytep> row_pointers(nrows);
+    for (int i = 0; i < nrows; ++i)
+        row_pointers[i] = (png_bytep)buffer + i * rowbytes;
+
+    // Must call this setjmp in every function that does PNG reads
+    if (setjmp(png_jmpbuf(sp)))  // NOLINT(cert-err52-cpp)
+        return "PNG library error";
+
+    png_read_rows(sp, &row_pointers[0], NULL, nrows);
+
+    // success
+    return "";
+}
+
+
+
 /// Destroys a PNG read struct.
 ///
 inline void
@@ -624,6 +647,107 @@ write_row(png_structp& sp, png_byte* data)
 
 
 
+/// Writes a complete chunk (e.g., IDAT data that was compressed without
+/// the help of libpng).
+///
+inline bool
+write_chunk(png_structp& sp, const char* name, const void* data, size_t size)
+{
+    if (setjmp(png_jmpbuf(sp))) {  // NOLINT(cert-err52-cpp)
+        //error ("PNG library error");
+        return false;
+    }
+    png_write_chunk(sp, (png_bytep)name, (png_bytep)data, size);
+    return true;
+}
+
+
+
+/// Applies to one row (of rowbytes bytes, with bpp bytes per pixel) the
+/// filter that makes it look most compressible, by libpng's heuristic of
+/// the minimum sum of absolute differences, and writes the filter type
+/// byte followed by the filtered row to out. The prev row must be all
+/// zero for the first row of the image. The scratch space must hold at
+/// least 2*rowbytes bytes.
+///
+inline void
+filter_row(const unsigned char* row, const unsigned char* prev,
+           size_t rowbytes, int bpp, unsigned char* out,
+           unsigned char* scratch)
+{
+    unsigned char* best  = scratch;
+    unsigned char* trial = scratch + rowbytes;
+    size_t bestsum       = std::numeric_limits<size_t>::max();
+    int besttype         = 0;
+    for (int type = 0; type <= 4; ++type) {
+        size_t sum = 0;
+        for (size_t i = 0; i < rowbytes; ++i) {
+            int x = row[i];
+            int a = i >= size_t(bpp) ? row[i - bpp] : 0;
+            int b = prev[i];
+            int c = i >= size_t(bpp) ? prev[i - bpp] : 0;
+            switch (type) {
+            case 1: x -= a; break;
+            case 2: x -= b; break;
+            case 3: x -= (a + b) / 2; break;
+            case 4: {
+                int pa = std::abs(b - c), pb = std::abs(a - c);
+                int pc = std::abs(a + b - 2 * c);
+                x -= (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c);
+                break;
+            }
+            default: break;
+            }
+            trial[i] = (unsigned char)x;
+            sum += std::abs(int((signed char)trial[i]));
+        }
+        if (sum < bestsum) {
+            bestsum  = sum;
+            besttype = type;
+            std::swap(best, trial);
+        }
+    }
+    out[0] = (unsigned char)besttype;
+    memcpy(out + 1, best, rowbytes);
+}
+
+
+
+/// Compresses a band of filtered image data as raw deflate data that can
+/// be joined to the compressed bands before and after it to make one
+/// zlib stream: the (up to 32KB of) data preceding the band are the
+/// preset dictionary, and the band ends in a sync flush, or if it's the
+/// last, ends the stream.
+///
+inline bool
+deflate_band(const unsigned char* data, size_t size, size_t dictsize,
+             int level, int strategy, bool last,
+             std::vector<unsigned char>& out)
+{
+    z_stream z;
+    memset(&z, 0, sizeof(z));
+    if (deflateInit2(&z, level, Z_DEFLATED, -15, 8, strategy) != Z_OK)
+        return false;
+    bool ok = !dictsize
+              || deflateSetDictionary(&z, data - dictsize, uInt(dictsize))
+                     == Z_OK;
+    out.resize(deflateBound(&z, uLong(size)) + 16);  // + room for the flush
+    z.next_in   = (Bytef*)data;
+    z.avail_in  = uInt(size);
+    z.next_out  = &out[0];
+    z.avail_out = uInt(out.size());
+    if (ok) {
+        int r = deflate(&z, last ? Z_FINISH : Z_SYNC_FLUSH);
+        ok    = last ? r == Z_STREAM_END
+                  : (r == Z_OK && !z.avail_in && z.avail_out);
+    }
+    out.resize(z.total_out);
+    deflateEnd(&z);
+    return ok;
+}
+
+
+
 /// Helper function - finalizes writing the image and destroy the write
 /// struct.
 inline void
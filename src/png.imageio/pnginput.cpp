@@ -56,6 +56,8 @@ public:
     }
     virtual bool read_native_scanline(int subimage, int miplevel, int y, int z,
                                       void* data) override;
+    virtual bool read_native_scanlines(int subimage, int miplevel, int ybegin,
+                                       int yend, int z, void* data) override;
 
 private:
     std::string m_filename;            ///< Stash the filename
@@ -66,6 +68,7 @@ private:
     int m_color_type;                  ///< PNG color model type
     int m_interlace_type;              ///< PNG interlace type
     std::vector<unsigned char> m_buf;  ///< Buffer the image pixels
+    std::vector<unsigned char> m_row;  ///< Scratch for skipped scanlines
     int m_subimage;                    ///< What subimage are we looking at?
     Imath::Color3f m_bg;               ///< Background color
     int m_next_scanline;
@@ -91,6 +94,15 @@ private:
     /// Extract the background color.
     ///
     bool get_background(float* red, float* green, float* blue);
+
+    /// Helper function: position the reader so that the next row read
+    /// will be scanline y (relative to the data window origin), re-opening
+    /// the file if we've already passed it.
+    bool seek_scanline(int y, int miplevel);
+
+    /// Helper function: convert npixels of freshly read unassociated
+    /// alpha data to associated alpha, unless asked not to.
+    void associate_alpha(void* data, int npixels);
 };
 
 
@@ -275,20 +287,88 @@ PNGInput::read_native_scanline(int subimage, int miplevel, int y, int z,
         memcpy(data, &m_buf[0] + y * size, size);
     } else {
         // Not an interlaced image -- read just one row
-        if (m_next_scanline > y) {
-            // User is trying to read an earlier scanline than the one we're
-            // up to.  Easy fix: close the file and re-open.
-            ImageSpec dummyspec;
-            int subimage = current_subimage();
-            if (!close() || !open(m_filename, dummyspec)
-                || !seek_subimage(subimage, miplevel))
-                return false;  // Somehow, the re-open failed
-            assert(m_next_scanline == 0 && current_subimage() == subimage);
+        if (!seek_scanline(y, miplevel))
+            return false;
+        // std::cerr << "reading scanline " << m_next_scanline << "\n";
+        std::string s = PNG_pvt::read_next_scanline(m_png, data);
+        if (s.length()) {
+            close();
+            error("%s", s.c_str());
+            return false;
         }
-        while (m_next_scanline <= y) {
-            // Keep reading until we're read the scanline we really need
-            // std::cerr << "reading scanline " << m_next_scanline << "\n";
-            std::string s = PNG_pvt::read_next_scanline(m_png, data);
+        ++m_next_scanline;
+    }
+
+    associate_alpha(data, m_spec.width);
+    return true;
+}
+
+
+
+bool
+PNGInput::read_native_scanlines(int subimage, int miplevel, int ybegin,
+                                int yend, int z, void* data)
+{
+    lock_guard lock(m_mutex);
+    if (!seek_subimage(subimage, miplevel))
+        return false;
+
+    ybegin -= m_spec.y;
+    yend -= m_spec.y;
+    if (ybegin < 0 || yend > m_spec.height)  // out of range scanlines
+        return false;
+    if (ybegin >= yend)
+        return true;
+
+    size_t size    = spec().scanline_bytes();
+    int nscanlines = yend - ybegin;
+    if (m_interlace_type != 0) {
+        // Interlaced.  Punt and read the whole image
+        if (m_buf.empty() && !readimg())
+            return false;
+        memcpy(data, &m_buf[0] + ybegin * size, nscanlines * size);
+    } else {
+        // Not interlaced -- have libpng decode the whole range of rows
+        // directly into the caller's buffer.
+        if (!seek_scanline(ybegin, miplevel))
+            return false;
+        std::string s = PNG_pvt::read_next_scanlines(m_png, data, nscanlines,
+                                                     size);
+        if (s.length()) {
+            close();
+            error("%s", s.c_str());
+            return false;
+        }
+        m_next_scanline += nscanlines;
+    }
+
+    associate_alpha(data, nscanlines * m_spec.width);
+    return true;
+}
+
+
+
+bool
+PNGInput::seek_scanline(int y, int miplevel)
+{
+    if (m_next_scanline > y) {
+        // User is trying to read an earlier scanline than the one we're
+        // up to.  Easy fix: close the file and re-open, with the same
+        // configuration.
+        ImageSpec dummyspec, config;
+        if (m_keep_unassociated_alpha)
+            config.attribute("oiio:UnassociatedAlpha", 1);
+        int subimage = current_subimage();
+        if (!close() || !open(m_filename, dummyspec, config)
+            || !seek_subimage(subimage, miplevel))
+            return false;  // Somehow, the re-open failed
+        assert(m_next_scanline == 0 && current_subimage() == subimage);
+    }
+    if (m_next_scanline < y) {
+        // Skip ahead to the scanline we really need
+        m_row.resize(spec().scanline_bytes());
+        while (m_next_scanline < y) {
+            std::string s = PNG_pvt::read_next_scanline(m_png, &m_row[0]);
             if (s.length()) {
                 close();
                 error("%s", s.c_str());
@@ -297,20 +377,25 @@ PNGInput::read_native_scanline(int subimage, int miplevel, int y, int z,
             ++m_next_scanline;
         }
     }
+    return true;
+}
+
+
 
+void
+PNGInput::associate_alpha(void* data, int npixels)
+{
     // PNG specifically dictates unassociated (un-"premultiplied") alpha.
     // Convert to associated unless we were requested not to do so.
     if (m_spec.alpha_channel != -1 && !m_keep_unassociated_alpha) {
         float gamma = m_spec.get_float_attribute("oiio:Gamma", 1.0f);
         if (m_spec.format == TypeDesc::UINT16)
-            associateAlpha((unsigned short*)data, m_spec.width,
-                           m_spec.nchannels, m_spec.alpha_channel, gamma);
+            associateAlpha((unsigned short*)data, npixels, m_spec.nchannels,
+                           m_spec.alpha_channel, gamma);
         else
-            associateAlpha((unsigned char*)data, m_spec.width, m_spec.nchannels,
+            associateAlpha((unsigned char*)data, npixels, m_spec.nchannels,
                            m_spec.alpha_channel, gamma);
     }
-
-    return true;
 }
 
 OIIO_PLUGIN_NAMESPACE_END
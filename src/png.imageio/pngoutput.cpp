@@ -34,6 +34,8 @@
 #include <ctime>
 #include <iostream>
 
+#include <OpenImageIO/thread.h>
+
 #include "png_pvt.h"
 
 
@@ -71,6 +73,14 @@ private:
     std::vector<png_text> m_pngtext;
     std::vector<unsigned char> m_tilebuffer;
     Filesystem::IOProxy* m_io = nullptr;
+    int m_zlevel;                          ///< zlib compression level
+    int m_zstrategy;                       ///< zlib compression strategy
+    int m_band_rows;                       ///< Rows per band (0 = serial)
+    int m_next_scanline;                   ///< Next scanline we'll write
+    std::vector<unsigned char> m_rows;     ///< Rows not yet compressed
+    std::vector<unsigned char> m_prevrow;  ///< Last row compressed
+    std::vector<unsigned char> m_window;   ///< Last 32K of filtered data
+    uLong m_adler;                         ///< Checksum of data so far
 
     // Initialize private members to pre-opened state
     void init(void)
@@ -81,9 +91,23 @@ private:
         m_convert_alpha = true;
         m_gamma         = 1.0;
         m_pngtext.clear();
-        m_io = nullptr;
+        m_io            = nullptr;
+        m_band_rows     = 0;
+        m_next_scanline = 0;
+        m_rows.clear();
+        m_prevrow.clear();
+        m_window.clear();
+        m_adler = adler32(0, NULL, 0);
     }
 
+    // Set up to filter and compress bands of rows in parallel, if it's
+    // enabled and the image is big enough to be worth it.
+    void init_bands();
+
+    // Filter and compress the rows in m_rows, in parallel bands, and
+    // write them as IDAT chunks. If finish is true, end the stream.
+    bool compress_rows(bool finish);
+
     // Add a parameter to the output
     bool put_parameter(const std::string& name, TypeDesc type,
                        const void* data);
@@ -182,28 +206,29 @@ PNGOutput::open(const std::string& name, const ImageSpec& userspec,
     else
         png_set_write_fn(m_png, m_io, PngWriteCallback, PngFlushCallback);
 
-    png_set_compression_level(
-        m_png, std::max(std::min(m_spec.get_int_attribute(
+    m_zlevel = std::max(std::min(m_spec.get_int_attribute(
                                      "png:compressionLevel",
                                      6 /* medium speed vs size tradeoff */),
                                  Z_BEST_COMPRESSION),
-                        Z_NO_COMPRESSION));
+                        Z_NO_COMPRESSION);
+    png_set_compression_level(m_png, m_zlevel);
     std::string compression = m_spec.get_string_attribute("compression");
     if (compression.empty()) {
-        png_set_compression_strategy(m_png, Z_DEFAULT_STRATEGY);
+        m_zstrategy = Z_DEFAULT_STRATEGY;
     } else if (Strutil::iequals(compression, "default")) {
-        png_set_compression_strategy(m_png, Z_DEFAULT_STRATEGY);
+        m_zstrategy = Z_DEFAULT_STRATEGY;
     } else if (Strutil::iequals(compression, "filtered")) {
-        png_set_compression_strategy(m_png, Z_FILTERED);
+        m_zstrategy = Z_FILTERED;
     } else if (Strutil::iequals(compression, "huffman")) {
-        png_set_compression_strategy(m_png, Z_HUFFMAN_ONLY);
+        m_zstrategy = Z_HUFFMAN_ONLY;
     } else if (Strutil::iequals(compression, "rle")) {
-        png_set_compression_strategy(m_png, Z_RLE);
+        m_zstrategy = Z_RLE;
     } else if (Strutil::iequals(compression, "fixed")) {
-        png_set_compression_strategy(m_png, Z_FIXED);
+        m_zstrategy = Z_FIXED;
     } else {
-        png_set_compression_strategy(m_png, Z_DEFAULT_STRATEGY);
+        m_zstrategy = Z_DEFAULT_STRATEGY;
     }
+    png_set_compression_strategy(m_png, m_zstrategy);
 
     PNG_pvt::write_info(m_png, m_info, m_color_type, m_spec, m_pngtext,
                         m_convert_alpha, m_gamma);
@@ -220,6 +245,127 @@ PNGOutput::open(const std::string& name, const ImageSpec& userspec,
     if (m_spec.tile_width && m_spec.tile_height)
         m_tilebuffer.resize(m_spec.image_bytes());
 
+    init_bands();
+    return true;
+}
+
+
+
+void
+PNGOutput::init_bands()
+{
+    // Each band is about 256KB of image data -- enough to keep the cost of
+    // restarting the compressor in each band negligible -- and we need at
+    // least two bands for there to be anything to gain.
+    int multithread = OIIO::get_int_attribute("png:multithread");
+    if (default_thread_pool()->size() <= 1
+        || !m_spec.get_int_attribute("png:multithread", multithread))
+        return;
+    size_t rowbytes = m_spec.scanline_bytes();
+    int band_rows   = int(std::max(size_t(1), (size_t(256) << 10) / rowbytes));
+    if (m_spec.height <= band_rows)
+        return;
+    m_band_rows = band_rows;
+    m_prevrow.assign(rowbytes, 0);
+}
+
+
+
+bool
+PNGOutput::compress_rows(bool finish)
+{
+    size_t rowbytes  = m_spec.scanline_bytes();
+    size_t frowbytes = rowbytes + 1;  // filtered rows lead with the type
+    int bpp          = int(m_spec.pixel_bytes());
+    int nrows        = int(m_rows.size() / rowbytes);
+    int nbands       = (nrows + m_band_rows - 1) / m_band_rows;
+    if (finish)
+        nbands = std::max(nbands, 1);  // always end the stream
+    if (!nbands)
+        return true;
+
+    // Filter the rows, in parallel. The filtered data follow the tail of
+    // the previous batch, so that every band has its dictionary handy.
+    size_t windowsize = m_window.size();
+    std::vector<unsigned char> filtered(windowsize + nrows * frowbytes);
+    if (windowsize)
+        memcpy(&filtered[0], &m_window[0], windowsize);
+    unsigned char* fdata = &filtered[0] + windowsize;
+    task_set tasks(default_thread_pool());
+    for (int b = 0; b < nbands; ++b) {
+        tasks.submit([&, b](int /*id*/) {
+            std::vector<unsigned char> scratch(2 * rowbytes);
+            int rend = std::min(nrows, (b + 1) * m_band_rows);
+            for (int r = b * m_band_rows; r < rend; ++r) {
+                const unsigned char* prev = r ? &m_rows[(r - 1) * rowbytes]
+                                              : &m_prevrow[0];
+                PNG_pvt::filter_row(&m_rows[r * rowbytes], prev, rowbytes,
+                                    bpp, fdata + r * frowbytes, &scratch[0]);
+            }
+        });
+    }
+    tasks.wait();
+
+    // Compress the bands, in parallel.
+    size_t bandbytes = m_band_rows * frowbytes;
+    size_t fsize     = nrows * frowbytes;
+    std::vector<std::vector<unsigned char>> zbands(nbands);
+    std::vector<uLong> adlers(nbands);
+    std::vector<char> oks(nbands);
+    for (int b = 0; b < nbands; ++b) {
+        tasks.submit([&, b](int /*id*/) {
+            size_t begin = std::min(fsize, b * bandbytes);
+            size_t size  = std::min(fsize - begin, bandbytes);
+            size_t dict  = std::min(windowsize + begin, size_t(32768));
+            oks[b]       = PNG_pvt::deflate_band(fdata + begin, size, dict,
+                                           m_zlevel, m_zstrategy,
+                                           finish && b == nbands - 1,
+                                           zbands[b]);
+            adlers[b]    = adler32(adler32(0, NULL, 0), fdata + begin,
+                                uInt(size));
+        });
+    }
+    tasks.wait();
+
+    // Write them in order as IDAT chunks. Together they make one zlib
+    // stream, so the first needs the zlib header, and the last the
+    // checksum of all the filtered data.
+    for (int b = 0; b < nbands; ++b) {
+        if (!oks[b]) {
+            error("PNG compression error");
+            return false;
+        }
+        std::vector<unsigned char>& z(zbands[b]);
+        size_t begin = std::min(fsize, b * bandbytes);
+        size_t size  = std::min(fsize - begin, bandbytes);
+        m_adler      = adler32_combine(m_adler, adlers[b], z_off_t(size));
+        if (!windowsize && b == 0) {
+            int flevel = (m_zstrategy >= Z_HUFFMAN_ONLY || m_zlevel < 2)
+                             ? 0
+                             : (m_zlevel < 6 ? 1 : (m_zlevel == 6 ? 2 : 3));
+            int header = (0x78 << 8) | (flevel << 6);
+            header += 31 - header % 31;
+            unsigned char h[2] = { (unsigned char)(header >> 8),
+                                   (unsigned char)(header & 0xff) };
+            z.insert(z.begin(), h, h + 2);
+        }
+        if (finish && b == nbands - 1) {
+            for (int i = 3; i >= 0; --i)
+                z.push_back((unsigned char)(m_adler >> (8 * i)));
+        }
+        if (!PNG_pvt::write_chunk(m_png, "IDAT", z.data(), z.size())) {
+            error("PNG library error");
+            return false;
+        }
+    }
+
+    // Remember what the next batch needs to pick up where we left off.
+    if (nrows)
+        m_prevrow.assign(&m_rows[(nrows - 1) * rowbytes],
+                         &m_rows[0] + nrows * rowbytes);
+    size_t keep = std::min(filtered.size(), size_t(32768));
+    m_window.assign(filtered.end() - keep, filtered.end());
+    m_rows.clear();
     return true;
 }
 
@@ -242,7 +388,21 @@ PNGOutput::close()
         std::vector<unsigned char>().swap(m_tilebuffer);
     }
 
-    if (m_png) {
+    if (m_png && m_band_rows) {
+        // Pad out any rows that were never written, compress what's left,
+        // and end the file ourselves -- libpng didn't write the image
+        // data, so it won't.
+        size_t rowbytes = m_spec.scanline_bytes();
+        m_rows.resize(m_rows.size()
+                          + (m_spec.height - m_next_scanline) * rowbytes,
+                      0);
+        ok &= compress_rows(true);
+        if (ok && !PNG_pvt::write_chunk(m_png, "IEND", NULL, 0)) {
+            error("PNG library error");
+            ok = false;
+        }
+        png_destroy_write_struct(&m_png, &m_info);
+    } else if (m_png) {
         PNG_pvt::finish_image(m_png, m_info);
     }
 
@@ -322,6 +482,22 @@ PNGOutput::write_scanline(int y, int z, TypeDesc format, const void* data,
     if (littleendian() && m_spec.format == TypeDesc::UINT16)
         swap_endian((unsigned short*)data, m_spec.width * m_spec.nchannels);
 
+    if (m_band_rows) {
+        // Stash the row, and compress when there are enough rows to keep
+        // all the threads busy.
+        if (y != m_next_scanline) {
+            error("PNG scanlines must be written in order");
+            return false;
+        }
+        const unsigned char* row = (const unsigned char*)data;
+        m_rows.insert(m_rows.end(), row, row + m_spec.scanline_bytes());
+        ++m_next_scanline;
+        if (m_rows.size() >= size_t(m_band_rows) * default_thread_pool()->size()
+                                 * m_spec.scanline_bytes())
+            return compress_rows(false);
+        return true;
+    }
+
     if (!PNG_pvt::write_row(m_png, (png_byte*)data)) {
         error("PNG library error");
         return false;
@@ -88,6 +88,86 @@ struct TIFF_tag_info {
 
 
 
+// Decode TIFF-flavored LZW (TIFF 6.0 spec, section 13): MSB-first codes
+// of 9 to 12 bits, where the code width grows one code earlier than in
+// GIF. Decoding stops at the EOI code, at the end of the input, or when
+// outsize bytes have been produced. Return the number of bytes written to
+// out, which will be short of the expected size if the data are corrupt.
+// Unlike libtiff, this keeps no state, so any number of strips may be
+// decoded in parallel.
+static size_t
+tiff_lzw_decode(const unsigned char* in, size_t insize, unsigned char* out,
+                size_t outsize)
+{
+    enum { Clear = 256, EOI = 257, FirstFree = 258, MaxCodes = 4096 };
+    // Each table entry is a previous entry plus one byte. The length and
+    // first byte let each string be emitted back to front in one pass.
+    uint16_t prefix[MaxCodes];
+    uint16_t length[MaxCodes];
+    unsigned char suffix[MaxCodes], first[MaxCodes];
+    for (int i = 0; i < 256; ++i) {
+        prefix[i] = 0;
+        length[i] = 1;
+        suffix[i] = first[i] = (unsigned char)i;
+    }
+    int nextcode = FirstFree, nbits = 9, oldcode = -1;
+    uint32_t bitbuf = 0;
+    int bitcount    = 0;
+    size_t inpos = 0, outpos = 0;
+    while (outpos < outsize) {
+        while (bitcount < nbits) {
+            if (inpos >= insize)
+                return outpos;
+            bitbuf = (bitbuf << 8) | in[inpos++];
+            bitcount += 8;
+        }
+        bitcount -= nbits;
+        int code = int(bitbuf >> bitcount) & ((1 << nbits) - 1);
+        if (code == EOI)
+            break;
+        if (code == Clear) {
+            nextcode = FirstFree;
+            nbits    = 9;
+            oldcode  = -1;
+            continue;
+        }
+        if (oldcode < 0) {
+            // First code after a Clear is always a literal
+            if (code > 255)
+                return outpos;
+            out[outpos++] = (unsigned char)code;
+            oldcode       = code;
+            continue;
+        }
+        if (code > nextcode)
+            return outpos;  // corrupt: refers to an undefined entry
+        if (nextcode < MaxCodes) {
+            // Add the previous string plus the first byte of this one.
+            // When code == nextcode (the KwKwK case), that's the entry
+            // being defined, whose first byte is the previous string's.
+            prefix[nextcode] = (uint16_t)oldcode;
+            suffix[nextcode] = first[code == nextcode ? oldcode : code];
+            first[nextcode]  = first[oldcode];
+            length[nextcode] = length[oldcode] + 1;
+            ++nextcode;
+        }
+        // Emit the string for code, truncating at the end of the buffer.
+        size_t len = length[code];
+        size_t end = std::min(outpos + len, outsize);
+        int c      = code;
+        for (size_t i = outpos + len; i > outpos; c = prefix[c])
+            if (--i < end)
+                out[i] = suffix[c];
+        outpos  = end;
+        oldcode = code;
+        if (nextcode >= (1 << nbits) - 1 && nbits < 12)
+            ++nbits;
+    }
+    return outpos;
+}
+
+
+
 // Note about MIP-maps versus subimages:
 //
 // TIFF files support subimages, but do not explicitly support
@@ -389,43 +469,147 @@ private:
             }
     }
 
-    void uncompress_one_strip(void* compressed_buf, unsigned long csize,
+    // Undo the floating point predictor (Adobe TIFF Technical Note 3) in
+    // place. Each row of an encoded strip holds the bytes of its values
+    // split into planes, most significant byte first, and then
+    // horizontally differenced bytewise with a stride of one pixel. The
+    // reassembled values are left in native byte order.
+    void undo_fp_predictor(unsigned char* data, int chans, int width,
+                           int height, int typesize)
+    {
+        size_t rowvals  = size_t(chans) * size_t(width);
+        size_t rowbytes = rowvals * typesize;
+        std::unique_ptr<unsigned char[]> tmp(new unsigned char[rowbytes]);
+        for (int y = 0; y < height; ++y, data += rowbytes) {
+            for (size_t i = chans; i < rowbytes; ++i)
+                data[i] += data[i - chans];
+            memcpy(tmp.get(), data, rowbytes);
+            for (int b = 0; b < typesize; ++b) {
+                const unsigned char* plane
+                    = tmp.get()
+                      + (littleendian() ? typesize - 1 - b : b) * rowvals;
+                for (size_t v = 0; v < rowvals; ++v)
+                    data[v * typesize + b] = plane[v];
+            }
+        }
+    }
+
+    // Decompress a raw strip (or tile) as returned by TIFFReadRawStrip or
+    // TIFFReadRawTile, then undo byte swapping and any predictor, leaving
+    // exactly what TIFFReadEncodedStrip would have. Both "strip_bytes" and
+    // the width/height/channels describe the uncompressed data. This is
+    // safe to call from multiple threads at once. If the data are corrupt,
+    // store false in *ok.
+    void uncompress_one_strip(const void* compressed_buf, unsigned long csize,
                               void* uncompressed_buf, size_t strip_bytes,
                               int channels, int width, int height,
                               int compression, bool* ok)
     {
-        ASSERT (compression == COMPRESSION_ADOBE_DEFLATE /*||
-                compression == COMPRESSION_NONE*/);
         if (compression == COMPRESSION_NONE) {
             // just copy if there's no compression
-            memcpy(uncompressed_buf, compressed_buf, csize);
-            if (m_is_byte_swapped && m_spec.format == TypeUInt16)
-                TIFFSwabArrayOfShort((unsigned short*)uncompressed_buf,
-                                     width * height * channels);
+            if (csize < strip_bytes) {
+                *ok = false;
+                return;
+            }
+            memcpy(uncompressed_buf, compressed_buf, strip_bytes);
+        } else if (compression == COMPRESSION_ADOBE_DEFLATE
+                   || compression == COMPRESSION_DEFLATE) {
+            uLong uncompressed_size = (uLong)strip_bytes;
+            auto zok = uncompress((Bytef*)uncompressed_buf, &uncompressed_size,
+                                  (const Bytef*)compressed_buf, csize);
+            if (zok != Z_OK || uncompressed_size != strip_bytes) {
+                *ok = false;
+                return;
+            }
+        } else if (compression == COMPRESSION_LZW) {
+            if (tiff_lzw_decode((const unsigned char*)compressed_buf, csize,
+                                (unsigned char*)uncompressed_buf, strip_bytes)
+                != strip_bytes) {
+                *ok = false;
+                return;
+            }
+        } else {
+            ASSERT_MSG(0, "unsupported raw compression %d", compression);
+            *ok = false;
             return;
         }
-        uLong uncompressed_size = (uLong)strip_bytes;
-        auto zok = uncompress((Bytef*)uncompressed_buf, &uncompressed_size,
-                              (const Bytef*)compressed_buf, csize);
-        if (zok != Z_OK || uncompressed_size != strip_bytes) {
-            *ok = false;
+
+        int typesize = int(m_spec.format.size());
+        if (m_predictor == PREDICTOR_FLOATINGPOINT) {
+            // The byte planes are always stored big endian, so this takes
+            // the place of the swab.
+            undo_fp_predictor((unsigned char*)uncompressed_buf, channels,
+                              width, height, typesize);
             return;
         }
-        if (m_is_byte_swapped && m_spec.format == TypeUInt16)
-            TIFFSwabArrayOfShort((unsigned short*)uncompressed_buf,
-                                 width * height * channels);
+        size_t nvals = size_t(width) * size_t(height) * size_t(channels);
+        if (m_is_byte_swapped) {
+            if (typesize == 2)
+                TIFFSwabArrayOfShort((uint16*)uncompressed_buf, nvals);
+            else if (typesize == 4)
+                TIFFSwabArrayOfLong((uint32*)uncompressed_buf, nvals);
+            else if (typesize == 8)
+                TIFFSwabArrayOfDouble((double*)uncompressed_buf, nvals);
+        }
         if (m_predictor == PREDICTOR_HORIZONTAL) {
-            if (m_spec.format == TypeUInt8)
-                undo_horizontal_predictor((unsigned char*)uncompressed_buf,
-                                          (unsigned char*)uncompressed_buf,
+            // N.B. Like libtiff, this is an integer difference even when
+            // the samples are floating point.
+            if (typesize == 1)
+                undo_horizontal_predictor((uint8_t*)uncompressed_buf,
+                                          (uint8_t*)uncompressed_buf,
                                           channels, width, height);
-            else if (m_spec.format == TypeUInt16)
-                undo_horizontal_predictor((unsigned short*)uncompressed_buf,
-                                          (unsigned short*)uncompressed_buf,
+            else if (typesize == 2)
+                undo_horizontal_predictor((uint16_t*)uncompressed_buf,
+                                          (uint16_t*)uncompressed_buf,
+                                          channels, width, height);
+            else if (typesize == 4)
+                undo_horizontal_predictor((uint32_t*)uncompressed_buf,
+                                          (uint32_t*)uncompressed_buf,
                                           channels, width, height);
         }
     }
 
+    // Can we read raw strips or tiles of this subimage and decompress
+    // them ourselves with uncompress_one_strip? (The caller still must
+    // check the photometric and bit depth.)
+    bool can_decode_raw()
+    {
+        if (m_compression != COMPRESSION_ADOBE_DEFLATE
+            && m_compression != COMPRESSION_DEFLATE
+            && m_compression != COMPRESSION_LZW)
+            return false;
+        int typesize = int(m_spec.format.size());
+        if (m_predictor == PREDICTOR_FLOATINGPOINT)
+            return m_spec.format == TypeDesc::HALF
+                   || m_spec.format == TypeDesc::FLOAT
+                   || m_spec.format == TypeDesc::DOUBLE;
+        return (m_predictor == PREDICTOR_NONE
+                || m_predictor == PREDICTOR_HORIZONTAL)
+               && (typesize == 1 || typesize == 2 || typesize == 4
+                   || (typesize == 8 && m_predictor == PREDICTOR_NONE));
+    }
+
+    // Upper bound on the raw size of a strip or tile that decompresses to
+    // "bytes". LZW can expand incompressible data by up to 12 bits per
+    // byte, which is more than zlib ever will.
+    size_t raw_bound(imagesize_t bytes) const
+    {
+        if (m_compression == COMPRESSION_LZW)
+            return size_t(bytes + bytes / 2 + 64);
+        return size_t(compressBound((uLong)bytes));
+    }
+
+    // Very old writers used an incompatible, LSB-first flavor of LZW that
+    // libtiff still decodes but tiff_lzw_decode does not. Peek at the
+    // first two bytes of a raw strip or tile to detect it.
+    bool is_old_style_lzw(uint32_t index, bool tile)
+    {
+        unsigned char head[2] = { 0, 0 };
+        tmsize_t n = tile ? TIFFReadRawTile(m_tif, index, head, 2)
+                          : TIFFReadRawStrip(m_tif, index, head, 2);
+        return n >= 2 && head[0] == 0 && (head[1] & 0x1);
+    }
+
     int tile_index(int x, int y, int z)
     {
         int xtile   = (x - m_spec.x) / m_spec.tile_width;
@@ -1170,15 +1354,23 @@ TIFFInput::readspec(bool read_meta)
         updatedDesc = true;
     }
     found = desc.rfind("oiio:SHA-1=");
-    if (found == std::string::npos)  // back compatibility with < 1.5
+    if (found == std::string::npos) {
+        // Back compatibility with < 1.5, which wrote a bare "SHA-1=" --
+        // but don't mistake the tail of another token, such as maketx's
+        // "oiio:SourceSHA-1=", for it.
         found = desc.rfind("SHA-1=");
+        while (found != std::string::npos && found > 0
+               && desc[found - 1] != ' ')
+            found = desc.rfind("SHA-1=", found - 1);
+    }
     if (found != std::string::npos) {
         size_t begin  = desc.find_first_of('=', found) + 1;
         size_t end    = std::min(begin + 40, desc.size());
         string_view s = string_view(desc.data() + begin, end - begin);
         m_spec.attribute("oiio:SHA-1", s);
         desc = regex_replace(desc, regex("oiio:SHA-1=[[:xdigit:]]*[ ]*"), "");
-        desc = regex_replace(desc, regex("SHA-1=[[:xdigit:]]*[ ]*"), "");
+        desc = regex_replace(desc, regex("(^|[ ])SHA-1=[[:xdigit:]]*[ ]*"),
+                             "$1");
         updatedDesc = true;
     }
     if (updatedDesc) {
@@ -1608,9 +1800,10 @@ TIFFInput::read_native_scanlines(int subimage, int miplevel, int ybegin,
     // thread pool to parallelize the decompression. This can give a large
     // speedup (5x or more!) because the zip decompression dwarfs the
     // actual raw I/O. But libtiff is totally serialized, so we can only
-    // parallelize by reading raw (compressed) strips then making calls to
-    // zlib ourselves to decompress. Don't bother trying to handle any of
-    // the uncommon cases with strips. This covers most real-world cases.
+    // parallelize by reading raw (compressed) strips then decompressing
+    // them ourselves (zlib for deflate, tiff_lzw_decode for LZW). Don't
+    // bother trying to handle any of the uncommon cases with strips. This
+    // covers most real-world cases.
     lock_guard lock(m_mutex);
     if (!seek_subimage(subimage, miplevel))
         return false;
@@ -1641,42 +1834,34 @@ TIFFInput::read_native_scanlines(int subimage, int miplevel, int ybegin,
                                                  yend, z, data);
     }
 
-    // Are we reading raw (compressed) strips and doing the decompression
-    // ourselves?
-    bool read_raw_strips =
-        // only deflate/zip compression
-        (m_compression
-         == COMPRESSION_ADOBE_DEFLATE /*|| m_compression == COMPRESSION_NONE*/)
-        // only horizontal predictor (or none)
-        && (m_predictor == PREDICTOR_HORIZONTAL
-            || m_predictor == PREDICTOR_NONE)
-        // contig planarconfig only (for now?)
-        && !m_separate
-        // only uint8, uint16
-        && (m_spec.format == TypeUInt8 || m_spec.format == TypeUInt16);
-
     // We know we wish to read as strips. But additionally, there are some
     // circumstances in which we want to read RAW strips, and do the
     // decompression ourselves, which we can feed to the thread pool to
-    // perform in parallel.
+    // perform in parallel. When we can't parallelize, there's nothing to
+    // gain over letting libtiff decode.
     thread_pool* pool = default_thread_pool();
-    bool parallelize =
+    int strips_in_file = (m_spec.height + m_rowsperstrip - 1)
+                         / m_rowsperstrip;
+    bool read_raw_strips =
         // and more than one, or no point parallelizing
         nstrips > 1
         // only if we are reading scanlines in order
         && ybegin == m_next_scanline
-        // only if we're threading and don't enter the thread pool recursively!
+        // only if we're threading (nested calls from inside the pool are
+        // fine, task_set::submit keeps them from deadlocking)
         && pool->size() > 1
-        && !pool->this_thread_is_in_pool()
         // and not if the feature is turned off
         && m_spec.get_int_attribute("tiff:multithread",
-                                    OIIO::get_int_attribute("tiff:multithread"));
+                                    OIIO::get_int_attribute("tiff:multithread"))
+        // only deflate/zip or LZW, on 8/16/32/64 bit data with a predictor
+        // that uncompress_one_strip knows how to undo
+        && can_decode_raw()
+        // but not the ancient incompatible flavor of LZW
+        && !(m_compression == COMPRESSION_LZW
+             && is_old_style_lzw((ybegin - m_spec.y) / m_rowsperstrip, false));
 
-    // Make room for, and read the raw (still compressed) strips. As each
-    // one is read, kick off the decompress and any other extras, to execute
-    // in parallel.
     task_set tasks(pool);
-    bool ok        = true;  // failed compression will stash a false here
+    bool ok        = true;  // failed decompression will stash a false here
     int y          = ybegin;
     size_t ystride = m_spec.scanline_bytes(true);
     int stripchans = m_separate ? 1 : m_spec.nchannels;  // chans in each strip
@@ -1685,60 +1870,85 @@ TIFFInput::read_native_scanlines(int subimage, int miplevel, int ybegin,
     int stripvals = m_spec.width * stripchans
                     * m_rowsperstrip;  // values in a strip
     imagesize_t strip_bytes = stripvals * m_spec.format.size();
-    size_t cbound           = compressBound((uLong)strip_bytes);
-    std::unique_ptr<char[]> compressed_scratch;
     std::unique_ptr<char[]> separate_tmp(
         m_separate ? new char[strip_bytes * nstrips * planes] : nullptr);
 
     if (read_raw_strips) {
-        // Make room for, and read the raw (still compressed) strips. As each
-        // one is read, kick off the decompress and any other extras, to execute
-        // in parallel.
-        compressed_scratch.reset(new char[cbound * nstrips * planes]);
-        for (size_t stripidx = 0; y + m_rowsperstrip <= yend;
-             y += m_rowsperstrip, ++stripidx) {
-            char* cbuf        = compressed_scratch.get() + stripidx * cbound;
-            tstrip_t stripnum = (y - m_spec.y) / m_rowsperstrip;
-            tsize_t csize;
-            if (read_raw_strips) {
-                csize = TIFFReadRawStrip(m_tif, stripnum, cbuf,
-                                         tmsize_t(cbound));
-            } else {
-                csize = TIFFReadEncodedStrip(m_tif, stripnum, data,
-                                             tmsize_t(strip_bytes));
-            }
-            if (csize < 0) {
-                std::string err = oiio_tiff_last_error();
-                error("TIFFRead%sStrip failed reading line y=%d,z=%d: %s",
-                      read_raw_strips ? "Raw" : "Encoded", y, z,
-                      err.size() ? err.c_str() : "unknown error");
-                ok = false;
+        // Read the raw (still compressed) strips. As each batch of strips
+        // is read, kick off the decompression, predictor and planar
+        // shuffling, to execute in parallel with reading the next batch.
+        // For "separate" planarconfig, each strip holds one channel, and
+        // the planes of a range of scanlines are strips_in_file apart.
+        size_t cbound = raw_bound(strip_bytes);
+        std::unique_ptr<char[]> compressed_scratch(
+            new char[cbound * nstrips * planes]);
+        std::unique_ptr<tsize_t[]> csizes(new tsize_t[nstrips * planes]);
+        char* cscratch = compressed_scratch.get();
+        tsize_t* csize = csizes.get();
+        char* septmp   = separate_tmp.get();
+        // Strips can be tiny (separate planarconfig files written by
+        // OIIO have one scanline per strip), so batch them up to give
+        // each task enough work to be worth the overhead.
+        int strips_per_task = std::max(1, int((1 << 16)
+                                              / (strip_bytes * planes)));
+        size_t stripidx = 0;
+        while (y + m_rowsperstrip <= yend) {
+            size_t firststrip = stripidx;
+            char* batchdata   = (char*)data;
+            for (int s = 0; s < strips_per_task && y + m_rowsperstrip <= yend;
+                 ++s, ++stripidx, y += m_rowsperstrip) {
+                for (int c = 0; c < planes; ++c) {
+                    size_t chunk      = stripidx * planes + c;
+                    tstrip_t stripnum = ((y - m_spec.y) / m_rowsperstrip)
+                                        + c * strips_in_file;
+                    csize[chunk] = TIFFReadRawStrip(m_tif, stripnum,
+                                                    cscratch + chunk * cbound,
+                                                    tmsize_t(cbound));
+                    if (csize[chunk] < 0) {
+                        std::string err = oiio_tiff_last_error();
+                        error(
+                            "TIFFReadRawStrip failed reading line y=%d,z=%d: %s",
+                            y, z, err.size() ? err.c_str() : "unknown error");
+                        tasks.wait();
+                        return false;
+                    }
+                }
             }
+            size_t endstrip     = stripidx;
             auto uncompress_etc = [=, &ok](int id) {
-                if (read_raw_strips)
-                    uncompress_one_strip(cbuf, (unsigned long)csize, data,
-                                         strip_bytes, this->m_spec.nchannels,
-                                         this->m_spec.width, m_rowsperstrip,
-                                         m_compression, &ok);
-                if (m_photometric == PHOTOMETRIC_MINISWHITE)
-                    invert_photometric(stripvals * stripchans, data);
+                char* out = batchdata;
+                for (size_t s = firststrip; s < endstrip;
+                     ++s, out += strip_bytes * planes) {
+                    char* ubuf = m_separate ? septmp + s * strip_bytes * planes
+                                            : out;
+                    for (int c = 0; c < planes; ++c) {
+                        size_t chunk = s * planes + c;
+                        uncompress_one_strip(cscratch + chunk * cbound,
+                                             (unsigned long)csize[chunk],
+                                             ubuf + c * strip_bytes,
+                                             strip_bytes, stripchans,
+                                             m_spec.width, m_rowsperstrip,
+                                             m_compression, &ok);
+                    }
+                    if (m_photometric == PHOTOMETRIC_MINISWHITE)
+                        invert_photometric(stripvals * planes, ubuf);
+                    if (m_separate)
+                        separate_to_contig(planes,
+                                           m_spec.width * m_rowsperstrip,
+                                           (unsigned char*)ubuf,
+                                           (unsigned char*)out);
+                }
             };
-            if (parallelize) {
-                // Push the rest of the work onto the thread pool queue
-                tasks.push(pool->push(uncompress_etc));
-            } else {
-                uncompress_etc(0);
-            }
-            data = (char*)data + strip_bytes * planes;
+            // Push the rest of the work onto the thread pool queue
+            tasks.submit(uncompress_etc);
+            data = (char*)data
+                   + (endstrip - firststrip) * strip_bytes * planes;
         }
 
     } else {
         // One of the cases where we don't bother reading raw, we read
         // encoded strips. Still can be a lot more efficient than reading
-        // individual scanlines. This is the clause that has to handle
-        // "separate" planarconfig.
-        int strips_in_file = (m_spec.height + m_rowsperstrip - 1)
-                             / m_rowsperstrip;
+        // individual scanlines.
         for (size_t stripidx = 0; y + m_rowsperstrip <= yend;
              y += m_rowsperstrip, ++stripidx) {
             for (int c = 0; c < planes; ++c) {
@@ -1753,7 +1963,7 @@ TIFFInput::read_native_scanlines(int subimage, int miplevel, int ybegin,
                     error(
                         "TIFFReadEncodedStrip failed reading line y=%d,z=%d: %s",
                         y, z, err.size() ? err.c_str() : "unknown error");
-                    ok = false;
+                    return false;
                 }
             }
             if (m_photometric == PHOTOMETRIC_MINISWHITE)
@@ -1776,11 +1986,19 @@ TIFFInput::read_native_scanlines(int subimage, int miplevel, int ybegin,
     m_next_scanline = y;
     for (; y < yend; ++y) {
         bool ok = read_native_scanline(subimage, miplevel, y, z, data);
-        if (!ok)
+        if (!ok) {
+            tasks.wait();
             return false;
+        }
         data = (char*)data + ystride;
     }
     tasks.wait();
+    if (!ok) {
+        error("Corrupt compressed data in TIFF strips %d-%d",
+              (ybegin - m_spec.y) / m_rowsperstrip,
+              (yend - m_spec.y - 1) / m_rowsperstrip);
+        return false;
+    }
     return true;
 }
 
@@ -1897,17 +2115,17 @@ TIFFInput::read_native_tiles(int subimage, int miplevel, int xbegin, int xend,
 
     // If the stars all align properly, use the thread pool to parallelize
     // the decompression. This can give a large speedup (5x or more!)
-    // because the zip decompression dwarfs the actual raw I/O. But libtiff
-    // is totally serialized, so we can only parallelize by making calls to
-    // zlib ourselves and then writing "raw" (compressed) strips. Don't
-    // bother trying to handle any of the uncommon cases with strips. This
-    // covers most real-world cases.
+    // because the decompression dwarfs the actual raw I/O. But libtiff is
+    // totally serialized, so we can only parallelize by reading raw
+    // (compressed) tiles and decompressing them ourselves. Don't bother
+    // trying to handle any of the uncommon cases with tiles. This covers
+    // most real-world cases.
     thread_pool* pool = default_thread_pool();
     ASSERT(m_spec.tile_depth >= 1);
     size_t ntiles = size_t(
-        (xend - xbegin + m_spec.tile_width - 1) / m_spec.tile_width
-        * (yend - ybegin + m_spec.tile_height - 1) / m_spec.tile_height
-        * (zend - zbegin + m_spec.tile_depth - 1) / m_spec.tile_depth);
+        ((xend - xbegin + m_spec.tile_width - 1) / m_spec.tile_width)
+        * ((yend - ybegin + m_spec.tile_height - 1) / m_spec.tile_height)
+        * ((zend - zbegin + m_spec.tile_depth - 1) / m_spec.tile_depth));
     bool parallelize =
         // more than one tile, or no point parallelizing
         ntiles > 1
@@ -1916,21 +2134,20 @@ TIFFInput::read_native_tiles(int subimage, int miplevel, int xbegin, int xend,
             && m_photometric != PHOTOMETRIC_PALETTE)
         // no non-multiple-of-8 bits per sample
         && (spec().format.size() * 8 == m_bitspersample)
-        // contig planarconfig only (for now?)
-        && !m_separate
-        // only deflate/zip compression with horizontal predictor
-        && m_compression == COMPRESSION_ADOBE_DEFLATE
-        && m_predictor == PREDICTOR_HORIZONTAL
-        // only uint8, uint16
-        && (m_spec.format == TypeUInt8 || m_spec.format == TypeUInt16)
+        // only deflate/zip or LZW, on 8/16/32/64 bit data with a predictor
+        // that uncompress_one_strip knows how to undo
+        && can_decode_raw()
         // No other unusual cases
         && !m_use_rgba_interface
-        // only if we're threading and don't enter the thread pool recursively!
+        // only if we're threading (nested calls from inside the pool are
+        // fine, task_set::submit keeps them from deadlocking)
         && pool->size() > 1
-        && !pool->this_thread_is_in_pool()
         // and not if the feature is turned off
         && m_spec.get_int_attribute("tiff:multithread",
-                                    OIIO::get_int_attribute("tiff:multithread"));
+                                    OIIO::get_int_attribute("tiff:multithread"))
+        // but not the ancient incompatible flavor of LZW
+        && !(m_compression == COMPRESSION_LZW
+             && is_old_style_lzw(tile_index(xbegin, ybegin, zbegin), true));
 
     // If we're not parallelizing, just call the parent class default
     // implementaiton of read_native_tiles, which will loop over the tiles
@@ -1942,19 +2159,27 @@ TIFFInput::read_native_tiles(int subimage, int miplevel, int xbegin, int xend,
 
     // Make room for, and read the raw (still compressed) tiles. As each one
     // is read, kick off the decompress and any other extras, to execute in
-    // parallel.
-    stride_t pixel_bytes   = (stride_t)m_spec.pixel_bytes(true);
-    stride_t tileystride   = pixel_bytes * m_spec.tile_width;
-    stride_t tilezstride   = tileystride * m_spec.tile_height;
-    stride_t ystride       = (xend - xbegin) * pixel_bytes;
-    stride_t zstride       = (yend - ybegin) * ystride;
-    imagesize_t tile_bytes = m_spec.tile_bytes(true);
-    int tilevals           = m_spec.tile_pixels() * m_spec.nchannels;
-    size_t cbound          = compressBound((uLong)tile_bytes);
-    std::unique_ptr<char[]> compressed_scratch(new char[cbound * ntiles]);
-    std::unique_ptr<char[]> scratch(new char[tile_bytes * ntiles]);
+    // parallel. For "separate" planarconfig, each tile holds one channel,
+    // and the planes of a tile are tiles_per_plane apart in the file.
+    int planes              = m_separate ? m_spec.nchannels : 1;
+    int tilechans           = m_separate ? 1 : m_spec.nchannels;
+    int tiles_per_plane     = int(TIFFNumberOfTiles(m_tif)) / planes;
+    stride_t pixel_bytes    = (stride_t)m_spec.pixel_bytes(true);
+    stride_t tileystride    = pixel_bytes * m_spec.tile_width;
+    stride_t tilezstride    = tileystride * m_spec.tile_height;
+    stride_t ystride        = (xend - xbegin) * pixel_bytes;
+    stride_t zstride        = (yend - ybegin) * ystride;
+    imagesize_t tile_bytes  = m_spec.tile_bytes(true);
+    imagesize_t plane_bytes = tile_bytes / planes;
+    int tilevals            = m_spec.tile_pixels() * m_spec.nchannels;
+    size_t cbound           = raw_bound(plane_bytes);
+    std::unique_ptr<char[]> compressed_scratch(
+        new char[cbound * ntiles * planes]);
+    std::unique_ptr<char[]> scratch(
+        new char[tile_bytes * ntiles * (m_separate ? 2 : 1)]);
+    std::unique_ptr<tsize_t[]> csizes(new tsize_t[ntiles * planes]);
     task_set tasks(pool);
-    bool ok = true;  // failed compression will stash a false here
+    bool ok = true;  // failed decompression will stash a false here
 
     // Strutil::printf ("Parallel tile case %d %d  %d %d  %d %d\n",
     //                  xbegin, xend, ybegin, yend, zbegin, zend);
@@ -1962,40 +2187,63 @@ TIFFInput::read_native_tiles(int subimage, int miplevel, int xbegin, int xend,
     for (int z = zbegin; z < zend; z += m_spec.tile_depth) {
         for (int y = ybegin; y < yend; y += m_spec.tile_height) {
             for (int x = xbegin; x < xend; x += m_spec.tile_width, ++tileidx) {
-                char* cbuf = compressed_scratch.get() + tileidx * cbound;
+                char* cbuf = compressed_scratch.get()
+                             + tileidx * planes * cbound;
                 char* ubuf = scratch.get() + tileidx * tile_bytes;
-                auto csize = TIFFReadRawTile(m_tif, tile_index(x, y, z), cbuf,
-                                             tmsize_t(cbound));
-                if (csize < 0) {
-                    std::string err = oiio_tiff_last_error();
-                    error(
-                        "TIFFReadRawTile failed reading tile x=%d,y=%d,z=%d: %s",
-                        x, y, z, err.size() ? err.c_str() : "unknown error");
-                    return false;
+                char* sepbuf
+                    = m_separate ? ubuf + ntiles * tile_bytes : nullptr;
+                tsize_t* csize = csizes.get() + tileidx * planes;
+                for (int c = 0; c < planes; ++c) {
+                    csize[c] = TIFFReadRawTile(m_tif,
+                                               tile_index(x, y, z)
+                                                   + c * tiles_per_plane,
+                                               cbuf + c * cbound,
+                                               tmsize_t(cbound));
+                    if (csize[c] < 0) {
+                        std::string err = oiio_tiff_last_error();
+                        error(
+                            "TIFFReadRawTile failed reading tile x=%d,y=%d,z=%d: %s",
+                            x, y, z, err.size() ? err.c_str() : "unknown error");
+                        tasks.wait();
+                        return false;
+                    }
                 }
+                // Edge tiles only copy the part that's inside the range
+                int tw = std::min(m_spec.tile_width, xend - x);
+                int th = std::min(m_spec.tile_height, yend - y);
+                int td = std::min(m_spec.tile_depth, zend - z);
                 // Push the rest of the work onto the thread pool queue
-                tasks.push(pool->push([=, &ok](int id) {
-                    uncompress_one_strip(cbuf, (unsigned long)csize, ubuf,
-                                         tile_bytes, this->m_spec.nchannels,
-                                         this->m_spec.tile_width,
-                                         this->m_spec.tile_height
-                                             * this->m_spec.tile_depth,
-                                         m_compression, &ok);
+                tasks.submit([=, &ok](int id) {
+                    char* decoded = m_separate ? sepbuf : ubuf;
+                    for (int c = 0; c < planes; ++c)
+                        uncompress_one_strip(cbuf + c * cbound,
+                                             (unsigned long)csize[c],
+                                             decoded + c * plane_bytes,
+                                             plane_bytes, tilechans,
+                                             this->m_spec.tile_width,
+                                             this->m_spec.tile_height
+                                                 * this->m_spec.tile_depth,
+                                             m_compression, &ok);
                     if (m_photometric == PHOTOMETRIC_MINISWHITE)
-                        invert_photometric(tilevals, ubuf);
-                    copy_image(this->m_spec.nchannels, this->m_spec.tile_width,
-                               this->m_spec.tile_height,
-                               this->m_spec.tile_depth, ubuf,
+                        invert_photometric(tilevals, decoded);
+                    if (m_separate)
+                        separate_to_contig(planes, m_spec.tile_pixels(),
+                                           (unsigned char*)sepbuf,
+                                           (unsigned char*)ubuf);
+                    copy_image(this->m_spec.nchannels, tw, th, td, ubuf,
                                size_t(pixel_bytes), pixel_bytes, tileystride,
                                tilezstride,
                                (char*)data + (z - zbegin) * zstride
                                    + (y - ybegin) * ystride
                                    + (x - xbegin) * pixel_bytes,
                                pixel_bytes, ystride, zstride);
-                }));
+                });
             }
         }
     }
+    tasks.wait();
+    if (!ok)
+        error("Corrupt compressed data in TIFF tiles");
     return ok;
 }
 
@@ -46,6 +46,7 @@
 #include <OpenImageIO/parallel.h>
 #include <OpenImageIO/strutil.h>
 #include <OpenImageIO/sysutil.h>
+#include <OpenImageIO/thread.h>
 #include <OpenImageIO/tiffutils.h>
 #include <OpenImageIO/timer.h>
 
@@ -60,6 +61,41 @@ namespace {
 
 static double DEFAULT_CHECKPOINT_INTERVAL_SECONDS = 5.0;
 static int MIN_SCANLINES_OR_TILES_PER_CHECKPOINT  = 64;
+
+
+
+// Indices of the tasks that have finished, in the order they finished,
+// so that compressed strips or tiles can be written as soon as they are
+// ready rather than in file order.
+class completion_queue {
+public:
+    void push(int index)
+    {
+        spin_lock lock(m_mutex);
+        m_done.push_back(index);
+    }
+
+    // Return the index of the next task to finish, running our own not
+    // yet started tasks while waiting. The caller must not pop more times
+    // than there are tasks.
+    int pop(task_set& tasks)
+    {
+        while (1) {
+            {
+                spin_lock lock(m_mutex);
+                if (m_next < m_done.size())
+                    return m_done[m_next++];
+            }
+            if (!tasks.run_own_task())
+                yield();
+        }
+    }
+
+private:
+    spin_mutex m_mutex;
+    std::vector<int> m_done;
+    size_t m_next = 0;
+};
 }  // namespace
 
 class TIFFOutput final : public ImageOutput {
@@ -98,6 +134,7 @@ private:
     int m_predictor;
     int m_photometric;
     int m_rowsperstrip;
+    int m_zipquality;              // zlib level for deflate, -1 = default
     unsigned int m_bitspersample;  ///< Of the *file*, not the client's view
     int m_outputchans;             // Number of channels for the output
     bool m_convert_rgb_to_cmyk;
@@ -111,6 +148,7 @@ private:
         m_predictor           = PREDICTOR_NONE;
         m_photometric         = PHOTOMETRIC_RGB;
         m_rowsperstrip        = 32;
+        m_zipquality          = -1;
         m_outputchans         = 0;
         m_convert_rgb_to_cmyk = false;
     }
@@ -165,11 +203,71 @@ private:
             }
     }
 
+    // Apply the floating point predictor (Adobe TIFF Technical Note 3) in
+    // place: split each row's values into byte planes, most significant
+    // first, then difference the bytes horizontally with a stride of one
+    // pixel.
+    void fp_predictor(unsigned char* data, int chans, int width, int height,
+                      int typesize)
+    {
+        size_t rowvals  = size_t(chans) * size_t(width);
+        size_t rowbytes = rowvals * typesize;
+        std::unique_ptr<unsigned char[]> tmp(new unsigned char[rowbytes]);
+        for (int y = 0; y < height; ++y, data += rowbytes) {
+            memcpy(tmp.get(), data, rowbytes);
+            for (int b = 0; b < typesize; ++b) {
+                unsigned char* plane
+                    = data + (littleendian() ? typesize - 1 - b : b) * rowvals;
+                for (size_t v = 0; v < rowvals; ++v)
+                    plane[v] = tmp[v * typesize + b];
+            }
+            for (size_t i = rowbytes - 1; i >= size_t(chans); --i)
+                data[i] -= data[i - chans];
+        }
+    }
+
+    // Apply the predictor to the strip (or tile) in uncompressed_buf,
+    // which is therefore modified, and compress it into compressed_buf,
+    // which has room for cbound bytes. The result is ready for
+    // TIFFWriteRawStrip or TIFFWriteRawTile. This is safe to call from
+    // multiple threads at once. If compression fails, store false in *ok.
     void compress_one_strip(void* uncompressed_buf, size_t strip_bytes,
                             void* compressed_buf, unsigned long cbound,
                             int channels, int width, int height,
                             unsigned long* compressed_size, bool* ok);
 
+    // Can we compress strips or tiles of this subimage ourselves with
+    // compress_one_strip and write them raw? (The caller still must check
+    // the photometric and bit depth.)
+    bool can_encode_raw()
+    {
+        if (m_compression != COMPRESSION_ADOBE_DEFLATE
+            && m_compression != COMPRESSION_LZW)
+            return false;
+        // Raw data must already be in the file's byte order, which might
+        // not be ours when appending to an existing file.
+        if (TIFFIsByteSwapped(m_tif))
+            return false;
+        int typesize = int(m_spec.format.size());
+        if (m_predictor == PREDICTOR_FLOATINGPOINT)
+            return m_spec.format == TypeDesc::HALF
+                   || m_spec.format == TypeDesc::FLOAT
+                   || m_spec.format == TypeDesc::DOUBLE;
+        if (m_predictor == PREDICTOR_HORIZONTAL)
+            return typesize == 1 || typesize == 2 || typesize == 4;
+        return m_predictor == PREDICTOR_NONE;
+    }
+
+    // Upper bound on the compressed size of a strip or tile of "bytes".
+    // LZW can expand incompressible data by up to 12 bits per byte, which
+    // is more than zlib ever will.
+    size_t compressed_bound(imagesize_t bytes) const
+    {
+        if (m_compression == COMPRESSION_LZW)
+            return size_t(bytes + bytes / 2 + 64);
+        return size_t(compressBound((uLong)bytes));
+    }
+
     int tile_index(int x, int y, int z)
     {
         int xtile   = (x - m_spec.x) / m_spec.tile_width;
@@ -471,7 +569,8 @@ TIFFOutput::open(const std::string& name, const ImageSpec& userspec,
     TIFFSetField(m_tif, TIFFTAG_COMPRESSION, m_compression);
 
     // Use predictor when using compression
-    m_predictor = PREDICTOR_NONE;
+    m_predictor  = PREDICTOR_NONE;
+    m_zipquality = -1;
     if (m_compression == COMPRESSION_LZW
         || m_compression == COMPRESSION_ADOBE_DEFLATE) {
         if (m_spec.format == TypeDesc::FLOAT
@@ -491,8 +590,10 @@ TIFFOutput::open(const std::string& name, const ImageSpec& userspec,
             TIFFSetField(m_tif, TIFFTAG_PREDICTOR, m_predictor);
         if (m_compression == COMPRESSION_ADOBE_DEFLATE) {
             int q = m_spec.get_int_attribute("tiff:zipquality", -1);
-            if (q >= 0)
-                TIFFSetField(m_tif, TIFFTAG_ZIPQUALITY, OIIO::clamp(q, 1, 9));
+            if (q >= 0) {
+                m_zipquality = OIIO::clamp(q, 1, 9);
+                TIFFSetField(m_tif, TIFFTAG_ZIPQUALITY, m_zipquality);
+            }
         }
     } else if (m_compression == COMPRESSION_JPEG) {
         TIFFSetField(m_tif, TIFFTAG_JPEGQUALITY,
@@ -1119,24 +1220,141 @@ TIFFOutput::write_scanline(int y, int z, TypeDesc format, const void* data,
 
 
 
+// Encode TIFF-flavored LZW (TIFF 6.0 spec, section 13) in a form any
+// compliant decoder, libtiff included, can read back: MSB-first codes of 9
+// to 12 bits, growing one code earlier than in GIF, with a Clear code
+// whenever the table fills. The bytes need not match libtiff's own encoder,
+// which also emits Clear codes when its compression ratio drops. Return the
+// number of bytes written to out, or 0 if they would not fit in outsize.
+// Unlike libtiff, this keeps no state, so any number of strips may be
+// encoded in parallel.
+static size_t
+tiff_lzw_encode(const unsigned char* in, size_t insize, unsigned char* out,
+                size_t outsize)
+{
+    enum { Clear = 256, EOI = 257, FirstFree = 258, MaxCode = 4094 };
+    enum { HashSize = 9001, HashShift = 5 };  // prime > 4096 * 2
+    // Open addressing hash from (prefix code, next byte) to the code for
+    // that string. A zero key marks an empty slot.
+    std::unique_ptr<uint32_t[]> hkey(new uint32_t[HashSize]);
+    std::unique_ptr<uint16_t[]> hcode(new uint16_t[HashSize]);
+    uint32_t bitbuf = 0;
+    int bitcount    = 0;
+    size_t outpos   = 0;
+    int nbits = 9, maxcode = (1 << nbits) - 1, nextcode = FirstFree;
+    auto put = [&](int code) -> bool {
+        bitbuf = (bitbuf << nbits) | uint32_t(code);
+        bitcount += nbits;
+        while (bitcount >= 8) {
+            if (outpos >= outsize)
+                return false;
+            bitcount -= 8;
+            out[outpos++] = (unsigned char)(bitbuf >> bitcount);
+        }
+        return true;
+    };
+    auto reset = [&]() {
+        memset(hkey.get(), 0, HashSize * sizeof(uint32_t));
+        nbits    = 9;
+        maxcode  = (1 << nbits) - 1;
+        nextcode = FirstFree;
+    };
+    // Add a table entry for the string just emitted plus one more byte
+    // (h < 0 only counts it), then start over with a Clear code if the
+    // table is full, or widen the codes if needed.
+    auto grow = [&](uint32_t key, int h) -> bool {
+        if (h >= 0) {
+            hkey[h]  = key;
+            hcode[h] = (uint16_t)nextcode;
+        }
+        if (++nextcode == MaxCode) {
+            if (!put(Clear))
+                return false;
+            reset();
+        } else if (nextcode > maxcode) {
+            ++nbits;
+            maxcode = (1 << nbits) - 1;
+        }
+        return true;
+    };
+
+    reset();
+    if (!put(Clear))
+        return 0;
+    if (insize) {
+        int ent = in[0];
+        for (size_t i = 1; i < insize; ++i) {
+            int c        = in[i];
+            uint32_t key = ((uint32_t(c) << 12) | uint32_t(ent)) + 1;
+            int h        = int(((uint32_t(c) << HashShift) ^ uint32_t(ent))
+                        % HashSize);
+            int disp     = h ? HashSize - h : 1;
+            while (hkey[h] && hkey[h] != key)
+                if ((h -= disp) < 0)
+                    h += HashSize;
+            if (hkey[h] == key) {
+                ent = hcode[h];  // extend the current string
+                continue;
+            }
+            if (!put(ent) || !grow(key, h))
+                return 0;
+            ent = c;
+        }
+        if (!put(ent) || !grow(0, -1))
+            return 0;
+    }
+    if (!put(EOI))
+        return 0;
+    if (bitcount) {
+        if (outpos >= outsize)
+            return 0;
+        out[outpos++] = (unsigned char)(bitbuf << (8 - bitcount));
+    }
+    return outpos;
+}
+
+
+
 void
 TIFFOutput::compress_one_strip(void* uncompressed_buf, size_t strip_bytes,
                                void* compressed_buf, unsigned long cbound,
                                int channels, int width, int height,
                                unsigned long* compressed_size, bool* ok)
 {
-    if (m_spec.format == TypeUInt8)
-        horizontal_predictor((unsigned char*)uncompressed_buf,
-                             (unsigned char*)uncompressed_buf, channels, width,
-                             height);
-    else if (m_spec.format == TypeUInt16)
-        horizontal_predictor((unsigned short*)uncompressed_buf,
-                             (unsigned short*)uncompressed_buf, channels, width,
-                             height);
+    int typesize = int(m_spec.format.size());
+    if (m_predictor == PREDICTOR_HORIZONTAL) {
+        if (typesize == 1)
+            horizontal_predictor((uint8_t*)uncompressed_buf,
+                                 (uint8_t*)uncompressed_buf, channels, width,
+                                 height);
+        else if (typesize == 2)
+            horizontal_predictor((uint16_t*)uncompressed_buf,
+                                 (uint16_t*)uncompressed_buf, channels, width,
+                                 height);
+        else if (typesize == 4)
+            horizontal_predictor((uint32_t*)uncompressed_buf,
+                                 (uint32_t*)uncompressed_buf, channels, width,
+                                 height);
+    } else if (m_predictor == PREDICTOR_FLOATINGPOINT) {
+        fp_predictor((unsigned char*)uncompressed_buf, channels, width, height,
+                     typesize);
+    }
+    if (m_compression == COMPRESSION_LZW) {
+        *compressed_size = tiff_lzw_encode((const unsigned char*)
+                                               uncompressed_buf,
+                                           strip_bytes,
+                                           (unsigned char*)compressed_buf,
+                                           cbound);
+        if (!*compressed_size)
+            *ok = false;
+        return;
+    }
     *compressed_size = cbound;
-    auto zok         = compress((Bytef*)compressed_buf, compressed_size,
-                        (const Bytef*)uncompressed_buf,
-                        (unsigned long)strip_bytes);
+    auto zok         = compress2((Bytef*)compressed_buf, compressed_size,
+                         (const Bytef*)uncompressed_buf,
+                         (unsigned long)strip_bytes,
+                         m_zipquality >= 0 ? m_zipquality
+                                           : Z_DEFAULT_COMPRESSION);
     if (zok != Z_OK)
         *ok = false;
 }
@@ -1150,11 +1368,12 @@ TIFFOutput::write_scanlines(int ybegin, int yend, int z, TypeDesc format,
 {
     // If the stars all align properly, try to write strips, and use the
     // thread pool to parallelize the compression. This can give a large
-    // speedup (5x or more!) because the zip compression dwarfs the
-    // actual raw I/O. But libtiff is totally serialized, so we can only
-    // parallelize by making calls to zlib ourselves and then writing
-    // "raw" (compressed) strips. Don't bother trying to handle any of
-    // the uncommon cases with strips. This covers most real-world cases.
+    // speedup (5x or more!) because the compression dwarfs the actual raw
+    // I/O. But libtiff is totally serialized, so we can only parallelize
+    // by compressing ourselves (zlib for deflate, tiff_lzw_encode for LZW)
+    // and then writing "raw" (compressed) strips. Don't bother trying to
+    // handle any of the uncommon cases with strips. This covers most
+    // real-world cases.
     thread_pool* pool = default_thread_pool();
     int nstrips       = (yend - ybegin + m_rowsperstrip - 1) / m_rowsperstrip;
     bool parallelize =
@@ -1170,14 +1389,12 @@ TIFFOutput::write_scanlines(int ybegin, int yend, int z, TypeDesc format,
         && (spec().format.size() * 8 == m_bitspersample)
         // contig planarconfig only
         && m_planarconfig == PLANARCONFIG_CONTIG
-        // only deflate/zip compression with horizontal predictor
-        && m_compression == COMPRESSION_ADOBE_DEFLATE
-        && m_predictor == PREDICTOR_HORIZONTAL
-        // only uint8, uint16
-        && (m_spec.format == TypeUInt8 || m_spec.format == TypeUInt16)
-        // only if we're threading and don't enter the thread pool recursively!
+        // only deflate/zip or LZW, with a predictor compress_one_strip
+        // knows how to apply
+        && can_encode_raw()
+        // only if we're threading (nested calls from inside the pool are
+        // fine, task_set::submit keeps them from deadlocking)
         && pool->size() > 1
-        && !pool->this_thread_is_in_pool()
         // and not if the feature is turned off
         && m_spec.get_int_attribute("tiff:multithread",
                                     OIIO::get_int_attribute("tiff:multithread"));
@@ -1203,59 +1420,81 @@ TIFFOutput::write_scanlines(int ybegin, int yend, int z, TypeDesc format,
     xstride = (stride_t)m_spec.pixel_bytes(true);
     ystride = xstride * m_spec.width;
 
-    // Allocate various temporary space we need
-    const void* origdata      = data;
-    imagesize_t scratch_bytes = m_spec.scanline_bytes() * (yend - ybegin);
-    // Because the predictor is destructive, we need to copy to temp space
-    std::unique_ptr<char[]> scratch(new char[scratch_bytes]);
-    memcpy(scratch.get(), data, scratch_bytes);
-    data                    = scratch.get();
+    // The predictors are destructive, so they need a copy of the caller's
+    // data to work on. If to_native_rectangle already made one, use it
+    // in place, otherwise each task copies its own strip to scratch space.
+    const char* src = (const char*)data;
+    char* work      = (char*)nativebuf.data();
+    std::unique_ptr<char[]> scratch;
+    if (data != (const void*)nativebuf.data()) {
+        if (m_predictor != PREDICTOR_NONE) {
+            scratch.reset(
+                new char[m_spec.scanline_bytes(true) * (yend - ybegin)]);
+            work = scratch.get();
+        } else {
+            work = (char*)data;  // compress right out of the caller's data
+        }
+    }
     imagesize_t strip_bytes = m_spec.scanline_bytes(true) * m_rowsperstrip;
-    size_t cbound           = compressBound((uLong)strip_bytes);
+    size_t cbound           = compressed_bound(strip_bytes);
     std::unique_ptr<char[]> compressed_scratch(new char[cbound * nstrips]);
-    unsigned long* compressed_len = OIIO_ALLOCA(unsigned long, nstrips);
-    int y                         = ybegin;
-    int y_at_stripstart           = y;
-
-    // Compress all the strips in parallel using the thread pool.
+    std::unique_ptr<unsigned long[]> compressed_len(new unsigned long[nstrips]);
+    unsigned long* clen = compressed_len.get();
+    int y               = ybegin;
+    int nfull           = 0;  // number of whole strips
+
+    // Compress all the strips in parallel using the thread pool. If the
+    // user allows it, each strip is written as soon as it is done,
+    // whatever the order. libtiff records where each one landed and
+    // writes the strip offsets when the directory is written.
+    bool any_order = m_spec.get_int_attribute("tiff:write_any_order");
+    completion_queue done;
     task_set tasks(pool);
     bool ok = true;  // failed compression will stash a false here
     for (size_t stripidx = 0; y + m_rowsperstrip <= yend;
-         y += m_rowsperstrip, ++stripidx) {
+         y += m_rowsperstrip, ++stripidx, ++nfull) {
         char* cbuf = compressed_scratch.get() + stripidx * cbound;
-        tasks.push(pool->push([=, &ok](int id) {
-            memcpy((void*)data, origdata, strip_bytes);
-            this->compress_one_strip((void*)data, strip_bytes, cbuf, cbound,
+        tasks.submit([=, &ok, &done](int id) {
+            char* strip = work + stripidx * strip_bytes;
+            if (strip != src + stripidx * strip_bytes)
+                memcpy(strip, src + stripidx * strip_bytes, strip_bytes);
+            this->compress_one_strip(strip, strip_bytes, cbuf, cbound,
                                      this->m_spec.nchannels, this->m_spec.width,
-                                     m_rowsperstrip, compressed_len + stripidx,
+                                     m_rowsperstrip, clen + stripidx,
                                      &ok);
-        }));
-        data     = (char*)data + strip_bytes;
-        origdata = (char*)origdata + strip_bytes;
+            if (any_order)
+                done.push(int(stripidx));
+        });
     }
     // tasks.wait(); DON'T WAIT -- start writing as strips are done!
 
     // Now write those compressed strips as they come out of the queue.
-    y = y_at_stripstart;
-    for (size_t stripidx = 0; ok && y + m_rowsperstrip <= yend;
-         y += m_rowsperstrip, ++stripidx) {
-        char* cbuf        = compressed_scratch.get() + stripidx * cbound;
-        tstrip_t stripnum = (y - m_spec.y) / m_rowsperstrip;
-        // Wait for THIS strip to be done before writing. But ok if
-        // others are still being compressed. And this is a non-blocking
-        // wait, it will steal tasks from the queue if the next strip
-        // it needs is not yet done.
-        tasks.wait_for_task(stripidx);
+    for (int s = 0; s < nfull; ++s) {
+        int stripidx;
+        if (any_order) {
+            // Write whichever strip finishes next.
+            stripidx = done.pop(tasks);
+        } else {
+            // Wait for THIS strip to be done before writing. But ok if
+            // others are still being compressed. And this is a non-blocking
+            // wait, it will steal tasks from the queue if the next strip
+            // it needs is not yet done.
+            stripidx = s;
+            tasks.wait_for_task(stripidx);
+        }
         if (!ok) {
             error("Compression error");
             return false;
         }
+        int ystrip        = ybegin + stripidx * m_rowsperstrip;
+        tstrip_t stripnum = (ystrip - m_spec.y) / m_rowsperstrip;
+        char* cbuf        = compressed_scratch.get() + stripidx * cbound;
         if (TIFFWriteRawStrip(m_tif, stripnum, (tdata_t)cbuf,
-                              tmsize_t(compressed_len[stripidx]))
+                              tmsize_t(clen[stripidx]))
             < 0) {
             std::string err = oiio_tiff_last_error();
-            error("TIFFWriteRawStrip failed writing line y=%d,z=%d: %s", y, z,
-                  err.size() ? err.c_str() : "unknown error");
+            error("TIFFWriteRawStrip failed writing line y=%d,z=%d: %s",
+                  ystrip, z, err.size() ? err.c_str() : "unknown error");
             return false;
         }
     }
@@ -1272,13 +1511,9 @@ TIFFOutput::write_scanlines(int ybegin, int yend, int z, TypeDesc format,
         m_checkpointItems = 0;
     }
 
-
-    if (y < yend && origdata != data)
-        memcpy((void*)data, origdata, (yend - y) * m_spec.scanline_bytes(true));
-
     // Write the stray scanlines at the end that can't make a full strip.
-    // Or all the scanlines if we weren't trying to write strips.
-    for (; ok && y < yend; ++y) {
+    // (write_scanline makes its own copy for the destructive predictor.)
+    for (data = src + (y - ybegin) * ystride; ok && y < yend; ++y) {
         ok &= write_scanline(y, z, format, data, xstride);
         data = (char*)data + ystride;
     }
@@ -1396,17 +1631,18 @@ TIFFOutput::write_tiles(int xbegin, int xend, int ybegin, int yend, int zbegin,
 
     // If the stars all align properly, try to use the thread pool to
     // parallelize the compression of the tiles. This can give a large
-    // speedup (5x or more!) because the zip compression dwarfs the actual
-    // raw I/O. But libtiff is totally serialized, so we can only
-    // parallelize by making calls to zlib ourselves and then writing "raw"
-    // (compressed) strips. Don't bother trying to handle any of the
-    // uncommon cases with strips. This covers most real-world cases.
+    // speedup (5x or more!) because the compression dwarfs the actual raw
+    // I/O. But libtiff is totally serialized, so we can only parallelize
+    // by compressing ourselves (zlib for deflate, tiff_lzw_encode for LZW)
+    // and then writing "raw" (compressed) tiles. Don't bother trying to
+    // handle any of the uncommon cases with tiles. This covers most
+    // real-world cases.
     thread_pool* pool = default_thread_pool();
     ASSERT(m_spec.tile_depth >= 1);
     size_t ntiles = size_t(
-        (xend - xbegin + m_spec.tile_width - 1) / m_spec.tile_width
-        * (yend - ybegin + m_spec.tile_height - 1) / m_spec.tile_height
-        * (zend - zbegin + m_spec.tile_depth - 1) / m_spec.tile_depth);
+        ((xend - xbegin + m_spec.tile_width - 1) / m_spec.tile_width)
+        * ((yend - ybegin + m_spec.tile_height - 1) / m_spec.tile_height)
+        * ((zend - zbegin + m_spec.tile_depth - 1) / m_spec.tile_depth));
     bool parallelize =
         // more than one tile, or no point parallelizing
         ntiles > 1
@@ -1417,14 +1653,12 @@ TIFFOutput::write_tiles(int xbegin, int xend, int ybegin, int yend, int zbegin,
         && (spec().format.size() * 8 == m_bitspersample)
         // contig planarconfig only
         && m_planarconfig == PLANARCONFIG_CONTIG
-        // only deflate/zip compression with horizontal predictor
-        && m_compression == COMPRESSION_ADOBE_DEFLATE
-        && m_predictor == PREDICTOR_HORIZONTAL
-        // only uint8, uint16
-        && (m_spec.format == TypeUInt8 || m_spec.format == TypeUInt16)
-        // only if we're threading and don't enter the thread pool recursively!
+        // only deflate/zip or LZW, with a predictor compress_one_strip
+        // knows how to apply
+        && can_encode_raw()
+        // only if we're threading (nested calls from inside the pool are
+        // fine, task_set::submit keeps them from deadlocking)
         && pool->size() > 1
-        && !pool->this_thread_is_in_pool()
         // and not if the feature is turned off
         && m_spec.get_int_attribute("tiff:multithread",
                                     OIIO::get_int_attribute("tiff:multithread"));
@@ -1443,23 +1677,29 @@ TIFFOutput::write_tiles(int xbegin, int xend, int ybegin, int yend, int zbegin,
     // Allocate various temporary space we need
     stride_t tile_bytes = (stride_t)m_spec.tile_bytes(true);
     std::vector<std::vector<unsigned char>> tilebuf(ntiles);
-    size_t cbound = compressBound((uLong)tile_bytes);
+    size_t cbound = compressed_bound(tile_bytes);
     std::unique_ptr<char[]> compressed_scratch(new char[ntiles * cbound]);
-    unsigned long* compressed_len = OIIO_ALLOCA(unsigned long, ntiles);
+    std::unique_ptr<unsigned long[]> compressed_len(new unsigned long[ntiles]);
+    std::unique_ptr<int[]> tilenum(new int[ntiles]);
 
     if (format == TypeDesc::UNKNOWN && xstride == AutoStride)
         xstride = m_spec.pixel_bytes(true);
     m_spec.auto_stride(xstride, ystride, zstride, format, m_spec.nchannels,
                        xend - xbegin, yend - ybegin);
 
-    // Compress all the tiles in parallel using the thread pool.
+    // Compress all the tiles in parallel using the thread pool. If the
+    // user allows it, each tile is written as soon as it is done, whatever
+    // the order. libtiff records where each one landed and writes the
+    // tile offsets when the directory is written.
+    bool any_order = m_spec.get_int_attribute("tiff:write_any_order");
+    completion_queue done;
     task_set tasks(pool);
     bool ok = true;  // failed compression will stash a false here
     for (int z = zbegin, tileno = 0; z < zend; z += m_spec.tile_depth) {
         for (int y = ybegin; y < yend; y += m_spec.tile_height) {
-            for (int x = xbegin; ok && x < xend;
-                 x += m_spec.tile_width, ++tileno) {
-                tasks.push(pool->push([&, x, y, z, tileno](int id) {
+            for (int x = xbegin; x < xend; x += m_spec.tile_width, ++tileno) {
+                tilenum[tileno] = tile_index(x, y, z);
+                tasks.submit([&, x, y, z, tileno](int id) {
                     const unsigned char* tilestart
                         = ((unsigned char*)data + (x - xbegin) * xstride
                            + (z - zbegin) * zstride + (y - ybegin) * ystride);
@@ -1491,10 +1731,11 @@ TIFFOutput::write_tiles(int xbegin, int xend, int ybegin, int yend, int zbegin,
                         = to_native_tile(format, tilestart, tile_xstride,
                                          tile_ystride, tile_zstride,
                                          tilebuf[tileno], m_dither, x, y, z);
-                    if (buf == (const void*)tilestart) {
+                    if (buf == (const void*)tilestart && !padded_tile
+                        && m_predictor != PREDICTOR_NONE) {
                         // Ugly detail: if to_native_rectangle did not allocate
                         // scratch space and copy to it, we need to do it now,
-                        // because the horizontal predictor is destructive.
+                        // because the predictors are destructive.
                         tilebuf[tileno].assign((char*)buf,
                                                ((char*)buf)
                                                    + m_spec.tile_bytes(true));
@@ -1504,38 +1745,40 @@ TIFFOutput::write_tiles(int xbegin, int xend, int ybegin, int yend, int zbegin,
                     compress_one_strip((void*)buf, tile_bytes, cbuf, cbound,
                                        m_spec.nchannels, m_spec.tile_width,
                                        m_spec.tile_height * m_spec.tile_depth,
-                                       compressed_len + tileno, &ok);
-                }));
+                                       &compressed_len[tileno], &ok);
+                    if (any_order)
+                        done.push(tileno);
+                });
             }
         }
     }
     // tasks.wait(); DON'T WAIT -- start writing as tiles are done!
 
-    for (int z = zbegin, tileno = 0; z < zend; z += m_spec.tile_depth) {
-        for (int y = ybegin; y < yend; y += m_spec.tile_height) {
-            for (int x = xbegin; ok && x < xend;
-                 x += m_spec.tile_width, ++tileno) {
-                // Wait for THIS tile to be done before writing. But ok if
-                // others are still being compressed. And this is a non-
-                // blocking wait, it will steal tasks from the queue if the
-                // next tile it needs is not yet done.
-                tasks.wait_for_task(tileno);
-                char* cbuf = compressed_scratch.get() + tileno * cbound;
-                if (!ok) {
-                    error("Compression error");
-                    return false;
-                }
-                if (TIFFWriteRawTile(m_tif, uint32_t(tile_index(x, y, z)), cbuf,
-                                     compressed_len[tileno])
-                    < 0) {
-                    std::string err = oiio_tiff_last_error();
-                    error(
-                        "TIFFWriteRawTile failed writing tile %d (x=%d,y=%d,z=%d): %s",
-                        tile_index(x, y, z), x, y, z,
-                        err.size() ? err.c_str() : "unknown error");
-                    return false;
-                }
-            }
+    for (int t = 0; t < int(ntiles); ++t) {
+        int tileno;
+        if (any_order) {
+            // Write whichever tile finishes next.
+            tileno = done.pop(tasks);
+        } else {
+            // Wait for THIS tile to be done before writing. But ok if
+            // others are still being compressed. And this is a non-
+            // blocking wait, it will steal tasks from the queue if the
+            // next tile it needs is not yet done.
+            tileno = t;
+            tasks.wait_for_task(tileno);
+        }
+        if (!ok) {
+            error("Compression error");
+            return false;
+        }
+        char* cbuf = compressed_scratch.get() + tileno * cbound;
+        if (TIFFWriteRawTile(m_tif, uint32_t(tilenum[tileno]), cbuf,
+                             compressed_len[tileno])
+            < 0) {
+            std::string err = oiio_tiff_last_error();
+            error("TIFFWriteRawTile failed writing tile %d: %s",
+                  tilenum[tileno], err.size() ? err.c_str() : "unknown error");
+            return false;
         }
     }
     return ok;
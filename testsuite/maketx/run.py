@@ -119,6 +119,37 @@ command += oiiotool (" --pattern noise 64x64 1"
 command += maketx_command ("bump.exr", "bumpslope.exr",
                            "--bumpslopes -d half", showinfo=True)
 
+# Test --outofcore : streaming the image through in bands must produce the
+# same texture as building it in memory, for a non-power-of-2 image and for
+# a lat-long environment map.
+command += maketx_command (oiio_images + "/grid.tif", "grid-outofcore.tx",
+                           "--outofcore 1")
+command += diff_command ("grid.tx", "grid-outofcore.tx")
+command += maketx_command ("checker.tif", "checker-env.tx", "--envlatl")
+command += maketx_command ("checker.tif", "checker-env-outofcore.tx",
+                           "--envlatl --outofcore 1")
+command += diff_command ("checker-env.tx", "checker-env-outofcore.tx")
+
+# Test batch mode, with several inputs on the command line: each texture
+# records the command that would have made it alone, so that update mode
+# finds nothing to do when it is rebuilt that way. (The --attrib value that
+# happens to match an input filename must survive in that command.)
+command += (oiio_app("maketx") + "-u --attrib Keywords checker.tif"
+            + " --jobs 2 checker.tif pink.tif" + redirect + " ;\n")
+command += (oiio_app("maketx") + "-u --attrib Keywords checker.tif"
+            + " checker.tif -o checker.tx" + redirect + " ;\n")
+
+# Test batch mode with a --manifest listing the inputs and outputs
+with open ("manifest.txt", "w") as manifest :
+    manifest.write ("# input output\n"
+                    + "checker.tif checker-manifest.tx\n\n"
+                    + "gray.tif gray-manifest.tx\n")
+command += (oiio_app("maketx") + "--manifest manifest.txt --jobs 2"
+            + redirect + " ;\n")
+command += maketx_command ("gray.tif", "gray-single.tx")
+command += diff_command ("checker.tx", "checker-manifest.tx")
+command += diff_command ("gray-single.tx", "gray-manifest.tx")
+
 
 outputs = [ "out.txt" ]
 